@@ -0,0 +1,656 @@
+#ifndef __CHUNKVEC_H
+#define __CHUNKVEC_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file chunkvec.h
+ * This file contains a vector template that keeps the elements of a long
+ * vector in chunks, so elements can be added or removed in the middle of it
+ * without moving the rest of it.
+ */
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <iterator>
+#include <type_traits>
+#include <stdexcept>
+#include <initializer_list>
+
+#include "smallvec.h"
+
+/**
+ * Vector that is split into chunks of contiguous elements when it is long.
+ * A vector with up to 2*chunk_size elements is a plain SmallVector, which
+ * keeps its first N elements inside the object, so the short vectors of most
+ * terms and expressions are indexed and iterated like one. A longer vector
+ * is split into chunks of chunk_size to 2*chunk_size elements, and goes back
+ * to a SmallVector when it shrinks to chunk_size elements.
+ * The number of elements in the chunks is kept in a Fenwick tree, so the
+ * chunk of an index is found in O(log n) time. Adding or removing an element
+ * moves the elements of its chunk and updates the tree in O(log n) time.
+ * When a chunk is split or removed, the chunks after it are moved and the
+ * tree is rebuilt in O(n/chunk_size) time. That happens at most once every
+ * chunk_size/2 edits of a chunk.
+ * Has the parts of the std::vector interface used by milo. Iterators are
+ * random access, but adding or removing elements invalidates them.
+ */
+template <class T, size_t N>
+class ChunkVector
+{
+	using Chunk = SmallVector<T, N>; ///< Contiguous elements.
+
+public:
+	/**
+	 * Aliases for ChunkVector
+	 */
+	using value_type = T;
+	using size_type = size_t;
+	using difference_type = std::ptrdiff_t;
+	using reference = T&;
+	using const_reference = const T&;
+
+	static constexpr size_type chunk_size = 64; ///< Smallest size of chunk of a long vector.
+
+	/**
+	 * Random access iterator at chunk and element in chunk.
+	 * The element is held by pointer, so a short vector is accessed and
+	 * walked like a SmallVector. Only an iterator of a long vector checks
+	 * for the end of a chunk. The end of the vector is past the last element
+	 * of the last chunk.
+	 */
+	template <class V, class E>
+	class Iterator
+	{
+	public:
+		/**
+		 * Aliases for iterator traits
+		 */
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = E*;
+		using reference = E&;
+
+		/**
+		 * Default constructor for iterator at no vector.
+		 */
+		Iterator() : m_v(nullptr), m_chunk(0), m_p(nullptr) {}
+
+		/**
+		 * Constructor for iterator.
+		 * @param v Vector.
+		 * @param chunk Index of chunk.
+		 * @param pos Position in chunk.
+		 */
+		Iterator(V* v, size_type chunk, size_type pos) : m_v(v), m_chunk(chunk), m_p(v->chunk(chunk).begin() + pos) {}
+
+		/**
+		 * Convert iterator to const iterator.
+		 */
+		template <class V2, class E2, class = typename std::enable_if<std::is_convertible<E2*, E*>::value>::type>
+		Iterator(const Iterator<V2, E2>& it) : m_v(it.m_v), m_chunk(it.m_chunk), m_p(it.m_p) {}
+
+		reference operator*() const { return *m_p; }                                              ///< Get element.
+		pointer operator->() const { return m_p; }                                                ///< Access element.
+		reference operator[](difference_type n) const { return *(*this + n); }                    ///< Get element n ahead.
+
+		/**
+		 * Move to next element.
+		 * @return This iterator.
+		 */
+		Iterator& operator++()
+		{
+			++m_p;
+			if (m_v->chunked() && m_p == m_v->m_chunks[m_chunk].end() && m_chunk + 1 < m_v->m_chunks.size()) {
+				m_p = m_v->m_chunks[++m_chunk].begin();
+			}
+			return *this;
+		}
+
+		/**
+		 * Move to previous element.
+		 * @return This iterator.
+		 */
+		Iterator& operator--()
+		{
+			if (m_v->chunked() && m_p == m_v->m_chunks[m_chunk].begin()) m_p = m_v->m_chunks[--m_chunk].end();
+			--m_p;
+			return *this;
+		}
+
+		Iterator operator++(int) { Iterator it = *this; ++*this; return it; }                     ///< Move to next element.
+		Iterator operator--(int) { Iterator it = *this; --*this; return it; }                     ///< Move to previous element.
+
+		/**
+		 * Move n elements ahead, staying in the chunk if possible.
+		 * @return This iterator.
+		 */
+		Iterator& operator+=(difference_type n)
+		{
+			if (!m_v->chunked()) {
+				m_p += n;
+				return *this;
+			}
+			auto& chunk = m_v->m_chunks[m_chunk];
+			difference_type pos = (m_p - chunk.begin()) + n;
+			if (pos >= 0 && (size_type) pos < chunk.size()) m_p = chunk.begin() + pos;
+			else *this = m_v->locate(index() + n);
+			return *this;
+		}
+
+		Iterator& operator-=(difference_type n) { return *this += -n; }                           ///< Move n elements back.
+		Iterator operator+(difference_type n) const { Iterator it = *this; return it += n; }      ///< Get iterator n ahead.
+		Iterator operator-(difference_type n) const { Iterator it = *this; return it -= n; }      ///< Get iterator n back.
+		friend Iterator operator+(difference_type n, const Iterator& it) { return it + n; }        ///< Get iterator n ahead.
+
+		/**
+		 * Get distance between iterators.
+		 */
+		difference_type operator-(const Iterator& it) const
+		{
+			if (m_chunk == it.m_chunk) return m_p - it.m_p;
+			return (difference_type) index() - (difference_type) it.index();
+		}
+
+		bool operator==(const Iterator& it) const { return m_p == it.m_p && m_chunk == it.m_chunk; }     ///< Compare positions.
+		bool operator!=(const Iterator& it) const { return !(*this == it); }                            ///< Compare positions.
+		bool operator<(const Iterator& it) const
+		{
+			return m_chunk < it.m_chunk || (m_chunk == it.m_chunk && m_p < it.m_p);
+		}                                                                                               ///< Compare positions.
+		bool operator>(const Iterator& it) const { return it < *this; }                                 ///< Compare positions.
+		bool operator<=(const Iterator& it) const { return !(it < *this); }                             ///< Compare positions.
+		bool operator>=(const Iterator& it) const { return !(*this < it); }                             ///< Compare positions.
+
+		/**
+		 * Get index of element in vector.
+		 * @return Index.
+		 */
+		size_type index() const { return m_v->start(m_chunk) + chunk_pos(); }
+
+		/**
+		 * Get index of chunk of element.
+		 * @return Index of chunk.
+		 */
+		size_type chunk_index() const { return m_chunk; }
+
+		/**
+		 * Get position of element in its chunk.
+		 * @return Position in chunk.
+		 */
+		size_type chunk_pos() const { return m_p - m_v->chunk(m_chunk).begin(); }
+
+	private:
+		friend class ChunkVector;
+		template <class, class> friend class Iterator;
+
+		V* m_v;            ///< Vector.
+		size_type m_chunk; ///< Index of chunk.
+		E* m_p;            ///< Element in chunk.
+	};
+
+	using iterator = Iterator<ChunkVector, T>;
+	using const_iterator = Iterator<const ChunkVector, const T>;
+	using reverse_iterator = std::reverse_iterator<iterator>;
+	using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+	/** @name Constructors */
+	//@{
+	/**
+	 * Default constructor for empty vector.
+	 */
+	ChunkVector() : m_size(0) {}
+
+	/**
+	 * Construct vector from initializer list.
+	 */
+	ChunkVector(std::initializer_list<T> li) : ChunkVector()
+	{
+		for ( auto& e : li ) push_back(e);
+	}
+
+	ChunkVector(const ChunkVector&) = default;                          ///< Copy constructor.
+	ChunkVector(ChunkVector&& v) noexcept : ChunkVector() { swap(v); }  ///< Move constructor leaves other vector empty.
+	ChunkVector& operator=(const ChunkVector&) = default;               ///< Assign copy of other vector.
+
+	/**
+	 * Move other vector into this one.
+	 */
+	ChunkVector& operator=(ChunkVector&& v) noexcept
+	{
+		if (this != &v) {
+			clear();
+			swap(v);
+		}
+		return *this;
+	}
+	//@}
+
+	/** @name Element Access */
+	//@{
+	T& operator[](size_type i) { return chunked() ? *locate(i) : m_flat[i]; }             ///< Get element.
+	const T& operator[](size_type i) const { return chunked() ? *locate(i) : m_flat[i]; } ///< Get element.
+	T& front() { return chunk(0).front(); }                                               ///< Get first element.
+	const T& front() const { return chunk(0).front(); }                                   ///< Get first element.
+	T& back() { return chunk(last()).back(); }                                            ///< Get last element.
+	const T& back() const { return chunk(last()).back(); }                                ///< Get last element.
+
+	/**
+	 * Get element with bounds check.
+	 */
+	T& at(size_type i)
+	{
+		if (i >= m_size) throw std::out_of_range("ChunkVector::at");
+		return (*this)[i];
+	}
+
+	/**
+	 * Get element with bounds check.
+	 */
+	const T& at(size_type i) const
+	{
+		if (i >= m_size) throw std::out_of_range("ChunkVector::at");
+		return (*this)[i];
+	}
+	//@}
+
+	/** @name Iterators */
+	//@{
+	iterator begin() { return iterator(this, 0, 0); }                                       ///< Iterator at first element.
+	const_iterator begin() const { return const_iterator(this, 0, 0); }                     ///< Iterator at first element.
+	const_iterator cbegin() const { return begin(); }                                       ///< Iterator at first element.
+	iterator end() { return iterator(this, last(), chunk(last()).size()); }                 ///< Iterator past last element.
+	const_iterator end() const { return const_iterator(this, last(), chunk(last()).size()); } ///< Iterator past last element.
+	const_iterator cend() const { return end(); }                                           ///< Iterator past last element.
+	reverse_iterator rbegin() { return reverse_iterator(end()); }                           ///< Reverse iterator at last element.
+	const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }         ///< Reverse iterator at last element.
+	reverse_iterator rend() { return reverse_iterator(begin()); }                           ///< Reverse iterator before first element.
+	const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }         ///< Reverse iterator before first element.
+	//@}
+
+	/** @name Capacity */
+	//@{
+	size_type size() const { return m_size; }                                ///< Get number of elements.
+	bool empty() const { return m_size == 0; }                               ///< True, if no elements.
+	size_type chunks() const { return chunked() ? m_chunks.size() : 1; }     ///< Get number of chunks.
+
+	/**
+	 * Get position after last element of chunk of position.
+	 * @param pos Position in vector.
+	 * @return Position of first element of next chunk or end.
+	 */
+	iterator chunk_end(const_iterator pos)
+	{
+		return (pos.m_chunk < last()) ? iterator(this, pos.m_chunk + 1, 0) : end();
+	}
+
+	/**
+	 * Get position of element in chunk.
+	 * @param k Index of chunk.
+	 * @param pos Position in chunk.
+	 * @return Iterator at element or end if there is no such element.
+	 */
+	const_iterator at_chunk(size_type k, size_type pos) const
+	{
+		if (k >= chunks() || pos >= chunk(k).size()) return end();
+		return const_iterator(this, k, pos);
+	}
+
+	/**
+	 * Make room for elements, if they fit in one chunk.
+	 * @param n Number of elements.
+	 */
+	void reserve(size_type n)
+	{
+		if (!chunked() && n <= 2*chunk_size) m_flat.reserve(n);
+	}
+	//@}
+
+	/** @name Modifiers */
+	//@{
+	/**
+	 * Destroy all elements.
+	 */
+	void clear()
+	{
+		m_flat.clear();
+		m_chunks.clear();
+		m_tree.clear();
+		m_size = 0;
+	}
+
+	/**
+	 * Add copy of element at end.
+	 */
+	void push_back(const T& e) { emplace_back(e); }
+
+	/**
+	 * Move element to end.
+	 */
+	void push_back(T&& e) { emplace_back(std::move(e)); }
+
+	/**
+	 * Construct element at end.
+	 * @return New element.
+	 */
+	template <class... Args>
+	T& emplace_back(Args&&... args)
+	{
+		if (!chunked()) {
+			if (m_flat.size() < 2*chunk_size) {
+				++m_size;
+				return m_flat.emplace_back(std::forward<Args>(args)...);
+			}
+			m_chunks.push_back(std::move(m_flat));
+		}
+		bool fNew = m_chunks.back().size() == 2*chunk_size;
+		if (fNew) {
+			m_chunks.emplace_back();
+			m_chunks.back().reserve(2*chunk_size);
+		}
+		T& e = m_chunks.back().emplace_back(std::forward<Args>(args)...);
+		++m_size;
+		if (fNew) build(); else if (!m_tree.empty()) add(last(), 1);
+		return e;
+	}
+
+	/**
+	 * Remove last element.
+	 */
+	void pop_back() { erase(end() - 1); }
+
+	/**
+	 * Insert copy of element before position.
+	 * @return Position of new element.
+	 */
+	iterator insert(const_iterator pos, const T& e) { return insert(pos, size_type(1), e); }
+
+	/**
+	 * Insert n copies of element before position.
+	 * @return Position of first new element.
+	 */
+	iterator insert(const_iterator pos, size_type n, const T& e)
+	{
+		T copy(e);
+		size_type index = pos.index();
+		chunk(pos.m_chunk).insert(pos.m_p, n, copy);
+		return grown(pos.m_chunk, index, n);
+	}
+
+	/**
+	 * Insert copies of range of elements before position.
+	 * Range must not be inside this vector.
+	 * @return Position of first new element.
+	 */
+	template <class InputIt>
+	iterator insert(const_iterator pos, InputIt first, InputIt last)
+	{
+		size_type index = pos.index();
+		size_type n = std::distance(first, last);
+		chunk(pos.m_chunk).insert(pos.m_p, first, last);
+		return grown(pos.m_chunk, index, n);
+	}
+
+	/**
+	 * Remove element at position.
+	 * @return Position after removed element.
+	 */
+	iterator erase(const_iterator pos) { return erase(pos, pos + 1); }
+
+	/**
+	 * Remove range of elements.
+	 * Chunks left empty are removed and a chunk left small is joined to the
+	 * chunk before it. A vector left with chunk_size elements is made short.
+	 * @return Position after removed elements.
+	 */
+	iterator erase(const_iterator first, const_iterator last)
+	{
+		if (!chunked()) {
+			size_type index = first.m_p - m_flat.begin();
+			m_flat.erase(first.m_p, last.m_p);
+			m_size = m_flat.size();
+			return iterator(this, 0, index);
+		}
+
+		size_type index = first.index();
+		size_type n = last - first;
+		if (n == 0) return locate(index);
+
+		size_type chunks = m_chunks.size();
+		size_type k = first.m_chunk, pos = first.m_p - m_chunks[k].begin();
+		for (size_type left = n; left > 0; ) {
+			Chunk& chunk = m_chunks[k];
+			size_type count = std::min(left, chunk.size() - pos);
+			chunk.erase(chunk.begin() + pos, chunk.begin() + pos + count);
+			if (!m_tree.empty()) add(k, -(difference_type) count);
+			left -= count;
+			if (chunk.empty() && m_chunks.size() > 1) remove(k); else ++k;
+			pos = 0;
+		}
+		m_size -= n;
+		if (m_size <= chunk_size) {
+			flatten();
+			return iterator(this, 0, index);
+		}
+
+		k = std::min(first.m_chunk, m_chunks.size() - 1);
+		if (k > 0 && m_chunks[k].size() < chunk_size/2 && m_chunks[k - 1].size() + m_chunks[k].size() <= 2*chunk_size) {
+			join(k - 1);
+		}
+		if (m_chunks.size() != chunks) build();
+		return locate(index);
+	}
+
+	/**
+	 * Change number of elements.
+	 * New elements are default constructed.
+	 */
+	void resize(size_type n)
+	{
+		if (n < m_size) erase(begin() + n, end());
+		while (m_size < n) emplace_back();
+	}
+
+	/**
+	 * Swap contents with other vector.
+	 */
+	void swap(ChunkVector& v) noexcept
+	{
+		std::swap(m_flat, v.m_flat);
+		m_chunks.swap(v.m_chunks);
+		m_tree.swap(v.m_tree);
+		std::swap(m_size, v.m_size);
+	}
+	//@}
+
+private:
+	Chunk m_flat;                  ///< Elements of short vector, empty if chunked.
+	std::vector<Chunk> m_chunks;   ///< Chunks of long vector in order, empty if short.
+	std::vector<size_type> m_tree; ///< Fenwick tree of sizes of chunks, empty if less than two.
+	size_type m_size;              ///< Number of elements.
+
+	/**
+	 * Check if vector is kept in chunks.
+	 */
+	bool chunked() const { return !m_chunks.empty(); }
+
+	/**
+	 * Get chunk. A short vector is its only chunk.
+	 * @param k Index of chunk.
+	 */
+	Chunk& chunk(size_type k) { return chunked() ? m_chunks[k] : m_flat; }
+
+	/**
+	 * Get chunk. A short vector is its only chunk.
+	 * @param k Index of chunk.
+	 */
+	const Chunk& chunk(size_type k) const { return chunked() ? m_chunks[k] : m_flat; }
+
+	/**
+	 * Get index of last chunk.
+	 */
+	size_type last() const { return chunked() ? m_chunks.size() - 1 : 0; }
+
+	/**
+	 * Get index of first element of chunk.
+	 * @param k Index of chunk.
+	 * @return Sum of sizes of chunks before it.
+	 */
+	size_type start(size_type k) const
+	{
+		if (m_tree.empty()) return 0;
+		size_type sum = 0;
+		for (size_type i = k; i > 0; i -= i & (~i + 1)) sum += m_tree[i];
+		return sum;
+	}
+
+	/**
+	 * Add to size of chunk in tree.
+	 * @param k Index of chunk.
+	 * @param n Change of size.
+	 */
+	void add(size_type k, difference_type n)
+	{
+		for (size_type i = k + 1; i < m_tree.size(); i += i & (~i + 1)) m_tree[i] += n;
+	}
+
+	/**
+	 * Build tree of sizes of chunks, if there is more than one.
+	 */
+	void build()
+	{
+		m_tree.clear();
+		if (m_chunks.size() <= 1) return;
+		m_tree.assign(m_chunks.size() + 1, 0);
+		for (size_type i = 1; i < m_tree.size(); ++i) {
+			m_tree[i] += m_chunks[i - 1].size();
+			size_type parent = i + (i & (~i + 1));
+			if (parent < m_tree.size()) m_tree[parent] += m_tree[i];
+		}
+	}
+
+	/**
+	 * Find chunk and position of index by descending tree.
+	 * @param i Index of element or size of vector for end.
+	 * @return Iterator at index.
+	 */
+	iterator locate(size_type i)
+	{
+		if (i >= m_size) return end();
+		if (m_tree.empty()) return iterator(this, 0, i);
+
+		size_type k = 0;
+		size_type step = 1;
+		while (2*step < m_tree.size()) step *= 2;
+		for ( ; step > 0; step /= 2) {
+			if (k + step < m_tree.size() && m_tree[k + step] <= i) {
+				k += step;
+				i -= m_tree[k];
+			}
+		}
+		return iterator(this, k, i);
+	}
+
+	/**
+	 * Find chunk and position of index by descending tree.
+	 * @param i Index of element or size of vector for end.
+	 * @return Iterator at index.
+	 */
+	const_iterator locate(size_type i) const { return const_cast<ChunkVector*>(this)->locate(i); }
+
+	/**
+	 * Update size after elements were added to chunk and split it if it is
+	 * too long.
+	 * @param k Index of chunk.
+	 * @param index Index of first new element.
+	 * @param n Number of new elements.
+	 * @return Iterator at first new element.
+	 */
+	iterator grown(size_type k, size_type index, size_type n)
+	{
+		m_size += n;
+		if (chunk(k).size() > 2*chunk_size) split(k);
+		else if (!m_tree.empty()) add(k, n);
+		return locate(index);
+	}
+
+	/**
+	 * Split chunk into chunks of chunk_size to 2*chunk_size elements.
+	 * A short vector becomes the first chunk.
+	 * @param k Index of chunk.
+	 */
+	void split(size_type k)
+	{
+		if (!chunked()) m_chunks.push_back(std::move(m_flat));
+		size_type size = m_chunks[k].size();
+		size_type pieces = size / chunk_size;
+		for (size_type p = 1; p < pieces; ++p) m_chunks.emplace_back();
+		std::move_backward(m_chunks.begin() + k + 1, m_chunks.end() - (pieces - 1), m_chunks.end());
+
+		Chunk& chunk = m_chunks[k];
+		for (size_type p = 1; p < pieces; ++p) {
+			Chunk& piece = m_chunks[k + p];
+			piece.clear();
+			piece.reserve(2*chunk_size);
+			for (size_type i = p*size/pieces; i < (p + 1)*size/pieces; ++i) piece.push_back(std::move(chunk[i]));
+		}
+		chunk.erase(chunk.begin() + size/pieces, chunk.end());
+		build();
+	}
+
+	/**
+	 * Move elements of chunk after chunk to end of chunk and remove it.
+	 * @param k Index of chunk.
+	 */
+	void join(size_type k)
+	{
+		Chunk& next = m_chunks[k + 1];
+		for ( auto& e : next ) m_chunks[k].push_back(std::move(e));
+		remove(k + 1);
+	}
+
+	/**
+	 * Remove chunk. Tree is not updated.
+	 * @param k Index of chunk.
+	 */
+	void remove(size_type k)
+	{
+		m_chunks.erase(m_chunks.begin() + k);
+	}
+
+	/**
+	 * Move elements of chunks back into short vector.
+	 */
+	void flatten()
+	{
+		if (m_chunks.size() == 1) m_flat = std::move(m_chunks.front());
+		else {
+			m_flat.reserve(m_size);
+			for ( auto& chunk : m_chunks ) {
+				for ( auto& e : chunk ) m_flat.push_back(std::move(e));
+			}
+		}
+		m_chunks.clear();
+		m_tree.clear();
+	}
+};
+
+#endif // __CHUNKVEC_H
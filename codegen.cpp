@@ -0,0 +1,235 @@
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file codegen.cpp
+ * This file contains the implementation of the CodeGenerator class.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "milo.h"
+#include "nodes.h"
+#include "codegen.h"
+
+using namespace std;
+
+CodeGenerator::CodeGenerator(Equation& eqn, bool fComplex) :
+	m_type(fComplex ? "std::complex<double>" : "double")
+{
+	m_result = generate(eqn.getRoot()).code;
+}
+
+CodeGenerator::Operand CodeGenerator::generate(Node* root)
+{
+	// Code of visited children of the nodes on the stack, in order
+	vector<Operand> operands;
+	traverseDerived(root, [](Node*) { return true; }, [this, &operands](Node* node) {
+		size_t n = 0;
+		if (node->getType() == Node::DIFFERENTIAL) n = 1;
+		else forEachChild(node, [&n](Node*) { ++n; });
+		vector<Operand> kids(operands.end() - n, operands.end());
+		operands.erase(operands.end() - n, operands.end());
+		operands.push_back(generate(node, kids));
+	});
+	return operands.back();
+}
+
+CodeGenerator::Operand CodeGenerator::generate(Node* node, const vector<Operand>& kids)
+{
+	bool fConstant = true;
+	string code = generateNode(node, kids, fConstant);
+	if (fConstant) {
+		vector<Complex> values;
+		for ( auto& kid : kids ) values.push_back(kid.value);
+		Complex z = node->getValue(values.data());
+		return { literal(z), true, z };
+	}
+
+	int n = node->getNth();
+	if (n <= 0) {
+		Complex z((!node->getSign() && ((n&1) == 1)) ? -1 : 1, 0);
+		return { literal(z), true, z };
+	}
+	code = power(code, n);
+	if (!node->getSign() && ((n&1) == 1)) code = temp("-" + code);
+	return { code, false, Complex(0, 0) };
+}
+
+string CodeGenerator::generateNode(Node* node, const vector<Operand>& kids, bool& fConstant)
+{
+	// Code of each class of node
+	struct Visitor
+	{
+		CodeGenerator& gen;
+		const vector<Operand>& kids;
+		bool& fConstant;
+
+		string operator()(Variable* var)
+		{
+			gen.m_vars.insert(var->getVariable());
+			fConstant = false;
+			return var->getVariable();
+		}
+
+		string operator()(Number*) { return string(); }
+		string operator()(Constant*) { return string(); }
+		string operator()(Expression*) { return gen.generateList(kids, true, fConstant); }
+		string operator()(Term*) { return gen.generateList(kids, false, fConstant); }
+
+		string operator()(Divide*)
+		{
+			const Operand& a = kids[0], & b = kids[1];
+			if (a.fConstant && b.fConstant) return string();
+			fConstant = false;
+			return gen.temp(a.code + " / " + b.code);
+		}
+
+		string operator()(Power*)
+		{
+			const Operand& a = kids[0], & b = kids[1];
+			if (a.fConstant && b.fConstant) return string();
+			fConstant = false;
+			if (!b.fConstant || b.value.imag() != 0 || !isInteger(b.value.real()) ||
+				abs(b.value.real()) > max_chain) {
+				return gen.temp("std::pow(" + a.code + ", " + b.code + ")");
+			}
+			int n = (int) b.value.real();
+			if (n == 0) return gen.literal(Complex(1, 0));
+			if (n < 0) return gen.temp(gen.literal(Complex(1, 0)) + " / " + gen.power(a.code, -n));
+			return gen.power(a.code, n);
+		}
+
+		string operator()(Function* function)
+		{
+			const Operand& arg = kids[0];
+			if (arg.fConstant) return string();
+			fConstant = false;
+			return gen.temp("std::" + function->getFunction() + "(" + arg.code + ")");
+		}
+
+		string operator()(Differential*)
+		{
+			const Operand& d = kids[0];
+			fConstant = d.fConstant;
+			return d.code;
+		}
+
+		string operator()(Input* in)
+		{
+			throw logic_error("cannot generate code for " + in->getName());
+		}
+	};
+	return visit(node, Visitor{ *this, kids, fConstant });
+}
+
+string CodeGenerator::generateList(const vector<Operand>& kids, bool fSum, bool& fConstant)
+{
+	Complex folded(fSum ? 0 : 1, 0);
+	bool fFolded = false;
+	vector<string> codes;
+	for ( auto& op : kids ) {
+		if (op.fConstant) {
+			if (fSum) folded += op.value; else folded *= op.value;
+			fFolded = true;
+		}
+		else {
+			codes.push_back(op.code);
+		}
+	}
+	if (codes.empty()) return string();
+	fConstant = false;
+
+	if (!fSum && folded == Complex(0, 0)) return literal(folded);
+
+	// Sorted operands give one temporary to a sum or product in any order, and
+	// the folded constant is applied last so the rest can be shared
+	sort(codes.begin(), codes.end());
+	string sep = fSum ? " + " : " * ";
+	string code = codes[0];
+	if (codes.size() > 1) {
+		for (size_t i = 1; i < codes.size(); ++i) code += sep + codes[i];
+		code = temp(code);
+	}
+	if (fFolded && folded != Complex(fSum ? 0 : 1, 0)) code = temp(code + sep + literal(folded));
+	return code;
+}
+
+string CodeGenerator::temp(const string& op)
+{
+	auto it = m_temps.find(op);
+	if (it != m_temps.end()) return it->second;
+
+	string name = "t" + to_string(m_lines.size());
+	m_lines.push_back("\tconst " + m_type + " " + name + " = " + op + ";");
+	m_temps.emplace(op, name);
+	return name;
+}
+
+string CodeGenerator::power(const string& base, int n)
+{
+	if (n == 1) return base;
+	if ((n&1) == 0) {
+		string half = power(base, n/2);
+		return temp(half + " * " + half);
+	}
+	return temp(power(base, n - 1) + " * " + base);
+}
+
+/**
+ * Get literal of double that C++ reads as a double.
+ * @param x Value.
+ * @return Literal of value.
+ */
+static string doubleLiteral(double x)
+{
+	if (!isfinite(x)) throw logic_error("constant is not finite");
+	ostringstream os;
+	os << setprecision(17) << x;
+	string s = os.str();
+	if (s.find_first_of(".e") == string::npos) s += ".0";
+	return s;
+}
+
+string CodeGenerator::literal(const Complex& z) const
+{
+	if (z.imag() == 0) return doubleLiteral(z.real());
+	if (m_type == "double") throw logic_error("equation is complex");
+	return m_type + "(" + doubleLiteral(z.real()) + ", " + doubleLiteral(z.imag()) + ")";
+}
+
+string CodeGenerator::function(const string& name) const
+{
+	ostringstream os;
+	os << "inline " << m_type << " " << name << "(";
+	for ( auto it = m_vars.begin(); it != m_vars.end(); ++it ) {
+		os << ((it == m_vars.begin()) ? "" : ", ") << m_type << " " << *it;
+	}
+	os << ")\n{\n";
+	for ( const auto& line : m_lines ) os << line << "\n";
+	os << "\treturn " << m_result << ";\n}\n";
+	return os.str();
+}
+
+string CodeGenerator::header(const string& name) const
+{
+	return "#include <cmath>\n#include <complex>\n\n" + function(name);
+}
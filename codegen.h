@@ -0,0 +1,143 @@
+#ifndef __CODEGEN_H
+#define __CODEGEN_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file codegen.h
+ * This file contains the declaration of the CodeGenerator class, which turns an
+ * equation into the source of a standalone inline C++ function.
+ */
+
+#include <set>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "milo.h"
+
+/**
+ * Generator of a C++ function that evaluates an equation.
+ * Every operation is assigned to a constant temporary. A temporary is reused
+ * when the same operation on the same operands comes up again, so common
+ * subexpressions are computed once. Integer powers become chains of squares,
+ * and subtrees without variables are folded into literals.
+ */
+class CodeGenerator
+{
+public:
+	/**
+	 * Constructor for CodeGenerator of an equation.
+	 * Throws logic_error if equation has an input, or if it is complex and
+	 * a real function is asked for.
+	 * @param eqn Equation to be generated.
+	 * @param fComplex If true, function is over std::complex<double>, otherwise double.
+	 */
+	CodeGenerator(Equation& eqn, bool fComplex = true);
+
+	/**
+	 * Get source of function taking variables in alphabetical order.
+	 * @param name Name of function.
+	 * @return Source of inline function.
+	 */
+	std::string function(const std::string& name) const;
+
+	/**
+	 * Get source of header with includes needed by function.
+	 * @param name Name of function.
+	 * @return Source of header.
+	 */
+	std::string header(const std::string& name) const;
+
+	static const int max_chain = 64; ///< Largest integer power done by multiplication.
+
+private:
+	/**
+	 * Generated code of a subtree.
+	 */
+	struct Operand
+	{
+		std::string code; ///< Temporary, variable or literal.
+		bool fConstant;   ///< True, if code is a literal.
+		Complex value;    ///< Value of literal.
+	};
+
+	std::string m_type;                                  ///< Type of values.
+	std::set<std::string> m_vars;                        ///< Variables used as parameters.
+	std::vector<std::string> m_lines;                    ///< Definitions of temporaries.
+	std::unordered_map<std::string, std::string> m_temps; ///< Temporary of each operation.
+	std::string m_result;                                ///< Code of equation.
+
+	/**
+	 * Generate code of subtree with an explicit stack, children before
+	 * their parents.
+	 * @param root Root of subtree.
+	 * @return Code of subtree.
+	 */
+	Operand generate(Node* root);
+
+	/**
+	 * Generate code of node from the code of its children.
+	 * @param node Node.
+	 * @param kids Code of children in order. The child of a differential is
+	 *             its derivative.
+	 * @return Code of subtree.
+	 */
+	Operand generate(Node* node, const std::vector<Operand>& kids);
+
+	/**
+	 * Generate code of node without its power and sign.
+	 * @param node Node.
+	 * @param kids Code of children in order.
+	 * @param[out] fConstant True, if subtree has no variables.
+	 * @return Code of subtree or empty if constant.
+	 */
+	std::string generateNode(Node* node, const std::vector<Operand>& kids, bool& fConstant);
+
+	/**
+	 * Generate code of sum or product of children folding their constants.
+	 * @param kids Code of children of expression or term.
+	 * @param fSum If true, sum, otherwise product.
+	 * @param[out] fConstant True, if all children are constant.
+	 * @return Code of sum or product or empty if constant.
+	 */
+	std::string generateList(const std::vector<Operand>& kids, bool fSum, bool& fConstant);
+
+	/**
+	 * Get temporary for operation, adding it if new.
+	 * @param op Operation.
+	 * @return Name of temporary.
+	 */
+	std::string temp(const std::string& op);
+
+	/**
+	 * Get temporary of integer power by repeated squaring.
+	 * @param base Code of base.
+	 * @param n Positive power.
+	 * @return Code of power.
+	 */
+	std::string power(const std::string& base, int n);
+
+	/**
+	 * Get literal of value.
+	 * @param z Value.
+	 * @return C++ literal of value.
+	 */
+	std::string literal(const Complex& z) const;
+};
+
+#endif // __CODEGEN_H
@@ -0,0 +1,91 @@
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file corpus.cpp
+ * This file contains the implementation of the Corpus class with POSIX mmap.
+ */
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "corpus.h"
+
+using namespace std;
+
+Corpus::Corpus(const string& fname) : m_data(nullptr), m_size(0)
+{
+	int fd = open(fname.c_str(), O_RDONLY);
+	if (fd < 0) throw logic_error("cannot open corpus " + fname);
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		throw logic_error("cannot read corpus " + fname);
+	}
+	m_size = st.st_size;
+
+	// The mapping stays valid after the file is closed
+	if (m_size > 0) {
+		void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			close(fd);
+			throw logic_error("cannot map corpus " + fname);
+		}
+		madvise(data, m_size, MADV_SEQUENTIAL);
+		m_data = static_cast<const char*>(data);
+	}
+	close(fd);
+}
+
+Corpus::~Corpus()
+{
+	if (m_data) munmap(const_cast<char*>(m_data), m_size);
+}
+
+const char* Corpus::iterator::lineEnd() const
+{
+	auto nl = static_cast<const char*>(memchr(m_pos, '\n', m_end - m_pos));
+	return nl ? nl : m_end;
+}
+
+string_view Corpus::iterator::operator*() const
+{
+	const char* end = lineEnd();
+	if (end > m_pos && end[-1] == '\r') --end;
+	return string_view(m_pos, end - m_pos);
+}
+
+Corpus::iterator& Corpus::iterator::operator++()
+{
+	const char* end = lineEnd();
+	m_pos = (end == m_end) ? m_end : end + 1;
+	skipEmpty();
+	return *this;
+}
+
+void Corpus::iterator::skipEmpty()
+{
+	while (m_pos != m_end && (*m_pos == '\n' || (*m_pos == '\r' && m_pos + 1 != m_end && m_pos[1] == '\n'))) {
+		m_pos += (*m_pos == '\n') ? 1 : 2;
+	}
+}
@@ -0,0 +1,125 @@
+#ifndef __CORPUS_H
+#define __CORPUS_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file corpus.h
+ * This file contains the loader of files with one equation on each line.
+ */
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * File of equations, one on each line, mapped into memory.
+ * Lines are string views into the mapping, so equations are parsed in place
+ * without copying them. Empty lines are skipped and a carriage return at the
+ * end of a line is dropped.
+ */
+class Corpus
+{
+public:
+	/**
+	 * Iterator over the lines of a corpus.
+	 */
+	class iterator
+	{
+	public:
+		/**
+		 * Constructor for iterator.
+		 * @param pos Start of line.
+		 * @param end End of text.
+		 */
+		iterator(const char* pos, const char* end) : m_pos(pos), m_end(end) { skipEmpty(); }
+
+		/**
+		 * Get current line.
+		 * @return Line without its end.
+		 */
+		std::string_view operator*() const;
+
+		/**
+		 * Advance to next line.
+		 * @return This iterator.
+		 */
+		iterator& operator++();
+
+		/**
+		 * Compare position of iterators.
+		 * @param it Other iterator.
+		 * @return True, if iterators are at different lines.
+		 */
+		bool operator!=(const iterator& it) const { return m_pos != it.m_pos; }
+
+	private:
+		const char* m_pos; ///< Start of current line.
+		const char* m_end; ///< End of text.
+
+		/**
+		 * Find end of current line.
+		 * @return End of line.
+		 */
+		const char* lineEnd() const;
+
+		/**
+		 * Advance past empty lines.
+		 */
+		void skipEmpty();
+	};
+
+	/**
+	 * Constructor mapping file into memory.
+	 * Throws logic_error if file cannot be opened or mapped.
+	 * @param fname Name of file.
+	 */
+	Corpus(const std::string& fname);
+
+	/**
+	 * Destructor unmaps file.
+	 */
+	~Corpus();
+
+	Corpus(const Corpus&)=delete;            ///< No copy constructor.
+	Corpus& operator=(const Corpus&)=delete; ///< No assignment operator.
+
+	/**
+	 * Get text of whole file.
+	 * @return Text of file.
+	 */
+	std::string_view getText() const { return std::string_view(m_data, m_size); }
+
+	/**
+	 * Get iterator at first line.
+	 * @return Iterator.
+	 */
+	iterator begin() const { return iterator(m_data, m_data + m_size); }
+
+	/**
+	 * Get iterator past last line.
+	 * @return Iterator.
+	 */
+	iterator end() const { return iterator(m_data + m_size, m_data + m_size); }
+
+private:
+	const char* m_data; ///< Mapped text or null for an empty file.
+	size_t m_size;      ///< Length of text.
+};
+
+#endif // __CORPUS_H
@@ -0,0 +1,81 @@
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file display.cpp
+ * This file contains the implementation of the DisplayList class.
+ */
+
+#include "display.h"
+
+using namespace std;
+using namespace UI;
+
+/**
+ * Names of opcodes in order of DisplayList::Op.
+ */
+static const char* const op_names[] = {
+	"char", "text", "parenthesis", "line", "differential", "select", "clear"
+};
+
+void DisplayList::at(int x0, int y0, const string& s, Attributes chrAttr, Color color)
+{
+	add(TEXT, x0, y0, (int) m_text.length(), (int) s.length(), chrAttr, color);
+	m_text += s;
+}
+
+void DisplayList::differential(int x0, int y0, const string& variable)
+{
+	add(DIFFERENTIAL, x0, y0, (int) m_text.length(), (int) variable.length());
+	m_text += variable;
+}
+
+void DisplayList::replay(Graphics& gc) const
+{
+	for ( auto& cmd : m_commands ) {
+		auto attr = (Attributes) cmd.attr;
+		auto color = (Color) cmd.color;
+		switch (cmd.op) {
+			case CHAR:         gc.at(cmd.x0, cmd.y0, cmd.x, attr, color); break;
+			case TEXT:         gc.at(cmd.x0, cmd.y0, m_text.substr(cmd.x, cmd.y), attr, color); break;
+			case PARENTHESIS:  gc.parenthesis(cmd.x, cmd.y, cmd.x0, cmd.y0); break;
+			case HORIZ_LINE:   gc.horiz_line(cmd.x, cmd.x0, cmd.y0); break;
+			case DIFFERENTIAL: gc.differential(cmd.x0, cmd.y0, m_text.substr(cmd.x, cmd.y)); break;
+			case SELECT:       gc.setSelect(cmd.x, cmd.y, cmd.x0, cmd.y0); break;
+			case CLEAR:        gc.clear_screen(); break;
+		}
+	}
+}
+
+void DisplayList::write(ostream& os) const
+{
+	for ( auto& cmd : m_commands ) {
+		os << op_names[cmd.op] << " " << cmd.x0 << "," << cmd.y0;
+		switch (cmd.op) {
+			case CHAR:         os << " '" << (char) cmd.x << "'"; break;
+			case TEXT:         os << " \"" << m_text.substr(cmd.x, cmd.y) << "\""; break;
+			case DIFFERENTIAL: os << " " << m_text.substr(cmd.x, cmd.y); break;
+			case HORIZ_LINE:   os << " " << cmd.x; break;
+			case PARENTHESIS:
+			case SELECT:       os << " " << cmd.x << "x" << cmd.y; break;
+			case CLEAR:        break;
+		}
+		if (cmd.attr != NONE) os << " attr " << (int) cmd.attr;
+		if (cmd.color != BLACK) os << " color " << (int) cmd.color;
+		os << endl;
+	}
+}
@@ -0,0 +1,251 @@
+#ifndef __DISPLAY_H
+#define __DISPLAY_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file display.h
+ * This file contains the declaration of the DisplayList class, a recorded
+ * sequence of drawing commands that can be replayed to any graphics backend.
+ */
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ui.h"
+
+namespace UI {
+
+	/**
+	 * Graphics context that records drawing instead of drawing.
+	 * Drawing an equation into a display list once after layout turns every
+	 * later redraw into a loop over a flat array of commands, instead of a
+	 * walk of the tree with virtual calls per node. A list can be replayed to
+	 * several backends, compared with an earlier list to skip a redraw that
+	 * changes nothing, or written out for testing.
+	 * Text metrics are taken from the graphics context given to the
+	 * constructor, so a list records the layout of that backend. When fonts
+	 * of the backend change, metrics of the list must be invalidated too.
+	 */
+	class DisplayList : public Graphics
+	{
+	public:
+		/**
+		 * Opcodes of drawing commands.
+		 */
+		enum Op : unsigned char { CHAR, TEXT, PARENTHESIS, HORIZ_LINE, DIFFERENTIAL, SELECT, CLEAR };
+
+		/**
+		 * Drawing command.
+		 * Operands not used by an opcode are zero, so commands can be compared
+		 * as a whole.
+		 */
+		struct Command {
+			Op op;               ///< Opcode.
+			unsigned char attr;  ///< Attributes of character or text.
+			unsigned char color; ///< Color of character or text.
+			int x0;              ///< Horizontal origin.
+			int y0;              ///< Vertical origin.
+			int x;               ///< Width, character or offset of text or variable.
+			int y;               ///< Height or length of text or variable.
+
+			/**
+			 * Compare two commands.
+			 * @param cmd Other command.
+			 * @return True, if commands are the same.
+			 */
+			bool operator==(const Command& cmd) const {
+				return op == cmd.op && attr == cmd.attr && color == cmd.color &&
+				       x0 == cmd.x0 && y0 == cmd.y0 && x == cmd.x && y == cmd.y;
+			}
+		};
+
+		/** @name Constructor and Virtual Destructor */
+		//@{
+		/**
+		 * Constructor for empty display list.
+		 * @param metrics Graphics context used to measure text.
+		 */
+		DisplayList(Graphics& metrics) : Graphics(), m_metrics(metrics) {}
+
+		/**
+		 * Virtual destructor.
+		 */
+		~DisplayList() {}
+		//@}
+
+		/** @name Virtual Public Member Functions */
+		//@{
+		/**
+		 * Record differential.
+		 * @param x0 Horizontal origin of differential.
+		 * @param y0 Vertical origin of differential.
+		 * @param variable Name of variable of differential.
+		 */
+		void differential(int x0, int y0, const std::string& variable);
+
+		/**
+		 * Record pair of parenthesis.
+		 * @param x_size Horizontal size of both parenthesis.
+		 * @param y_size Vertical size of parenthesis.
+		 * @param x0 Horizontal origin of parenthesis.
+		 * @param y0 Vertical origin of parenthesis.
+		 */
+		void parenthesis(int x_size, int y_size, int x0, int y0) { add(PARENTHESIS, x0, y0, x_size, y_size); }
+
+		/**
+		 * Record horizontal line.
+		 * @param x_size Horizontal size of line.
+		 * @param x0 Horizontal origin of line.
+		 * @param y0 Vertical origin of line.
+		 */
+		void horiz_line(int x_size, int x0, int y0) { add(HORIZ_LINE, x0, y0, x_size); }
+
+		/**
+		 * Record a character.
+		 * @param x0 Horizontal origin of character.
+		 * @param y0 Vertical origin of character.
+		 * @param c  Character to be drawn at x0,y0.
+		 * @param chrAttr Attribute of character.
+		 * @param color Color of character.
+		 */
+		void at(int x0, int y0, int c, Attributes chrAttr, Color color = BLACK) {
+			add(CHAR, x0, y0, c, 0, chrAttr, color);
+		}
+
+		/**
+		 * Record a string.
+		 * @param x0 Horizontal origin of string.
+		 * @param y0 Vertical origin of string.
+		 * @param s  String to be drawn at x0,y0.
+		 * @param chrAttr Attribute of string.
+		 * @param color Color of string.
+		 */
+		void at(int x0, int y0, const std::string& s, Attributes chrAttr, Color color = BLACK);
+
+		/**
+		 * Record clearing of screen.
+		 */
+		void clear_screen() { add(CLEAR, 0, 0); }
+
+		/**
+		 * A display list has nothing to flush.
+		 */
+		void out() {}
+
+		/**
+		 * Set and record selected area.
+		 * @param x Horizontal size of selection area.
+		 * @param y Vertical size of selection area.
+		 * @param x0 Horizontal origin of selection area.
+		 * @param y0 Vertical origin of selection area.
+		 */
+		void setSelect(int x, int y, int x0, int y0) {
+			Graphics::setSelect(x, y, x0, y0);
+			add(SELECT, x0, y0, x, y);
+		}
+		//@}
+
+		/**
+		 * Remove all commands.
+		 */
+		void clear() { m_commands.clear(); m_text.clear(); }
+
+		/**
+		 * Exchange commands with other display list.
+		 * Metrics of both lists are kept.
+		 * @param list Other display list.
+		 */
+		void swap(DisplayList& list) { m_commands.swap(list.m_commands); m_text.swap(list.m_text); }
+
+		/**
+		 * Draw recorded commands in graphics context.
+		 * The frame of the graphics context is not changed.
+		 * @param gc Graphics context.
+		 */
+		void replay(Graphics& gc) const;
+
+		/**
+		 * Get number of recorded commands.
+		 * @return Number of commands.
+		 */
+		size_t size() const { return m_commands.size(); }
+
+		/**
+		 * Get recorded commands.
+		 * @return Vector of commands.
+		 */
+		const std::vector<Command>& getCommands() const { return m_commands; }
+
+		/**
+		 * Check if two lists draw the same.
+		 * @param list Other display list.
+		 * @return True, if lists have the same commands.
+		 */
+		bool operator==(const DisplayList& list) const {
+			return m_commands == list.m_commands && m_text == list.m_text;
+		}
+
+		/**
+		 * Check if two lists draw differently.
+		 * @param list Other display list.
+		 * @return True, if lists have different commands.
+		 */
+		bool operator!=(const DisplayList& list) const { return !(*this == list); }
+
+		/**
+		 * Write commands, one per line.
+		 * @param os Output stream.
+		 */
+		void write(std::ostream& os) const;
+
+	protected:
+		/** @name Virtual Measuring Functions */
+		//@{
+		int measureTextHeight() { return m_metrics.getTextHeight(); }                             ///< Measure with backend.
+		int measureTextLength(const std::string& s) { return m_metrics.getTextLength(s); }        ///< Measure with backend.
+		int measureCharLength(char c) { return m_metrics.getCharLength(c); }                      ///< Measure with backend.
+		int measureParenthesisWidth(int height) { return m_metrics.getParenthesisWidth(height); } ///< Measure with backend.
+		int measureDivideLineHeight() { return m_metrics.getDivideLineHeight(); }                 ///< Measure with backend.
+		int measureDifferentialHeight(const std::string& v) { return m_metrics.getDifferentialHeight(v); } ///< Measure with backend.
+		int measureDifferentialWidth(const std::string& v) { return m_metrics.getDifferentialWidth(v); }   ///< Measure with backend.
+		int measureDifferentialBase(const std::string& v) { return m_metrics.getDifferentialBase(v); }     ///< Measure with backend.
+		//@}
+
+	private:
+		Graphics& m_metrics;             ///< Graphics context that measures text.
+		std::vector<Command> m_commands; ///< Recorded commands.
+		std::string m_text;              ///< Text of all TEXT and DIFFERENTIAL commands.
+
+		/**
+		 * Append command to list.
+		 * @param op Opcode.
+		 * @param x0 Horizontal origin.
+		 * @param y0 Vertical origin.
+		 * @param x First operand.
+		 * @param y Second operand.
+		 * @param attr Attributes.
+		 * @param color Color.
+		 */
+		void add(Op op, int x0, int y0, int x = 0, int y = 0, Attributes attr = NONE, Color color = BLACK) {
+			m_commands.push_back({ op, (unsigned char) attr, (unsigned char) color, x0, y0, x, y });
+		}
+	};
+}
+
+#endif // __DISPLAY_H
@@ -0,0 +1,209 @@
+#ifndef __DUAL_H
+#define __DUAL_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file dual.h
+ * This file contains the Dual class for forward mode automatic differentiation.
+ * A Dual carries a value together with its partial derivatives, so evaluating
+ * an expression with duals gives its value and gradient in one pass.
+ */
+
+#include <complex>
+#include <vector>
+
+/**
+ * Complex value with its gradient to a list of variables.
+ * An empty gradient is a constant, so constants cost nothing to carry.
+ */
+class Dual
+{
+public:
+	using Complex = std::complex<double>; ///< @brief Specialized as complex double.
+
+	/**
+	 * Constructor for constant Dual.
+	 * @param value Value of constant.
+	 */
+	Dual(const Complex& value = Complex(0, 0)) : m_value(value) {}
+
+	/**
+	 * Constructor for Dual of a variable.
+	 * @param value Value of variable.
+	 * @param n Number of variables in gradient.
+	 * @param index Index of this variable in gradient.
+	 */
+	Dual(const Complex& value, size_t n, size_t index) : m_value(value), m_grad(n)
+	{
+		m_grad[index] = Complex(1, 0);
+	}
+
+	/**
+	 * Get value.
+	 * @return Value of Dual.
+	 */
+	const Complex& getValue() const { return m_value; }
+
+	/**
+	 * Get partial derivative to a variable.
+	 * @param index Index of variable in gradient.
+	 * @return Partial derivative or zero for a constant.
+	 */
+	Complex getPartial(size_t index) const { return index < m_grad.size() ? m_grad[index] : Complex(0, 0); }
+
+	/**
+	 * Check if Dual is constant.
+	 * @return True, if gradient is empty.
+	 */
+	bool isConstant() const { return m_grad.empty(); }
+
+	/**
+	 * Apply function by chain rule.
+	 * @param f Value of function at value of Dual.
+	 * @param df Derivative of function at value of Dual.
+	 * @return Dual of function.
+	 */
+	Dual chain(const Complex& f, const Complex& df) const
+	{
+		Dual z(f);
+		z.m_grad = m_grad;
+		for ( auto& g : z.m_grad ) g *= df;
+		return z;
+	}
+
+	/** @name Arithmetic Operators */
+	//@{
+	/**
+	 * Add Dual to this one.
+	 * @param b Dual to be added.
+	 * @return Reference to this Dual.
+	 */
+	Dual& operator+=(const Dual& b) { return axpy(b, 1); }
+
+	/**
+	 * Subtract Dual from this one.
+	 * @param b Dual to be subtracted.
+	 * @return Reference to this Dual.
+	 */
+	Dual& operator-=(const Dual& b) { return axpy(b, -1); }
+
+	/**
+	 * Multiply this Dual by product rule.
+	 * @param b Dual to be multiplied.
+	 * @return Reference to this Dual.
+	 */
+	Dual& operator*=(const Dual& b)
+	{
+		for ( auto& g : m_grad ) g *= b.m_value;
+		Complex a = m_value;
+		m_value *= b.m_value;
+		return axpy(b, a, false);
+	}
+
+	/**
+	 * Divide this Dual by quotient rule.
+	 * @param b Divisor.
+	 * @return Reference to this Dual.
+	 */
+	Dual& operator/=(const Dual& b)
+	{
+		for ( auto& g : m_grad ) g /= b.m_value;
+		m_value /= b.m_value;
+		return axpy(b, -m_value/b.m_value, false);
+	}
+
+	/**
+	 * Negate Dual.
+	 * @return Negated Dual.
+	 */
+	Dual operator-() const { return chain(-m_value, -1); }
+	//@}
+
+	/**
+	 * Raise Dual to power of Dual.
+	 * A constant power does not need the log of base, so zero to a power works.
+	 * @param a Base.
+	 * @param b Exponent.
+	 * @return Dual of power.
+	 */
+	friend Dual pow(const Dual& a, const Dual& b)
+	{
+		Complex z = std::pow(a.m_value, b.m_value);
+		Complex dz = (b.m_value == Complex(0, 0)) ? Complex(0, 0) : b.m_value*std::pow(a.m_value, b.m_value - Complex(1, 0));
+		Dual p = a.chain(z, dz);
+		if (!b.isConstant()) p.axpy(b, z*std::log(a.m_value), false);
+		return p;
+	}
+
+private:
+	Complex m_value;             ///< Value.
+	std::vector<Complex> m_grad; ///< Partial derivative to each variable.
+
+	/**
+	 * Add multiple of gradient of Dual to this gradient.
+	 * @param b Dual to be added.
+	 * @param k Multiple of b.
+	 * @param fValue If true, add multiple of value of b too.
+	 * @return Reference to this Dual.
+	 */
+	Dual& axpy(const Dual& b, const Complex& k, bool fValue = true)
+	{
+		if (fValue) m_value += k*b.m_value;
+		if (m_grad.size() < b.m_grad.size()) m_grad.resize(b.m_grad.size());
+		for (size_t i = 0; i < b.m_grad.size(); ++i) m_grad[i] += k*b.m_grad[i];
+		return *this;
+	}
+};
+
+/** @name Dual Arithmetic Operators */
+//@{
+/**
+ * Add two Duals.
+ * @param a First Dual.
+ * @param b Second Dual.
+ * @return Sum.
+ */
+inline Dual operator+(Dual a, const Dual& b) { return a += b; }
+
+/**
+ * Subtract two Duals.
+ * @param a First Dual.
+ * @param b Second Dual.
+ * @return Difference.
+ */
+inline Dual operator-(Dual a, const Dual& b) { return a -= b; }
+
+/**
+ * Multiply two Duals.
+ * @param a First Dual.
+ * @param b Second Dual.
+ * @return Product.
+ */
+inline Dual operator*(Dual a, const Dual& b) { return a *= b; }
+
+/**
+ * Divide two Duals.
+ * @param a Dividend.
+ * @param b Divisor.
+ * @return Quotient.
+ */
+inline Dual operator/(Dual a, const Dual& b) { return a /= b; }
+//@}
+
+#endif // __DUAL_H
@@ -0,0 +1,716 @@
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file egraph.cpp
+ * This file contains the implementation of the EGraph class.
+ */
+
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+
+#include "milo.h"
+#include "nodes.h"
+#include "rewrite.h"
+#include "egraph.h"
+
+using namespace std;
+
+/**
+ * Check if symbol is power or sign of its child.
+ * @param op Symbol of node.
+ * @return True, if symbol is ^n or -.
+ */
+static bool isWrapper(const string& op) { return op == "-" || op[0] == '^'; }
+
+/**
+ * Get class name part of symbol.
+ * @param op Symbol of node.
+ * @return Class name of node.
+ */
+static string opName(const string& op) { return op.substr(0, op.find('/')); }
+
+/**
+ * Get label part of symbol.
+ * @param op Symbol of node.
+ * @return Label of node such as function name or empty.
+ */
+static string opLabel(const string& op)
+{
+	auto pos = op.find('/');
+	return (pos == string::npos) ? string() : op.substr(pos + 1);
+}
+
+/**
+ * Cost of a node to evaluate it, roughly in multiplications.
+ * Each factor and term past the first needs one operation, functions are expensive.
+ */
+static double evalCost(const string& op, const vector<double>& kids)
+{
+	static const unordered_map<string, double> weights = {
+		{ Function::name, 20 }, { Power::name, 10 }, { Divide::name, 4 }, { "-", 1 }
+	};
+	double cost = 0;
+	for ( auto k : kids ) cost += k;
+
+	string name = opName(op);
+	if (op[0] == '^') {
+		int n = abs(stoi(op.substr(1)));
+		while (n > 1) { cost += 1 + (n & 1); n >>= 1; }
+	}
+	else if (name == Term::name || name == Expression::name) {
+		cost += kids.size() - 1;
+	}
+	else if (weights.find(name) != weights.end()) {
+		cost += weights.at(name);
+	}
+	return cost;
+}
+
+const unordered_map<string, EGraph::CostFunction> EGraph::cost_models = {
+	{ "size",  [](const string& op, const vector<double>& kids) {
+		double cost = isWrapper(op) ? 0 : 1;
+		for ( auto k : kids ) cost += k;
+		return cost;
+	} },
+	{ "depth", [](const string& op, const vector<double>& kids) {
+		double cost = 0;
+		for ( auto k : kids ) cost = max(cost, k);
+		return cost + (isWrapper(op) ? 0 : 1);
+	} },
+	{ "eval",  evalCost },
+};
+
+size_t EGraph::ENodeHash::operator()(const ENode& n) const
+{
+	size_t seed = hash<int>()(n.op);
+	boost::hash_combine(seed, boost::hash_range(n.kids.begin(), n.kids.end()));
+	return seed;
+}
+
+int EGraph::find(int id) const
+{
+	while (m_parent[id] != id) {
+		m_parent[id] = m_parent[m_parent[id]];
+		id = m_parent[id];
+	}
+	return id;
+}
+
+int EGraph::numClasses() const
+{
+	int n = 0;
+	for ( int id = 0; id < (int) m_parent.size(); ++id ) n += (find(id) == id);
+	return n;
+}
+
+int EGraph::intern(const string& op)
+{
+	auto pos = m_op_ids.emplace(op, m_ops.size());
+	if (pos.second) m_ops.push_back({ op, opName(op), opLabel(op) });
+	return pos.first->second;
+}
+
+int EGraph::add(const string& op, vector<int> kids)
+{
+	return add(intern(op), move(kids));
+}
+
+int EGraph::add(int op, vector<int> kids)
+{
+	for ( auto& k : kids ) k = find(k);
+	ENode node{op, kids};
+
+	auto pos = m_memo.find(node);
+	if (pos != m_memo.end()) return find(m_node_class[pos->second]);
+
+	int id = m_parent.size();
+	m_parent.push_back(id);
+	m_classes.emplace_back(1, m_nodes.size());
+	m_memo.emplace(node, m_nodes.size());
+	m_nodes.push_back(node);
+	m_node_class.push_back(id);
+	return id;
+}
+
+int EGraph::add(Node* root, const Subst* s)
+{
+	/**
+	 * Node on stack with its symbol and number of children once they are pushed.
+	 */
+	struct Entry { Node* node; int op; int kids; };
+
+	// Classes of added children of the nodes on the stack, in order
+	vector<int> done;
+	vector<Entry> stack = { { root, -1, -1 } };
+	while (!stack.empty()) {
+		Entry& top = stack.back();
+		Node* node = top.node;
+		int id;
+		if (top.kids >= 0) {
+			vector<int> kids(done.end() - top.kids, done.end());
+			done.resize(done.size() - top.kids);
+			id = add(top.op, move(kids));
+			stack.pop_back();
+		}
+		else if (s && node->getType() == Variable::type && static_cast<Variable*>(node)->getVariable().length() == 1) {
+			char var = static_cast<Variable*>(node)->getVariable()[0];
+			auto b = find_if(s->begin(), s->end(), [var](auto& b) { return b.first == var; });
+			if (b == s->end()) throw logic_error("unbound pattern variable " + string(1, var));
+			id = find(b->second);
+			stack.pop_back();
+		}
+		else {
+			vector<Node*> kids;
+			top.op = intern(RuleSet::symbol(node, kids, false));
+			top.kids = kids.size();
+			for ( auto kid = kids.rbegin(); kid != kids.rend(); ++kid ) stack.push_back({ *kid, -1, -1 });
+			continue;
+		}
+
+		if (node->getNth() != 1) id = add("^" + to_string(node->getNth()), { id });
+		if (!node->getSign()) id = add("-", { id });
+		done.push_back(id);
+	}
+	return done.back();
+}
+
+bool EGraph::merge(int a, int b)
+{
+	a = find(a); b = find(b);
+	if (a == b) return false;
+	if (m_classes[a].size() < m_classes[b].size()) swap(a, b);
+
+	m_parent[b] = a;
+	m_classes[a].insert(m_classes[a].end(), m_classes[b].begin(), m_classes[b].end());
+	m_classes[b].clear();
+	return true;
+}
+
+void EGraph::rebuild()
+{
+	// Canonical nodes that become equal put their classes together, until none do.
+	bool merged = true;
+	while (merged) {
+		merged = false;
+		m_memo.clear();
+		for ( auto& c : m_classes ) c.clear();
+
+		for ( int i = 0; i < (int) m_nodes.size(); ++i ) {
+			for ( auto& k : m_nodes[i].kids ) k = find(k);
+			auto pos = m_memo.emplace(m_nodes[i], i);
+			if (pos.second) {
+				m_classes[find(m_node_class[i])].push_back(i);
+			}
+			else {
+				merged |= merge(m_node_class[pos.first->second], m_node_class[i]);
+			}
+		}
+	}
+}
+
+vector<EGraph::TokenOps> EGraph::intern(const vector<RuleSet::Token>& lhs)
+{
+	vector<TokenOps> ops;
+	for ( auto& t : lhs ) {
+		ops.push_back({ t.var ? -1 : intern(t.symbol),
+		                t.nth != 1 ? intern("^" + to_string(t.nth)) : -1,
+		                intern("-") });
+	}
+	return ops;
+}
+
+void EGraph::ematch(const vector<RuleSet::Token>& lhs, const vector<TokenOps>& ops, int pos, int id,
+                    int wrap, const Subst& s, vector<Subst>& out) const
+{
+	id = find(id);
+	auto& t = lhs[pos];
+
+	// Sign is the outer wrapper of a node, power the inner one.
+	int op = (wrap == 0 && !t.sign) ? ops[pos].neg : (wrap <= 1 && t.nth != 1) ? ops[pos].nth : -1;
+	if (op >= 0) {
+		int next = (op == ops[pos].neg) ? 1 : 2;
+		for ( int n : m_classes[id] ) {
+			if (m_nodes[n].op == op) ematch(lhs, ops, pos, m_nodes[n].kids[0], next, s, out);
+		}
+		return;
+	}
+
+	if (t.var) {
+		for ( auto& b : s ) {
+			if (b.first == t.var) {
+				if (find(b.second) == id) out.push_back(s);
+				return;
+			}
+		}
+		out.push_back(s);
+		out.back().push_back({ t.var, id });
+		return;
+	}
+
+	for ( int n : m_classes[id] ) {
+		auto& node = m_nodes[n];
+		if (node.op != ops[pos].op || (int) node.kids.size() != t.kids) continue;
+
+		vector<Subst> partial = { s };
+		int kid = pos + 1;
+		for ( size_t i = 0; i < node.kids.size() && !partial.empty(); ++i ) {
+			vector<Subst> next;
+			for ( auto& ps : partial ) ematch(lhs, ops, kid, node.kids[i], 0, ps, next);
+			partial.swap(next);
+			kid = lhs[kid].end;
+		}
+		out.insert(out.end(), partial.begin(), partial.end());
+	}
+}
+
+bool EGraph::saturate(const RuleSet& rules, int node_limit, double seconds)
+{
+	auto start = chrono::steady_clock::now();
+	vector<vector<TokenOps>> ops;
+	for ( int r = 0; r < rules.size(); ++r ) ops.push_back(intern(rules.getRule(r).lhs));
+
+	for ( int iteration = 0; iteration < max_iterations; ++iteration ) {
+		// Find every match first so rules see the same e-graph.
+		vector<Match> matches;
+		for ( int id = 0; id < (int) m_classes.size(); ++id ) {
+			if (find(id) != id) continue;
+			for ( int r = 0; r < rules.size(); ++r ) {
+				auto& rule = rules.getRule(r);
+				vector<Subst> found;
+				if (rule.window <= 1) {
+					ematch(rule.lhs, ops[r], 0, id, 0, Subst(), found);
+					for ( auto& s : found ) matches.push_back({ r, id, -1, 0, s });
+					continue;
+				}
+				for ( int n : m_classes[id] ) {
+					auto& node = m_nodes[n];
+					if (m_ops[node.op].name != Term::name) continue;
+					for ( int i = 0; i + rule.window <= (int) node.kids.size(); ++i ) {
+						vector<Subst> partial = { Subst() };
+						int pos = 0;
+						for ( int j = 0; j < rule.window && !partial.empty(); ++j ) {
+							vector<Subst> next;
+							for ( auto& ps : partial ) ematch(rule.lhs, ops[r], pos, node.kids[i + j], 0, ps, next);
+							partial.swap(next);
+							pos = rule.lhs[pos].end;
+						}
+						for ( auto& s : partial ) matches.push_back({ r, id, n, i, s });
+					}
+				}
+			}
+		}
+
+		bool changed = false;
+		int nodes = m_nodes.size();
+		for ( auto& m : matches ) {
+			Node* rhs = RuleSet::unwrap(rules.getRule(m.rule).rhs->getRoot());
+			if (m.node < 0) {
+				changed |= merge(m.id, add(rhs, &m.subst));
+				continue;
+			}
+
+			// Splice right side into the factors of the term.
+			int window = rules.getRule(m.rule).window;
+			vector<int> kids(m_nodes[m.node].kids.begin(), m_nodes[m.node].kids.begin() + m.index);
+			if (rhs->getType() == Term::type && rhs->getNth() == 1 && rhs->getSign()) {
+				for ( auto factor : *static_cast<Term*>(rhs) ) kids.push_back(add(RuleSet::unwrap(factor), &m.subst));
+			}
+			else {
+				kids.push_back(add(rhs, &m.subst));
+			}
+			auto& old = m_nodes[m.node].kids;
+			kids.insert(kids.end(), old.begin() + m.index + window, old.end());
+
+			int id = (kids.size() == 1) ? kids[0] : add(Term::name + "/" + to_string(kids.size()), kids);
+			changed |= merge(m.id, id);
+		}
+		rebuild();
+
+		if (!changed && nodes == (int) m_nodes.size()) return true;
+		if ((int) m_nodes.size() > node_limit) break;
+		chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+		if (seconds > 0 && elapsed.count() > seconds) break;
+	}
+	return false;
+}
+
+bool EGraph::isNumber(int id, const string& value) const
+{
+	for ( int n : m_classes[find(id)] ) {
+		if (m_ops[m_nodes[n].op].text == Number::name + "/" + value) return true;
+	}
+	return false;
+}
+
+int EGraph::number(int n)
+{
+	int id = add(Number::name + "/" + to_string(abs(n)), {});
+	return (n < 0) ? add("-", { id }) : id;
+}
+
+int EGraph::sum(const vector<int>& kids)
+{
+	// Terms of a sum are put in line so an expression never holds an expression.
+	vector<int> terms;
+	for ( int k : kids ) {
+		if (isNumber(k, "0")) continue;
+		const ENode& node = m_nodes[m_classes[find(k)][0]];
+		if (m_ops[node.op].name == Expression::name)
+			terms.insert(terms.end(), node.kids.begin(), node.kids.end());
+		else
+			terms.push_back(k);
+	}
+	if (terms.empty()) return number(0);
+	if (terms.size() == 1) return terms[0];
+	return add(Expression::name + "/" + to_string(terms.size()), terms);
+}
+
+int EGraph::product(const vector<int>& kids)
+{
+	// Factors of a product are put in line so a term never holds a term,
+	// and whole numbers are multiplied into one leading factor.
+	vector<int> factors;
+	vector<int> stack(kids.rbegin(), kids.rend());
+	long n = 1;
+	while (!stack.empty()) {
+		int k = stack.back();
+		stack.pop_back();
+		const ENode& node = m_nodes[m_classes[find(k)][0]];
+		if (m_ops[node.op].text == "-") {
+			n = -n;
+			k = node.kids[0];
+		}
+
+		const ENode& body = m_nodes[m_classes[find(k)][0]];
+		string label = m_ops[body.op].label;
+		if (m_ops[body.op].name == Number::name && isInteger(label))
+			n *= stol(label);
+		else if (m_ops[body.op].name == Term::name)
+			stack.insert(stack.end(), body.kids.rbegin(), body.kids.rend());
+		else
+			factors.push_back(k);
+	}
+	if (n == 0) return number(0);
+	if (abs(n) != 1 || factors.empty()) factors.insert(factors.begin(), number(abs(n)));
+
+	int id = (factors.size() == 1) ? factors[0] : add(Term::name + "/" + to_string(factors.size()), factors);
+	return (n < 0) ? negate(id) : id;
+}
+
+int EGraph::negate(int id)
+{
+	if (isNumber(id, "0")) return id;
+	const ENode& node = m_nodes[m_classes[find(id)][0]];
+	return (m_ops[node.op].text == "-") ? node.kids[0] : add("-", { id });
+}
+
+int EGraph::power(int id, int n)
+{
+	if (n == 0) return number(1);
+	if (n == 1) return id;
+	return add(Power::name, { id, number(n) });
+}
+
+int EGraph::divide(int a, int b)
+{
+	if (isNumber(a, "0")) return a;
+	if (isNumber(b, "1")) return a;
+	return add(Divide::name, { a, b });
+}
+
+int EGraph::function(const string& name, int arg)
+{
+	return add(Function::name + "/" + name, { arg });
+}
+
+int EGraph::derivative(int id, const string& var)
+{
+	auto key = make_pair(find(id), var);
+	auto pos = m_derivatives.find(key);
+	if (pos != m_derivatives.end()) return find(pos->second);
+
+	// Any node of a class has the same derivative, so take the first.
+	int d = derive(key.first, m_nodes[m_classes[key.first][0]], var);
+	m_derivatives.emplace(key, d);
+	return d;
+}
+
+int EGraph::derive(int id, ENode node, const string& var)
+{
+	string name = m_ops[node.op].name, label = m_ops[node.op].label;
+	auto& k = node.kids;
+
+	if (m_ops[node.op].text == "-") return negate(derivative(k[0], var));
+	if (m_ops[node.op].text[0] == '^') {
+		int n = stoi(m_ops[node.op].text.substr(1));
+		return product({ number(n), n == 2 ? k[0] : add("^" + to_string(n - 1), { k[0] }), derivative(k[0], var) });
+	}
+	if (name == Number::name || name == Constant::name) return number(0);
+	if (name == Variable::name) return number(label == var ? 1 : 0);
+
+	if (name == Expression::name) {
+		vector<int> terms;
+		for ( int t : k ) terms.push_back(derivative(t, var));
+		return sum(terms);
+	}
+	if (name == Term::name) {
+		// Product rule reuses the classes of the other factors in every term.
+		vector<int> terms;
+		for ( size_t i = 0; i < k.size(); ++i ) {
+			int d = derivative(k[i], var);
+			if (isNumber(d, "0")) continue;
+			vector<int> factors = k;
+			factors[i] = d;
+			terms.push_back(product(factors));
+		}
+		return sum(terms);
+	}
+	if (name == Function::name) {
+		int arg = k[0], d = derivative(arg, var);
+		if (isNumber(d, "0")) return d;
+		if (label == "sin") return product({ function("cos", arg), d });
+		if (label == "cos") return negate(product({ function("sin", arg), d }));
+		if (label == "tan") return divide(d, power(function("cos", arg), 2));
+		if (label == "log") return divide(d, arg);
+		if (label == "exp") return product({ id, d });
+		throw logic_error("no derivative of function " + label);
+	}
+	if (name == Divide::name) {
+		int da = derivative(k[0], var), db = derivative(k[1], var);
+		if (isNumber(db, "0")) return divide(da, k[1]);
+		return divide(sum({ product({ da, k[1] }), negate(product({ k[0], db })) }), power(k[1], 2));
+	}
+	if (name == Power::name) {
+		int da = derivative(k[0], var), db = derivative(k[1], var);
+		const ENode& exp = m_nodes[m_classes[find(k[1])][0]];
+		if (isNumber(db, "0") && m_ops[exp.op].name == Number::name && isInteger(m_ops[exp.op].label)) {
+			int n = stoi(m_ops[exp.op].label);
+			return product({ number(n), power(k[0], n - 1), da });
+		}
+		// d(a^b) = a^b (b' log(a) + b a'/a)
+		int log = function("log", k[0]);
+		return product({ id, sum({ product({ db, log }), product({ k[1], divide(da, k[0]) }) }) });
+	}
+	if (name == Differential::name) {
+		return derivative(derivative(k[0], label), var);
+	}
+	throw logic_error("no derivative of " + name);
+}
+
+void EGraph::differentiate()
+{
+	for ( int n = 0; n < (int) m_nodes.size(); ++n ) {
+		if (m_ops[m_nodes[n].op].name != Differential::name) continue;
+		merge(m_node_class[n], derivative(m_nodes[n].kids[0], m_ops[m_nodes[n].op].label));
+	}
+	rebuild();
+}
+
+string EGraph::extract(int id, const CostFunction& cost)
+{
+	// Relax costs of classes until no node gets cheaper.
+	const double inf = numeric_limits<double>::infinity();
+	vector<double> costs(m_classes.size(), inf);
+	m_best.assign(m_classes.size(), -1);
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for ( int n = 0; n < (int) m_nodes.size(); ++n ) {
+			vector<double> kids;
+			for ( int k : m_nodes[n].kids ) kids.push_back(costs[find(k)]);
+			if (find_if(kids.begin(), kids.end(), [inf](double c) { return c == inf; }) != kids.end()) continue;
+
+			double c = cost(m_ops[m_nodes[n].op].text, kids);
+			int cls = find(m_node_class[n]);
+			if (c < costs[cls]) {
+				costs[cls] = c; m_best[cls] = n;
+				changed = true;
+			}
+		}
+	}
+
+	ostringstream os;
+	{
+		XML::Stream xml(os, string());
+		emit(xml, id, EXPRESSION);
+	}
+	return os.str();
+}
+
+/**
+ * Output header of node with power and sign attributes.
+ * @param xml XML output stream.
+ * @param name Class name of node.
+ * @param nth Integer power of node.
+ * @param neg True, if node is negative.
+ */
+static void header(XML::Stream& xml, const string& name, int nth, bool neg)
+{
+	xml << XML::HEADER << name;
+	if (nth != 1) xml << XML::NAME_VALUE << "nth" << to_string(nth);
+	if (neg) xml << XML::NAME_VALUE << "negative" << "true";
+}
+
+void EGraph::emit(XML::Stream& xml, int id, Slot slot) const
+{
+	// Power and sign of a node are attributes of its XML.
+	int nth = 1;
+	bool neg = false;
+	const ENode* node = &m_nodes[m_best[find(id)]];
+	if (m_ops[node->op].text == "-") {
+		neg = true; id = node->kids[0]; node = &m_nodes[m_best[find(id)]];
+	}
+	if (m_ops[node->op].text[0] == '^') {
+		nth = stoi(m_ops[node->op].text.substr(1)); id = node->kids[0]; node = &m_nodes[m_best[find(id)]];
+	}
+	string name = m_ops[node->op].name;
+	bool wrapper = isWrapper(m_ops[node->op].text);
+
+	// Wrap node so it fits its slot: expressions hold terms and terms hold factors.
+	int footers = 0;
+	if (slot == EXPRESSION && name != Expression::name) {
+		header(xml, Expression::name, nth, neg); xml << XML::HEADER_END;
+		nth = 1; neg = false; slot = TERM; ++footers;
+	}
+	if (slot == TERM && name != Term::name) {
+		header(xml, Term::name, nth, neg); xml << XML::HEADER_END;
+		nth = 1; neg = false; slot = FACTOR; ++footers;
+	}
+	if (slot == FACTOR && (name == Term::name || wrapper)) {
+		header(xml, Expression::name, nth, neg); xml << XML::HEADER_END;
+		nth = 1; neg = false; ++footers;
+		if (wrapper) { header(xml, Term::name, 1, false); xml << XML::HEADER_END; ++footers; }
+	}
+
+	if (wrapper) {
+		emit(xml, id, FACTOR);
+	}
+	else {
+		string label = m_ops[node->op].label;
+		header(xml, name, nth, neg);
+		if (name == Variable::name || name == Constant::name) {
+			xml << XML::NAME_VALUE << "name" << label << XML::ATOM_END;
+		}
+		else if (name == Number::name) {
+			xml << XML::NAME_VALUE << "value" << label << XML::ATOM_END;
+		}
+		else {
+			if (name == Function::name) xml << XML::NAME_VALUE << "name" << label;
+			if (name == Differential::name) xml << XML::NAME_VALUE << "variable" << label;
+			xml << XML::HEADER_END;
+
+			Slot kid_slot = (name == Expression::name) ? TERM :
+				            (name == Differential::name || name == Function::name) ? EXPRESSION : FACTOR;
+			for ( int k : node->kids ) {
+				// Nested powers and quotients keep their parenthesis as the parser does.
+				string kid = m_ops[m_nodes[m_best[find(k)]].op].name;
+				bool binary = (name == Power::name || name == Divide::name) &&
+					          (kid == Power::name || kid == Divide::name);
+				emit(xml, k, binary ? EXPRESSION : kid_slot);
+			}
+			xml << XML::FOOTER;
+		}
+	}
+	while (footers--) xml << XML::FOOTER;
+}
+
+/**
+ * Wrap cost function so differentials are never extracted.
+ * @param cost Name of cost model in EGraph::cost_models.
+ * @return Cost function that is infinite for differentials.
+ */
+static EGraph::CostFunction noDifferentials(const string& cost)
+{
+	auto base = EGraph::cost_models.at(cost);
+	return [base](const string& op, const vector<double>& kids) {
+		return (opName(op) == Differential::name) ? numeric_limits<double>::infinity() : base(op, kids);
+	};
+}
+
+bool Equation::saturate(const RuleSet& rules, const string& cost, double seconds)
+{
+	if (!m_inputs.empty()) return false;
+
+	EGraph graph;
+	int root = graph.add(m_root);
+	graph.saturate(rules, EGraph::max_nodes, seconds);
+
+	NodePtr node;
+	node = Node::create(graph.extract(root, EGraph::cost_models.at(cost)), *this, nullptr);
+	node->setDrawParenthesis(false);
+
+	clearSelect();
+	bool result = node->toString() != m_root->toString();
+	m_root = node;
+	return result;
+}
+
+bool Equation::derivative(const string& var, const RuleSet& rules, const string& cost)
+{
+	if (!m_inputs.empty()) return false;
+
+	EGraph graph;
+	int root = graph.derivative(graph.add(m_root), var);
+	graph.differentiate();
+	graph.saturate(rules);
+
+	NodePtr node;
+	node = Node::create(graph.extract(root, noDifferentials(cost)), *this, nullptr);
+	node->setDrawParenthesis(false);
+
+	clearSelect();
+	m_root = node;
+	return true;
+}
+
+bool Equation::differentiate(const RuleSet& rules, const string& cost)
+{
+	if (!m_inputs.empty()) return false;
+
+	EGraph graph;
+	int root = graph.add(m_root);
+	graph.differentiate();
+	graph.saturate(rules);
+
+	NodePtr node;
+	node = Node::create(graph.extract(root, noDifferentials(cost)), *this, nullptr);
+	node->setDrawParenthesis(false);
+
+	clearSelect();
+	bool result = node->toString() != m_root->toString();
+	m_root = node;
+	return result;
+}
+
+NodePtr Differential::getDerivative() const
+{
+	EGraph graph;
+	int root = graph.derivative(graph.add(m_function), getVariable());
+
+	NodePtr node;
+	node = Node::create(graph.extract(root, noDifferentials("size")), m_eqn, nullptr);
+	return node;
+}
+
+// Derivative is built symbolically so its gradient is first order again.
+Dual Differential::getNodeDual(const vector<SymbolTable::Id>&, const Dual* duals) const
+{
+	return duals[0];
+}
@@ -0,0 +1,344 @@
+#ifndef __EGRAPH_H
+#define __EGRAPH_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file egraph.h
+ * This file contains the declaration of the EGraph class. An e-graph stores
+ * many equivalent forms of an equation at once: each equivalence class holds
+ * nodes whose children are classes. Rewrite rules only ever add nodes and merge
+ * classes, so no form is lost, and the cheapest form is extracted at the end.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include "milo.h"
+#include "rewrite.h"
+
+/**
+ * Hash-consed equivalence classes of nodes with congruence closure.
+ * A node is a symbol from RuleSet::symbol() without power and sign, plus its
+ * child classes. Power and sign are separate nodes such as ^2 and - so that
+ * a pattern variable can bind the body of a node. Symbols are interned, so
+ * nodes are hashed and compared as integers.
+ */
+class EGraph
+{
+public:
+	/**
+	 * Cost of a node given its symbol and the cost of each child class.
+	 */
+	using CostFunction = std::function<double (const std::string& op, const std::vector<double>& kids)>;
+
+	/**
+	 * Add subtree of equation to e-graph.
+	 * The subtree is walked with an explicit stack.
+	 * @param node Root of subtree.
+	 * @return Class of root.
+	 */
+	int add(Node* node) { return add(node, nullptr); }
+
+	/**
+	 * Add node to e-graph unless an equal node already exists.
+	 * @param op Symbol of node.
+	 * @param kids Child classes of node.
+	 * @return Class of node.
+	 */
+	int add(const std::string& op, std::vector<int> kids);
+
+	/**
+	 * Get canonical class of class id.
+	 * @param id Class id.
+	 * @return Canonical class id.
+	 */
+	int find(int id) const;
+
+	/**
+	 * Merge two classes as being equivalent.
+	 * @param a First class.
+	 * @param b Second class.
+	 * @return True, if classes were not already merged.
+	 */
+	bool merge(int a, int b);
+
+	/**
+	 * Restore congruence: nodes with equal symbols and child classes are in the same class.
+	 */
+	void rebuild();
+
+	/**
+	 * Apply rules until nothing changes or the budget runs out.
+	 * The budget is counted in nodes and rounds, so the result does not
+	 * depend on the speed of the machine. A time limit can be added for
+	 * interactive use, but then the result depends on it.
+	 * @param rules Rules to be applied, both directions are not implied.
+	 * @param node_limit Stop when e-graph has more nodes than this.
+	 * @param seconds Stop after a round when this much time has passed, no limit if 0.
+	 * @return True, if e-graph was saturated within budget.
+	 */
+	bool saturate(const RuleSet& rules, int node_limit = max_nodes, double seconds = 0);
+
+	/**
+	 * Extract cheapest subtree of class as XML fragment of an expression.
+	 * @param id Class to be extracted.
+	 * @param cost Cost function of a node.
+	 * @return XML fragment of cheapest expression.
+	 */
+	std::string extract(int id, const CostFunction& cost);
+
+	/**
+	 * Add derivative of class to e-graph.
+	 * Derivatives are memoized by class, so a subtree shared by a class and its
+	 * derivative is stored once and the derivative stays near the size of the class.
+	 * @param id Class to be differentiated.
+	 * @param var Name of variable.
+	 * @return Class of derivative.
+	 */
+	int derivative(int id, const std::string& var);
+
+	/**
+	 * Merge every differential node with the derivative of its function.
+	 */
+	void differentiate();
+
+	/**
+	 * Get number of nodes in e-graph.
+	 * @return Number of nodes.
+	 */
+	int numNodes() const { return m_nodes.size(); }
+
+	/**
+	 * Get number of equivalence classes in e-graph.
+	 * @return Number of classes.
+	 */
+	int numClasses() const;
+
+	static const std::unordered_map<std::string, CostFunction> cost_models; ///< Cost functions by name.
+
+	static const int max_nodes = 20000;    ///< Default node limit of saturate().
+	static const int max_iterations = 30;  ///< Maximum rounds of rules in saturate().
+
+private:
+	/**
+	 * Node in e-graph with children that are classes.
+	 */
+	struct ENode
+	{
+		int op;                ///< Interned symbol of node.
+		std::vector<int> kids; ///< Child classes.
+
+		/**
+		 * Overloaded equal operator for hash map.
+		 * @param b Node to be compared.
+		 * @return True, if symbols and children are equal.
+		 */
+		bool operator==(const ENode& b) const { return op == b.op && kids == b.kids; }
+	};
+
+	/**
+	 * Hash of ENode for hash map.
+	 */
+	struct ENodeHash
+	{
+		/**
+		 * Combine hash of symbol and children.
+		 * @param n Node to be hashed.
+		 * @return Hash value.
+		 */
+		size_t operator()(const ENode& n) const;
+	};
+
+	/**
+	 * Interned symbol split into its parts once.
+	 */
+	struct Op
+	{
+		std::string text;  ///< Symbol such as function/sin, ^2 or -.
+		std::string name;  ///< Class name part of symbol.
+		std::string label; ///< Label part of symbol or empty.
+	};
+
+	/**
+	 * Interned symbols of one token of a rule.
+	 */
+	struct TokenOps
+	{
+		int op;  ///< Symbol of node or -1 for pattern variable.
+		int nth; ///< Symbol of power or -1.
+		int neg; ///< Symbol of negative sign.
+	};
+
+	using Subst = std::vector<std::pair<char, int>>; ///< @brief Classes bound to pattern variables.
+
+	/**
+	 * Position where a rule matched, stored until all matches are found.
+	 */
+	struct Match
+	{
+		int rule;   ///< Index of rule.
+		int id;     ///< Class matched.
+		int node;   ///< Term node matched by window or -1.
+		int index;  ///< Index of first factor in window.
+		Subst subst; ///< Pattern variable bindings.
+	};
+
+	mutable std::vector<int> m_parent;         ///< Union-find parent of each class.
+	std::vector<ENode> m_nodes;                ///< All nodes.
+	std::vector<int> m_node_class;             ///< Class each node was added to.
+	std::vector<std::vector<int>> m_classes;   ///< Nodes of each canonical class.
+	std::unordered_map<ENode, int, ENodeHash> m_memo; ///< Index of each canonical node.
+	std::vector<int> m_best;                   ///< Cheapest node of each class after extract.
+	std::map<std::pair<int, std::string>, int> m_derivatives; ///< Derivative of each class by variable.
+	std::vector<Op> m_ops;                     ///< Interned symbols.
+	std::unordered_map<std::string, int> m_op_ids; ///< Index of each interned symbol.
+
+	/**
+	 * Get index of symbol, interning it if new.
+	 * @param op Symbol of node.
+	 * @return Index of symbol.
+	 */
+	int intern(const std::string& op);
+
+	/**
+	 * Add node to e-graph unless an equal node already exists.
+	 * @param op Interned symbol of node.
+	 * @param kids Child classes of node.
+	 * @return Class of node.
+	 */
+	int add(int op, std::vector<int> kids);
+
+	/**
+	 * Add subtree of equation to e-graph filling pattern variables.
+	 * @param node Root of subtree.
+	 * @param s Bindings of one letter variables or null to add them as they are.
+	 * @return Class of root.
+	 */
+	int add(Node* node, const Subst* s);
+
+	/**
+	 * Intern symbols of tokens of left side of rule.
+	 * @param lhs Left side of rule.
+	 * @return Symbols of each token.
+	 */
+	std::vector<TokenOps> intern(const std::vector<RuleSet::Token>& lhs);
+
+	/**
+	 * Find all bindings of pattern that match class.
+	 * Power and sign of a token are matched as wrapper nodes first.
+	 * @param lhs Left side of rule.
+	 * @param ops Interned symbols of left side.
+	 * @param pos Index of token to be matched.
+	 * @param id Class to be matched.
+	 * @param wrap Number of wrappers of token already matched.
+	 * @param s Bindings so far.
+	 * @param[out] out Bindings of every match.
+	 */
+	void ematch(const std::vector<RuleSet::Token>& lhs, const std::vector<TokenOps>& ops, int pos, int id,
+	            int wrap, const Subst& s, std::vector<Subst>& out) const;
+
+	/** @name Derivative Helpers
+	 * Add nodes to e-graph folding zeros, ones and double negatives.
+	 */
+	//@{
+	/**
+	 * Check if class contains a number.
+	 * @param id Class to be checked.
+	 * @param value Number as in its symbol.
+	 * @return True, if class contains number.
+	 */
+	bool isNumber(int id, const std::string& value) const;
+
+	/**
+	 * Add integer number.
+	 * @param n Value of number.
+	 * @return Class of number.
+	 */
+	int number(int n);
+
+	/**
+	 * Add sum of classes.
+	 * @param kids Classes to be added.
+	 * @return Class of sum.
+	 */
+	int sum(const std::vector<int>& kids);
+
+	/**
+	 * Add product of classes.
+	 * @param kids Classes to be multiplied.
+	 * @return Class of product.
+	 */
+	int product(const std::vector<int>& kids);
+
+	/**
+	 * Add negative of class.
+	 * @param id Class to be negated.
+	 * @return Class of negative.
+	 */
+	int negate(int id);
+
+	/**
+	 * Add integer power of class.
+	 * @param id Base class.
+	 * @param n Integer power.
+	 * @return Class of power.
+	 */
+	int power(int id, int n);
+
+	/**
+	 * Add quotient of classes.
+	 * @param a Dividend class.
+	 * @param b Divisor class.
+	 * @return Class of quotient.
+	 */
+	int divide(int a, int b);
+
+	/**
+	 * Add function of class.
+	 * @param name Name of function such as sin.
+	 * @param arg Class of argument.
+	 * @return Class of function.
+	 */
+	int function(const std::string& name, int arg);
+
+	/**
+	 * Add derivative of one node of a class.
+	 * @param id Class of node.
+	 * @param node Node to be differentiated.
+	 * @param var Name of variable.
+	 * @return Class of derivative.
+	 */
+	int derive(int id, ENode node, const std::string& var);
+	//@}
+
+	/** Slot in XML that a node has to fit. */
+	enum Slot { FACTOR, TERM, EXPRESSION };
+
+	/**
+	 * Output cheapest subtree of class to XML stream.
+	 * @param xml XML output stream.
+	 * @param id Class to be output.
+	 * @param slot Slot the class has to fit.
+	 */
+	void emit(XML::Stream& xml, int id, Slot slot) const;
+};
+
+#endif // __EGRAPH_H
@@ -20,8 +20,13 @@
  * This file contains the implementation of the panels that use class Equation.
  */
 
+#include <filesystem>
+
 #include "panel.h"
 #include "milo.h"
+#include "rewrite.h"
+#include "solve.h"
+#include "codegen.h"
 
 using namespace std;
 using namespace UI;
@@ -386,8 +391,8 @@ bool EqnBox::do_space(const KeyEvent& event)
 		if (parent == nullptr) return false;
 		
 		if (parent->getType() == Term::type) {
-			Term* term = dynamic_cast<Term*>(parent);
-			m_eqn->setSelect(*(term->begin()), *(--term->end()));
+			Term* term = static_cast<Term*>(parent);
+			m_eqn->setSelect(*(term->begin()), *(term->end() - 1));
 		}
 		else
 			m_eqn->setSelect(parent);
@@ -610,6 +615,8 @@ void EqnBox::doKey(const KeyEvent& key)
 	m_fChange = false;
 	auto key_entry = key_event_map.find(key);
 	if (key_entry != key_event_map.end()) {
+		m_shown = Snapshot(); // Handlers change selection without reporting it
+		invalidate();
 		m_fChange = (key_entry->second)(*this, key);
 	}
 }
@@ -619,6 +626,8 @@ void EqnBox::doMouse(const MouseEvent& mouse)
 	m_fChange = false;
 	auto mouse_entry = mouse_event_map.find(mouse);
 	if (mouse_entry != mouse_event_map.end()) {
+		m_shown = Snapshot(); // Handlers change selection without reporting it
+		invalidate();
 		m_fChange = (mouse_entry->second)(*this, mouse);
 	}
 }
@@ -626,6 +635,24 @@ void EqnBox::doMouse(const MouseEvent& mouse)
 const unordered_map<string, EqnBox::menu_handler> EqnBox::menu_map = {
 	{ string("simplify"),  [](EqnBox& p) { return p.getEqn().simplify(); } },
 	{ string("normalize"), [](EqnBox& p) { p.getEqn().normalize(); return true; } },
+	{ string("rewrite"),   [](EqnBox& p) { return p.getEqn().rewrite(RuleSet::getDefault()); } },
+	{ string("saturate"),  [](EqnBox& p) { return p.getEqn().saturate(RuleSet::getDefault()); } },
+	{ string("expand"),    [](EqnBox& p) { return p.getEqn().expand(); } },
+	{ string("differentiate"), [](EqnBox& p) { return p.getEqn().differentiate(RuleSet::getDefault()); } },
+	{ string("codegen"),   [](EqnBox& p) {
+			string code = CodeGenerator(p.getEqn()).header("milo_function");
+			string path = filesystem::absolute("milo_function.h").string();
+			ofstream os(path);
+			if (!(os << code)) throw logic_error("cannot write " + path);
+			MiloApp::getGlobal().setStatus("codegen: wrote " + path);
+			return false;
+		}
+	},
+	{ string("plot"),      [](EqnBox& p) {
+			MiloApp::getGlobal().getWindow().addPanel(new PlotPanel(p.getEqn()));
+			return false;
+		}
+	},
 };
 
 bool EqnBox::doMenu(const string& menuFunctionName)
@@ -633,6 +660,8 @@ bool EqnBox::doMenu(const string& menuFunctionName)
     m_fChange = false;
 	auto menu_entry = menu_map.find(menuFunctionName);
 	if (menu_entry != menu_map.end()) {
+		m_shown = Snapshot();
+		invalidate();
 		m_fChange = (menu_entry->second)(*this);
 		return true;
 	}
@@ -653,13 +682,25 @@ void EqnBox::getCursorOrig(int& x, int& y)
 void EqnBox::doDraw()
 {
 	m_eqn->setSelect(*m_gc);
-	m_eqn->getRoot()->draw(*m_gc);
+	m_display.replay(*m_gc);
+	m_fDraw = false;
 }
 
 Box EqnBox::calculateSize()
 {
-	m_eqn->getRoot()->calculateSize(*m_gc);
-	m_eqn->getRoot()->calculateOrigin(*m_gc, 0, 0);
+	if (m_fLayout) {
+		m_eqn->getRoot()->calculateSize(*m_gc);
+		m_eqn->getRoot()->calculateOrigin(*m_gc, 0, 0);
+
+		// Drawing only changes with layout, so redraws replay this recording
+		m_record.clear();
+		m_eqn->getRoot()->draw(m_record);
+		if (m_record != m_display) {
+			m_display.swap(m_record);
+			m_fDraw = true;
+		}
+		m_fLayout = false;
+	}
 	m_gc->set(getSize());
 	return getSize();
 }
@@ -695,7 +736,12 @@ void EqnPanel::doMouse(const UI::MouseEvent& mouse)
 
 bool EqnPanel::doPanelMenu(const std::string& menuFunctionName)
 {
-	return m_eqnBox.doMenu(menuFunctionName);
+	if (!m_eqnBox.doMenu(menuFunctionName)) return false;
+	if (m_eqnBox.hasChanged()) {
+		calculateSize();
+		pushUndo();
+	}
+	return true;
 }
 
 void EqnPanel::copy(XML::Parser& in)
@@ -703,6 +749,32 @@ void EqnPanel::copy(XML::Parser& in)
 	m_eqnBox.newEqn(in);
 }
 
+/**
+ * Undo state of panel kept as snapshots of its equations.
+ */
+struct SnapshotState : public MiloPanel::UndoState
+{
+	/**
+	 * Constructor for state of panel.
+	 * @param s Snapshots of equations.
+	 * @param fLeft True, if left side is active.
+	 */
+	SnapshotState(vector<Snapshot>&& s, bool fLeft = true) : snapshots(move(s)), fLeft(fLeft) {}
+
+	vector<Snapshot> snapshots;      ///< Snapshot of each equation.
+	bool fLeft;                      ///< True, if left side is active.
+};
+
+MiloPanel::UndoState::Ptr EqnPanel::saveUndo()
+{
+	return make_shared<SnapshotState>(vector<Snapshot>{ m_eqnBox.snapshot(m_pool) });
+}
+
+void EqnPanel::restoreUndo(const UndoState& state)
+{
+	m_eqnBox.newEqn(static_cast<const SnapshotState&>(state).snapshots[0]);
+}
+
 void EqnPanel::setBox(int x, int y, int x0, int y0)
 {
 	m_gc->set(x, y, x0, y0);
@@ -763,8 +835,17 @@ void AlgebraPanel::doMouse(const UI::MouseEvent& mouse)
 	}
 }
 
+const unordered_map<string, AlgebraPanel::menu_handler> AlgebraPanel::menu_map = {
+	{ string("solve"), [](AlgebraPanel& p) { return p.insertRoots(); } },
+};
+
 bool AlgebraPanel::doPanelMenu(const std::string& menuFunctionName)
 {
+	auto menu_entry = menu_map.find(menuFunctionName);
+	if (menu_entry != menu_map.end()) {
+		(menu_entry->second)(*this);
+		return true;
+	}
 	if (getCurrentSide().doMenu(menuFunctionName)) {
 		if (getCurrentSide().hasChanged()) {
 			calculateSize();
@@ -782,6 +863,20 @@ void AlgebraPanel::copy(XML::Parser& in)
 	m_right.newEqn(in);
 }
 
+MiloPanel::UndoState::Ptr AlgebraPanel::saveUndo()
+{
+	vector<Snapshot> snapshots = { m_left.snapshot(m_pool), m_right.snapshot(m_pool) };
+	return make_shared<SnapshotState>(move(snapshots), m_side == LEFT);
+}
+
+void AlgebraPanel::restoreUndo(const UndoState& state)
+{
+	auto& snapshots = static_cast<const SnapshotState&>(state);
+	m_side = snapshots.fLeft ? LEFT : RIGHT;
+	m_left.newEqn(snapshots.snapshots[0]);
+	m_right.newEqn(snapshots.snapshots[1]);
+}
+
 bool AlgebraPanel::do_init()
 {
 	MiloPanel::panel_map[AlgebraPanel::name] = MiloPanel::create<AlgebraPanel>;
@@ -834,6 +929,31 @@ void AlgebraPanel::xml_out(XML::Stream& xml)
 	xml << m_left.getEqn() << m_right.getEqn();
 }
 
+vector<Complex> AlgebraPanel::solve(const string& var)
+{
+	Solver solver(m_left.getEqn().getRoot(), m_right.getEqn().getRoot(), var);
+	return solver.solve();
+}
+
+bool AlgebraPanel::insertRoots()
+{
+	string var = Solver::findVariable(m_left.getEqn().getRoot(), m_right.getEqn().getRoot());
+	if (var.empty()) return false;
+
+	vector<Complex> roots;
+	try {
+		roots = solve(var);
+	}
+	catch (logic_error&) {
+		return false;
+	}
+	MiloWindow& window = MiloApp::getGlobal().getWindow();
+	for ( auto z : roots ) {
+		window.addPanel(new AlgebraPanel(var + "=" + Solver::toString(z)));
+	}
+	return !roots.empty();
+}
+
 AlgebraPanel::Side AlgebraPanel::readSide(XML::Parser& in)
 {
 	in.next(XML::HEADER, side_tag).next(XML::HEADER_END).next(XML::ELEMENT);
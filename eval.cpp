@@ -0,0 +1,352 @@
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file eval.cpp
+ * This file contains the implementation of the Evaluator class. The program is
+ * run by one template, which is instantiated for each supported scalar type.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "milo.h"
+#include "eval.h"
+#include "kernels.h"
+
+using namespace std;
+
+/**
+ * Names of functions in order of their index in a program, which is the order
+ * of Kernels::Func.
+ */
+static const vector<string> function_names = { "sin", "cos", "tan", "log", "exp" };
+
+/**
+ * Get ids of variables of equation in alphabetical order of their names.
+ * @param flat Snapshot of equation.
+ * @return Ids of variables.
+ */
+static vector<SymbolTable::Id> variables(const FlatEquation& flat)
+{
+	auto vars = flat.getVariables();
+	auto& table = SymbolTable::global();
+	sort(vars.begin(), vars.end(), [&table](SymbolTable::Id a, SymbolTable::Id b) {
+		return table.getName(a) < table.getName(b);
+	});
+	return vars;
+}
+
+Evaluator::Evaluator(Node* node) : Evaluator(FlatEquation(node, true)) {}
+
+Evaluator::Evaluator(Node* node, const vector<SymbolTable::Id>& vars) : Evaluator(FlatEquation(node, true), vars) {}
+
+Evaluator::Evaluator(const FlatEquation& flat) : Evaluator(flat, variables(flat)) {}
+
+Evaluator::Evaluator(const FlatEquation& flat, const vector<SymbolTable::Id>& vars) :
+	m_vars(vars), m_slots(SymbolTable::global().size(), -1), m_fReal(true), m_depth(0)
+{
+	for (size_t i = 0; i < vars.size(); ++i) m_slots.at(vars[i]) = (int) i;
+	m_program.reserve(flat.size());
+	compile(flat);
+}
+
+void Evaluator::compile(const FlatEquation& flat)
+{
+	// Nodes whose children are being compiled, with the values on the stack
+	// before the node, number of children compiled and index of next child
+	struct Frame { FlatEquation::Index i; int depth; int n; FlatEquation::Index next; int function; };
+	vector<Frame> stack;
+	FlatEquation::Index i = 0;
+	int depth = 0;
+	while (true) {
+		// Leaves are compiled at once, other nodes after their children
+		m_depth = max(m_depth, depth + 1);
+		auto kind = flat.getKind(i);
+		int function = 0;
+		switch (kind) {
+			case Node::NUMBER:
+				m_program.push_back({ Op::NUMBER, Complex(flat.getNumber(i), 0), 0, true });
+				break;
+			case Node::CONSTANT: {
+				char name = (char) flat.getSymbol(i);
+				if (name == 'i') m_fReal = false;
+				emit(Op::CONSTANT, name);
+				break;
+			}
+			case Node::VARIABLE: {
+				auto id = flat.getSymbol(i);
+				if (m_slots[id] >= 0) {
+					emit(Op::VARIABLE, m_slots[id]);
+				}
+				else {
+					Complex z = SymbolTable::global().getValue(id);
+					if (z.imag() != 0) m_fReal = false;
+					m_program.push_back({ Op::VALUE, z, 0, true });
+				}
+				break;
+			}
+			case Node::FUNCTION: {
+				const string& name = SymbolTable::global().getName(flat.getSymbol(i));
+				auto it = find(function_names.begin(), function_names.end(), name);
+				if (it == function_names.end()) throw logic_error("cannot evaluate function " + name);
+				function = (int) distance(function_names.begin(), it);
+				break;
+			}
+			case Node::DIFFERENTIAL:
+				if (!flat.isDerived()) throw logic_error("cannot evaluate differential without derivative");
+				break;
+			case Node::EXPRESSION:
+			case Node::TERM:
+			case Node::DIVIDE:
+			case Node::POWER:
+				break;
+			default:
+				throw logic_error(string("cannot evaluate ") + FlatEquation::getKindName(kind));
+		}
+		if (flat.getArity(i) > 0 || kind == Node::EXPRESSION || kind == Node::TERM) {
+			stack.push_back({ i, depth, 0, i + 1, function });
+		}
+		else if (flat.getNth(i) != 1 || !flat.getSign(i)) {
+			emit(Op::NTH, flat.getNth(i), flat.getSign(i));
+		}
+
+		// Finish nodes with all children compiled, then go to the next child.
+		// Each child adds one value to those on the stack before its parent.
+		while (!stack.empty() && stack.back().n == flat.getArity(stack.back().i)) {
+			const Frame& f = stack.back();
+			switch (flat.getKind(f.i)) {
+				case Node::EXPRESSION: emit(Op::SUM, f.n); break;
+				case Node::TERM:       emit(Op::PRODUCT, f.n); break;
+				case Node::DIVIDE:     emit(Op::DIVIDE); break;
+				case Node::POWER:      emit(Op::POWER); break;
+				case Node::FUNCTION:   emit(Op::FUNCTION, f.function); break;
+				default:               break;
+			}
+			if (flat.getNth(f.i) != 1 || !flat.getSign(f.i)) emit(Op::NTH, flat.getNth(f.i), flat.getSign(f.i));
+			stack.pop_back();
+		}
+		if (stack.empty()) return;
+
+		Frame& f = stack.back();
+		i = f.next;
+		depth = f.depth + f.n++;
+		f.next += flat.getSize(i);
+	}
+}
+
+/**
+ * Traits of scalar type.
+ */
+template <class T>
+struct Scalar
+{
+	using real = T;                        ///< Type of real part.
+	static const bool fComplex = false;    ///< True, if type is complex.
+
+	/**
+	 * Convert complex value.
+	 * @param z Value with zero imaginary part.
+	 * @return Real part.
+	 */
+	static T make(const Complex& z) { return T(z.real()); }
+};
+
+/**
+ * Traits of complex scalar type.
+ */
+template <class R>
+struct Scalar<complex<R>>
+{
+	using real = R;                        ///< Type of real part.
+	static const bool fComplex = true;     ///< True, if type is complex.
+
+	/**
+	 * Convert complex value.
+	 * @param z Value.
+	 * @return Value in precision of type.
+	 */
+	static complex<R> make(const Complex& z) { return complex<R>(R(z.real()), R(z.imag())); }
+};
+
+template <class T>
+T Evaluator::evaluate(const T* values) const
+{
+	using R = typename Scalar<T>::real;
+	if (!Scalar<T>::fComplex && !m_fReal) throw logic_error("equation is complex");
+
+	// Most equations fit a stack on the call stack, which keeps batches free of allocation
+	T local[max_local];
+	vector<T> heap;
+	T* stack = local;
+	if (m_depth > max_local) {
+		heap.resize(m_depth);
+		stack = heap.data();
+	}
+
+	int top = -1;
+	for ( const auto& op : m_program ) {
+		switch (op.code) {
+		case Op::NUMBER:
+		case Op::VALUE:
+			stack[++top] = Scalar<T>::make(op.value);
+			break;
+		case Op::CONSTANT:
+			if (op.n == 'e') stack[++top] = T(exp(R(1)));
+			else if (op.n == 'P') stack[++top] = T(4*atan(R(1)));
+			else stack[++top] = Scalar<T>::make(Complex(0, 1));
+			break;
+		case Op::VARIABLE:
+			stack[++top] = values[op.n];
+			break;
+		case Op::SUM:
+		case Op::PRODUCT: {
+			if (op.n == 0) {
+				stack[++top] = T((op.code == Op::SUM) ? 0 : 1);
+				break;
+			}
+			int first = top - op.n + 1;
+			T z = stack[first];
+			for (int i = first + 1; i <= top; ++i) {
+				if (op.code == Op::SUM) z += stack[i]; else z *= stack[i];
+			}
+			top = first;
+			stack[top] = z;
+			break;
+		}
+		case Op::DIVIDE:
+			--top;
+			stack[top] /= stack[top + 1];
+			break;
+		case Op::POWER:
+			--top;
+			stack[top] = pow(stack[top], stack[top + 1]);
+			break;
+		case Op::FUNCTION: {
+			T& z = stack[top];
+			switch (op.n) {
+			case 0:  z = sin(z); break;
+			case 1:  z = cos(z); break;
+			case 2:  z = tan(z); break;
+			case 3:  z = log(z); break;
+			default: z = exp(z); break;
+			}
+			break;
+		}
+		case Op::NTH: {
+			T z(1);
+			for (int i = 0; i < op.n; ++i) { z *= stack[top]; }
+			if (!op.sign && ((op.n&1) == 1)) z *= T(-1);
+			stack[top] = z;
+			break;
+		}
+		}
+	}
+	return stack[0];
+}
+
+template float Evaluator::evaluate(const float*) const;
+template double Evaluator::evaluate(const double*) const;
+template long double Evaluator::evaluate(const long double*) const;
+template complex<float> Evaluator::evaluate(const complex<float>*) const;
+template complex<double> Evaluator::evaluate(const complex<double>*) const;
+template complex<long double> Evaluator::evaluate(const complex<long double>*) const;
+
+Complex Evaluator::value(const Complex* values) const
+{
+	bool fReal = m_fReal;
+	double reals[max_local];
+	vector<double> heap;
+	double* xs = reals;
+	if (m_vars.size() > max_local) {
+		heap.resize(m_vars.size());
+		xs = heap.data();
+	}
+	for (size_t i = 0; fReal && i < m_vars.size(); ++i) {
+		fReal = values[i].imag() == 0;
+		xs[i] = values[i].real();
+	}
+	if (fReal) {
+		double x = evaluate(xs);
+		if (!isnan(x)) return Complex(x, 0);
+	}
+	return evaluate(values);
+}
+
+void Evaluator::evaluate(size_t n, const Complex* values, Complex* results) const
+{
+	// Each value on the stack is a column with a row for each point
+	size_t width = m_vars.size();
+	vector<vector<Complex>> stack(m_depth, vector<Complex>(n));
+	int top = -1;
+	for ( const auto& op : m_program ) {
+		switch (op.code) {
+		case Op::NUMBER:
+		case Op::VALUE:
+		case Op::CONSTANT: {
+			Complex z = op.value;
+			if (op.code == Op::CONSTANT) {
+				z = (op.n == 'e') ? Complex(exp(1.0), 0) : ((op.n == 'P') ? Complex(4*atan(1.0), 0) : Complex(0, 1));
+			}
+			++top;
+			fill(stack[top].begin(), stack[top].end(), z);
+			break;
+		}
+		case Op::VARIABLE:
+			++top;
+			for (size_t i = 0; i < n; ++i) stack[top][i] = values[i*width + op.n];
+			break;
+		case Op::SUM:
+		case Op::PRODUCT: {
+			if (op.n == 0) {
+				++top;
+				fill(stack[top].begin(), stack[top].end(), Complex((op.code == Op::SUM) ? 0 : 1, 0));
+				break;
+			}
+			int first = top - op.n + 1;
+			for (int k = first + 1; k <= top; ++k) {
+				for (size_t i = 0; i < n; ++i) {
+					if (op.code == Op::SUM) stack[first][i] += stack[k][i]; else stack[first][i] *= stack[k][i];
+				}
+			}
+			top = first;
+			break;
+		}
+		case Op::DIVIDE:
+		case Op::POWER:
+			--top;
+			for (size_t i = 0; i < n; ++i) {
+				Complex& z = stack[top][i];
+				z = (op.code == Op::DIVIDE) ? z/stack[top + 1][i] : pow(z, stack[top + 1][i]);
+			}
+			break;
+		case Op::FUNCTION:
+			Kernels::apply((Kernels::Func) op.n, stack[top].data(), stack[top].data(), n);
+			break;
+		case Op::NTH:
+			for (size_t i = 0; i < n; ++i) {
+				Complex z(1, 0);
+				for (int k = 0; k < op.n; ++k) { z *= stack[top][i]; }
+				if (!op.sign && ((op.n&1) == 1)) z *= Complex(-1, 0);
+				stack[top][i] = z;
+			}
+			break;
+		}
+	}
+	copy(stack[0].begin(), stack[0].end(), results);
+}
@@ -0,0 +1,184 @@
+#ifndef __EVAL_H
+#define __EVAL_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file eval.h
+ * This file contains the declaration of the Evaluator class, which compiles an
+ * equation once and evaluates it in a chosen scalar type: float, double or
+ * long double, or std::complex of one of them.
+ */
+
+#include <complex>
+#include <string>
+#include <vector>
+#include "milo.h"
+#include "symtab.h"
+#include "flat.h"
+
+/**
+ * Evaluator of an equation templated on scalar type.
+ * The equation is compiled from a FlatEquation into a program for a stack
+ * machine in postfix order. The program is not folded, so constants e and P are computed in the
+ * precision of the scalar type. Variables that are not bound take their
+ * current values as constants.
+ * An equation without the constant i and without complex values of unbound
+ * variables is real. It can be evaluated with real types, which need about
+ * half the work of complex ones. A real evaluation is NaN where a log or a
+ * power needs a complex result.
+ */
+class Evaluator
+{
+public:
+	/**
+	 * Constructor for Evaluator binding all variables in alphabetical order.
+	 * Throws logic_error if equation has an input.
+	 * @param node Root of equation.
+	 */
+	Evaluator(Node* node);
+
+	/**
+	 * Constructor for Evaluator binding given variables.
+	 * Throws logic_error if equation has an input.
+	 * @param node Root of equation.
+	 * @param vars Ids of variables in order of their values.
+	 */
+	Evaluator(Node* node, const std::vector<SymbolTable::Id>& vars);
+
+	/**
+	 * Constructor for Evaluator of snapshot binding all variables in
+	 * alphabetical order.
+	 * Throws logic_error if snapshot has an input or a differential that is
+	 * not derived.
+	 * @param flat Snapshot of equation with derivatives of differentials.
+	 */
+	Evaluator(const FlatEquation& flat);
+
+	/**
+	 * Constructor for Evaluator of snapshot binding given variables.
+	 * Throws logic_error if snapshot has an input or a differential that is
+	 * not derived.
+	 * @param flat Snapshot of equation with derivatives of differentials.
+	 * @param vars Ids of variables in order of their values.
+	 */
+	Evaluator(const FlatEquation& flat, const std::vector<SymbolTable::Id>& vars);
+
+	/**
+	 * Check if equation can be evaluated with a real type.
+	 * @return True, if real.
+	 */
+	bool isReal() const { return m_fReal; }
+
+	/**
+	 * Get ids of bound variables.
+	 * @return Ids in order of their values.
+	 */
+	const std::vector<SymbolTable::Id>& getVariables() const { return m_vars; }
+
+	/**
+	 * Evaluate equation.
+	 * Throws logic_error if type is real and equation is not.
+	 * @param values Values of bound variables.
+	 * @return Value of equation.
+	 */
+	template <class T>
+	T evaluate(const T* values) const;
+
+	/**
+	 * Evaluate equation at many points, with batch kernels for functions.
+	 * @param n Number of points.
+	 * @param values Values of bound variables, one row of values for each point.
+	 * @param[out] results Value at each point.
+	 */
+	void evaluate(size_t n, const Complex* values, Complex* results) const;
+
+	/**
+	 * Evaluate equation with real double arithmetic where possible.
+	 * The complex program is run if equation or values are not real, or if
+	 * real arithmetic gives NaN.
+	 * @param values Values of bound variables.
+	 * @return Value of equation.
+	 */
+	Complex value(const Complex* values) const;
+
+private:
+	/**
+	 * Instruction of stack machine.
+	 */
+	struct Op
+	{
+		/**
+		 * Operation of instruction.
+		 */
+		enum Code {
+			NUMBER,   ///< Push number.
+			CONSTANT, ///< Push constant e, P or i.
+			VALUE,    ///< Push value of unbound variable.
+			VARIABLE, ///< Push bound variable.
+			SUM,      ///< Replace top n values by their sum.
+			PRODUCT,  ///< Replace top n values by their product.
+			DIVIDE,   ///< Replace top two values by their quotient.
+			POWER,    ///< Replace top two values by first to power of second.
+			FUNCTION, ///< Apply function to top value.
+			NTH       ///< Raise top value to nth power and apply sign.
+		};
+
+		Code code;     ///< Operation.
+		Complex value; ///< Value of number or unbound variable.
+		int n;         ///< Number of values, power, slot, function or name of constant.
+		bool sign;     ///< Sign of power.
+	};
+
+	std::vector<Op> m_program;           ///< Program in postfix order.
+	std::vector<SymbolTable::Id> m_vars; ///< Ids of bound variables.
+	std::vector<int> m_slots;            ///< Slot of each id or -1 if not bound.
+	bool m_fReal;                        ///< True, if equation is real.
+	int m_depth;                         ///< Most values on stack.
+
+	/**
+	 * Append program of equation, walking it with an explicit stack.
+	 * @param flat Snapshot of equation.
+	 */
+	void compile(const FlatEquation& flat);
+
+	/**
+	 * Append instruction.
+	 * @param code Operation.
+	 * @param n Number of values, power, slot, function or name of constant.
+	 * @param sign Sign of power.
+	 */
+	void emit(Op::Code code, int n = 0, bool sign = true)
+	{
+		m_program.push_back({ code, Complex(0, 0), n, sign });
+	}
+
+	static const int max_local = 32; ///< Depth of stack that is not allocated.
+};
+
+/** @name Instantiated Scalar Types */
+//@{
+extern template float Evaluator::evaluate(const float*) const;
+extern template double Evaluator::evaluate(const double*) const;
+extern template long double Evaluator::evaluate(const long double*) const;
+extern template std::complex<float> Evaluator::evaluate(const std::complex<float>*) const;
+extern template std::complex<double> Evaluator::evaluate(const std::complex<double>*) const;
+extern template std::complex<long double> Evaluator::evaluate(const std::complex<long double>*) const;
+//@}
+
+#endif // __EVAL_H
@@ -0,0 +1,130 @@
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file flat.cpp
+ * This file contains the implementation of the FlatEquation class.
+ */
+
+#include <algorithm>
+#include <ostream>
+
+#include "milo.h"
+#include "nodes.h"
+#include "flat.h"
+
+using namespace std;
+
+/**
+ * Names of kinds of nodes in order of Node::Kind.
+ */
+static const char* const kind_names[] = {
+	"number", "constant", "variable", "expression", "function",
+	"divide", "power", "differential", "input", "term"
+};
+
+FlatEquation::FlatEquation(Node* root, bool fDerive) : m_fDerive(fDerive)
+{
+	add(root, fDerive);
+}
+
+void FlatEquation::add(Node* root, bool fDerive)
+{
+	// Indices of nodes whose subtrees are being added
+	vector<Index> open;
+	auto pre = [this, &open](Node* node) {
+		if (!open.empty()) ++m_arities[open.back()];
+		Index i = (Index) m_kinds.size();
+		open.push_back(i);
+
+		auto kind = node->getType();
+		m_kinds.push_back(kind);
+		m_sizes.push_back(1);
+		m_arities.push_back(0);
+		m_nths.push_back(node->getNth());
+		m_signs.push_back(node->getSign());
+		m_numbers.push_back(0);
+		m_symbols.push_back(SymbolTable::none);
+
+		switch (kind) {
+			case Node::NUMBER:
+				m_numbers[i] = static_cast<Number*>(node)->getReal();
+				break;
+			case Node::CONSTANT:
+				m_symbols[i] = static_cast<Constant*>(node)->getConstant();
+				break;
+			case Node::VARIABLE:
+				m_symbols[i] = static_cast<Variable*>(node)->getId();
+				break;
+			case Node::FUNCTION:
+				m_symbols[i] = SymbolTable::global().find(static_cast<Function*>(node)->getFunction());
+				break;
+			case Node::DIFFERENTIAL:
+				m_symbols[i] = static_cast<Differential*>(node)->getId();
+				break;
+			default:
+				break;
+		}
+		return true;
+	};
+	auto post = [this, &open](Node*) {
+		Index i = open.back();
+		open.pop_back();
+		m_sizes[i] = (Index) m_kinds.size() - i;
+	};
+	if (fDerive) traverseDerived(root, pre, post); else traverse(root, pre, post);
+}
+
+const char* FlatEquation::getKindName(Node::Kind kind)
+{
+	return kind_names[kind];
+}
+
+vector<SymbolTable::Id> FlatEquation::getVariables() const
+{
+	vector<SymbolTable::Id> vars;
+	for (size_t i = 0; i < size(); ++i) {
+		if (m_kinds[i] == Node::VARIABLE && find(vars.begin(), vars.end(), m_symbols[i]) == vars.end()) {
+			vars.push_back(m_symbols[i]);
+		}
+	}
+	return vars;
+}
+
+void FlatEquation::write(ostream& os) const
+{
+	// Stack of ends of subtrees being written gives depth of each node
+	vector<Index> ends;
+	for (Index i = 0; i < (Index) size(); ++i) {
+		while (!ends.empty() && ends.back() == i) ends.pop_back();
+		os << string(2*ends.size(), ' ') << getKindName(m_kinds[i]);
+		switch (m_kinds[i]) {
+			case Node::NUMBER:       os << " " << m_numbers[i]; break;
+			case Node::CONSTANT:     os << " " << (char) m_symbols[i]; break;
+			case Node::DIFFERENTIAL:
+			case Node::VARIABLE:
+			case Node::FUNCTION:
+				if (m_symbols[i] != SymbolTable::none) os << " " << SymbolTable::global().getName(m_symbols[i]);
+				break;
+			default: break;
+		}
+		if (m_nths[i] != 1) os << " ^" << m_nths[i];
+		if (!m_signs[i]) os << " -";
+		os << " [" << i << "," << i + m_sizes[i] << ")" << endl;
+		if (m_sizes[i] > 1) ends.push_back(i + m_sizes[i]);
+	}
+}
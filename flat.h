@@ -0,0 +1,177 @@
+#ifndef __FLAT_H
+#define __FLAT_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file flat.h
+ * This file contains the declaration of the FlatEquation class, a read only
+ * copy of an equation tree kept in arrays.
+ */
+
+#include <iosfwd>
+#include <vector>
+#include "milo.h"
+#include "symtab.h"
+
+/**
+ * Snapshot of an equation as parallel arrays in pre-order.
+ * Each node of the tree is one index into the arrays. A node is followed by
+ * its children, so its subtree is the range of indices from the node up to
+ * the node plus the size of its subtree. The first child of a node is the
+ * next index and each following child starts where the subtree of the one
+ * before it ends.
+ * Passes that only read the equation walk the arrays instead of following
+ * pointers between nodes on the heap. A snapshot is not changed after it is
+ * built and keeps no pointer into the tree, so it can be read by many threads
+ * at once and outlives the equation it was made from.
+ */
+class FlatEquation
+{
+public:
+	using Index = int; ///< Index of node in snapshot.
+
+	/**
+	 * Range of indices of children of a node.
+	 * Iterating over it does no allocation.
+	 */
+	class Children
+	{
+	public:
+		/**
+		 * Iterator over children of a node.
+		 */
+		class iterator
+		{
+		public:
+			/**
+			 * Constructor for iterator.
+			 * @param flat Snapshot.
+			 * @param i Index of child.
+			 */
+			iterator(const FlatEquation& flat, Index i) : m_flat(flat), m_i(i) {}
+
+			/**
+			 * Get index of current child.
+			 * @return Index.
+			 */
+			Index operator*() const { return m_i; }
+
+			/**
+			 * Advance past subtree of current child.
+			 * @return This iterator.
+			 */
+			iterator& operator++() { m_i += m_flat.getSize(m_i); return *this; }
+
+			/**
+			 * Compare position of iterators.
+			 * @param it Other iterator.
+			 * @return True, if iterators are at different children.
+			 */
+			bool operator!=(const iterator& it) const { return m_i != it.m_i; }
+
+		private:
+			const FlatEquation& m_flat; ///< Snapshot.
+			Index m_i;                  ///< Index of current child.
+		};
+
+		/**
+		 * Constructor for children of node.
+		 * @param flat Snapshot.
+		 * @param i Index of node.
+		 */
+		Children(const FlatEquation& flat, Index i) : m_flat(flat), m_begin(i + 1), m_end(i + flat.getSize(i)) {}
+
+		iterator begin() const { return iterator(m_flat, m_begin); } ///< Iterator at first child.
+		iterator end() const { return iterator(m_flat, m_end); }     ///< Iterator past last child.
+
+	private:
+		const FlatEquation& m_flat; ///< Snapshot.
+		Index m_begin;              ///< Index of first child.
+		Index m_end;                ///< Index past subtree of node.
+	};
+
+	/**
+	 * Constructor for snapshot of tree.
+	 * The child of a differential is its function, unless fDerive is set, in
+	 * which case the child is the derivative of the function.
+	 * @param root Root of tree.
+	 * @param fDerive If true, differentials have derivatives as children.
+	 */
+	FlatEquation(Node* root, bool fDerive = false);
+
+	/** @name Node Access */
+	//@{
+	size_t size() const { return m_kinds.size(); }                              ///< Get number of nodes.
+	Node::Kind getKind(Index i) const { return m_kinds[i]; }                     ///< Get kind of node.
+	Index getSize(Index i) const { return m_sizes[i]; }                          ///< Get number of nodes in subtree.
+	int getArity(Index i) const { return m_arities[i]; }                         ///< Get number of children.
+	int getNth(Index i) const { return m_nths[i]; }                              ///< Get power of node.
+	bool getSign(Index i) const { return m_signs[i] != 0; }                      ///< Get sign of node.
+	double getNumber(Index i) const { return m_numbers[i]; }                     ///< Get value of number or zero.
+	Children children(Index i) const { return Children(*this, i); }              ///< Get children of node.
+	bool isDerived() const { return m_fDerive; }                                 ///< True, if differentials have derivatives.
+
+	/**
+	 * Get symbol of node.
+	 * This is the id of a variable or a function, the name of a constant, or
+	 * the id of the variable of a differential. Other nodes have no symbol.
+	 * @param i Index of node.
+	 * @return Symbol or SymbolTable::none.
+	 */
+	int getSymbol(Index i) const { return m_symbols[i]; }
+	//@}
+
+	/**
+	 * Get name of kind of node, which is the name of its class.
+	 * @param kind Kind of node.
+	 * @return Name of kind.
+	 */
+	static const char* getKindName(Node::Kind kind);
+
+	/**
+	 * Get ids of variables in snapshot.
+	 * @return Ids in order of their first use.
+	 */
+	std::vector<SymbolTable::Id> getVariables() const;
+
+	/**
+	 * Write snapshot with one node on each line.
+	 * @param os Output stream.
+	 */
+	void write(std::ostream& os) const;
+
+private:
+	std::vector<Node::Kind> m_kinds; ///< Kind of each node.
+	std::vector<Index> m_sizes;      ///< Size of subtree of each node.
+	std::vector<int> m_arities;      ///< Number of children of each node.
+	std::vector<int> m_nths;         ///< Power of each node.
+	std::vector<char> m_signs;       ///< Sign of each node.
+	std::vector<double> m_numbers;   ///< Value of each number.
+	std::vector<int> m_symbols;      ///< Symbol of each node.
+	bool m_fDerive;                  ///< True, if differentials have derivatives.
+
+	/**
+	 * Append subtree in pre-order with an explicit stack.
+	 * @param root Root of subtree.
+	 * @param fDerive If true, differentials have derivatives as children.
+	 */
+	void add(Node* root, bool fDerive);
+};
+
+#endif // __FLAT_H
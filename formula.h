@@ -0,0 +1,686 @@
+#ifndef __FORMULA_H
+#define __FORMULA_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file formula.h
+ * This file contains formula literals, equations in milo syntax that are parsed
+ * at compile time. MILO_FORMULA("x^2+3x") runs a constexpr parser over its
+ * string into a table of nodes, and every node of the table becomes a type
+ * whose evaluation the compiler inlines. The header needs no milo object files.
+ *
+ * @code
+ * auto f = MILO_FORMULA("x^2+3xy_1");
+ * double z = f(Formula::bind<'x'>(2.0), Formula::bind<Formula::name("y_1")>(0.5));
+ * @endcode
+ */
+
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+/**
+ * Compile-time parser and evaluator of formula literals.
+ * The grammar is the grammar of the Parser in parser.cpp. Differentials and
+ * inputs cannot be evaluated, so they are rejected with the errors of a
+ * malformed formula, which stop compilation.
+ */
+namespace Formula {
+
+/**
+ * Operation of node.
+ */
+enum Code {
+	NUMBER,   ///< Number literal.
+	CONSTANT, ///< Constant e, P or i.
+	VARIABLE, ///< Variable bound at evaluation.
+	SUM,      ///< Sum of first and second.
+	PRODUCT,  ///< Product of first and second.
+	NEGATE,   ///< First times -1.
+	DIVIDE,   ///< First divided by second.
+	POWER,    ///< First to power of second.
+	FUNCTION  ///< Function of first.
+};
+
+/**
+ * Built in function of node.
+ */
+enum Func { SIN, COS, TAN, LOG, EXP };
+
+/**
+ * Name of constant or variable packed into an integer, so it can be a template
+ * argument. Characters are packed from the lowest byte up, so a one letter
+ * name is its character and names of up to eight characters, such as x_12,
+ * fit.
+ */
+using Name = unsigned long long;
+
+/**
+ * Node of parsed formula.
+ */
+struct Node
+{
+	Code code = NUMBER; ///< Operation.
+	double value = 0;   ///< Value of number.
+	Name name = 0;      ///< Name of constant or variable.
+	int slot = 0;       ///< Index of variable in values.
+	Func func = SIN;    ///< Function.
+	int first = -1;     ///< Index of first operand.
+	int second = -1;    ///< Index of second operand.
+};
+
+/**
+ * Table of nodes of a parsed formula with its variables.
+ */
+template <std::size_t N>
+struct Tape
+{
+	Node nodes[N] = {};        ///< Nodes with operands before operations.
+	int size = 0;              ///< Number of nodes.
+	int root = -1;             ///< Index of root node.
+	Name variables[N] = {};    ///< Variables in alphabetical order.
+	int count = 0;             ///< Number of variables.
+
+	/**
+	 * Get slot of variable.
+	 * @param name Name of variable.
+	 * @return Index of variable or -1 if formula does not have variable.
+	 */
+	constexpr int slot(Name name) const
+	{
+		for (int i = 0; i < count; ++i) {
+			if (variables[i] == name) return i;
+		}
+		return -1;
+	}
+};
+
+/** @name Character Classes */
+//@{
+constexpr bool isDigit(char c) { return c >= '0' && c <= '9'; }
+constexpr bool isAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+constexpr bool isEnd(char c) { return c == '\0' || c == '+' || c == '-' || c == ')'; }
+//@}
+
+/**
+ * Pack name of variable, such as x or x_12, into an integer.
+ * Throws logic_error if name has more than eight characters.
+ * @param s Null terminated name.
+ * @return Packed name.
+ */
+constexpr Name name(const char* s)
+{
+	Name packed = 0;
+	for (std::size_t i = 0; s[i]; ++i) {
+		if (i == sizeof(Name)) throw std::logic_error("variable name too long");
+		packed |= (Name) (unsigned char) s[i] << 8*i;
+	}
+	return packed;
+}
+
+/**
+ * Unpack name of variable.
+ * @param packed Packed name.
+ * @return Name of variable.
+ */
+inline std::string unpack(Name packed)
+{
+	std::string s;
+	for ( ; packed != 0; packed >>= 8) s += (char) (packed & 0xff);
+	return s;
+}
+
+/**
+ * Compare packed names in alphabetical order.
+ * @param a First name.
+ * @param b Second name.
+ * @return True, if a comes before b.
+ */
+constexpr bool before(Name a, Name b)
+{
+	for ( ; a != 0 || b != 0; a >>= 8, b >>= 8) {
+		if ((a & 0xff) != (b & 0xff)) return (a & 0xff) < (b & 0xff);
+	}
+	return false;
+}
+
+/**
+ * Get length of string.
+ * @param s Null terminated string.
+ * @return Number of characters.
+ */
+constexpr std::size_t length(const char* s)
+{
+	std::size_t n = 0;
+	while (s[n]) ++n;
+	return n;
+}
+
+/**
+ * Constexpr parser of formula into a tape.
+ * Throws logic_error on a malformed formula, which is a compile error when
+ * parsing at compile time.
+ */
+template <std::size_t N>
+class Parser
+{
+public:
+	/**
+	 * Constructor for Parser class.
+	 * @param text Formula to be parsed.
+	 */
+	constexpr explicit Parser(const char* text) : m_text(text), m_pos(0), m_tape() {}
+
+	/**
+	 * Parse formula.
+	 * @return Tape of formula.
+	 */
+	constexpr Tape<N> parse()
+	{
+		m_tape.root = expression(false);
+		bindVariables();
+		return m_tape;
+	}
+
+private:
+	const char* m_text; ///< Formula to be parsed.
+	std::size_t m_pos;  ///< Index of next character.
+	Tape<N> m_tape;     ///< Nodes parsed so far.
+
+	/**
+	 * Get character ahead without advancing.
+	 * @param ahead Number of characters to look past next one.
+	 * @return Character or '\0' past end.
+	 */
+	constexpr char peek(std::size_t ahead = 0) const
+	{
+		for (std::size_t i = 0; i < ahead; ++i) {
+			if (!m_text[m_pos + i]) return '\0';
+		}
+		return m_text[m_pos + ahead];
+	}
+
+	/**
+	 * Get next character and advance.
+	 * @return Next character or '\0' at end.
+	 */
+	constexpr char next()
+	{
+		char c = m_text[m_pos];
+		if (c) ++m_pos;
+		return c;
+	}
+
+	/**
+	 * Advance past string if it is next.
+	 * @param s String to be matched.
+	 * @return True, if string matched.
+	 */
+	constexpr bool match(const char* s)
+	{
+		std::size_t n = 0;
+		for ( ; s[n]; ++n) {
+			if (peek(n) != s[n]) return false;
+		}
+		m_pos += n;
+		return true;
+	}
+
+	/**
+	 * Append node.
+	 * @param code Operation of node.
+	 * @param first Index of first operand.
+	 * @param second Index of second operand.
+	 * @return Index of node.
+	 */
+	constexpr int add(Code code, int first = -1, int second = -1)
+	{
+		if (m_tape.size == (int) N) throw std::logic_error("formula too long");
+		Node& node = m_tape.nodes[m_tape.size];
+		node.code = code;
+		node.first = first;
+		node.second = second;
+		return m_tape.size++;
+	}
+
+	/**
+	 * Parse terms up to the end of an expression.
+	 * @param fNested If true, expression is closed by ')', otherwise by end of formula.
+	 * @return Index of sum.
+	 */
+	constexpr int expression(bool fNested)
+	{
+		int sum = -1;
+		while (true) {
+			bool fNeg = false;
+			if (peek() == '+' || peek() == '-') fNeg = (next() == '-');
+			int node = term();
+			if (fNeg) node = add(NEGATE, node);
+			sum = (sum < 0) ? node : add(SUM, sum, node);
+
+			char c = peek();
+			if (c == '\0' || c == ')') {
+				if ((c == ')') != fNested) throw std::logic_error("unbalanced parenthesis");
+				next();
+				return sum;
+			}
+		}
+	}
+
+	/**
+	 * Parse factors up to the end of a term.
+	 * @return Index of product.
+	 */
+	constexpr int term()
+	{
+		int product = -1;
+		while (!isEnd(peek())) {
+			int node = factor();
+			product = (product < 0) ? node : add(PRODUCT, product, node);
+		}
+		if (product < 0) throw std::logic_error("bad format");
+		return product;
+	}
+
+	/**
+	 * Parse factor with a following divisor or exponent.
+	 * @return Index of factor.
+	 */
+	constexpr int factor()
+	{
+		int node = primary();
+		char c = peek();
+		if (c != '/' && c != '^') return node;
+
+		next();
+		if (isEnd(peek())) throw std::logic_error("bad format");
+		return add((c == '/') ? DIVIDE : POWER, node, factor());
+	}
+
+	/**
+	 * Parse factor without a divisor or exponent.
+	 * @return Index of factor.
+	 */
+	constexpr int primary()
+	{
+		char c = peek();
+		if (c == '(') {
+			next();
+			return expression(true);
+		}
+		constexpr const char* names[] = { "sin(", "cos(", "tan(", "log(", "exp(" };
+		for (int f = SIN; f <= EXP; ++f) {
+			if (match(names[f])) {
+				int node = add(FUNCTION, expression(true));
+				m_tape.nodes[node].func = (Func) f;
+				return node;
+			}
+		}
+		if (match("D/D")) throw std::logic_error("formula cannot have a differential");
+		if ((c == 'e' || c == 'P' || c == 'i') && !isSubscript(1)) {
+			int node = add(CONSTANT);
+			m_tape.nodes[node].name = next();
+			return node;
+		}
+		if (isDigit(c)) return number();
+		if (isAlpha(c)) {
+			int node = add(VARIABLE);
+			m_tape.nodes[node].name = variable();
+			return node;
+		}
+		if (c == '?' || c == '#' || c == '[') throw std::logic_error("formula cannot have an input");
+		throw std::logic_error("bad format");
+	}
+
+	/**
+	 * Check if subscript of a variable name is ahead.
+	 * @param ahead Number of characters to look past next one.
+	 * @return True, if an underscore and a digit are ahead.
+	 */
+	constexpr bool isSubscript(std::size_t ahead = 0) const
+	{
+		return peek(ahead) == '_' && isDigit(peek(ahead + 1));
+	}
+
+	/**
+	 * Parse name of variable, a letter optionally followed by an underscore
+	 * and a subscript of digits as in the Parser in parser.cpp.
+	 * @return Packed name.
+	 */
+	constexpr Name variable()
+	{
+		char text[sizeof(Name) + 2] = {};
+		std::size_t n = 0;
+		text[n++] = next();
+		if (isSubscript()) {
+			do {
+				if (n == sizeof(Name)) throw std::logic_error("variable name too long");
+				text[n++] = next();
+			} while (isDigit(peek()));
+		}
+		return name(text);
+	}
+
+	/**
+	 * Parse number with optional fraction and exponent.
+	 * The value is exact for up to 15 digits and powers of ten up to 22.
+	 * @return Index of number.
+	 */
+	constexpr int number()
+	{
+		double mantissa = 0;
+		int power = 0;
+		while (isDigit(peek())) mantissa = 10*mantissa + (next() - '0');
+		if (peek() == '.') {
+			next();
+			for ( ; isDigit(peek()); --power) mantissa = 10*mantissa + (next() - '0');
+		}
+
+		// An exponent needs digits, so a lone e is left as the constant
+		char e = peek(), s = peek(1);
+		if ((e == 'e' || e == 'E') && (isDigit(s) || ((s == '-' || s == '+') && isDigit(peek(2))))) {
+			next();
+			bool fNeg = (peek() == '-');
+			if (!isDigit(peek())) next();
+			int exponent = 0;
+			while (isDigit(peek())) {
+				int digit = next() - '0';
+				if (exponent < 1000) exponent = 10*exponent + digit;
+			}
+			power += fNeg ? -exponent : exponent;
+		}
+
+		double scale = 1;
+		for (int i = 0; i < ((power < 0) ? -power : power); ++i) scale *= 10;
+		int node = add(NUMBER);
+		m_tape.nodes[node].value = (power < 0) ? mantissa/scale : mantissa*scale;
+		return node;
+	}
+
+	/**
+	 * Assign slots to variables in alphabetical order.
+	 */
+	constexpr void bindVariables()
+	{
+		// Insert each new name into the sorted names
+		for (int i = 0; i < m_tape.size; ++i) {
+			Name name = m_tape.nodes[i].name;
+			if (m_tape.nodes[i].code != VARIABLE || m_tape.slot(name) >= 0) continue;
+			int j = m_tape.count++;
+			for ( ; j > 0 && before(name, m_tape.variables[j - 1]); --j) {
+				m_tape.variables[j] = m_tape.variables[j - 1];
+			}
+			m_tape.variables[j] = name;
+		}
+		for (int i = 0; i < m_tape.size; ++i) {
+			if (m_tape.nodes[i].code == VARIABLE) m_tape.nodes[i].slot = m_tape.slot(m_tape.nodes[i].name);
+		}
+	}
+};
+
+/**
+ * Parsed formula of a text type.
+ * @tparam Text Class with a static constexpr get() returning the formula.
+ */
+template <class Text>
+struct Source
+{
+	static constexpr std::size_t capacity = 2*length(Text::get()) + 1;       ///< Most nodes of formula.
+	static constexpr Tape<capacity> tape = Parser<capacity>(Text::get()).parse(); ///< Parsed formula.
+
+	static const int max_chain = 64;                ///< Largest integer power done by multiplication.
+	static const int not_integer = max_chain + 1;   ///< Exponent that is not a small integer.
+
+	/**
+	 * Get exponent of node if it is a small integer.
+	 * @param i Index of node.
+	 * @return Integer or not_integer.
+	 */
+	static constexpr int integer(int i)
+	{
+		const Node& node = tape.nodes[i];
+		if (node.code == NEGATE) {
+			int n = integer(node.first);
+			return (n == not_integer) ? n : -n;
+		}
+		if (node.code == NUMBER && node.value <= max_chain && node.value == (int) node.value) {
+			return (int) node.value;
+		}
+		return not_integer;
+	}
+};
+
+/**
+ * Get integer power by repeated squaring.
+ * @tparam N Power.
+ * @param x Base.
+ * @return Base to power.
+ */
+template <int N, class T>
+inline T power(const T& x)
+{
+	if constexpr (N < 0) {
+		return T(1)/power<-N>(x);
+	}
+	else if constexpr (N == 0) {
+		return T(1);
+	}
+	else if constexpr (N == 1) {
+		return x;
+	}
+	else if constexpr (N%2 == 0) {
+		T half = power<N/2>(x);
+		return half*half;
+	}
+	else {
+		return power<N - 1>(x)*x;
+	}
+}
+
+/**
+ * Expression template of a node of a formula.
+ * @tparam Text Class of formula.
+ * @tparam I Index of node.
+ */
+template <class Text, int I>
+struct Expr
+{
+	using source = Source<Text>;                          ///< Parsed formula.
+	static constexpr Node node = source::tape.nodes[I];   ///< Node of this type.
+
+	/**
+	 * Evaluate node.
+	 * @param values Values of variables by slot.
+	 * @return Value of node.
+	 */
+	template <class T>
+	static T eval(const T* values)
+	{
+		if constexpr (node.code == NUMBER) {
+			return T(node.value);
+		}
+		else if constexpr (node.code == CONSTANT) {
+			if constexpr (node.name == 'i') {
+				static_assert(!std::is_floating_point<T>::value, "imaginary unit needs a complex type");
+				return T(0, 1);
+			}
+			else {
+				return T((node.name == 'e') ? 2.718281828459045235 : 3.141592653589793238);
+			}
+		}
+		else if constexpr (node.code == VARIABLE) {
+			return values[node.slot];
+		}
+		else if constexpr (node.code == SUM) {
+			return Expr<Text, node.first>::eval(values) + Expr<Text, node.second>::eval(values);
+		}
+		else if constexpr (node.code == PRODUCT) {
+			return Expr<Text, node.first>::eval(values)*Expr<Text, node.second>::eval(values);
+		}
+		else if constexpr (node.code == NEGATE) {
+			// Multiplying keeps the sign of a zero imaginary part as the runtime does
+			return T(-1)*Expr<Text, node.first>::eval(values);
+		}
+		else if constexpr (node.code == DIVIDE) {
+			return Expr<Text, node.first>::eval(values)/Expr<Text, node.second>::eval(values);
+		}
+		else if constexpr (node.code == POWER) {
+			constexpr int n = source::integer(node.second);
+			if constexpr (n != source::not_integer) {
+				return power<n>(Expr<Text, node.first>::eval(values));
+			}
+			else {
+				return std::pow(Expr<Text, node.first>::eval(values), Expr<Text, node.second>::eval(values));
+			}
+		}
+		else {
+			T arg = Expr<Text, node.first>::eval(values);
+			if constexpr (node.func == SIN) return std::sin(arg);
+			else if constexpr (node.func == COS) return std::cos(arg);
+			else if constexpr (node.func == TAN) return std::tan(arg);
+			else if constexpr (node.func == LOG) return std::log(arg);
+			else return std::exp(arg);
+		}
+	}
+};
+
+/**
+ * Value bound to a variable by name.
+ * @tparam Var Name of variable, a character or a name packed by name().
+ */
+template <Name Var, class T>
+struct Bound
+{
+	T value; ///< Value of variable.
+};
+
+/**
+ * Bind value to variable.
+ * @tparam Var Name of variable, a character or a name packed by name().
+ * @param value Value of variable.
+ * @return Bound value.
+ */
+template <Name Var, class T>
+constexpr Bound<Var, T> bind(const T& value) { return { value }; }
+
+/**
+ * Check that names are distinct.
+ * @return True, if no name is repeated.
+ */
+template <Name... Names>
+constexpr bool distinct()
+{
+	const Name names[] = { Names..., 0 };
+	for (std::size_t i = 0; i < sizeof...(Names); ++i) {
+		for (std::size_t j = i + 1; j < sizeof...(Names); ++j) {
+			if (names[i] == names[j]) return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Formula literal made by MILO_FORMULA.
+ * Evaluates over double or std::complex<double>. Over double, the constant i
+ * does not compile and functions are real.
+ * @tparam Text Class with a static constexpr get() returning the formula.
+ */
+template <class Text>
+class Compiled
+{
+public:
+	using source = Source<Text>;                     ///< Parsed formula.
+	using expression = Expr<Text, source::tape.root>; ///< Expression template of root.
+
+	/**
+	 * Get text of formula.
+	 * @return Formula.
+	 */
+	static constexpr const char* text() { return Text::get(); }
+
+	/**
+	 * Get number of variables.
+	 * @return Number of variables.
+	 */
+	static constexpr int count() { return source::tape.count; }
+
+	/**
+	 * Get name of variable.
+	 * @param slot Index of variable in alphabetical order.
+	 * @return Packed name of variable.
+	 */
+	static constexpr Name variable(int slot) { return source::tape.variables[slot]; }
+
+	/**
+	 * Evaluate formula.
+	 * @param values Values of variables in alphabetical order.
+	 * @return Value of formula.
+	 */
+	template <class T>
+	static T evaluate(const T* values) { return expression::template eval<T>(values); }
+
+	/**
+	 * Evaluate formula with values looked up by name.
+	 * @param lookup Function that is called once for each variable with its name as a string.
+	 * @return Value of formula.
+	 */
+	template <class T, class F>
+	static T evaluate(F lookup)
+	{
+		T values[(count() > 0) ? count() : 1] = {};
+		for (int i = 0; i < count(); ++i) values[i] = lookup(unpack(variable(i)));
+		return evaluate(values);
+	}
+
+	/**
+	 * Evaluate formula with every variable bound by name.
+	 * A missing, unknown or repeated variable does not compile.
+	 * @param bound Values bound to variables.
+	 * @return Value of formula.
+	 */
+	template <class T = double, Name... Names>
+	T operator()(const Bound<Names, T>&... bound) const
+	{
+		static_assert(distinct<Names...>(), "variable of formula bound twice");
+		static_assert(((source::tape.slot(Names) >= 0) && ...), "formula does not have variable");
+		static_assert((int) sizeof...(Names) == count(), "every variable of formula must be bound");
+		T values[(count() > 0) ? count() : 1] = {};
+		((values[source::tape.slot(Names)] = bound.value), ...);
+		return evaluate(values);
+	}
+};
+
+} // namespace Formula
+
+/**
+ * Make formula literal from a string literal in milo syntax.
+ * A malformed formula does not compile.
+ * @param text String literal of formula.
+ * @return Formula::Compiled object.
+ */
+#define MILO_FORMULA(text) \
+	([] { \
+		struct Text { static constexpr const char* get() { return text; } }; \
+		return Formula::Compiled<Text>(); \
+	}())
+
+#endif // __FORMULA_H
@@ -0,0 +1,249 @@
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file kernels.cpp
+ * This file contains the scalar and SSE2 vector types for the kernels of
+ * simd.h, and the selection of kernels at run time. The AVX2 vector type is in
+ * kernels_avx2.cpp, which is the only file compiled for AVX2.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "simd.h"
+#include "kernels.h"
+
+namespace {
+
+/**
+ * Vector of one double.
+ */
+struct Scalar
+{
+	static const size_t width = 1; ///< Number of lanes.
+	double v;                      ///< Value.
+
+	Scalar(double x = 0) : v(x) {}
+	static Scalar load(const double* p) { return *p; }
+	void store(double* p) const { *p = v; }
+};
+
+/** @name Scalar Operations */
+//@{
+inline Scalar operator+(Scalar a, Scalar b) { return a.v + b.v; }
+inline Scalar operator-(Scalar a, Scalar b) { return a.v - b.v; }
+inline Scalar operator*(Scalar a, Scalar b) { return a.v*b.v; }
+inline Scalar operator/(Scalar a, Scalar b) { return a.v/b.v; }
+inline Scalar operator-(Scalar a) { return -a.v; }
+inline bool operator<(Scalar a, Scalar b) { return a.v < b.v; }
+inline bool operator>(Scalar a, Scalar b) { return a.v > b.v; }
+inline bool operator==(Scalar a, Scalar b) { return a.v == b.v; }
+inline Scalar select(bool m, Scalar a, Scalar b) { return m ? a : b; }
+inline Scalar sqrt(Scalar a) { return std::sqrt(a.v); }
+inline Scalar abs(Scalar a) { return std::fabs(a.v); }
+inline Scalar copysign(Scalar mag, Scalar sgn) { return std::copysign(mag.v, sgn.v); }
+
+inline Scalar pow2(Scalar k)
+{
+	double biased = k.v + (two52 + 1023);
+	uint64_t bits;
+	memcpy(&bits, &biased, sizeof(bits));
+	bits <<= 52;
+	double x;
+	memcpy(&x, &bits, sizeof(x));
+	return x;
+}
+
+inline Scalar exponent(Scalar x, Scalar& mantissa)
+{
+	uint64_t bits, m;
+	memcpy(&bits, &x.v, sizeof(bits));
+	m = (bits & 0x000FFFFFFFFFFFFFull) | 0x3FF0000000000000ull;
+	memcpy(&mantissa.v, &m, sizeof(m));
+	return (double) (bits >> 52);
+}
+//@}
+
+#ifdef __SSE2__
+/**
+ * Vector of two doubles.
+ */
+struct Sse2
+{
+	static const size_t width = 2; ///< Number of lanes.
+	__m128d v;                     ///< Values.
+
+	Sse2(double x = 0) : v(_mm_set1_pd(x)) {}
+	Sse2(__m128d x) : v(x) {}
+	static Sse2 load(const double* p) { return _mm_loadu_pd(p); }
+	void store(double* p) const { _mm_storeu_pd(p, v); }
+};
+
+/**
+ * Mask of two lanes.
+ */
+struct Sse2Mask
+{
+	__m128d m; ///< All ones in lanes that are true.
+};
+
+/** @name SSE2 Operations */
+//@{
+inline Sse2 operator+(Sse2 a, Sse2 b) { return _mm_add_pd(a.v, b.v); }
+inline Sse2 operator-(Sse2 a, Sse2 b) { return _mm_sub_pd(a.v, b.v); }
+inline Sse2 operator*(Sse2 a, Sse2 b) { return _mm_mul_pd(a.v, b.v); }
+inline Sse2 operator/(Sse2 a, Sse2 b) { return _mm_div_pd(a.v, b.v); }
+inline Sse2 operator-(Sse2 a) { return _mm_xor_pd(a.v, _mm_set1_pd(-0.0)); }
+inline Sse2Mask operator<(Sse2 a, Sse2 b) { return { _mm_cmplt_pd(a.v, b.v) }; }
+inline Sse2Mask operator>(Sse2 a, Sse2 b) { return { _mm_cmpgt_pd(a.v, b.v) }; }
+inline Sse2Mask operator==(Sse2 a, Sse2 b) { return { _mm_cmpeq_pd(a.v, b.v) }; }
+inline Sse2 select(Sse2Mask m, Sse2 a, Sse2 b) { return _mm_or_pd(_mm_and_pd(m.m, a.v), _mm_andnot_pd(m.m, b.v)); }
+inline Sse2 sqrt(Sse2 a) { return _mm_sqrt_pd(a.v); }
+inline Sse2 abs(Sse2 a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a.v); }
+
+inline Sse2 copysign(Sse2 mag, Sse2 sgn)
+{
+	__m128d sign = _mm_set1_pd(-0.0);
+	return _mm_or_pd(_mm_andnot_pd(sign, mag.v), _mm_and_pd(sign, sgn.v));
+}
+
+inline Sse2 pow2(Sse2 k)
+{
+	__m128i bits = _mm_castpd_si128(_mm_add_pd(k.v, _mm_set1_pd(two52 + 1023)));
+	return _mm_castsi128_pd(_mm_slli_epi64(bits, 52));
+}
+
+inline Sse2 exponent(Sse2 x, Sse2& mantissa)
+{
+	__m128i bits = _mm_castpd_si128(x.v);
+	__m128i m = _mm_and_si128(bits, _mm_set1_epi64x(0x000FFFFFFFFFFFFFll));
+	mantissa = _mm_castsi128_pd(_mm_or_si128(m, _mm_set1_epi64x(0x3FF0000000000000ll)));
+	__m128i e = _mm_or_si128(_mm_srli_epi64(bits, 52), _mm_castpd_si128(_mm_set1_pd(two52)));
+	return _mm_sub_pd(_mm_castsi128_pd(e), _mm_set1_pd(two52));
+}
+//@}
+#endif
+
+} // namespace
+
+const KernelSet scalar_kernels = makeKernels<Scalar>();
+
+#ifdef __SSE2__
+const KernelSet sse2_kernels = makeKernels<Sse2>();
+#else
+const KernelSet sse2_kernels = { { nullptr, nullptr, nullptr, nullptr, nullptr } };
+#endif
+
+using namespace std;
+
+/**
+ * Names of functions in order of Kernels::Func.
+ */
+static const vector<string> function_names = { "sin", "cos", "tan", "log", "exp" };
+
+/**
+ * Check if kernel computes argument accurately.
+ * @param func Function.
+ * @param z Argument.
+ * @return True, if argument is in range of kernel.
+ */
+static bool inRange(Kernels::Func func, const Complex& z)
+{
+	double a = abs(z.real()), b = abs(z.imag());
+	if (!isfinite(a) || !isfinite(b)) return false;
+	switch (func) {
+	case Kernels::SIN:
+	case Kernels::COS: return a <= 1e5 && b <= 700;
+	case Kernels::TAN: return a <= 5e4;
+	case Kernels::EXP: return a <= 700 && b <= 1e5;
+	default:           return true;
+	}
+}
+
+/**
+ * Get kernels of instruction set.
+ * @param isa Instruction set.
+ * @return Kernels.
+ */
+static const KernelSet& kernels(Kernels::Isa isa)
+{
+	switch (isa) {
+	case Kernels::AVX2: return avx2_kernels;
+	case Kernels::SSE2: return sse2_kernels;
+	default:            return scalar_kernels;
+	}
+}
+
+Kernels::Func Kernels::find(const string& name)
+{
+	auto it = std::find(function_names.begin(), function_names.end(), name);
+	if (it == function_names.end()) throw logic_error("no kernel for function " + name);
+	return (Func) distance(function_names.begin(), it);
+}
+
+bool Kernels::isSupported(Isa isa)
+{
+	if (kernels(isa).functions[0] == nullptr) return false;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	if (isa == AVX2) return __builtin_cpu_supports("avx2");
+#endif
+	return true;
+}
+
+Kernels::Isa Kernels::best()
+{
+	static const Isa isa = isSupported(AVX2) ? AVX2 : (isSupported(SSE2) ? SSE2 : SCALAR);
+	return isa;
+}
+
+string Kernels::getName(Isa isa)
+{
+	static const vector<string> names = { "scalar", "sse2", "avx2" };
+	return names.at(isa);
+}
+
+Complex Kernels::scalar(Func func, const Complex& z)
+{
+	switch (func) {
+	case SIN: return sin(z);
+	case COS: return cos(z);
+	case TAN: return tan(z);
+	case LOG: return log(z);
+	default:  return exp(z);
+	}
+}
+
+void Kernels::apply(Func func, const Complex* z, Complex* out, size_t n, Isa isa)
+{
+	if (!isSupported(isa)) throw logic_error("instruction set " + getName(isa) + " not supported");
+
+	// Arguments out of range are kept before output may overwrite them
+	vector<pair<size_t, Complex>> outside;
+	for (size_t i = 0; i < n; ++i) {
+		if (!inRange(func, z[i])) outside.emplace_back(i, z[i]);
+	}
+	kernels(isa).functions[func](reinterpret_cast<const double*>(z), reinterpret_cast<double*>(out), n);
+	for ( auto& arg : outside ) out[arg.first] = scalar(func, arg.second);
+}
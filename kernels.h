@@ -0,0 +1,100 @@
+#ifndef __KERNELS_H
+#define __KERNELS_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file kernels.h
+ * This file contains batch versions of the functions of Function, which apply
+ * a function to an array of complex values with SIMD instructions.
+ */
+
+#include <cstddef>
+#include <string>
+#include "milo.h"
+
+/**
+ * Batch complex sin, cos, tan, log and exp.
+ * Kernels exist for SSE2 and AVX2, and for plain doubles as a fallback. The
+ * best instruction set of the processor is chosen at run time. Arguments that
+ * the kernels do not reduce accurately, which are real parts above 1e5 for the
+ * trigonometric functions, overflowing exponentials and values that are not
+ * finite, are computed one at a time with the scalar functions.
+ */
+namespace Kernels
+{
+	/**
+	 * Instruction set of kernels.
+	 */
+	enum Isa { SCALAR, SSE2, AVX2 };
+
+	/**
+	 * Function of kernel, in the order of Evaluator.
+	 */
+	enum Func { SIN, COS, TAN, LOG, EXP };
+
+	/**
+	 * Find function by name.
+	 * Throws logic_error if there is no kernel for function.
+	 * @param name Name of function.
+	 * @return Function.
+	 */
+	Func find(const std::string& name);
+
+	/**
+	 * Check if processor and build support instruction set.
+	 * @param isa Instruction set.
+	 * @return True, if supported.
+	 */
+	bool isSupported(Isa isa);
+
+	/**
+	 * Get best supported instruction set.
+	 * @return Instruction set.
+	 */
+	Isa best();
+
+	/**
+	 * Get name of instruction set.
+	 * @param isa Instruction set.
+	 * @return Name.
+	 */
+	std::string getName(Isa isa);
+
+	/**
+	 * Apply function to array.
+	 * Output may be the same array as input.
+	 * Throws logic_error if instruction set is not supported.
+	 * @param func Function.
+	 * @param z Arguments.
+	 * @param out Values.
+	 * @param n Number of arguments.
+	 * @param isa Instruction set.
+	 */
+	void apply(Func func, const Complex* z, Complex* out, size_t n, Isa isa = best());
+
+	/**
+	 * Apply scalar version of function.
+	 * @param func Function.
+	 * @param z Argument.
+	 * @return Value.
+	 */
+	Complex scalar(Func func, const Complex& z);
+}
+
+#endif // __KERNELS_H
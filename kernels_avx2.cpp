@@ -0,0 +1,96 @@
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file kernels_avx2.cpp
+ * This file contains the AVX2 vector type for the kernels of simd.h. It is
+ * compiled with AVX2 enabled and only called when the processor has it.
+ */
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "simd.h"
+
+#ifdef __AVX2__
+namespace {
+
+/**
+ * Vector of four doubles.
+ */
+struct Avx2
+{
+	static const size_t width = 4; ///< Number of lanes.
+	__m256d v;                     ///< Values.
+
+	Avx2(double x = 0) : v(_mm256_set1_pd(x)) {}
+	Avx2(__m256d x) : v(x) {}
+	static Avx2 load(const double* p) { return _mm256_loadu_pd(p); }
+	void store(double* p) const { _mm256_storeu_pd(p, v); }
+};
+
+/**
+ * Mask of four lanes.
+ */
+struct Avx2Mask
+{
+	__m256d m; ///< All ones in lanes that are true.
+};
+
+/** @name AVX2 Operations */
+//@{
+inline Avx2 operator+(Avx2 a, Avx2 b) { return _mm256_add_pd(a.v, b.v); }
+inline Avx2 operator-(Avx2 a, Avx2 b) { return _mm256_sub_pd(a.v, b.v); }
+inline Avx2 operator*(Avx2 a, Avx2 b) { return _mm256_mul_pd(a.v, b.v); }
+inline Avx2 operator/(Avx2 a, Avx2 b) { return _mm256_div_pd(a.v, b.v); }
+inline Avx2 operator-(Avx2 a) { return _mm256_xor_pd(a.v, _mm256_set1_pd(-0.0)); }
+inline Avx2Mask operator<(Avx2 a, Avx2 b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ) }; }
+inline Avx2Mask operator>(Avx2 a, Avx2 b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ) }; }
+inline Avx2Mask operator==(Avx2 a, Avx2 b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ) }; }
+inline Avx2 select(Avx2Mask m, Avx2 a, Avx2 b) { return _mm256_blendv_pd(b.v, a.v, m.m); }
+inline Avx2 sqrt(Avx2 a) { return _mm256_sqrt_pd(a.v); }
+inline Avx2 abs(Avx2 a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v); }
+
+inline Avx2 copysign(Avx2 mag, Avx2 sgn)
+{
+	__m256d sign = _mm256_set1_pd(-0.0);
+	return _mm256_or_pd(_mm256_andnot_pd(sign, mag.v), _mm256_and_pd(sign, sgn.v));
+}
+
+inline Avx2 pow2(Avx2 k)
+{
+	__m256i bits = _mm256_castpd_si256(_mm256_add_pd(k.v, _mm256_set1_pd(two52 + 1023)));
+	return _mm256_castsi256_pd(_mm256_slli_epi64(bits, 52));
+}
+
+inline Avx2 exponent(Avx2 x, Avx2& mantissa)
+{
+	__m256i bits = _mm256_castpd_si256(x.v);
+	__m256i m = _mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFFll));
+	mantissa = _mm256_castsi256_pd(_mm256_or_si256(m, _mm256_set1_epi64x(0x3FF0000000000000ll)));
+	__m256i e = _mm256_or_si256(_mm256_srli_epi64(bits, 52), _mm256_castpd_si256(_mm256_set1_pd(two52)));
+	return _mm256_sub_pd(_mm256_castsi256_pd(e), _mm256_set1_pd(two52));
+}
+//@}
+
+} // namespace
+
+const KernelSet avx2_kernels = makeKernels<Avx2>();
+#else
+const KernelSet avx2_kernels = { { nullptr, nullptr, nullptr, nullptr, nullptr } };
+#endif
@@ -0,0 +1,187 @@
+#ifndef __LEXER_H
+#define __LEXER_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file lexer.h
+ * This file contains the recognition of keywords and operators for Parser
+ * with a trie that is built at compile time.
+ */
+
+#include <cstddef>
+
+namespace Lexer
+{
+	/**
+	 * Tokens of keywords and operators.
+	 */
+	enum Token {
+		NONE,         ///< No keyword.
+		FUNCTION,     ///< Function name and its open parenthesis.
+		DIFFERENTIAL, ///< Start of differential D/D.
+		PLUS,         ///< Plus sign.
+		MINUS,        ///< Minus sign.
+		DIVIDE,       ///< Division.
+		POWER,        ///< Power.
+		OPEN,         ///< Open parenthesis.
+		CLOSE         ///< Close parenthesis.
+	};
+
+	/**
+	 * Keyword and its token.
+	 */
+	struct Keyword
+	{
+		const char* text; ///< Text of keyword.
+		Token token;      ///< Token of keyword.
+	};
+
+	/**
+	 * Names of built in functions. Function::functions is built from this
+	 * list, and each name followed by an open parenthesis is a keyword.
+	 */
+	constexpr const char* functions[] = { "sin", "cos", "tan", "log", "exp" };
+
+	constexpr size_t num_functions = sizeof(functions)/sizeof(functions[0]); ///< Number of functions.
+
+	/**
+	 * Keywords of parser other than function names.
+	 */
+	constexpr Keyword keywords[] = {
+		{ "D/D", DIFFERENTIAL },
+		{ "+", PLUS }, { "-", MINUS }, { "/", DIVIDE }, { "^", POWER },
+		{ "(", OPEN }, { ")", CLOSE }
+	};
+
+	/**
+	 * Get length of string at compile time.
+	 * @param s Null terminated string.
+	 * @return Length of string.
+	 */
+	constexpr size_t length(const char* s)
+	{
+		size_t n = 0;
+		while (s[n] != '\0') ++n;
+		return n;
+	}
+
+	/**
+	 * Get most states a trie of all keywords can need, one for each
+	 * character plus the start state.
+	 * @return Most states of trie.
+	 */
+	constexpr size_t countStates()
+	{
+		size_t n = 1;
+		for ( auto& keyword : keywords ) n += length(keyword.text);
+		for ( auto name : functions ) n += length(name) + 1;
+		return n;
+	}
+
+	/**
+	 * Longest keyword at a position in text.
+	 */
+	struct Match
+	{
+		Token token;   ///< Token of keyword or NONE.
+		size_t length; ///< Length of keyword or zero.
+	};
+
+	/**
+	 * Trie of keywords.
+	 * Each state has a transition for every ASCII character, so matching a
+	 * keyword costs one table load per character no matter how many keywords
+	 * there are.
+	 */
+	class Trie
+	{
+	public:
+		/**
+		 * Constructor for Trie class.
+		 * Builds trie of all keywords.
+		 */
+		constexpr Trie() : m_next(), m_token(), m_size(1)
+		{
+			for ( auto& keyword : keywords ) {
+				m_token[insert(0, keyword.text)] = keyword.token;
+			}
+			for ( auto name : functions ) {
+				m_token[insert(insert(0, name), "(")] = FUNCTION;
+			}
+		}
+
+		/**
+		 * Find longest keyword at start of text.
+		 * @param text Text.
+		 * @param length Length of text.
+		 * @return Token and length of keyword.
+		 */
+		constexpr Match match(const char* text, size_t length) const
+		{
+			Match found = { NONE, 0 };
+			int state = 0;
+			for (size_t i = 0; i < length && (unsigned char) text[i] < ascii; ++i) {
+				state = m_next[state][(unsigned char) text[i]];
+				if (state == 0) break;
+				if (m_token[state] != NONE) found = { m_token[state], i + 1 };
+			}
+			return found;
+		}
+
+		/**
+		 * Get number of states of trie.
+		 * @return Number of states.
+		 */
+		constexpr int size() const { return m_size; }
+
+	private:
+		static const int ascii = 128;                       ///< Number of characters.
+		static constexpr size_t max_states = countStates(); ///< Most states of trie.
+
+		static_assert(max_states <= 256, "states of trie must fit in a byte");
+
+		unsigned char m_next[max_states][ascii]; ///< Next state of each character, zero for none.
+		Token m_token[max_states];               ///< Token of keyword ending at state.
+		int m_size;                              ///< Number of states.
+
+		/**
+		 * Add text to trie.
+		 * @param state State to start from.
+		 * @param text Text to be added.
+		 * @return State at end of text.
+		 */
+		constexpr int insert(int state, const char* text)
+		{
+			for (const char* c = text; *c != '\0'; ++c) {
+				auto& next = m_next[state][(unsigned char) *c];
+				if (next == 0) next = (unsigned char) m_size++;
+				state = next;
+			}
+			return state;
+		}
+	};
+
+	inline constexpr Trie trie; ///< Trie of keywords of parser.
+
+	static_assert(trie.match("sin(x)", 6).length == 4, "function keyword");
+	static_assert(trie.match("sinx", 4).token == NONE, "function needs parenthesis");
+	static_assert(trie.match("D/Dx", 4).token == DIFFERENTIAL, "differential keyword");
+}
+
+#endif // __LEXER_H
@@ -30,6 +30,7 @@
 
 #include "util.h"
 #include "milo.h"
+#include "nodes.h"
 #include "ui.h"
 
 using namespace std;
@@ -155,13 +156,83 @@ Node* Node::getNextRight()
 
 Complex Node::getValue() const
 {
+	// Values of visited children of the nodes on the stack, in order
+	vector<Complex> values;
+	traverse(const_cast<Node*>(this),
+		[](Node* node) { return node->getType() != DIFFERENTIAL; },
+		[&values](Node* node) {
+			size_t n = 0;
+			if (node->getType() != DIFFERENTIAL) forEachChild(node, [&n](Node*) { ++n; });
+			Complex z = node->getValue(values.data() + values.size() - n);
+			values.resize(values.size() - n);
+			values.push_back(z);
+		});
+	return values.back();
+}
+
+Complex Node::getValue(const Complex* values) const
+{
+	Complex v = getNodeValue(values);
 	Complex z(1, 0);
-	for (int i = 0; i < m_nth; ++i) { z *= getNodeValue(); }
+	for (int i = 0; i < m_nth; ++i) { z *= v; }
 	if (!m_sign && ((m_nth&1) == 1)) z *= Complex(-1, 0);
 	return z;
 }
 
+Dual Node::getDual(const vector<SymbolTable::Id>& vars) const
+{
+	// Duals of visited children of the nodes on the stack, in order. Children
+	// of nodes with no positive power are not needed.
+	vector<Dual> duals;
+	traverseDerived(const_cast<Node*>(this),
+		[](Node* node) { return node->m_nth > 0; },
+		[&duals, &vars](Node* node) {
+			Dual z(Complex(1, 0));
+			if (node->m_nth > 0) {
+				size_t n = 0;
+				if (node->getType() == DIFFERENTIAL) n = 1;
+				else forEachChild(node, [&n](Node*) { ++n; });
+				Dual v = node->getNodeDual(vars, duals.data() + duals.size() - n);
+				duals.erase(duals.end() - n, duals.end());
+				for (int i = 0; i < node->m_nth; ++i) { z *= v; }
+			}
+			if (!node->m_sign && ((node->m_nth&1) == 1)) z = -z;
+			duals.push_back(z);
+		});
+	return duals.back();
+}
+
+void Node::normalize()
+{
+	traverse(this,
+		[](Node* node) { node->beginNormalize(); return true; },
+		[](Node* node) { node->normalizeNode(); });
+}
+
+bool Node::simplify()
+{
+	bool result = false;
+	traverse(this,
+		[](Node* node) { return node->beginSimplify(); },
+		[&result](Node* node) { result |= node->simplifyNode(); });
+	return result;
+}
+
 void Node::calculateSize(UI::Graphics& gc)
+{
+	// Children are sized before their parents. Expressions that are factors
+	// of a term are drawn in parenthesis, which has to be known to size them.
+	traverse(this,
+		[](Node* node) {
+			if (node->getType() == TERM) {
+				forEachChild(node, [](Node* factor) { if (factor->getType() == EXPRESSION) factor->setDrawParenthesis(true); });
+			}
+			return true;
+		},
+		[&gc](Node* node) { node->sizeNode(gc); });
+}
+
+void Node::sizeNode(UI::Graphics& gc)
 {
 	Node::Frame frame = calcSize(gc);
 
@@ -181,9 +252,21 @@ void Node::calculateSize(UI::Graphics& gc)
 }
 
 void Node::calculateOrigin(UI::Graphics& gc, int x, int y)
+{
+	// Parents place their children before the children place theirs
+	setOrigin(gc, x, y);
+	traverse(this, [&gc](Node* node) { node->placeChildren(gc); return true; }, [](Node*) {});
+}
+
+void Node::setOrigin(UI::Graphics& gc, int x, int y)
 {
 	m_frame.box.setOrigin(x, y);
 	if (m_nth == 1) m_parenthesis.setOrigin(x, y); else m_parenthesis.setOrigin(x, y + gc.getTextHeight());
+}
+
+void Node::placeChildren(UI::Graphics& gc)
+{
+	int x = m_frame.box.x0(), y = m_frame.box.y0();
 	if (m_fDrawParenthesis)    x += gc.getParenthesisWidth();
 	if (isFactor() && !m_sign) x += gc.getCharLength('-');
 
@@ -192,6 +275,25 @@ void Node::calculateOrigin(UI::Graphics& gc, int x, int y)
 
 // Draw this node and subtree in this graphic context
 void Node::draw(UI::Graphics& gc) const
+{
+	// Parents draw before their children. Signs between terms are drawn by
+	// their expression just before each term.
+	vector<pair<const Node*, const Expression*>> stack = { { this, nullptr } };
+	while (!stack.empty()) {
+		const Node* node = stack.back().first;
+		const Expression* expr = stack.back().second;
+		stack.pop_back();
+		if (expr) expr->drawSign(gc, node);
+		node->drawOwn(gc);
+
+		size_t first = stack.size();
+		const Expression* parent = node->getType() == EXPRESSION ? static_cast<const Expression*>(node) : nullptr;
+		forEachChild(const_cast<Node*>(node), [&stack, parent](Node* kid) { stack.emplace_back(kid, parent); });
+		reverse(stack.begin() + first, stack.end());
+	}
+}
+
+void Node::drawOwn(UI::Graphics& gc) const
 {
 	if (m_fDrawParenthesis)  gc.parenthesis(m_parenthesis);
 	if (isFactor() && !m_sign) {
@@ -204,7 +306,7 @@ void Node::draw(UI::Graphics& gc) const
 		gc.at(m_frame.box.x0() + m_frame.box.width() - gc.getTextLength(n),
 			  m_frame.box.y0(), n, UI::Graphics::Attributes::NONE);
 	}
-	drawNode(gc);	
+	drawNode(gc);
 }
 
 // Set up drawing for this node and its subtree
@@ -342,7 +444,7 @@ void Equation::selectNodeOrInput(Node* node)
 	if (getCurrentInput()) disableCurrentInput();
 
 	if (node->getType() == Input::type) {
-		Input* in = dynamic_cast<Input*>(node);
+		Input* in = static_cast<Input*>(node);
 		in->makeCurrent();
 		clearSelect();
 	}
@@ -420,12 +522,13 @@ void NodeIterator::prev()
 FactorIterator::FactorIterator(Node* node) : m_node(node)
 {
 	if (!m_node) return;
-	if (!m_node->getParent() || m_node->getParent()->isFactor()) {
+	if (!m_node->getParent() || m_node->getParent()->getType() != Term::type) {
 		m_node = nullptr;
 		return;
 	}
-	m_pTerm = dynamic_cast<Term*>(m_node->getParent());
-	m_gpExpr = dynamic_cast<Expression*>(m_pTerm->getParent());
+	// Parent of a term is always an expression
+	m_pTerm = static_cast<Term*>(m_node->getParent());
+	m_gpExpr = static_cast<Expression*>(m_pTerm->getParent());
 	m_factor_index = m_pTerm->factors.get_index(m_node);
 	m_term_index = m_gpExpr->terms.get_index(m_pTerm);
 }
@@ -620,25 +723,29 @@ void FactorIterator::insertAfter(Node* node)
 void FactorIterator::replace(Node* node)
 {
 	if (!node) logic_error("Node cannot be null");
-	m_pTerm->factors[m_factor_index] = node;
+	m_pTerm->factors.replace_index(m_factor_index, node);
 	node->setParent(m_pTerm);
 }
 
 void FactorIterator::replace(Term* term)
 {
 	if (!term) logic_error("Term cannot be null");
-	m_gpExpr->terms[m_term_index] = term;
+	m_gpExpr->terms.replace_index(m_term_index, term);
 	term->setParent(m_gpExpr);
 }
 
 void FactorIterator::swap(FactorIterator& a, FactorIterator& b)
 {
 	NodePtr tmp; tmp = a.m_node;
-	a.m_pTerm->factors[a.m_factor_index] = b.m_pTerm->factors[b.m_factor_index];
+	a.m_pTerm->factors.replace_index(a.m_factor_index, b.m_pTerm->factors[b.m_factor_index]);
 	a.m_node = b.m_node;
 
-	b.m_pTerm->factors[b.m_factor_index] = tmp;
+	b.m_pTerm->factors.replace_index(b.m_factor_index, tmp);
 	b.m_node = tmp;
+
+	// Nodes may have changed terms
+	a.m_node->setParent(a.m_pTerm);
+	b.m_node->setParent(b.m_pTerm);
 }
 
 namespace Log
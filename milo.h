@@ -27,6 +27,7 @@
  */
 
 #include <string>
+#include <string_view>
 #include <memory>
 #include <complex>
 #include <iostream>
@@ -35,11 +36,12 @@
 #include <vector>
 #include <ctime>
 #include <algorithm>
-#include <typeindex>
 
 #include "util.h"
 #include "xml.h"
 #include "smart.h"
+#include "dual.h"
+#include "symtab.h"
 
 // Forward class declerations
 namespace UI { class Graphics; }
@@ -48,6 +50,7 @@ class Term;
 class Expression;
 class Input;
 class Equation;
+class RuleSet;
 
 // Hidden class declerations for pointers and reference
 class Parser;
@@ -62,14 +65,14 @@ using NodeIter = NodeVector::iterator;    ///< Iterator into vector of node poin
 using TermPtr = SmartPtr<Term>;           ///< Shared pointer for Term class
 using TermVector = SmartVector<Term>;     ///< Specialized smart vector of terms.
 using ExpressionPtr = SmartPtr<Expression>; ///< Shared pointer for expression class.
-using EqnPtr = SmartPtr<Equation>;        ///< Shared pointer for equation
+using EqnPtr = std::unique_ptr<Equation>;  ///< Pointer that owns an equation.
 //@}
 
 /**
  * Abstract base class for symbolic classes that make up an equation.
  * Any class that will be part of the equation tree structor derives from this class.
  */
-class Node : public std::enable_shared_from_this<Node>
+class Node : public RefCounted
 {
 public:
 	/**
@@ -85,6 +88,15 @@ public:
 	 */
 	enum Select { NONE, START, END, ALL };
 
+	/**
+	 * Final classes of nodes.
+	 * Kinds of factors are in the order that factors are sorted in a term.
+	 */
+	enum Kind : unsigned char {
+		NUMBER, CONSTANT, VARIABLE, EXPRESSION, FUNCTION,
+		DIVIDE, POWER, DIFFERENTIAL, INPUT, TERM
+	};
+
 	/**
 	 * List of strings corresponding to enum Select.
 	 * Use enum State as index into select_tags to get its strings.
@@ -103,32 +115,35 @@ public:
 	/**
 	 * Constructor for Node class.
 	 * Directly initialize the Node class private data members.
+	 * @param kind Final class of node.
 	 * @param eqn Equation associated with this node.
 	 * @param parent Node object that is parent of this node. If NULL, this node is root.
 	 * @param fNeg True, if node is negated.
 	 * @param s Node selection state.
 	 */
-    Node(Equation& eqn, Node* parent, bool fNeg = false, Select s = NONE ) : 
-	    m_eqn(eqn), m_parent(parent), m_sign(!fNeg), m_select(s) {}
+    Node(Kind kind, Equation& eqn, Node* parent, bool fNeg = false, Select s = NONE ) : 
+	    m_eqn(eqn), m_kind(kind), m_parent(parent), m_sign(!fNeg), m_select(s) {}
 
 	/**
 	 * Constructor for Node class.
 	 * Directly initialize the Node class private data members from parser
+	 * @param kind Final class of node.
 	 * @param parser Parser to create this node from.
 	 * @param parent Node object that is parent of this node. If NULL, this node is root.
 	 * @param fNeg True, if node is negated.
 	 * @param s Node selection state.
 	 */
-	Node(Parser& p, Node* parent, bool fNeg = false, Select s = NONE );
+	Node(Kind kind, Parser& p, Node* parent, bool fNeg = false, Select s = NONE );
 
 	/**
 	 * XML constructor for Node class.
 	 * Initialize the constructor from XML input stream.
+	 * @param kind Final class of node.
 	 * @param in XML input stream.
 	 * @param eqn Equation associated with this node.
 	 * @param parent Parent node object.
 	 */
-	Node(XML::Parser& in, Equation& eqn, Node* parent);
+	Node(Kind kind, XML::Parser& in, Equation& eqn, Node* parent);
 	
 	virtual ~Node() {} ///< Abstract base class needs virtual desctructor.
 	//@}
@@ -175,14 +190,16 @@ public:
 
 	/**
 	 * Put node's subtree to a standard algebraic form.
+	 * Children are normalized before their parent.
 	 */
-	virtual void normalize() {}
+	void normalize();
 
 	/**
 	 * Simplify node's subtree algebraiclly.
+	 * Children are simplified before their parent.
 	 * @return True if node's subtree was changed.
 	 */
-	virtual bool simplify() { return false; }
+	bool simplify();
 
 	/**
 	 * Compare this node string representation to the given node's string representation.
@@ -199,14 +216,17 @@ public:
 	virtual const std::string& getName() const=0;
 
 	/**
-	 * Get final class type of node class object.
-	 * @return Class type of node object.
+	 * Get final class of node object.
+	 * Kind is kept in node, so getting it needs no virtual call.
+	 * @return Kind of node object.
 	 */
-	virtual std::type_index getType() const=0;
+	Kind getType() const { return m_kind; }
 	//@}
 
 	/**
 	 * Calculate size of node subtree in given graphics context.
+	 * The subtree is walked with an explicit stack, so its depth is not
+	 * limited by the call stack.
 	 * @param gc Graphics context used to calculate size.
 	 */
 	void calculateSize(UI::Graphics& gc);
@@ -218,6 +238,66 @@ public:
 	 */
 	XML::Stream& out(XML::Stream& xml);
 
+	/**
+	 * Serialize this node and child nodes to XML fragment without root tag.
+	 * @param str Output string object.
+	 */
+	void out(std::string& str);
+
+	/**
+	 * Create node subtree from XML fragment without root tag.
+	 * @param str String containing XML fragment.
+	 * @param eqn Equation associated with new nodes.
+	 * @param parent Parent of new node.
+	 * @return New node or null if no node found.
+	 */
+	static Node* create(const std::string& str, Equation& eqn, Node* parent);
+
+	/**
+	 * Create node subtree from XML after the header of its root was read.
+	 * The subtree is read with an explicit stack, so it can be of any depth.
+	 * @param in XML parser after the header of the root.
+	 * @param eqn Equation associated with new nodes.
+	 * @param parent Parent of new node.
+	 * @return New node.
+	 */
+	static Node* create(XML::Parser& in, Equation& eqn, Node* parent);
+
+	/**
+	 * Create node directly from its contents and children without XML.
+	 * The new node becomes the parent of its children. Power, sign and
+	 * selection of the new node are left at their defaults.
+	 * Throws logic_error if children do not fit the kind of node.
+	 * @param kind Final class of new node.
+	 * @param name Name of variable, function or constant, variable of
+	 *             differential or text of input. Not used by other kinds.
+	 * @param value Value of number. Not used by other kinds.
+	 * @param kids Children of new node in order.
+	 * @param eqn Equation associated with new node.
+	 * @param parent Parent of new node.
+	 * @return New node.
+	 */
+	static Node* create(Kind kind, const std::string& name, double value, const std::vector<NodePtr>& kids,
+	                    Equation& eqn, Node* parent);
+
+	/**
+	 * Copy this node without its children into given equation.
+	 * Power, sign and parenthesis are copied, selection is not.
+	 * @param kids Children of copy in order.
+	 * @param eqn Equation associated with copy.
+	 * @return Copy of node.
+	 */
+	NodePtr copy(const std::vector<NodePtr>& kids, Equation& eqn);
+
+	/**
+	 * Copy subtree of this node into given equation without XML.
+	 * The subtree is walked with an explicit stack. Selection is not copied.
+	 * @param eqn Equation associated with new nodes.
+	 * @param parent Parent of new node.
+	 * @return Root of copy.
+	 */
+	NodePtr clone(Equation& eqn, Node* parent = nullptr);
+
 	/**
 	 * Calculate origin of each node in subtree.
 	 * The size of each node in subtree needs to be precalculated.
@@ -227,6 +307,15 @@ public:
 	 */
 	void calculateOrigin(UI::Graphics& gc, int x, int y);
 
+	/**
+	 * Set origin of this node without placing the nodes of its subtree.
+	 * Used by calcOrig to place children, which calculateOrigin then visits.
+	 * @param gc Graphics context to calculate origin.
+	 * @param x  Horizontal origin of node.
+	 * @param y  Vertical origin of node.
+	 */
+	void setOrigin(UI::Graphics& gc, int x, int y);
+
 	/**
 	 * Calculate the size and origin of the subtree of this node.
 	 * @param gc Graphics context class object.
@@ -304,11 +393,33 @@ public:
 	 */
 	Node* getParent() const { return m_parent; }
 
+	/**
+	 * Get position of this node in vector of its parent.
+	 * Kept up to date by SmartVector, but only a hint if the vector was
+	 * reordered directly or the node is also held by another vector.
+	 * In a long vector it is the chunk and position in the chunk, so use
+	 * SmartVector::get_index for the index.
+	 * @return Position in vector of parent or -1.
+	 */
+	int getIndex() const { return m_index; }
+
+	/**
+	 * Set position of this node in vector of its parent.
+	 * @param index Position in vector of parent.
+	 */
+	void setIndex(int index) { m_index = index; }
+
 	/**
 	 * Get depth from root of this node. 0 is root.
 	 * @return Depth of this node.
 	 */
-	int getDepth() const { return getDepth(0); }
+	int getDepth() const
+	{
+		int depth = 0;
+		for (const Node* node = m_parent; node; node = node->m_parent) ++depth;
+		return depth;
+	}
+
 	/**
 	 * Get value of integer power of this node.
 	 * @return Value of m_nth.
@@ -350,6 +461,20 @@ public:
 	 */
 	Complex getValue() const;
 
+	/**
+	 * Calculate value of this node from the values of its children.
+	 * @param values Values of children in order, not used by a differential.
+	 * @return Value of this node with its power and sign.
+	 */
+	Complex getValue(const Complex* values) const;
+
+	/**
+	 * Calculate value of this node and its subtree with gradient to variables.
+	 * @param vars Ids of variables in order of gradient.
+	 * @return Value and gradient of this node's subtree.
+	 */
+	Dual getDual(const std::vector<SymbolTable::Id>& vars) const;
+
 	/**
 	 * Create node by its name in the given equation
 	 * @param name Name of node to be created.
@@ -358,26 +483,10 @@ public:
 	 */
 	static bool createNodeByName(std::string name, Equation& eqn);
 
-	/**
-	 * Return shared_ptr for this Node object.
-	 * If none exists, create one.
-	 * @return Shared pointer for this Node object
-	 */
-	std::shared_ptr<Node> getSharedPtr()
-	{
-		std::shared_ptr<Node> sp;
-		try {
-			sp = this->shared_from_this();
-		}
-		catch (std::exception& ex) {
-			sp = std::shared_ptr<Node>(this);
-		}
-		return sp;
-	}
-
 	friend class FactorIterator;
 protected:
 	Equation& m_eqn;   ///< Equation object associated with this node.
+	const Kind m_kind; ///< Final class of this node.
 
 private:
 	/** @name Virtual Private Member Functions */
@@ -412,14 +521,14 @@ private:
 
 	/**
 	 * Calculate frame of this node's subtree in graphics context.
-	 * Frame includes size and vertical offset.
+	 * Frame includes size and vertical offset. Children are already sized.
 	 * @param gc Graphics context.
 	 * @return Return frame of this subtree.
 	 */
 	virtual Frame calcSize(UI::Graphics& gc)=0;
 
 	/**
-	 * Calculate origin of the nodes in the subtree relative to point x,y.
+	 * Set origin of the children of this node relative to point x,y.
 	 * @param gc Graphics context.
 	 * @param x  Horizontal origin.
 	 * @param y  Vertical origin.
@@ -427,32 +536,81 @@ private:
 	virtual void calcOrig(UI::Graphics& gc, int x, int y)=0;
 
 	/**
-	 * Draw subtree in this graphics context.
+	 * Draw this node without its children in this graphics context.
+	 * Children are drawn after their parent by draw.
 	 * @param gc Graphics context.
 	 */
 	virtual void drawNode(UI::Graphics& gc) const=0;
 
 	/**
 	 * Get value of this node's subtree.
+	 * Children are evaluated first by getValue, which passes in their values.
+	 * @param values Values of children in order, none for a differential.
 	 * @return Subtree value.
 	 */
-	virtual Complex getNodeValue() const=0;
+	virtual Complex getNodeValue(const Complex* values) const=0;
+
+	/**
+	 * Get value of this node's subtree with gradient to variables.
+	 * Children are evaluated first by getDual, which passes in their duals.
+	 * @param vars Ids of variables in order of gradient.
+	 * @param duals Values and gradients of children in order. The child
+	 *              of a differential is its derivative.
+	 * @return Subtree value and gradient.
+	 */
+	virtual Dual getNodeDual(const std::vector<SymbolTable::Id>& vars, const Dual* duals) const=0;
+
+	/**
+	 * Prepare this node to be normalized before its children are.
+	 * Default function does nothing.
+	 */
+	virtual void beginNormalize() {}
+
+	/**
+	 * Put this node to a standard algebraic form after its children are.
+	 * Default function does nothing which is correct for leaf node.
+	 */
+	virtual void normalizeNode() {}
+
+	/**
+	 * Prepare this node to be simplified before its children are.
+	 * Default function returns false so children are not simplified.
+	 * @return True, if children are to be simplified.
+	 */
+	virtual bool beginSimplify() { return false; }
+
+	/**
+	 * Simplify this node after its children are.
+	 * Default function returns false which is correct for leaf node.
+	 * @return True, if this node was changed.
+	 */
+	virtual bool simplifyNode() { return false; }
 
 	/**
-	 * Stream subtree to XML stream.
+	 * Stream rest of header of this node to XML stream.
+	 * Children and footer are streamed by out.
 	 * @param xml XML stream.
 	 */
 	virtual void xml_out(XML::Stream& xml) const=0;
 	//@}
 
 	/**
-	 * Recursively calculate the depth of this node.
-	 * @param depth Current calculated depth.
-	 * @return Return depth of this node.
+	 * Calculate frame of this node from the frames of its children.
+	 * @param gc Graphics context.
 	 */
-	int getDepth(int depth) const {
-		return (!m_parent) ? depth : m_parent->getDepth(++depth);
-	}
+	void sizeNode(UI::Graphics& gc);
+
+	/**
+	 * Set origin of the children of this node from its own origin.
+	 * @param gc Graphics context.
+	 */
+	void placeChildren(UI::Graphics& gc);
+
+	/**
+	 * Draw parenthesis, sign and power of this node, then the node itself.
+	 * @param gc Graphics context.
+	 */
+	void drawOwn(UI::Graphics& gc) const;
 
 	Node* m_parent;    ///< Parent node of this node. Can be null if root.
 	bool m_sign;       ///< True if positve.
@@ -460,6 +618,7 @@ private:
 	Frame m_frame;     ///< Frame of this node includes enclosing rect and vertical offset.
 	Box m_parenthesis; ///< Rectangle that contains paranthesis of this node.
 	int m_nth = 1;     ///< Integer power of ths node.
+	int m_index = -1;  ///< Position of this node in vector of its parent.
 	bool m_fDrawParenthesis = false; ///< If true, draw paranthesis around this node.
 };
 
@@ -476,23 +635,14 @@ public:
 	 * @param p Parser object.
 	 * @param parent Parent node.
 	 */
-    Term(Parser& p, Expression* parent) : Node(p, (Node*) parent) { while(add(p)); }
-
-	/**
-	 * XML constructor for Term class.
-	 * Read in XML for Term class.
-	 * @param in XML input stream.
-	 * @param eqn Equation associated with this node.
-	 * @param parent Parent node object.	 
-	 */
-	Term(XML::Parser& in, Equation& eqn, Node* parent);
+	Term(Parser& p, Expression* parent);
 
 	/**
 	 * Constructor for Term class loading in factors from a node vector.
 	 * @param f Factors to be loaded into new Term object.
 	 * @param parent Parent expresion.
 	 */
-    Term(NodeVector& f, Equation& eqn, Expression* parent) : Node(eqn, (Node*) parent) { factors.swap(f); }
+    Term(NodeVector& f, Equation& eqn, Expression* parent) : Node(type, eqn, (Node*) parent) { factors.swap(f); }
 	
  	/**
 	 * Constructor for Term class.
@@ -502,7 +652,7 @@ public:
 	 * @param fNeg If true, node is negative.
 	 */
     Term(Node* node, Equation& eqn, Expression* parent, bool fNeg = false) : 
-	    Node(eqn, (Node*) parent, fNeg), factors(node) 
+	    Node(type, eqn, (Node*) parent, fNeg), factors(node) 
 	{
 		node->setParent(this);
 	}
@@ -513,14 +663,6 @@ public:
 	~Term() {}
 	//@}
 	
-	/**
-	 * Static helper function to parse Term class.
-	 * @param p Parser object pointing to operator.
-	 * @param parent Parent node.
-	 * @return Number object or null if number not present.
-	 */
-	static Node* parse(Parser& p, Node* parent = nullptr);
-
 	/** @name Virtual Public Member Functions */
 	//@{
 	/**
@@ -556,35 +698,16 @@ public:
 	 */
 	int numFactors() const;
 
-	/**
-	 * Refactor subtree to a standard form.
-	 * For Term class, reorder factors in a standard order
-	 * and combine common factors.
-	 * 2cb(3a)^4 normalized to 162bc(a^4)
-	 */
-	void normalize();
-
-	/**
-	 * Attempt to algebraically simplify the subtree this node is the root.
-	 * @return True, if subtree was changed.
-	 */
-	bool simplify();
-
 	/**
 	 * Get name of this class.
 	 * @return Name of this class.
 	 */
 	const std::string& getName() const { return name; }
 
-	/**
-	 * Get name of this class.
-	 * @return Name of this class.
-	 */
-	std::type_index getType() const { return type; }
 	//@}
 	
 	static const std::string name;     ///< Name of Term class.
-	static const std::type_index type; ///< Type of Term class.
+	static constexpr Kind type = TERM; ///< Type of Term class.
 
 	/**
 	 * Helper function to take factors from a term and insert into this term.
@@ -653,16 +776,15 @@ public:
 	void multiply(TermPtr old_term);
 
 	/**
-	 * Return shared_ptr for this Term object.
-	 * Downcast it from base Node shared pointer.
-	 * @return Shared pointer for this Term object
+	 * Replace a run of factors with the factors of another term.
+	 * @param index Index of first factor to be replaced.
+	 * @param count Number of factors to be replaced.
+	 * @param new_term Term object with factors to be transferred.
 	 */
-	std::shared_ptr<Term> getSharedPtr()
-	{
-		return std::dynamic_pointer_cast<Term>(this->Node::getSharedPtr());
-	}
+	void replace(int index, int count, TermPtr new_term);
 
 	friend class FactorIterator;
+	friend class Parser;
 private:
 	NodeVector factors; ///< Term owns this tree
 	Box m_internal;     ///< Bounding box of this node.
@@ -699,10 +821,39 @@ private:
 	Node* getRightSibling(Node* node);
 
 	/**
-	 * Get value of this subtree.
+	 * Get value of this subtree from the values of its children.
+	 * @param values Values of children in order.
 	 * @return Complex value of this subtree.
 	 */
-	Complex getNodeValue() const;
+	Complex getNodeValue(const Complex* values) const;
+
+	/**
+	 * Get value of this subtree with gradient to variables.
+	 * @param vars Ids of variables in order of gradient.
+	 * @param duals Values and gradients of children in order.
+	 * @return Value and gradient of this subtree.
+	 */
+	Dual getNodeDual(const std::vector<SymbolTable::Id>& vars, const Dual* duals) const;
+
+	/**
+	 * Raise factors to the power of this term before they are simplified.
+	 * @return True, so factors are simplified.
+	 */
+	bool beginSimplify();
+
+	/**
+	 * Refactor to a standard form after factors are normalized.
+	 * For Term class, reorder factors in a standard order
+	 * and combine common factors.
+	 * 2cb(3a)^4 normalized to 162bc(a^4)
+	 */
+	void normalizeNode();
+
+	/**
+	 * Combine numbers and common factors after factors are simplified.
+	 * @return True, if term was changed.
+	 */
+	bool simplifyNode();
 
 	/**
 	 * Output XML of this node.
@@ -731,12 +882,6 @@ private:
 	 */
 	void drawNode(UI::Graphics& gc) const;
 	//@}
-	
-	/**
-	 * Add factors to this Term object from parser.
-	 * @return True if factors were added.
-	 */
-	bool add(Parser& p);
 };
 
 /**
@@ -749,26 +894,13 @@ class Expression : public Node
 public:
 	/** @name Constructor and Virtual Destructor */
 	//@{
-	 /**
-	  * XML constructor for Expression class.
-	  * Read in XML for Expression class.
-	  * @param in XML input stream.
-	  * @param parent Parent node object.	 
-      * @param eqn Equation associated with this node.
-	  */
-	Expression(XML::Parser& in, Equation& eqn, Node* parent);
-
 	/**
 	 * Parser constructor for Expression class.
 	 * @param p Parser object.
 	 * @param eqn Equation associated with this node.
 	 * @param parent Parent node.
 	 */
-    Expression(Parser& p, Node* parent = nullptr) : Node(p, parent)
-	{
-		while(add(p));
-		setDrawParenthesis(true);
-	}
+	Expression(Parser& p, Node* parent = nullptr);
 
  	/**
 	 * Constructor for Expression class.
@@ -776,7 +908,7 @@ public:
 	 * @param eqn Equation associated with this node.
 	 * @param parent Parent expresion.
 	 */
-    Expression(Term* term, Equation& eqn, Node* parent = nullptr) : Node(eqn, parent), terms(term)
+    Expression(Term* term, Equation& eqn, Node* parent = nullptr) : Node(type, eqn, parent), terms(term)
 	{ 
 		term->setParent(this); setDrawParenthesis(true);
 	}
@@ -788,11 +920,22 @@ public:
 	 * @param parent Parent expresion.
 	 */
     Expression(Node* factor, Equation& eqn, Node* parent = nullptr) : 
-	    Node(eqn, parent), terms(new Term(factor, eqn, this))
+	    Node(type, eqn, parent), terms(new Term(factor, eqn, this))
 	{ 
 		factor->setParent(terms[0]); setDrawParenthesis(true);
 	}
 
+ 	/**
+	 * Constructor for Expression class loading in terms from a term vector.
+	 * @param t Terms to be loaded into new Expression object.
+	 * @param eqn Equation associated with this node.
+	 * @param parent Parent node.
+	 */
+    Expression(TermVector& t, Equation& eqn, Node* parent = nullptr) : Node(type, eqn, parent)
+	{
+		terms.swap(t); setParent(); setDrawParenthesis(true);
+	}
+
 	/**
 	 * Abstract base class needs virtual destructor.
 	 */
@@ -828,35 +971,16 @@ public:
 	 */
 	int numFactors() const;
 
-	/**
-	 * Refactor subtree to a standard form.
-	 * For Expression class, reorder terms in alphabetical order
-	 * and combine common terms.
-	 * ab+3ba normalized to 4ab.
-	 */
-	void normalize();
-
-	/**
-	 * Attempt to algebraically simplify the subtree this node is the root.
-	 * @return True, if subtree was changed.
-	 */
-	bool simplify();
-
 	/**
 	 * Get name of this class.
 	 * @return Name of this class.
 	 */
 	const std::string& getName() const { return name; }
 
-	/**
-	 * Get name of this class.
-	 * @return Name of this class.
-	 */
-	std::type_index getType() const { return type; }
 	//@}
 	
 	static const std::string name;     ///< Name of this class.
-	static const std::type_index type; ///< Type of this class.
+	static constexpr Kind type = EXPRESSION; ///< Type of this class.
 
 	/**
 	 * Get number of terms.
@@ -898,14 +1022,6 @@ public:
 	 */
 	static Term* getTerm(Parser& p, Expression* parent);
 
-	/**
-	 * Helper static function to parse Expression.
-	 * @param p Parser object.
-	 * @param parent Parent expression.
-	 * @return Created Expression object.
-	 */
-	static Node* parse(Parser& p, Node* parent);
-
 	/**
 	 * Add a Number to expression.
 	 * @param n Numeric value to be added.
@@ -919,7 +1035,22 @@ public:
 	 */
 	void add(ExpressionPtr old_expr);
 
+	/**
+	 * Replace all terms with the terms from Expression object.
+	 * @param new_expr Expression object with terms to be transferred.
+	 */
+	void replace(ExpressionPtr new_expr);
+
+	/**
+	 * Draw the sign in front of a term of this expression.
+	 * The sign of the first term is only drawn if it is negative.
+	 * @param gc Graphics context.
+	 * @param term Term of this expression.
+	 */
+	void drawSign(UI::Graphics& gc, const Node* term) const;
+
 	friend class FactorIterator;
+	friend class Parser;
 private:
 	TermVector terms; ///< Expression owns this tree a list of terms.
 	Box m_internal;   ///< Bounding box of this node.
@@ -981,18 +1112,39 @@ private:
 	void drawNode(UI::Graphics& gc) const;
 
 	/**
-	 * Get value of this subtree.
+	 * Get value of this subtree from the values of its children.
+	 * @param values Values of children in order.
 	 * @return Complex value of this subtree.
 	 */
-	Complex getNodeValue() const;
-	//@}
-	
+	Complex getNodeValue(const Complex* values) const;
+
 	/**
-	 * Add terms to expression from parser.
-	 * @param p Parser object.
-	 * @return True, if term was added.
+	 * Get value of this subtree with gradient to variables.
+	 * @param vars Ids of variables in order of gradient.
+	 * @param duals Values and gradients of children in order.
+	 * @return Value and gradient of this subtree.
+	 */
+	Dual getNodeDual(const std::vector<SymbolTable::Id>& vars, const Dual* duals) const;
+
+	/**
+	 * Nothing to prepare before terms are simplified.
+	 * @return True, so terms are simplified.
+	 */
+	bool beginSimplify() { return true; }
+
+	/**
+	 * Refactor to a standard form after terms are normalized.
+	 * For Expression class, reorder terms in alphabetical order.
+	 */
+	void normalizeNode();
+
+	/**
+	 * Combine numbers and common terms after terms are simplified.
+	 * ab+3ab simplified to 4ab.
+	 * @return True, if expression was changed.
 	 */
-	bool add(Parser& p);
+	bool simplifyNode();
+	//@}
 };
 
 /**
@@ -1317,6 +1469,41 @@ public:
 	static void swap(FactorIterator& a, FactorIterator& b);
 };
 
+/**
+ * First error found while parsing the text of an equation.
+ */
+struct ParseError
+{
+	/**
+	 * Kinds of errors.
+	 */
+	enum Code {
+		NONE,       ///< No error.
+		UNEXPECTED, ///< Character that cannot start a factor or follow a term.
+		OPERAND,    ///< Division or power without its second operand.
+		VARIABLE,   ///< Differential without name of variable.
+		EXPRESSION, ///< Differential without expression in parenthesis.
+		OPEN,       ///< Open parenthesis that is not closed.
+		CLOSE,      ///< Close parenthesis that was not opened.
+		INPUT,      ///< Input that is not closed.
+		NUMBER      ///< Number too large for a double.
+	};
+
+	Code code = NONE;    ///< Kind of error.
+	size_t offset = 0;   ///< Byte offset of error in text.
+	std::string message; ///< Description of error.
+
+	/**
+	 * Throw error as logic_error with its offset, if there is one.
+	 */
+	void check() const
+	{
+		if (code != NONE) throw std::logic_error(message + " at " + std::to_string(offset));
+	}
+};
+
+class ParseResult;
+
 /**
  * Holds the node tree that represents a mathematical equation. It also
  * provides an interface for manipulating the nodes to algebraically 
@@ -1329,9 +1516,18 @@ public:
 	//@{
 	/**
 	 * Constructor to load an equation represented by string such as 'a+b/c'.
-	 * @param eq String containing equation to be created.
+	 * The text is parsed in place without a copy.
+	 * Throws logic_error with first error in text.
+	 * @param eq Text containing equation to be created.
+	 */
+	Equation(std::string_view eq);
+
+	/**
+	 * Parse text of an equation without throwing for errors in the text.
+	 * @param eq Text containing equation to be created.
+	 * @return Equation or first error in text.
 	 */
-	Equation(const std::string& eq);
+	static ParseResult parse(std::string_view eq);
 
 	/**
 	 * Constructor to load equation from xml
@@ -1539,6 +1735,69 @@ public:
 	 */
 	void normalize() { m_root->normalize(); }
 
+	/**
+	 * Rewrite equation with rules until no more rules match.
+	 * @param rules Compiled set of rewrite rules.
+	 * @return True, if equation was changed.
+	 */
+	bool rewrite(const RuleSet& rules);
+
+	/**
+	 * Simplify equation by equality saturation with rules.
+	 * Every form the rules reach is kept in an e-graph and the cheapest is extracted.
+	 * @param rules Set of rewrite rules.
+	 * @param cost Name of cost model in EGraph::cost_models.
+	 * @param seconds Time limit of saturation, no limit if 0.
+	 * @return True, if equation was changed.
+	 */
+	bool saturate(const RuleSet& rules, const std::string& cost = "size", double seconds = 0);
+
+	/**
+	 * Replace equation with its derivative to a variable.
+	 * The derivative shares subexpressions with the equation in an e-graph
+	 * and is simplified there by the rules before it is extracted.
+	 * @param var Name of variable.
+	 * @param rules Set of rewrite rules used to simplify derivative.
+	 * @param cost Name of cost model in EGraph::cost_models.
+	 * @return True, if equation was changed.
+	 */
+	bool derivative(const std::string& var, const RuleSet& rules, const std::string& cost = "size");
+
+	/**
+	 * Replace every differential in equation with the derivative of its function.
+	 * @param rules Set of rewrite rules used to simplify derivatives.
+	 * @param cost Name of cost model in EGraph::cost_models.
+	 * @return True, if equation was changed.
+	 */
+	bool differentiate(const RuleSet& rules, const std::string& cost = "size");
+
+	/**
+	 * Calculate value of equation with its gradient in one pass.
+	 * @param vars Ids of variables in order of gradient.
+	 * @return Value and gradient of equation.
+	 */
+	Dual getDual(const std::vector<SymbolTable::Id>& vars) const { return m_root->getDual(vars); }
+
+	/**
+	 * Expand equation into a sum of monomials.
+	 * Factors that are not polynomial, such as functions, are kept as they are.
+	 * @return True, if equation was changed.
+	 */
+	bool expand();
+
+	/**
+	 * Expand equation and collect its terms by powers of a variable.
+	 * @param var Name of variable.
+	 * @return True, if equation was changed.
+	 */
+	bool collect(const std::string& var);
+
+	/**
+	 * Evaluate equation as a polynomial in Horner form.
+	 * @return Value of equation.
+	 */
+	Complex evaluate();
+
 	/**
 	 * Get left most node of equation.
 	 */
@@ -1560,7 +1819,7 @@ public:
                          On exit points to factor after last factor inserted.
 	 * @param text String to get parsed factors.
 	 */
-	void insert(FactorIterator& it, const std::string& text);
+	void insert(FactorIterator& it, std::string_view text);
 
 	Node* getRoot() { return m_root; }
 
@@ -1568,12 +1827,26 @@ public:
 
 	Node* getSelectEnd() { return m_selectEnd; }
 private:
+	friend class Snapshot;
+
 	NodePtr m_root;                ///< Equation owns this tree.
 	std::vector<Input*> m_inputs;  ///< List of input nodes in equation.
 	int m_input_index = -1;        ///< Index of current input.
 	Node* m_selectStart = nullptr; ///< Node at start of selection.
 	Node* m_selectEnd = nullptr;   ///< Node at end of selection.
 
+	/**
+	 * Constructor for equation that is loaded later.
+	 */
+	Equation() {}
+
+	/**
+	 * Load equation from text.
+	 * @param eq Text containing equation.
+	 * @return First error in text, with code NONE if there is none.
+	 */
+	ParseError load(std::string_view eq);
+
 	/**
 	 * Helper static function that parses term in string, load factors into array.
 	 */
@@ -1592,6 +1865,60 @@ private:
 	void xml_in(XML::Parser& in);
 };
 
+/**
+ * Equation parsed from text or the error that stopped it, in the manner of
+ * std::expected.
+ */
+class ParseResult
+{
+public:
+	/**
+	 * Constructor for result with equation.
+	 * @param eqn Parsed equation.
+	 */
+	ParseResult(std::unique_ptr<Equation> eqn) : m_eqn(std::move(eqn)) {}
+
+	/**
+	 * Constructor for result with error.
+	 * @param error Error in text.
+	 */
+	ParseResult(const ParseError& error) : m_error(error) {}
+
+	/**
+	 * Check if text was parsed.
+	 * @return True, if result has equation.
+	 */
+	bool hasValue() const { return m_eqn != nullptr; }
+
+	/**
+	 * Check if text was parsed.
+	 * @return True, if result has equation.
+	 */
+	explicit operator bool() const { return hasValue(); }
+
+	/**
+	 * Get parsed equation. Result must have an equation.
+	 * @return Equation.
+	 */
+	Equation& value() { return *m_eqn; }
+
+	/**
+	 * Take ownership of parsed equation.
+	 * @return Equation or null if there was an error.
+	 */
+	std::unique_ptr<Equation> release() { return std::move(m_eqn); }
+
+	/**
+	 * Get error in text.
+	 * @return Error, with code NONE if there is an equation.
+	 */
+	const ParseError& error() const { return m_error; }
+
+private:
+	std::unique_ptr<Equation> m_eqn; ///< Parsed equation or null.
+	ParseError m_error;              ///< Error in text.
+};
+
 /**
  * Take input from keyboard and display it on screen.
  * Usually just holds a string of letters and numbers representing a term.
@@ -1652,11 +1979,6 @@ public:
 	 */
 	const std::string& getName() const { return name; }
 
-	/**
-	 * Get type of this class.
-	 * @return Type of this class.
-	 */
-	std::type_index getType() const { return type; }
 	//@}
 
 	/** @name Helper Public Member functions */
@@ -1746,7 +2068,7 @@ public:
 	static Input* parse(Parser& p, Node* parent = nullptr);
 
 	static const std::string name;     ///< Name of Input class.
-	static const std::type_index type; ///< Type of Input class.
+	static constexpr Kind type = INPUT; ///< Type of Input class.
 private:
 	int m_sn;            ///< Unique serial number of Input class.
 	std::string m_typed; ///< Stored type characters from keyboard.
@@ -1780,7 +2102,13 @@ private:
 	 * Throw an error if this is called.
 	 * @return Nothing is ever returned.
 	 */
-	Complex getNodeValue() const;
+	Complex getNodeValue(const Complex*) const;
+
+	/**
+	 * Get value of this subtree with gradient to variables.
+	 * @return Value and gradient of this subtree.
+	 */
+	Dual getNodeDual(const std::vector<SymbolTable::Id>&, const Dual*) const;
 	
 	/**
 	 * Output XML of this node.
@@ -21,10 +21,24 @@
  */
 
 #include <fstream>
+#include <iomanip>
 #include <vector>
 #include <map>
+#include <set>
 #include "milo.h"
+#include "nodes.h"
 #include "panel.h"
+#include "rewrite.h"
+#include "solve.h"
+#include "plot.h"
+#include "codegen.h"
+#include "formula.h"
+#include "eval.h"
+#include "flat.h"
+#include "snapshot.h"
+#include "display.h"
+#include "kernels.h"
+#include "corpus.h"
 
 using namespace std;
 using namespace UI;
@@ -46,60 +60,12 @@ public:
 	//@{
 
 	/**
-	 * Get height of text in lines.
-	 * @return All ASCII characters are one line in height.
-	 */
-	int getTextHeight() { return 1; }
-
-	/**
-	 * Get length of string in characters.
-	 * @return Length of string in characters.
-	 */
-	int getTextLength(const std::string& s) { return s.length(); }
-
-	/**
-	 * Length of character in ASCII is 1.
-	 * @return Return one.
-	 */
-	int getCharLength(char) { return 1; }
-
-	/**
-	 * Get width of a parenthesis in characters which is always 1.
-	 * @return Return one.
-	 */
-	int getParenthesisWidth(int) { return 1; }
-
-	/**
-	 * Get height of line in a division node which is always 1.
-	 * @return Return one.
-	 */
-	int getDivideLineHeight() { return 1; }
-
-	/**
-	 * Get height of differential in lines of text.
-	 * @return Height of differential in lines of text.
-	 */
-	int getDifferentialHeight(char) { return 3; }
-
-	/**
-	 * Get width of differential in lines of text.
-	 * @return Width of differential in lines of text.
-	 */
-	int getDifferentialWidth(char)  { return 2; }
-
-	/**
-	 * Get vertical offset of differential.
-	 * @return Vertical offset of differential in lines of text.
-	 */
-	int getDifferentialBase(char)   { return 1; }
-
-	/**
-	 * Draw differential of width x0 and height y0 with char variable name.
+	 * Draw differential of width x0 and height y0 with variable name.
 	 * @param x0 Horizontal origin of differential.
 	 * @param y0 Vertical origin of differential.
 	 * @param variable Name of variable of differential.
 	 */
-	void differential(int x0, int y0, char variable);
+	void differential(int x0, int y0, const string& variable);
 
 	/**
 	 * Draw pair of parenthesis around a node of size x_size, y_size and origin x0,y0.
@@ -125,7 +91,7 @@ public:
 	 * @param c  Character to be drawn at x0,y0.
 	 * @param color Color of line.
 	 */
-	void at(int x, int y, int c, Attributes, Color color = BLACK) { m_field[y][x] = c; m_colors[y][x] = color; }
+	void at(int x, int y, int c, Attributes, Color color = BLACK) { fit(x + 1, y); m_field[y][x] = c; m_colors[y][x] = color; }
 
 	/**
 	 * Draw a string at x,y with a color.
@@ -159,6 +125,60 @@ public:
 		}
 	}
 	//@}
+protected:
+	/** @name Virtual Measuring Functions */
+	//@{
+	/**
+	 * Measure height of text in lines.
+	 * @return All ASCII characters are one line in height.
+	 */
+	int measureTextHeight() { return 1; }
+
+	/**
+	 * Measure length of string in characters.
+	 * @return Length of string in characters.
+	 */
+	int measureTextLength(const std::string& s) { return s.length(); }
+
+	/**
+	 * Measure length of character, which in ASCII is 1.
+	 * @return Return one.
+	 */
+	int measureCharLength(char) { return 1; }
+
+	/**
+	 * Measure width of a parenthesis in characters which is always 1.
+	 * @return Return one.
+	 */
+	int measureParenthesisWidth(int) { return 1; }
+
+	/**
+	 * Measure height of line in a division node which is always 1.
+	 * @return Return one.
+	 */
+	int measureDivideLineHeight() { return 1; }
+
+	/**
+	 * Measure height of differential in lines of text.
+	 * @return Height of differential in lines of text.
+	 */
+	int measureDifferentialHeight(const string&) { return 3; }
+
+	/**
+	 * Measure width of differential in characters, which is the d and the
+	 * variable name, or a blank if it has none.
+	 * @param variable Variable name of differential.
+	 * @return Width of differential in characters.
+	 */
+	int measureDifferentialWidth(const string& variable) { return 1 + max<int>(variable.length(), 1); }
+
+	/**
+	 * Measure vertical offset of differential.
+	 * @return Vertical offset of differential in lines of text.
+	 */
+	int measureDifferentialBase(const string&) { return 1; }
+	//@}
+
 private:
 	vector<string> m_field;           ///< 2D text array.
 	vector< vector<Color> > m_colors; ///< 2D color array.
@@ -171,11 +191,34 @@ private:
 	 * @param y Vertical origin of line.
 	 * @param c Character to be drawn at x0,y0.
 	 */
-	void at(int x, int y, int c) { m_field[y][x] = c; m_colors[y][x] = Color::BLACK; }
+	void at(int x, int y, int c) { fit(x + 1, y); m_field[y][x] = c; m_colors[y][x] = Color::BLACK; }
+
+	/**
+	 * Grow text array so that row y and the rows above it exist and row y
+	 * is at least x characters wide.
+	 * @param x Horizontal size of row.
+	 * @param y Row to be grown.
+	 */
+	void fit(int x, int y) {
+		if ((int) m_field.size() <= y) {
+			m_field.resize(y + 1);
+			m_colors.resize(y + 1);
+		}
+		if ((int) m_field[y].size() < x) {
+			m_field[y].resize(x, ' ');
+			m_colors[y].resize(x, Color::BLACK);
+		}
+	}
+
+	/**
+	 * Grow text array to the size of the frame of this graphics context.
+	 */
+	void fit() { for (int i = 0; i < m_frame.height(); ++i) fit(m_frame.width(), i); }
 };
 
 void AsciiGraphics::at(int x, int y, const string& s, Attributes, Color color)
 {
+	fit(x + s.length(), y);
 	for (unsigned int n = 0; n < s.length(); ++n) { 
 		m_field[y][x + n] = s[n]; m_colors[y][x + n] = color;
 	}
@@ -183,6 +226,7 @@ void AsciiGraphics::at(int x, int y, const string& s, Attributes, Color color)
 
 void AsciiGraphics::clear_screen()
 { 
+	fit();
 	for (int i = 0; i < m_frame.height(); ++i ) {
 		for (int j = 0; j < m_frame.width(); ++j) {
 			m_field[i][j] = ' ';
@@ -193,6 +237,7 @@ void AsciiGraphics::clear_screen()
 
 void AsciiGraphics::out()
 { 
+	fit();
 	for (int i = 0; i < m_frame.height(); ++i ) {
 		for (int j = 0; j < m_frame.width(); ++j) {
 			if (m_colors[i][j]) m_os << "\033[3" + to_string(m_colors[i][j]) + "m";
@@ -222,12 +267,12 @@ void AsciiGraphics::parenthesis(int x_size, int y_size, int x0, int y0)
 	}
 }
 
-void AsciiGraphics::differential(int x0, int y0, char variable)
+void AsciiGraphics::differential(int x0, int y0, const string& variable)
 {
 	m_field[y0][x0+1] = 'd';
-	m_field[y0+1][x0+1] = '-';
+	for (int i = 0; i < max<int>(variable.length(), 1); ++i) m_field[y0+1][x0+1+i] = '-';
 	m_field[y0+2][x0] = 'd';
-	m_field[y0+2][x0+ 1] = variable;
+	for (size_t i = 0; i < variable.length(); ++i) m_field[y0+2][x0+1+i] = variable[i];
 }
 
 /**
@@ -265,6 +310,18 @@ static void parse(const string& eqn_str)
 	panel.newEqn(eqn_str);
 }
 
+/**
+ * Parse equation from first line of file, for equations too long for an argument.
+ * @param fname Name of file with equation.
+ */
+static void load(const string& fname)
+{
+	ifstream is(fname);
+	string eqn_str;
+	getline(is, eqn_str);
+	panel.newEqn(eqn_str);
+}
+
 /**
  * Load filename with xml version of equation
  * @param fname Name of file with xml
@@ -276,6 +333,48 @@ static void xml_in(const string& fname)
 	panel.newEqn(in);
 }
 
+/** Parse every line of a file of equations in place.
+ * Outputs number of equations and factors, then last equation.
+ * @param fname Name of file with one equation on each line.
+ */
+static void corpus(const string& fname)
+{
+	Corpus corpus(fname);
+	size_t equations = 0, factors = 0;
+	string last;
+	for ( auto line : corpus ) {
+		Equation eqn(line);
+		++equations;
+		factors += eqn.getRoot()->numFactors();
+		last = eqn.toString();
+	}
+	cout << "equations " << equations << endl;
+	cout << "factors " << factors << endl;
+	cout << last << endl;
+}
+
+/** Check every line of a file of equations without exceptions for errors.
+ * Outputs line number, offset and description of each error, then number
+ * of valid and invalid lines.
+ * @param fname Name of file with one equation on each line.
+ */
+static void lint(const string& fname)
+{
+	Corpus corpus(fname);
+	size_t line = 0, valid = 0, invalid = 0;
+	for ( auto text : corpus ) {
+		++line;
+		ParseResult result = Equation::parse(text);
+		if (result) {
+			++valid;
+			continue;
+		}
+		++invalid;
+		cout << "line " << line << " offset " << result.error().offset << ": " << result.error().message << endl;
+	}
+	cout << "valid " << valid << " invalid " << invalid << endl;
+}
+
 /** Output current equation in xml to standard output.
  */
 static void xml_out(const string&)
@@ -326,6 +425,33 @@ static void art(const string&)
 	AsciiApp::gc->out();
 }
 
+/** Record drawing of current equation, output its commands and replay it as ascii art.
+ */
+static void display(const string&)
+{
+	Equation& eqn = panel.getEqn();
+	Graphics& gc = *AsciiApp::gc;
+
+	DisplayList list(gc);
+	eqn.draw(list);
+	list.write(cout);
+	DisplayList again(gc);
+	eqn.draw(again);
+	cout << "display " << list.size() << " commands " << (list == again ? "same" : "different") << endl;
+
+	gc.set(list.getBox());
+	list.replay(gc);
+	gc.out();
+}
+
+/** Output number of text metrics asked for and measured by ascii graphics.
+ */
+static void metrics(const string&)
+{
+	cout << "metrics requested " << AsciiApp::gc->getMetricRequests()
+	     << " measured " << AsciiApp::gc->getMetricMisses() << endl;
+}
+
 /** Normalize current equation.
  */
 static void normalize(const string&)
@@ -340,6 +466,356 @@ static void simplify(const string&)
 	panel.getEqn().simplify();
 }
 
+/** Rewrite current equation with rules from file.
+ */
+static void rules(const string& fname)
+{
+	ifstream is(fname);
+	if (!is) throw logic_error("cannot open rule file " + fname);
+	RuleSet rules(is);
+	panel.getEqn().rewrite(rules);
+}
+
+/** Simplify current equation by equality saturation.
+ * Parameters are rule file, optional name of cost model and optional time
+ * limit in seconds.
+ */
+static void saturate(const string& params)
+{
+	StringVector args = split(',', params);
+	if (args.empty() || args.size() > 3) throw logic_error("--saturate needs rule file, cost model and time limit");
+	ifstream is(args[0]);
+	if (!is) throw logic_error("cannot open rule file " + args[0]);
+	RuleSet rules(is);
+	panel.getEqn().saturate(rules, args.size() >= 2 ? args[1] : "size", args.size() == 3 ? stod(args[2]) : 0);
+}
+
+/** Expand current equation into sum of monomials.
+ */
+static void expand(const string&)
+{
+	panel.getEqn().expand();
+}
+
+/** Collect current equation by powers of variable.
+ */
+static void collect(const string& var)
+{
+	if (var.empty()) throw logic_error("--collect needs a variable name");
+	panel.getEqn().collect(var);
+}
+
+/** Set values of variables given as name=value pairs.
+ */
+static void set_values(const string& params)
+{
+	for ( auto& pair : split(',', params) ) {
+		auto sep = pair.find('=');
+		if (sep == 0 || sep == string::npos) throw logic_error("--set needs name=value pairs");
+		Variable::setRealValue(pair.substr(0, sep), stod(pair.substr(sep + 1)));
+	}
+}
+
+/** Output value of current equation evaluated in Horner form.
+ */
+static void value(const string&)
+{
+	Complex z = panel.getEqn().evaluate();
+	cout << z.real() << " " << z.imag() << endl;
+}
+
+/** Split names of variables written one after another, such as xy or x_1y.
+ * @param text Names of variables.
+ * @return Name of each variable.
+ */
+static StringVector variable_names(const string& text)
+{
+	StringVector names;
+	for (size_t i = 0; i < text.length(); ) {
+		if (!isalpha(text[i])) throw logic_error("bad variable name in " + text);
+		size_t n = 1;
+		if (text[i + 1] == '_' && isdigit(text[i + 2])) {
+			for (n = 2; isdigit(text[i + n]); ++n) {}
+		}
+		names.push_back(text.substr(i, n));
+		i += n;
+	}
+	return names;
+}
+
+/** Output value of current equation and its partial derivative to each variable.
+ */
+static void gradient(const string& params)
+{
+	StringVector names = variable_names(params);
+	vector<SymbolTable::Id> vars;
+	for ( auto& name : names ) vars.push_back(SymbolTable::global().find(name));
+	Dual z = panel.getEqn().getDual(vars);
+	cout << z.getValue().real() << " " << z.getValue().imag() << endl;
+	for (size_t i = 0; i < names.size(); ++i) {
+		cout << names[i] << " " << z.getPartial(i).real() << " " << z.getPartial(i).imag() << endl;
+	}
+}
+
+/** Replace current equation with its derivative.
+ * Parameters are variable name and optional rule file to simplify with.
+ */
+static void derivative(const string& params)
+{
+	StringVector args = split(',', params);
+	if (args.empty() || args.size() > 2 || args[0].empty()) throw logic_error("--derivative needs variable and rule file");
+	RuleSet rules;
+	if (args.size() == 2) {
+		ifstream is(args[1]);
+		if (!is) throw logic_error("cannot open rule file " + args[1]);
+		rules.load(is);
+	}
+	panel.getEqn().derivative(args[0], rules);
+}
+
+/** Replace differentials in current equation with derivatives.
+ */
+static void differentiate(const string&)
+{
+	panel.getEqn().differentiate(RuleSet());
+}
+
+/** Output roots of an equality for a variable.
+ * Parameters are equality and variable name.
+ */
+static void solve(const string& params)
+{
+	StringVector args = split(',', params);
+	if (args.size() != 2 || args[1].empty()) throw logic_error("--solve needs equality and variable");
+	auto sep = args[0].find('=');
+	if (sep == string::npos) throw logic_error("--solve needs equality");
+	Equation left(args[0].substr(0, sep)), right(args[0].substr(sep + 1));
+	Solver solver(left.getRoot(), right.getRoot(), args[1]);
+	for ( auto z : solver.solve() ) cout << args[1] << "=" << Solver::toString(z) << endl;
+}
+
+/** Draw plot of current equation and output number of new samples.
+ * Parameters are start and end of range, columns and rows. Samples are kept
+ * while the equation does not change.
+ */
+static void plot(const string& params)
+{
+	static unique_ptr<Plot> plot;
+	static string plotted;
+
+	StringVector args = split(',', params);
+	if (args.size() != 4) throw logic_error("--plot needs range, columns and rows");
+	Equation& eqn = panel.getEqn();
+	if (!plot || eqn.toString() != plotted) {
+		Node* root = eqn.getRoot();
+		plot.reset(new Plot(root, Solver::findVariable(root, root)));
+		plotted = eqn.toString();
+	}
+	plot->setRange(stod(args[0]), stod(args[1]));
+	size_t evaluated = plot->numEvaluated();
+	plot->sample(stoi(args[2]), stoi(args[3]));
+	AsciiApp::gc->set(plot->getSize().width(), plot->getSize().height(), 0, 0);
+	AsciiApp::gc->clear_screen();
+	plot->draw(*AsciiApp::gc);
+	AsciiApp::gc->out();
+	cout << "samples " << plot->numEvaluated() - evaluated << endl;
+}
+
+/** Output current equation as C++ function.
+ * Parameters are name of function and optional "real" for a function over double.
+ */
+static void codegen(const string& params)
+{
+	StringVector args = split(',', params);
+	if (args.empty() || args.size() > 2 || (args.size() == 2 && args[1] != "real")) {
+		throw logic_error("--codegen needs function name and optional real");
+	}
+	cout << CodeGenerator(panel.getEqn(), args.size() == 1).function(args[0]);
+}
+
+/** Output value of current equation in each precision.
+ * Real types are only used if the equation is real.
+ */
+static void evaluate(const string&)
+{
+	Evaluator eval(panel.getEqn().getRoot());
+	vector<Complex> values;
+	for ( auto id : eval.getVariables() ) values.push_back(SymbolTable::global().getValue(id));
+
+	cout << (eval.isReal() ? "real" : "complex") << endl;
+	cout << setprecision(9);
+	if (eval.isReal()) {
+		vector<float> floats;
+		vector<double> doubles;
+		vector<long double> longs;
+		for ( auto z : values ) {
+			floats.push_back(z.real());
+			doubles.push_back(z.real());
+			longs.push_back(z.real());
+		}
+		cout << "float " << eval.evaluate(floats.data()) << endl;
+		cout << "double " << eval.evaluate(doubles.data()) << endl;
+		cout << "long double " << eval.evaluate(longs.data()) << endl;
+	}
+	vector<complex<float>> floats(values.begin(), values.end());
+	vector<complex<long double>> longs(values.begin(), values.end());
+	cout << "complex float " << eval.evaluate(floats.data()) << endl;
+	cout << "complex double " << eval.evaluate(values.data()) << endl;
+	cout << "complex long double " << eval.evaluate(longs.data()) << endl;
+	cout << setprecision(6);
+}
+
+/** Output value of formula literal and value of same text from runtime parser.
+ * @param f Formula literal.
+ */
+template <class F>
+static void formulaCase(F f)
+{
+	Complex z = f.template evaluate<Complex>([](const string& name) { return Variable::findValue(name); });
+	Complex runtime = Equation(f.text()).getRoot()->getValue();
+	cout << f.text() << " " << z.real() << " " << z.imag() << endl;
+	if (!(abs(z - runtime) <= 1e-12*(1 + abs(runtime)))) {
+		cout << "runtime " << runtime.real() << " " << runtime.imag() << endl;
+	}
+}
+
+/** Output snapshot of current equation in arrays, one node on each line.
+ * Parameter is tree, or derive to give differentials derivatives as children.
+ */
+static void flat(const string& params)
+{
+	if (params != "tree" && params != "derive") throw logic_error("--flat needs tree or derive");
+	FlatEquation(panel.getEqn().getRoot(), params == "derive").write(cout);
+}
+
+static Snapshot::Pool snapshot_pool;   ///< Nodes shared by snapshots.
+static vector<Snapshot> snapshots;      ///< Snapshots taken by --snapshot.
+
+/** Collect distinct nodes of snapshot.
+ * @param node Root of subtree.
+ * @param[out] nodes Nodes of subtree.
+ */
+static void collect(const PersistentNode* node, set<const PersistentNode*>& nodes)
+{
+	vector<const PersistentNode*> stack = { node };
+	while (!stack.empty()) {
+		node = stack.back();
+		stack.pop_back();
+		if (!nodes.insert(node).second) continue;
+		for ( auto& kid : node->getChildren() ) stack.push_back(kid.get());
+	}
+}
+
+/** Take snapshot of current equation.
+ * Output number of distinct nodes in snapshot and in all snapshots, which
+ * only grows by the nodes that changed.
+ */
+static void snapshot(const string&)
+{
+	snapshots.push_back(panel.snapshot(snapshot_pool));
+	set<const PersistentNode*> last, all;
+	collect(snapshots.back().getRoot().get(), last);
+	for ( auto& s : snapshots ) collect(s.getRoot().get(), all);
+	cout << "snapshot " << snapshots.size() - 1 << " nodes " << last.size() << " in all " << all.size() << endl;
+}
+
+/** Replace current equation with snapshot.
+ * @param n Number of snapshot.
+ */
+static void restore(const string& n)
+{
+	panel.newEqn(snapshots.at(stoi(n)));
+}
+
+/** Output values of formula literals parsed at compile time.
+ * Values of variables are set by --set. The runtime value of a formula is
+ * only output when it differs, so both parsers share these grammar tests.
+ */
+static void formula(const string&)
+{
+	formulaCase(MILO_FORMULA("x^2+3x-1"));
+	formulaCase(MILO_FORMULA("-x+2y"));
+	formulaCase(MILO_FORMULA("+2(x+1)(y-1)"));
+	formulaCase(MILO_FORMULA("x/y/2"));
+	formulaCase(MILO_FORMULA("x^2^y"));
+	formulaCase(MILO_FORMULA("x^(-3)+x^y"));
+	formulaCase(MILO_FORMULA("sin(x)^2+cos(x)^2"));
+	formulaCase(MILO_FORMULA("tan(x/2)-log(y^2)"));
+	formulaCase(MILO_FORMULA("exp(iPx)"));
+	formulaCase(MILO_FORMULA("log(-x)"));
+	formulaCase(MILO_FORMULA("e^x-2e"));
+	formulaCase(MILO_FORMULA("1.5E2x+2.5e-1"));
+	formulaCase(MILO_FORMULA("3.25xy-0.1"));
+	formulaCase(MILO_FORMULA("x-(y-(x-y))"));
+	formulaCase(MILO_FORMULA("1/(x^2+1)"));
+	formulaCase(MILO_FORMULA("ixPy"));
+	formulaCase(MILO_FORMULA("x_1^2+3x_12y-e_1+x_1e"));
+
+	auto f = MILO_FORMULA("x_1^2+y");
+	cout << f.text() << " bound " << f(Formula::bind<Formula::name("x_1")>(3.0), Formula::bind<'y'>(0.5)) << endl;
+}
+
+/** Random number generator for tests that must give the same output everywhere.
+ * @param seed State of generator.
+ * @param lo Lowest value.
+ * @param hi Highest value.
+ * @return Value between lo and hi.
+ */
+static double random(uint64_t& seed, double lo, double hi)
+{
+	seed = seed*6364136223846793005ull + 1442695040888963407ull;
+	return lo + (hi - lo)*((seed >> 11)*(1.0/9007199254740992.0));
+}
+
+/** Compare batch function kernels of every supported instruction set with
+ * scalar functions, then batch evaluation of current equation with evaluation
+ * one point at a time. Output is the same on every processor unless a kernel
+ * is not accurate.
+ */
+static void kernels(const string&)
+{
+	const double tol = 1e-13;
+	uint64_t seed = 1;
+	vector<Complex> args = { Complex(0, 0), Complex(-2, 0), Complex(-2, -0.0),
+	                         Complex(0, -3), Complex(1e-310, 0), Complex(2e5, 1),
+	                         Complex(1, 800), Complex(710, 1) };
+	for (int i = 0; i < 1000; ++i) args.emplace_back(random(seed, -50, 50), random(seed, -5, 5));
+
+	vector<Complex> values(args.size());
+	for (int f = Kernels::SIN; f <= Kernels::EXP; ++f) {
+		auto func = (Kernels::Func) f;
+		bool fOk = true;
+		for (int isa = Kernels::SCALAR; isa <= Kernels::AVX2; ++isa) {
+			if (!Kernels::isSupported((Kernels::Isa) isa)) continue;
+			Kernels::apply(func, args.data(), values.data(), args.size(), (Kernels::Isa) isa);
+			for (size_t i = 0; i < args.size(); ++i) {
+				Complex ref = Kernels::scalar(func, args[i]);
+				if (values[i] != ref && !(abs(values[i] - ref) <= tol*max(abs(ref), 1.0))) {
+					cout << Kernels::getName((Kernels::Isa) isa) << " error at " << args[i]
+					     << " " << values[i] << " " << ref << endl;
+					fOk = false;
+				}
+			}
+		}
+		if (fOk) cout << vector<string>{ "sin", "cos", "tan", "log", "exp" }[f] << " ok" << endl;
+	}
+
+	Evaluator eval(panel.getEqn().getRoot());
+	size_t width = eval.getVariables().size(), n = 100;
+	vector<Complex> points(n*width), results(n);
+	for ( auto& z : points ) z = Complex(random(seed, -3, 3), random(seed, -1, 1));
+	eval.evaluate(n, points.data(), results.data());
+	bool fOk = true;
+	for (size_t i = 0; i < n; ++i) {
+		Complex ref = eval.evaluate(points.data() + i*width);
+		if (!(abs(results[i] - ref) <= tol*max(abs(ref), 1.0))) {
+			cout << "batch error " << results[i] << " " << ref << endl;
+			fOk = false;
+		}
+	}
+	if (fOk) cout << "batch ok" << endl;
+}
+
 /** Add keys as input to equation.
  */
 static void keys(const string& keys)
@@ -406,13 +882,36 @@ using func_ptr = void (*)(const string& s);
  */
 const unordered_map<string, func_ptr> test_funcs = {
 	{ "parse:",    parse     },
+	{ "load:",     load      },
 	{ "xml:",      xml_in    },
+	{ "corpus:",   corpus    },
+	{ "lint:",     lint      },
 	{ "test",      test      },
 	{ "ascii-art", art       },
+	{ "display",   display   },
+	{ "metrics",   metrics   },
 	{ "eqn-out",   eqn_out   },
 	{ "xml-out",   xml_out   },
 	{ "normalize", normalize },
 	{ "simplify",  simplify  },
+	{ "rules:",    rules     },
+	{ "saturate:", saturate  },
+	{ "expand",    expand    },
+	{ "collect:",  collect   },
+	{ "set:",      set_values },
+	{ "value",     value     },
+	{ "evaluate",  evaluate  },
+	{ "gradient:", gradient  },
+	{ "derivative:", derivative },
+	{ "differentiate", differentiate },
+	{ "solve:", solve },
+	{ "plot:", plot },
+	{ "codegen:", codegen },
+	{ "flat:", flat },
+	{ "snapshot", snapshot },
+	{ "restore:", restore },
+	{ "formula", formula },
+	{ "kernels", kernels },
 	{ "keys:",     keys      },
 	{ "geom:",     geometry  },
 	{ "find:",     find      },
@@ -48,54 +48,6 @@ public:
 	/** @name Virtual Public Member Functions */
 	//@{
 	
-	/**
-	 * Get height of text in lines.
-	 * @return All ASCII characters are one line in height.
-	 */
-	int getTextHeight() { return 1; }
-
-	/**
-	 * Get length of string in characters.
-	 * @return Length of string in characters.
-	 */
-	int getTextLength(const std::string& s) { return s.length(); }
-
-	/**
-	 * Length of character in ASCII is 1.
-	 * @return Return one.
-	 */
-	int getCharLength(char) { return 1; }
-
-	/**
-	 * Get width of a parenthesis in characters which is always 1.
-	 * @return Return one.
-	 */
-	int getParenthesisWidth(int) { return 1; }
-
-	/**
-	 * Get height of line in a division node which is always 1.
-	 * @return Return one.
-	 */
-	int getDivideLineHeight() { return 1; }
-
-	/**
-	 * Get height of differential in lines of text.
-	 * @return Height of differential in lines of text.
-	 */
-	int getDifferentialHeight(char) { return 3; }
-
-	/**
-	 * Get width of differential in lines of text.
-	 * @return Width of differential in lines of text.
-	 */
-	int getDifferentialWidth(char)  { return 2; }
-
-	/**
-	 * Get vertical offset of differential.
-	 * @return Vertical offset of differential in lines of text.
-	 */
-	int getDifferentialBase(char)   { return 1; }
-
 	/**
 	 * Draw a character at x,y with a color.
 	 * @param x Horizontal origin of line.
@@ -169,12 +121,12 @@ public:
 	}
 
 	/**
-	 * Draw differential of width x0 and height y0 with char variable name.
+	 * Draw differential of width x0 and height y0 with variable name.
 	 * @param x0 Horizontal origin of differential.
 	 * @param y0 Vertical origin of differential.
 	 * @param variable Name of variable of differential.
 	 */
-	void differential(int x0, int y0, char variable);
+	void differential(int x0, int y0, const string& variable);
 
 	/**
 	 * Draw pair of parenthesis around a node of size x_size, y_size and origin x0,y0.
@@ -238,6 +190,60 @@ public:
 	}
 	//@}
 
+protected:
+	/** @name Virtual Measuring Functions */
+	//@{
+	/**
+	 * Measure height of text in lines.
+	 * @return All ASCII characters are one line in height.
+	 */
+	int measureTextHeight() { return 1; }
+
+	/**
+	 * Measure length of string in characters.
+	 * @return Length of string in characters.
+	 */
+	int measureTextLength(const std::string& s) { return s.length(); }
+
+	/**
+	 * Measure length of character, which in ASCII is 1.
+	 * @return Return one.
+	 */
+	int measureCharLength(char) { return 1; }
+
+	/**
+	 * Measure width of a parenthesis in characters which is always 1.
+	 * @return Return one.
+	 */
+	int measureParenthesisWidth(int) { return 1; }
+
+	/**
+	 * Measure height of line in a division node which is always 1.
+	 * @return Return one.
+	 */
+	int measureDivideLineHeight() { return 1; }
+
+	/**
+	 * Measure height of differential in lines of text.
+	 * @return Height of differential in lines of text.
+	 */
+	int measureDifferentialHeight(const string&) { return 3; }
+
+	/**
+	 * Measure width of differential in characters, which is the d and the
+	 * variable name, or a blank if it has none.
+	 * @param variable Variable name of differential.
+	 * @return Width of differential in characters.
+	 */
+	int measureDifferentialWidth(const string& variable) { return 1 + max<int>(variable.length(), 1); }
+
+	/**
+	 * Measure vertical offset of differential.
+	 * @return Vertical offset of differential in lines of text.
+	 */
+	int measureDifferentialBase(const string&) { return 1; }
+	//@}
+
 private:
     bool m_has_colors;      ///< If true, flag is screen has colors.
 	int m_xMouse;           ///< Last mouse horizontal coordinate
@@ -284,9 +290,13 @@ public:
 	 */
 	void doMouse(UI::MouseEvent& mouse);
 
-	/** Redraw ncurses screen. 
+	/**
+	 * Redraw panels on ncurses screen.
+	 * Panels whose drawing and box did not change are not drawn again,
+	 * unless the whole screen is redrawn.
+	 * @param fAll True, if screen was cleared and every panel is drawn.
 	 */
-	void redraw();
+	void redraw(bool fAll);
 };
 
 /**
@@ -332,6 +342,11 @@ public:
 	 */
 	void redraw_screen();
 
+	/**
+	 * Redraw only panels that changed, unless menus were drawn over them.
+	 */
+	void update_screen();
+
 	/**
 	 * Get new graphics object.
 	 * @return New graphics object.
@@ -392,6 +407,12 @@ public:
 private:
 	CursesGraphics m_default_graphics; // Graphics context for no panel
 	MenuBar m_menubar;   ///< menu bar
+	bool m_fClear = true; ///< True, if menus were drawn over panels.
+
+	/**
+	 * Draw message on last line of screen.
+	 */
+	void drawStatus();
 
 	/**
 	 * GUI specific virtual member function to put current window on top.
@@ -467,12 +488,12 @@ void CursesGraphics::parenthesis(int x_size, int y_size, int x0, int y0)
 	}
 }
 
-void CursesGraphics::differential(int x0, int y0, char variable)
+void CursesGraphics::differential(int x0, int y0, const string& variable)
 {
 	at(x0+1, y0, 'd');
-	at(x0+1, y0+1, '-');
+	for (int i = 0; i < max<int>(variable.length(), 1); ++i) at(x0+1+i, y0+1, '-');
 	at(x0, y0+2, 'd');
-	at(x0+1, y0+2, variable);
+	for (size_t i = 0; i < variable.length(); ++i) at(x0+1+i, y0+2, variable[i]);
 }
 
 const unordered_map<int, KeyEvent> CursesApp::key_map = {
@@ -716,7 +737,7 @@ const unordered_map<int, MouseEvent> CursesApp::mouse_event_map = {
 	{ 0x18000000, MouseEvent(Mouse::POSITION, 0, Modifiers::NO_MOD) }
 };
 
-void CursesWindow::redraw()
+void CursesWindow::redraw(bool fAll)
 {
 	int h0 = 0, w0 = 0;
 	for ( auto& p : m_panels ) {
@@ -726,6 +747,7 @@ void CursesWindow::redraw()
 	}
 	int h_max, w_max;
 	getmaxyx(stdscr, h_max, w_max);
+	--h_max; // Last line is status line
 	if (h_max - 1 > h0) {
 		h0 = (h_max - 1)/m_panels.size();
 	}
@@ -733,16 +755,36 @@ void CursesWindow::redraw()
 		h0 = -1;
 	}
 	int y0 = 1;
+	for ( auto& p : m_panels ) {
+		Box old = p->getBox();
+		Box b = p->getSize();
+		p->setBox(w_max, max(h0, b.height()), 0, y0 + 1);
+		y0 += max(h0, b.height()) + 1;
+		Box box = p->getBox();
+		if (box.x0() != old.x0() || box.y0() != old.y0() || box.width() != old.width() || box.height() != old.height()) {
+			fAll = true;
+		}
+	}
+
+	// A panel that moved leaves its old drawing behind, so all are drawn again
+	if (fAll) clear();
+	y0 = 1;
 	bool m_first = true;
 	for ( auto& p : m_panels ) {
 		if (m_first) {
 			m_first = false;
-		} else {
+		} else if (fAll) {
 			app.getGlobalGraphics().horiz_line(w_max, 0, y0);
 		}
-		Box b = p->getSize();
-		p->setBox(w_max, max(h0, b.height()), 0, y0 + 1);
-		y0 += max(h0, b.height()) + 1;
+		Box box = p->getBox();
+		y0 = box.y0() + box.height();
+		if (!fAll && !p->needsDraw()) continue;
+		if (!fAll) {
+			for (int y = box.y0(); y < box.y0() + box.height(); ++y) {
+				move(y, 0);
+				clrtoeol();
+			}
+		}
 		p->doDraw();
 	}	
 }
@@ -780,19 +822,43 @@ MouseEvent CursesApp::getMouseEvent(int code)
 void CursesApp::redraw_screen()
 {
 	clear();
-	getWindow().redraw();
+	getWindow().redraw(true);
+	m_menubar.draw();
+	drawStatus();
+	refresh();
+	m_fClear = m_menubar.active();
+}
+
+void CursesApp::update_screen()
+{
+	if (m_fClear || m_menubar.active()) {
+		redraw_screen();
+		return;
+	}
+	getWindow().redraw(false);
 	m_menubar.draw();
+	drawStatus();
 	refresh();
 }
 
+void CursesApp::drawStatus()
+{
+	int h_max, w_max;
+	getmaxyx(stdscr, h_max, w_max);
+	move(h_max - 1, 0);
+	clrtoeol();
+	addnstr(getStatus().c_str(), w_max);
+}
+
 void CursesApp::do_loop()
 {
 	while (UI::MiloApp::isRunning()) {
 		int xCursor = 0, yCursor = 0;
 		int code = 0;
-		redraw_screen();
+		update_screen();
 		if (m_menubar.active() || !hasPanel()) {
 			code = getGraphics().getChar(0, 0, false);
+			setStatus(string());
 			MouseEvent mouseEvent = getMouseEvent(code);
 			if (mouseEvent) {
 				m_menubar.handleMouse(mouseEvent);
@@ -815,6 +881,7 @@ void CursesApp::do_loop()
 		else {
 			continue;
 		}
+		setStatus(string());
 		MouseEvent mouseEvent = getMouseEvent(code);
 		if (mouseEvent) {
 			if (!m_menubar.handleMouse(mouseEvent)) {
@@ -823,6 +890,7 @@ void CursesApp::do_loop()
 		}
 		else {
 			if (code == KEY_RESIZE) {
+				for ( auto& p : getWindow() ) p->invalidate();
 				redraw_screen();
 				continue;
 			}
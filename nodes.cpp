@@ -31,15 +31,61 @@
 
 #include "milo.h"
 #include "nodes.h"
+#include "lexer.h"
 #include "ui.h"
 
 using namespace std;
 
+/* Terms of an expression follow a sign, negative factors of a term are
+ * in "(-...)" and the operator of a binary node is before its second node.
+ * The nodes between the root and the visited node are kept in a path so
+ * each node can be written in the context of its parent.
+ */
+string subtreeString(const Node* root)
+{
+	string s;
+	vector<Node*> path;
+	traverse(const_cast<Node*>(root),
+		[&s, &path](Node* node) {
+			Node* parent = path.empty() ? nullptr : path.back();
+			path.push_back(node);
+			if (parent) {
+				switch (parent->getType()) {
+					case Node::EXPRESSION:
+						s += node->getSign() ? '+' : '-';
+						break;
+					case Node::TERM:
+						if (!node->getSign()) s += "(-";
+						break;
+					case Node::DIVIDE:
+					case Node::POWER:
+						if (node == static_cast<Binary*>(parent)->getSecond()) s += static_cast<Binary*>(parent)->getOp();
+						break;
+					default:
+						break;
+				}
+			}
+			switch (node->getType()) {
+				case Node::EXPRESSION:   s += "("; return true;
+				case Node::FUNCTION:     s += static_cast<Function*>(node)->getFunction(); return true;
+				case Node::DIFFERENTIAL: s += "D/D" + static_cast<Differential*>(node)->getVariable(); return true;
+				case Node::TERM:
+				case Node::DIVIDE:
+				case Node::POWER:        return true;
+				default:                 s += node->toString(); return false;
+			}
+		},
+		[&s, &path](Node* node) {
+			path.pop_back();
+			if (node->getType() == Node::EXPRESSION) s += ")";
+			if (!path.empty() && path.back()->getType() == Node::TERM && !node->getSign()) s += ")";
+		});
+	return s;
+}
+
 
 Node::Frame Divide::calcSize(UI::Graphics& gc)
 {
-	m_first->calculateSize(gc);
-	m_second->calculateSize(gc);
 	Frame frame = { 
 		{ max(m_first->getFrame().box.width(), m_second->getFrame().box.width()),
 		  m_first->getFrame().box.height() + gc.getDivideLineHeight() + m_second->getFrame().box.height(), 
@@ -54,31 +100,30 @@ Node::Frame Divide::calcSize(UI::Graphics& gc)
 void Divide::calcOrig(UI::Graphics& gc, int x, int y)
 {
 	m_internal.setOrigin(x, y);
-	m_first->calculateOrigin(gc,  x + (m_internal.width() - m_first->getFrame().box.width())/2, 
-							      y + getFrame().base - m_first->getFrame().box.height());
-	m_second->calculateOrigin(gc, x + (m_internal.width() - m_second->getFrame().box.width())/2,
-							      y + getFrame().base + gc.getDivideLineHeight());
+	m_first->setOrigin(gc,  x + (m_internal.width() - m_first->getFrame().box.width())/2, 
+							y + getFrame().base - m_first->getFrame().box.height());
+	m_second->setOrigin(gc, x + (m_internal.width() - m_second->getFrame().box.width())/2,
+							y + getFrame().base + gc.getDivideLineHeight());
 }
 
 
 void Divide::drawNode(UI::Graphics& gc) const
 {
 	gc.horiz_line(m_internal.width(), m_internal.x0(), m_internal.y0() + getFrame().base);
-	m_first->draw(gc);
-	m_second->draw(gc);
 }
 
-Complex Divide::getNodeValue() const
+Complex Divide::getNodeValue(const Complex* values) const
+{
+	return values[0] / values[1];
+}
+
+Dual Divide::getNodeDual(const vector<SymbolTable::Id>&, const Dual* duals) const
 {
-	Complex a = m_first->getValue();
-	Complex b = m_second->getValue();
-	return a / b;
+	return duals[0] / duals[1];
 }
 
 Node::Frame Power::calcSize(UI::Graphics& gc)
 {
-	m_first->calculateSize(gc);
-	m_second->calculateSize(gc);
 	Frame frame = { 
 		{ m_first->getFrame().box.width() + m_second->getFrame().box.width(),
 		  m_first->getFrame().box.height() + 
@@ -94,23 +139,24 @@ Node::Frame Power::calcSize(UI::Graphics& gc)
 void Power::calcOrig(UI::Graphics& gc, int x, int y)
 {
 	m_internal.setOrigin(x, y);
-	m_first->calculateOrigin(gc, x, y + getFrame().base);
-	m_second->calculateOrigin(gc, x + m_first->getFrame().box.width(), 
-							      y + getFrame().base - m_second->getFrame().box.height() 
-                                    + gc.getTextHeight()/2);
+	m_first->setOrigin(gc, x, y + getFrame().base);
+	m_second->setOrigin(gc, x + m_first->getFrame().box.width(), 
+						y + getFrame().base - m_second->getFrame().box.height() 
+						+ gc.getTextHeight()/2);
 }
 
-void Power::drawNode(UI::Graphics& gc) const
+void Power::drawNode(UI::Graphics&) const
 {
-	m_first->draw(gc);
-	m_second->draw(gc);
 }
 
-Complex Power::getNodeValue() const
+Complex Power::getNodeValue(const Complex* values) const
 {
-	Complex a = m_first->getValue();
-	Complex b = m_second->getValue();
-	return pow(a, b);
+	return pow(values[0], values[1]);
+}
+
+Dual Power::getNodeDual(const vector<SymbolTable::Id>&, const Dual* duals) const
+{
+	return pow(duals[0], duals[1]);
 }
 
 Complex Function::sinZ(Complex z)
@@ -139,17 +185,41 @@ Complex Function::expZ(Complex z) {
 	return exp(z);
 }
 
-const Function::func_map Function::functions = {
-	{ "sin", &sinZ },
-	{ "cos", &cosZ },
-	{ "tan", &tanZ },
-	{ "log", &logZ },
-	{ "exp", &expZ }
-};
+// Calls and derivatives below are in the order of names in Lexer::functions.
+const Function::func_map Function::functions = []() {
+	const func_ptr calls[] = { &sinZ, &cosZ, &tanZ, &logZ, &expZ };
+	static_assert(sizeof(calls)/sizeof(calls[0]) == Lexer::num_functions, "one function for each name in lexer");
+
+	func_map m;
+	for (size_t i = 0; i < Lexer::num_functions; ++i) m.emplace(Lexer::functions[i], calls[i]);
+	return m;
+}();
+
+vector<string> Function::getFunctions()
+{
+	vector<string> names;
+	for ( auto& f : functions ) names.push_back(f.first);
+	sort(names.begin(), names.end());
+	return names;
+}
+
+const Function::func_map Function::derivatives = []() {
+	const func_ptr calls[] = {
+		[](Complex z) { return cos(z); },
+		[](Complex z) { return -sin(z); },
+		[](Complex z) { return 1.0/(cos(z)*cos(z)); },
+		[](Complex z) { return 1.0/z; },
+		[](Complex z) { return exp(z); }
+	};
+	static_assert(sizeof(calls)/sizeof(calls[0]) == Lexer::num_functions, "one derivative for each name in lexer");
+
+	func_map m;
+	for (size_t i = 0; i < Lexer::num_functions; ++i) m.emplace(Lexer::functions[i], calls[i]);
+	return m;
+}();
 
 Node::Frame Function::calcSize(UI::Graphics& gc) 
 {
-	m_arg->calculateSize(gc);
 	Frame frame = { 
 		{ gc.getTextLength(m_name) + m_arg->getFrame().box.width(),
 		  m_arg->getFrame().box.height(), 0, 0
@@ -163,31 +233,35 @@ Node::Frame Function::calcSize(UI::Graphics& gc)
 void Function::calcOrig(UI::Graphics& gc, int x, int y)
 {
 	m_internal.setOrigin(x, y);
-	m_arg->calculateOrigin(gc, x + gc.getTextLength(m_name), 
-						       y + getFrame().base - m_arg->getFrame().base);
+	m_arg->setOrigin(gc, x + gc.getTextLength(m_name), 
+					 y + getFrame().base - m_arg->getFrame().base);
 }
 
 void Function::drawNode(UI::Graphics& gc) const
 {
 	gc.at(m_internal.x0(), m_internal.y0(), m_name,
 		  UI::Graphics::Attributes::NONE, UI::Graphics::Color::GREEN);
-	m_arg->draw(gc);
 }
 
-Complex Function::getNodeValue() const
+Complex Function::getNodeValue(const Complex* values) const
+{
+	return m_func(values[0]);
+}
+
+Dual Function::getNodeDual(const vector<SymbolTable::Id>&, const Dual* duals) const
 {
-	Complex arg = m_arg->getValue();
-	return m_func(arg);
+	const Dual& arg = duals[0];
+	if (arg.isConstant()) return m_func(arg.getValue());
+	return arg.chain(m_func(arg.getValue()), derivatives.at(m_name)(arg.getValue()));
 }
 
 Node::Frame Differential::calcSize(UI::Graphics& gc)
 {
-	m_function->calculateSize(gc);
 	Frame frame = {
-		{ gc.getDifferentialWidth(m_variable) + m_function->getFrame().box.width(),
-		  max(gc.getDifferentialHeight(m_variable), m_function->getFrame().box.height()), 0, 0
+		{ gc.getDifferentialWidth(getVariable()) + m_function->getFrame().box.width(),
+		  max(gc.getDifferentialHeight(getVariable()), m_function->getFrame().box.height()), 0, 0
 		},
-		max(gc.getDifferentialBase(m_variable), m_function->getFrame().base)
+		max(gc.getDifferentialBase(getVariable()), m_function->getFrame().base)
 	};
 	m_internal = frame.box;
 	return frame;
@@ -196,16 +270,20 @@ Node::Frame Differential::calcSize(UI::Graphics& gc)
 void Differential::calcOrig(UI::Graphics& gc, int x, int y)
 {
 	m_internal.setOrigin(x, y);
-	m_function->calculateOrigin(gc, x + gc.getDifferentialWidth(m_variable),
-								    y + getFrame().base - m_function->getFrame().base);
+	m_function->setOrigin(gc, x + gc.getDifferentialWidth(getVariable()),
+						  y + getFrame().base - m_function->getFrame().base);
 }
 
 void Differential::drawNode(UI::Graphics& gc) const 
 {
 	gc.differential(m_internal.x0(), 
-					m_internal.y0() + getFrame().base - gc.getDifferentialBase(m_variable),
-					m_variable);
-	m_function->draw(gc);
+					m_internal.y0() + getFrame().base - gc.getDifferentialBase(getVariable()),
+					getVariable());
+}
+
+Complex Differential::getNodeValue(const Complex*) const
+{
+	return m_function->getDual({ m_id }).getPartial(0);
 }
 
 const Constant::const_map Constant::constants = {
@@ -232,11 +310,11 @@ void Constant::drawNode(UI::Graphics& gc) const
 		  UI::Graphics::Attributes::ITALIC, UI::Graphics::Color::RED);
 }
 
-Variable::var_map Variable::values;
-
 Node::Frame Variable::calcSize(UI::Graphics& gc) 
 {
-	Frame frame = { { gc.getCharLength(m_name), gc.getTextHeight(), 0, 0 }, 0 };
+	const string& name = getVariable();
+	int width = (name.length() == 1) ? gc.getCharLength(name[0]) : gc.getTextLength(name);
+	Frame frame = { { width, gc.getTextHeight(), 0, 0 }, 0 };
 	m_internal = frame.box;
     return frame;
 }
@@ -248,20 +326,39 @@ void Variable::calcOrig(UI::Graphics&, int x, int y)
 
 void Variable::drawNode(UI::Graphics& gc) const
 {
-	gc.at(m_internal.x0(), m_internal.y0(), m_name, UI::Graphics::Attributes::ITALIC);
+	const string& name = getVariable();
+	if (name.length() == 1)
+		gc.at(m_internal.x0(), m_internal.y0(), name[0], UI::Graphics::Attributes::ITALIC);
+	else
+		gc.at(m_internal.x0(), m_internal.y0(), name, UI::Graphics::Attributes::ITALIC);
 }
 
-void Variable::setValue(char name, const Complex& value)
+void Variable::setValue(const string& name, const Complex& value)
 {
-	auto it = values.find(name);
-	if (it != values.end() ) it->second = value;
+	auto& table = SymbolTable::global();
+	auto id = table.find(name);
+	if (id != SymbolTable::none && table.getKind(id) == SymbolTable::VARIABLE) table.setValue(id, value);
 }
 
-void Variable::setRealValue(char name, double real)
+void Variable::setRealValue(const string& name, double real)
 {
 	setValue(name, { real, 0 });
 }
 
+Dual Variable::getNodeDual(const vector<SymbolTable::Id>& vars, const Dual*) const
+{
+	auto it = find(vars.begin(), vars.end(), m_id);
+	if (it == vars.end()) return getNodeValue(nullptr);
+	return Dual(getNodeValue(nullptr), vars.size(), it - vars.begin());
+}
+
+Complex Variable::findValue(const string& name)
+{
+	auto& table = SymbolTable::global();
+	auto id = table.find(name);
+	return (id != SymbolTable::none && table.getKind(id) == SymbolTable::VARIABLE) ? table.getValue(id) : Complex(0, 0);
+}
+
 string Number::toString() const
 {
 	if (m_isInteger) return to_string((int) m_value);
@@ -282,7 +379,13 @@ string Number::toString() const
 
 Node::Frame Number::calcSize(UI::Graphics& gc) 
 {
-	Frame frame = { { gc.getTextLength(toString()), gc.getTextHeight(), 0, 0 }, 0 };
+	// Only format value again when it has changed since last layout
+	if (m_text.empty() || m_textValue != m_value || m_textInteger != m_isInteger) {
+		m_text = toString();
+		m_textValue = m_value;
+		m_textInteger = m_isInteger;
+	}
+	Frame frame = { { gc.getTextLength(m_text), gc.getTextHeight(), 0, 0 }, 0 };
 	m_internal = frame.box;
     return frame;
 }
@@ -294,15 +397,13 @@ void Number::calcOrig(UI::Graphics&, int x, int y)
 
 void Number::drawNode(UI::Graphics& gc) const
 {
-	gc.at(m_internal.x0(), m_internal.y0(), toString(), UI::Graphics::Attributes::NONE);
+	gc.at(m_internal.x0(), m_internal.y0(), m_text, UI::Graphics::Attributes::NONE);
 }
 
-Node::Frame Term::calcSize(UI::Graphics& gc) 
+Node::Frame Term::calcSize(UI::Graphics&) 
 {
 	int x = 0, b = 0, y = 0;
 	for ( auto n : factors ) { 
-		if (n->getType() == Expression::type) n->setDrawParenthesis(true);
-		n->calculateSize(gc); 
 		x += n->getFrame().box.width();
 		y = max(y, n->getFrame().box.height() - n->getFrame().base);
 		b = max(b, n->getFrame().base);
@@ -315,55 +416,49 @@ Node::Frame Term::calcSize(UI::Graphics& gc)
 void Term::calcOrig(UI::Graphics& gc, int x, int y)
 {
 	for ( auto n : factors ) {
-		n->calculateOrigin(gc, x, y + getFrame().base - n->getFrame().base);
+		n->setOrigin(gc, x, y + getFrame().base - n->getFrame().base);
 		x += n->getFrame().box.width();
 	}
 }
 
-void Term::drawNode(UI::Graphics& gc) const
+void Term::drawNode(UI::Graphics&) const
 {
-	for ( auto n : factors ) n->draw(gc);
 }
 
 string Term::toString() const
 {
-	string s = "";
-	for ( auto f : factors ) { 
-		s += ( f->getSign() ? "" : "(-" ) + f->toString() + ( f->getSign() ? "" : ")" );
-	}
-	return s; 	
+	return subtreeString(this);
 }
 
 Node* Term::getLeftSibling(Node* node)
 {
-	for (unsigned int i = 1; i < factors.size(); ++i) {
-		if (factors[i] == node)
-			return factors[i - 1];
-	}
-	return nullptr;
+	return factors.before(node);
 }
 
 Node* Term::getRightSibling(Node* node)
 {
-	for (unsigned int i = 0; i < factors.size() - 1; ++i) {
-		if (factors[i] == node) 
-			return factors[i + 1];
-	}
-	return nullptr;
+	return factors.after(node);
 }
 
-Complex Term::getNodeValue() const
+Complex Term::getNodeValue(const Complex* values) const
 {
 	Complex value = 1;
-	for (auto n : factors) { value *= n->getValue(); }
+	for (size_t i = 0; i < factors.size(); ++i) { value *= values[i]; }
+	return value;
+}
+
+Dual Term::getNodeDual(const vector<SymbolTable::Id>&, const Dual* duals) const
+{
+	Dual value(Complex(1, 0));
+	for (size_t i = 0; i < factors.size(); ++i) { value *= duals[i]; }
 	return value;
 }
 
 NodeIter Term::pos(Node* me)
 {
 	if (!me->getParent() || me->getParent()->getType() != Term::type) throw logic_error("bad parent");
-	Term* term = dynamic_cast<Term*>(me->getParent());
-	return find(term->factors.begin(), term->factors.end(), me);
+	Term* term = static_cast<Term*>(me->getParent());
+	return term->factors.find(me);
 }
 
 Node::Frame Expression::calcSize(UI::Graphics& gc) 
@@ -371,7 +466,6 @@ Node::Frame Expression::calcSize(UI::Graphics& gc)
 	int x = 0, b = 0, y = 0;
 	for ( auto n : terms ) { 
 		if (n != terms.begin() || !n->getSign()) x += gc.getCharLength('-');
-		n->calculateSize(gc); 
 		x += n->getFrame().box.width();
 		y = max(y, n->getFrame().box.height() - n->getFrame().base);
 		b = max(b, n->getFrame().base);
@@ -386,62 +480,61 @@ void Expression::calcOrig(UI::Graphics& gc, int x, int y)
 	m_internal.setOrigin(x, y);
 	for ( auto n : terms ) {
 		if (n != terms.begin() || !n->getSign()) x += gc.getCharLength('-');
-		n->calculateOrigin(gc, x, y + getFrame().base - n->getFrame().base);
+		n->setOrigin(gc, x, y + getFrame().base - n->getFrame().base);
 		x += n->getFrame().box.width();
 	}
 }
 
-void Expression::drawNode(UI::Graphics& gc) const
+void Expression::drawNode(UI::Graphics&) const
 {
-	for ( auto n : terms ) {
-		if (n != terms.begin()->get() || !n->getSign()) {
-			gc.at(n->getFrame().box.x0() - 1, 
-				  n->getFrame().box.y0() + n->getFrame().base,
-				  n->getSign() ? '+' : '-', UI::Graphics::Attributes::NONE);
-		}
-		n->draw(gc); 
+}
+
+void Expression::drawSign(UI::Graphics& gc, const Node* term) const
+{
+	if (term != terms.begin()->get() || !term->getSign()) {
+		gc.at(term->getFrame().box.x0() - 1, 
+			  term->getFrame().box.y0() + term->getFrame().base,
+			  term->getSign() ? '+' : '-', UI::Graphics::Attributes::NONE);
 	}
 }
 
 string Expression::toString() const
 { 
-	string s = "(";
-	for ( auto t : terms ) { 
-		s += t->getSign() ? '+' : '-'; 
-		s += t->toString();
-	}
-	return s += ")";
+	return subtreeString(this);
 }
 
-Complex Expression::getNodeValue() const
+Complex Expression::getNodeValue(const Complex* values) const
 {
 	Complex value = 0;
-	for (auto n : terms) { value += n->getValue(); }
+	for (size_t i = 0; i < terms.size(); ++i) { value += values[i]; }
+	return value;
+}
+
+Dual Expression::getNodeDual(const vector<SymbolTable::Id>&, const Dual* duals) const
+{
+	Dual value;
+	for (size_t i = 0; i < terms.size(); ++i) { value += duals[i]; }
 	return value;
 }
 
 Node* Expression::getLeftSibling(Node* node)
 {
-	for (unsigned int i = 1; i < terms.size(); ++i) {
-		if (terms[i] == node)
-			return terms[i - 1]->last();
-	}
-	return nullptr;
+	if (node->getType() != Term::type) return nullptr;
+	Term* term = terms.before(static_cast<Term*>(node));
+	return (term) ? term->last() : nullptr;
 }
 
 Node* Expression::getRightSibling(Node* node)
 {
-	for (unsigned int i = 0; i < terms.size() - 1; ++i) {
-		if (terms[i] == node)
-			return terms[i + 1]->first();
-	}
-	return nullptr;
+	if (node->getType() != Term::type) return nullptr;
+	Term* term = terms.after(static_cast<Term*>(node));
+	return (term) ? term->first() : nullptr;
 }
 
 int Input::input_sn = -1;
 
 Input::Input(Equation& eqn, std::string txt, bool current, Node* parent, bool neg, Node::Select s) :
-	Node(eqn, parent, neg, s), m_sn(++input_sn), m_typed(txt), m_current(current)
+	Node(type, eqn, parent, neg, s), m_sn(++input_sn), m_typed(txt), m_current(current)
 {
 	eqn.addInput(this);
 	if (current) eqn.setCurrentInput(m_sn);
@@ -475,7 +568,12 @@ string Input::toString() const
 		return "[" + m_typed  + "]";
 }
 
-Complex Input::getNodeValue() const
+Complex Input::getNodeValue(const Complex*) const
+{
+	throw logic_error("input has no value");
+}
+
+Dual Input::getNodeDual(const vector<SymbolTable::Id>&, const Dual*) const
 {
 	throw logic_error("input has no value");
 }
@@ -516,13 +614,13 @@ bool Node::createNodeByName(string name, Equation& eqn)
 bool Divide::create(Equation& eqn)
 {
 	Input* in = eqn.getCurrentInput();
-	if (!in) return false;
+	if (!in || in->getParent()->getType() != Term::type) return false;
 	
 	FactorIterator in_pos(in);
 	auto pos = in_pos;
-	bool fNeg = !in->getParent()->getSign();
-	if (fNeg) in->getParent()->negative();
-	Term* upper_term = dynamic_cast<Term*>(in->getParent());
+	Term* upper_term = static_cast<Term*>(in->getParent());
+	bool fNeg = !upper_term->getSign();
+	if (fNeg) upper_term->negative();
 	
 	in_pos = in->emptyBuffer();
 	if (in_pos.isBeginTerm() && in->empty()) {
@@ -546,6 +644,7 @@ bool Power::create(Equation& eqn)
 	if (!in) return false;
 	
 	FactorIterator in_pos(in);
+	Node* parent = in->getParent();
 	Node* a_factor = nullptr;
 	Expression* a = nullptr;
 	if (!in->empty()) {
@@ -558,7 +657,7 @@ bool Power::create(Equation& eqn)
 	a = new Expression(a_factor, eqn);
 	
 	Expression* b = new Expression(new Input(eqn), eqn);
-	Power* p = new Power(a, b, eqn, in->getParent());
+	Power* p = new Power(a, b, eqn, parent);
 	in_pos.replace(p);
 	return true;
 }
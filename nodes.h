@@ -25,13 +25,25 @@
  * virtual member functions. This header file is not part of the external interface.
  */
 #include <vector>
+#include <utility>
+#include <algorithm>
 #include <exception>
+#include <stdexcept>
 #include <unordered_map>
 #include "milo.h"
+#include "symtab.h"
 
 // Forward class decleration
 class Parser;
 
+/**
+ * Get string representation of subtree without recursion.
+ * Used by toString of nodes with children. Leaves use their own toString.
+ * @param root Root of subtree.
+ * @return String representation of subtree.
+ */
+std::string subtreeString(const Node* root);
+
 /**
  * Base class for nodes represent an operator that contains two expressions.
  * Not all pure virtual functions are overriden so is an abstract base class.
@@ -51,17 +63,8 @@ public:
 	 * @param neg If true, node is negative.
 	 * @param s   Selection state of node.
 	 */
-    Binary(char op, Node* one, Node* two, Equation& eqn, Node* parent, bool neg, Node::Select s) : 
-	    Node(eqn, parent, neg, s), m_op(op), m_first(one), m_second(two) {}
-
-	/**
-	 * XML constructor for Binary class.
-	 * Read in XML that is common for all nodes that have a Binary base class.
-	 * @param in XML input stream.
-	 * @param eqn Equation associated with this node.
-	 * @param parent Parent node object.	 
-	 */
-	Binary(XML::Parser& in, Equation& eqn, Node* parent);
+    Binary(Kind kind, char op, Node* one, Node* two, Equation& eqn, Node* parent, bool neg, Node::Select s) : 
+	    Node(kind, eqn, parent, neg, s), m_op(op), m_first(one), m_second(two) {}
 
 	/**
 	 * Virtual desctructor.
@@ -77,7 +80,7 @@ public:
 	 * Simply first node, operator, second node.
 	 * @return String representation of Binary object.
 	 */
-	std::string toString() const { return m_first->toString() + std::string(1, m_op) + m_second->toString(); }
+	std::string toString() const { return subtreeString(this); }
 
 	/**
 	 * Override for isLeaf virtual function.
@@ -113,13 +116,22 @@ public:
 	ExpressionPtr getSecondExpression();
 
 	/**
-	 * Static helper function to parse Binary class.
-	 * @param p Parser object pointing to operator.
-	 * @param one First expression already parsed.
-	 * @param parent Parent node.
-	 * @return Binary object or null if operator not binary.
+	 * Get first node of this node.
+	 * @return First node.
+	 */
+	Node* getFirst() const { return m_first; }
+
+	/**
+	 * Get second node of this node.
+	 * @return Second node.
 	 */
-	static Node* parse(Parser& p, Node* one, Node* parent);
+	Node* getSecond() const { return m_second; }
+
+	/**
+	 * Get operator of this node.
+	 * @return Character of operator.
+	 */
+	char getOp() const { return m_op; }
 
 protected:
 	char m_op;        ///< Character repesentation of operator.
@@ -187,24 +199,12 @@ public:
 	 * @param s   Selection state of node.
 	 */
     Divide(Node* one, Node* two, Equation& eqn, Node* parent, bool neg = false, Node::Select s = Node::Select::NONE) : 
-	    Binary('/', one, two, eqn, parent, neg, s) 
+	    Binary(type, '/', one, two, eqn, parent, neg, s) 
 	{ 
 		m_first->setParent(this); m_second->setParent(this); 
 		m_first->setDrawParenthesis(false); m_second->setDrawParenthesis(false);
 	}
 
-   /**
-	 * XML constructor for Divide class.
-	 * Read in XML for Divide class.
-	 * @param in XML input stream.
-     * @param eqn Equation associated with this node.
-	 * @param parent Parent node object.	 
- 	 */
-    Divide(XML::Parser& in, Equation& eqn, Node* parent) : Binary(in, eqn, parent)
-	{ 
-		m_op = '/'; m_first->setDrawParenthesis(false); m_second->setDrawParenthesis(false);
-	}
-
 	/**
 	 * Abstract base class needs virtual destructor.
 	 */
@@ -218,24 +218,6 @@ public:
 	 * @return Name of this class.
 	 */
 	const std::string& getName() const { return name; }
-
-	/**
-	 * Get name of this class.
-	 * @return Name of this class.
-	 */
-	std::type_index getType() const { return type; }
-
-	/**
-	 * Refactor subtree to a standard form.
-	 * For Divide class, replace a/b with ab^-1.
-	 */
-	void normalize();
-
-	/**
-	 * Attempt to algebraically simplify the subtree this node is the root.
-	 * @return True, if subtree was changed.
-	 */
-	bool simplify();
 	//@}
 
 	/**
@@ -247,7 +229,7 @@ public:
 	static bool create(Equation& eqn);
 	
 	static const std::string name;     ///< Name of Divide class.
-	static const std::type_index type; ///< Type of Divide class.
+	static constexpr Kind type = DIVIDE; ///< Type of Divide class.
 
  private:
 	/** @name Virtual Private Member Functions */
@@ -274,14 +256,35 @@ public:
 	void drawNode(UI::Graphics& gc) const;
 
 	/**
-	 * Get value of this subtree.
+	 * Get value of this subtree from the values of its children.
+	 * @param values Values of children in order.
 	 * @return Complex value of this subtree.
 	 */
-	Complex getNodeValue() const;
+	Complex getNodeValue(const Complex* values) const;
+
+	/**
+	 * Get value of this subtree with gradient to variables.
+	 * @param vars Ids of variables in order of gradient.
+	 * @param duals Values and gradients of children in order.
+	 * @return Value and gradient of this subtree.
+	 */
+	Dual getNodeDual(const std::vector<SymbolTable::Id>& vars, const Dual* duals) const;
+
+	/**
+	 * Nothing to prepare before operands are simplified.
+	 * @return True, so operands are simplified.
+	 */
+	bool beginSimplify() { return true; }
+
+	/**
+	 * Refactor to a standard form after operands are normalized.
+	 * For Divide class, replace a/b with ab^-1.
+	 */
+	void normalizeNode();
 	//@}
 
 	/**
-	 * Static Helper function for Divide::normalize()
+	 * Static Helper function for Divide::normalizeNode()
 	 * @param n Node* containing a/b
 	 * @return  Return expressoin ab^-1
 	 */
@@ -308,24 +311,12 @@ public:
 	 * @param s   Selection state of node.
 	 */
     Power(Node* one, Node* two, Equation& eqn, Node* parent, bool neg = false, Node::Select s = Node::Select::NONE) : 
-	    Binary('^', one, two, eqn, parent, neg, s) 
+	    Binary(type, '^', one, two, eqn, parent, neg, s) 
 	{ 
 		m_first->setParent(this); m_second->setParent(this);
 		m_first->setDrawParenthesis(m_first->numFactors()>1); m_second->setDrawParenthesis(false);
 	}
 
-	/**
-	 * XML constructor for Divide class.
-	 * Read in XML for Divide class.
-	 * @param in XML input stream.
-     * @param eqn Equation associated with this node.
-	 * @param parent Parent node object.	 
- 	 */
-    Power(XML::Parser& in, Equation& eqn, Node* parent) : Binary(in, eqn, parent)
-	{ 
-		m_op = '^'; m_first->setDrawParenthesis(m_first->numFactors()>1); m_second->setDrawParenthesis(false);
-	}
-
 	/**
 	 * Abstract base class needs virtual destructor.
 	 */
@@ -339,24 +330,6 @@ public:
 	 * @return Name of this class.
 	 */
 	const std::string& getName() const { return name; }
-
-	/**
-	 * Get name of this class.
-	 * @return Name of this class.
-	 */
-	std::type_index getType() const { return type; }
-
-	/**
-	 * Refactor subtree to a standard form.
-	 * For Power class, replace (ab)^2(c^d)^2  with (a^2)(b^2)c^(2d)
-	 */
-	void normalize();
-
-	/**
-	 * Attempt to algebraically simplify the subtree this node is the root.
-	 * @return True, if subtree was changed.
-	 */
-	bool simplify();
 	//@}
 
 	/**
@@ -375,7 +348,7 @@ public:
 	static bool simplify(NodeVector& factors);
 	
 	static const std::string name;     ///< Name of Power class.
-	static const std::type_index type; ///< Type of Power class.
+	static constexpr Kind type = POWER; ///< Type of Power class.
 
 private:
 	/** @name Virtual Private Member Functions */
@@ -402,10 +375,36 @@ private:
 	void drawNode(UI::Graphics& gc) const;
 
 	/**
-	 * Get value of this subtree.
+	 * Get value of this subtree from the values of its children.
+	 * @param values Values of children in order.
 	 * @return Complex value of this subtree.
 	 */
-	Complex getNodeValue() const;
+	Complex getNodeValue(const Complex* values) const;
+
+	/**
+	 * Get value of this subtree with gradient to variables.
+	 * @param vars Ids of variables in order of gradient.
+	 * @param duals Values and gradients of children in order.
+	 * @return Value and gradient of this subtree.
+	 */
+	Dual getNodeDual(const std::vector<SymbolTable::Id>& vars, const Dual* duals) const;
+
+	/**
+	 * Move power of this node into its exponent before operands are normalized.
+	 */
+	void beginNormalize();
+
+	/**
+	 * Refactor to a standard form after operands are normalized.
+	 * For Power class, replace (ab)^2(c^d)^2  with (a^2)(b^2)c^(2d)
+	 */
+	void normalizeNode();
+
+	/**
+	 * Nothing to prepare before operands are simplified.
+	 * @return True, so operands are simplified.
+	 */
+	bool beginSimplify() { return true; }
 	//@}
 	
 	/**
@@ -444,7 +443,16 @@ public:
 	 * @param s   Selection state of node.
 	 */
     Constant(char name, Complex value, Equation& eqn, Node* parent, bool neg = false, Node::Select s = Node::Select::NONE) : 
-	    Node(eqn, parent, neg, s), m_name(name), m_value(value) {}
+	    Node(type, eqn, parent, neg, s), m_name(name), m_value(value) {}
+
+	/**
+	 * Constructor for Constant class looking up value of constant.
+	 * Throws logic_error if constant is unknown.
+	 * @param name Constant name.
+     * @param eqn Equation associated with this node.
+	 * @param parent Parent node.
+	 */
+	Constant(char name, Equation& eqn, Node* parent);
 
 	 /**
 	  * XML constructor for Constant class.
@@ -477,15 +485,16 @@ public:
 	 */
 	const std::string& getName() const { return name; }
 
-	/**
-	 * Get name of this class.
-	 * @return Name of this class.
-	 */
-	std::type_index getType() const { return type; }
 	//@}
 	
+	/**
+	 * Get name of constant.
+	 * @return Character name of constant.
+	 */
+	char getConstant() const { return m_name; }
+
 	static const std::string name;     ///< Name of constant.
-	static const std::type_index type; ///< Type of constant.
+	static constexpr Kind type = CONSTANT; ///< Type of constant.
 
 	/**
 	 * Static helper function to parse Constant class.
@@ -534,7 +543,13 @@ private:
 	 * Get value of this constant.
 	 * @return Complex value of this constant.
 	 */
-	Complex getNodeValue() const { return constants.at(m_name); }
+	Complex getNodeValue(const Complex*) const { return constants.at(m_name); }
+
+	/**
+	 * Get value of this subtree with gradient to variables.
+	 * @return Value of this subtree with no gradient.
+	 */
+	Dual getNodeDual(const std::vector<SymbolTable::Id>&, const Dual*) const { return getNodeValue(nullptr); }
 	//@}
 };
 
@@ -555,18 +570,15 @@ public:
 	Variable(Parser& p, Node* parent);
 
 	/**
-	 * Constructor for Constant class.
+	 * Constructor for Variable class.
 	 * @param name Variable name.
      * @param eqn Equation associated with this node.
 	 * @param parent Parent node.
 	 * @param neg If true, node is negative.
 	 * @param s   Selection state of node.
 	 */
-    Variable(char name, Equation& eqn, Node* parent, bool neg = false, Node::Select s = Node::Select::NONE) : 
-	    Node(eqn, parent, neg, s), m_name(name)
-    { 
-		values.emplace(name, Complex(0, 0)); 
-	}
+    Variable(const std::string& name, Equation& eqn, Node* parent, bool neg = false, Node::Select s = Node::Select::NONE) : 
+	    Node(type, eqn, parent, neg, s), m_id(SymbolTable::global().intern(name, SymbolTable::VARIABLE)) {}
 
 	/**
 	 * XML constructor for Variable class.
@@ -583,15 +595,13 @@ public:
 	~Variable() {}
 	//@}
 	
-	using var_map = std::unordered_map<char, Complex>; ///< @brief Specialization for mapping name to value.
-
 	/** @name Virtual Public Member Functions */
 	//@{
 	/**
 	 * String representation of variable is its name.
 	 * @return Name of variable.
 	 */
-	std::string toString() const { return std::string(1, m_name); }
+	std::string toString() const { return getVariable(); }
 
 	/**
 	 * Get name of this class.
@@ -599,15 +609,22 @@ public:
 	 */
 	const std::string& getName() const { return name; }
 
-	/**
-	 * Get name of this class.
-	 * @return Name of this class.
-	 */
-	std::type_index getType() const { return type; }
 	//@}
 	
+	/**
+	 * Get name of variable.
+	 * @return Name of variable.
+	 */
+	const std::string& getVariable() const { return SymbolTable::global().getName(m_id); }
+
+	/**
+	 * Get id of variable in symbol table.
+	 * @return Id of variable.
+	 */
+	SymbolTable::Id getId() const { return m_id; }
+
 	static const std::string name;     ///< Name of Variable class.
-	static const std::type_index type; ///< Type of Variable class.
+	static constexpr Kind type = VARIABLE; ///< Type of Variable class.
 
 	/**
 	 * Static helper function to parse Variable class.
@@ -619,23 +636,29 @@ public:
 
 	/**
 	 * Static helper function to set value of a variable.
+	 * Nothing is set if there is no such variable.
 	 * @param name Variable name.
 	 * @param value Value of Variable.
 	 */
-	static void setValue(char name, const Complex& value);
+	static void setValue(const std::string& name, const Complex& value);
 
 	/**
 	 * Static helper function to set real value of a variable.
 	 * @param name Variable name.
 	 * @param real Real value of Variable.
 	 */
-	static void setRealValue(char name, double real);
+	static void setRealValue(const std::string& name, double real);
 
-private:
-	char m_name;    ///< Name of Variable
-	Box m_internal; ///< Bounding box of this node.
+	/**
+	 * Static helper function to get value of a variable.
+	 * @param name Variable name.
+	 * @return Value of variable or zero if there is no such variable.
+	 */
+	static Complex findValue(const std::string& name);
 
-	static var_map values; ///< Mapping of all variable name to their values.
+private:
+	SymbolTable::Id m_id; ///< Id of name of Variable.
+	Box m_internal;       ///< Bounding box of this node.
 
 	/** @name Virtual Private Member Functions */
 	//@{
@@ -670,7 +693,14 @@ private:
 	 * Get value of this subtree.
 	 * @return Complex value of this subtree.
 	 */
-	Complex getNodeValue() const { return values[m_name]; }
+	Complex getNodeValue(const Complex*) const { return SymbolTable::global().getValue(m_id); }
+
+	/**
+	 * Get value of this subtree with gradient to variables.
+	 * @param vars Ids of variables in order of gradient.
+	 * @return Value and gradient of this subtree.
+	 */
+	Dual getNodeDual(const std::vector<SymbolTable::Id>& vars, const Dual*) const;
 	//@}
 };
 
@@ -688,7 +718,7 @@ public:
 	 * @param p Parser object.
 	 * @param parent Parent node.
 	 */
-    Number(Parser& p, Node* parent) : Node(p, parent), m_isInteger(true) { getNumber(p); }
+    Number(Parser& p, Node* parent) : Node(type, p, parent), m_isInteger(true) { getNumber(p); }
 
 	/**
 	 * Constructor for Number class.
@@ -699,7 +729,7 @@ public:
 	 * @param s   Selection state of node.
 	 */
     Number(std::string real, Equation& eqn, Node* parent, bool neg = false, Node::Select s = Node::Select::NONE) :
-	    Node(eqn, parent, neg, s), m_value(stod(real)), m_isInteger(isInteger(real)) {}
+	    Node(type, eqn, parent, neg, s), m_value(stod(real)), m_isInteger(isInteger(real)) {}
 
 	/**
 	 * Constructor for Number class.
@@ -710,7 +740,7 @@ public:
 	 * @param s   Selection state of node.
 	 */
     Number(int n, Equation& eqn, Node* parent, bool neg = false, Node::Select s = Node::Select::NONE) :
-	    Node(eqn, parent, neg, s), m_value(n), m_isInteger(true) {}
+	    Node(type, eqn, parent, neg, s), m_value(n), m_isInteger(true) {}
 
 	/**
 	 * Constructor for Number class.
@@ -721,7 +751,7 @@ public:
 	 * @param s   Selection state of node.
 	 */
 	Number(double d, Equation& eqn, Node* parent, bool neg = false, Node::Select s = Node::Select::NONE) :
-	    Node(eqn, parent, neg, s), m_value(d), m_isInteger(isInteger(d)) {}
+	    Node(type, eqn, parent, neg, s), m_value(d), m_isInteger(isInteger(d)) {}
 
 	 /**
 	  * XML constructor for Number class.
@@ -757,22 +787,16 @@ public:
 	 * @return Name of this class.
 	 */
 	const std::string& getName() const { return name; }
-
+	//@}
+	
 	/**
-	 * Get name of this class.
-	 * @return Name of this class.
+	 * Get real value of number.
+	 * @return Value of Number.
 	 */
-	std::type_index getType() const { return type; }
+	double getReal() const { return m_value; }
 
-	/**
-	 * Attempt to algebraically simplify the subtree this node is the root.
-	 * @return True, if subtree was changed.
-	 */
-	bool simplify();
-	//@}
-	
 	static const std::string name;     ///< Name of Number class.
-	static const std::type_index type; ///< Type of Number class.
+	static constexpr Kind type = NUMBER; ///< Type of Number class.
 
 	/**
 	 * Static helper function to parse Number class.
@@ -783,9 +807,12 @@ public:
 	static Number* parse(Parser& p, Node* parent);
 
 private:
-	double m_value;   ///< Value of Number.
-	bool m_isInteger; ///< True, if integer.
-	Box m_internal;   ///< Bounding box of this node.
+	double m_value;             ///< Value of Number.
+	bool m_isInteger;           ///< True, if integer.
+	Box m_internal;             ///< Bounding box of this node.
+	std::string m_text;         ///< Text of value as last sized.
+	double m_textValue = 0;     ///< Value that m_text shows.
+	bool m_textInteger = false; ///< Integer flag that m_text shows.
 
 	/** @name Virtual Private Member Functions */
 	//@{
@@ -827,7 +854,19 @@ private:
 	 * Get value of this subtree.
 	 * @return Complex value of this subtree.
 	 */
-	Complex getNodeValue() const { return {m_value, 0}; }
+	Complex getNodeValue(const Complex*) const { return {m_value, 0}; }
+
+	/**
+	 * Get value of this subtree with gradient to variables.
+	 * @return Value of this subtree with no gradient.
+	 */
+	Dual getNodeDual(const std::vector<SymbolTable::Id>&, const Dual*) const { return getNodeValue(nullptr); }
+
+	/**
+	 * Raise value to the power of this node.
+	 * @return True, if number was changed.
+	 */
+	bool simplifyNode();
 	//@}
 };
 
@@ -847,14 +886,6 @@ public:
 	 */
 	using func_map = std::unordered_map<std::string, func_ptr>;
 
-	/**
-	 * Get function object from Parser.
-	 * @param p Parser object.
-	 * @param parent Parent for new Function object.
-	 * @return Function object or null if no function found in parser.
-	 */
-	static Function* parse(Parser& p, Node* parent);
-
 	/** @name Virtual Public Member Functions */
 	//@{
 	/**
@@ -862,7 +893,7 @@ public:
 	 * String representation is function_name(argument).
 	 * @return String representation of Function.
 	 */
-	std::string toString() const { return m_name + m_arg->toString(); }
+	std::string toString() const { return subtreeString(this); }
 
 	/**
 	 * Override for isLeaf virtual function.
@@ -884,12 +915,6 @@ public:
 	 */
 	int numFactors() const { return m_arg->numFactors() + 1; }
 
-	/**
-	 * Refactor subtree to a standard form.
-	 * For Function class, normalize argument.
-	 */
-	void normalize() { m_arg->normalize(); }
-
 	/**
 	 * Function class specialization of default virtural member function.
 	 * Sort functions in reverse alphabetical order.
@@ -904,40 +929,52 @@ public:
 	 */
 	const std::string& getName() const { return name; }
 
-	/**
-	 * Get name of this class.
-	 * @return Name of this class.
-	 */
-	std::type_index getType() const { return type; }
 	//@}
 	
+	/**
+	 * Get name of mathematical function such as sin.
+	 * @return Name of function.
+	 */
+	const std::string& getFunction() const { return m_name; }
+
+	/**
+	 * Get argument of function.
+	 * @return Argument node.
+	 */
+	Node* getArgument() const { return m_arg; }
+
+	/**
+	 * Get function pointer that evaluates function.
+	 * @return Function pointer.
+	 */
+	func_ptr getCall() const { return m_func; }
+
+	/**
+	 * Get function pointer that evaluates derivative of function.
+	 * @return Function pointer of derivative.
+	 */
+	func_ptr getDerivative() const { return derivatives.at(m_name); }
+
+	/**
+	 * Get names of built in functions.
+	 * @return Names of functions in alphabetical order.
+	 */
+	static std::vector<std::string> getFunctions();
+
 	static const std::string name;     ///< Name of Function class.
-	static const std::type_index type; ///< Type of Function type.
+	static constexpr Kind type = FUNCTION; ///< Type of Function type.
 	
 	/** @name Constructor and Virtual Destructor */
 	//@{
 	/**
-	 * Constructor for Function class.
+	 * Constructor for Function class with given argument.
+	 * Throws logic_error if function is unknown.
 	 * @param name Name of function.
-	 * @param fp Pointer to function to evaluate arguments.
-	 * @param p Parser object.
+	 * @param arg Argument of function.
      * @param eqn Equation associated with this node.
 	 * @param parent Parent node.
-	 * @param neg If true, node is negative.
-	 * @param s   Selection state of node.
-	 */
-    Function(const std::string& name, func_ptr fp, Parser& p, Node* parent, 
-			 bool neg = false, Node::Select s = Node::Select::NONE) : 
-	    Node(p, parent, neg, s), m_name(name), m_func(fp), m_arg(new Expression(p, this)) {}
-
-	/**
-	 * XML constructor for Function class.
-	 * Read in XML for Function class.
-	 * @param in XML input stream.
-     * @param eqn Equation associated with this node.
-	 * @param parent Parent node object.	 
 	 */
-	Function(XML::Parser& in, Equation& eqn, Node* parent);
+	Function(const std::string& name, Node* arg, Equation& eqn, Node* parent);
 
 	/**
 	 * Abstract base class needs virtual destructor.
@@ -993,16 +1030,29 @@ private:
 	void drawNode(UI::Graphics& gc) const;
 
 	/**
-	 * Get value of this subtree.
+	 * Get value of this subtree from the values of its children.
+	 * @param values Values of children in order.
 	 * @return Complex value of this subtree.
 	 */
-	Complex getNodeValue() const;
+	Complex getNodeValue(const Complex* values) const;
+
+	/**
+	 * Get value of this subtree with gradient to variables.
+	 * @param vars Ids of variables in order of gradient.
+	 * @param duals Values and gradients of children in order.
+	 * @return Value and gradient of this subtree.
+	 */
+	Dual getNodeDual(const std::vector<SymbolTable::Id>& vars, const Dual* duals) const;
 	//@}
 	
 	/** Association of function names with their function pointers.	
 	 */
 	static const func_map functions;
 
+	/** Association of function names with their derivatives.
+	 */
+	static const func_map derivatives;
+
 	static Complex sinZ(Complex z); ///< Function for sin.
 	static Complex cosZ(Complex z); ///< Function for cos.
 	static Complex tanZ(Complex z); ///< Function for tan.
@@ -1019,20 +1069,13 @@ public:
 	/** @name Constructor and Virtual Destructor */
 	//@{
 	/**
-	 * Constructor for Differential class.
-	 * @param p Parser object.
+	 * Constructor for Differential class with given function.
+	 * @param variable Variable of differential, empty if it has none.
+	 * @param function Function to be differentiated.
+     * @param eqn Equation associated with this node.
 	 * @param parent Parent node.
 	 */
-    Differential(Parser& p, Node* parent);
-
-	/**
-	  * XML constructor for Differential class.
-	  * Read in XML for Differential class.
-	  * @param in XML input stream.
-      * @param eqn Equation associated with this node.
-	  * @param parent Parent node object.	 
-	  */
-	Differential(XML::Parser& in, Equation& eqn, Node* parent);
+	Differential(const std::string& variable, Node* function, Equation& eqn, Node* parent);
 
 	/**
 	 * Abstract base class needs virtual destructor.
@@ -1073,40 +1116,38 @@ public:
 	 * @return Name of this class.
 	 */
 	const std::string& getName() const { return name; }
-
+	//@}
+	
 	/**
-	 * Get name of this class.
-	 * @return Name of this class.
+	 * Get variable of differential.
+	 * @return Variable name, empty if differential has none.
 	 */
-	std::type_index getType() const { return type; }
+	const std::string& getVariable() const;
 
 	/**
-	 * Refactor subtree to a standard form.
-	 * For Differential class, normalize function argument.
+	 * Get id of variable in symbol table.
+	 * @return Id of variable or SymbolTable::none if differential has none.
 	 */
-	void normalize() { m_function->normalize(); }
+	SymbolTable::Id getId() const { return m_id; }
 
 	/**
-	 * Attempt to algebraically simplify the subtree this node is the root.
-	 * @return True, if subtree was changed.
+	 * Get function to be differentiated.
+	 * @return Function node.
 	 */
-	bool simplify() { return false; }
-	//@}
-	
-	static const std::string name;     ///< Name of Differential class.
-	static const std::type_index type; ///< Type of Differential class.
+	Node* getFunction() const { return m_function; }
 
 	/**
-	 * Get Differential object from Parser.
-	 * @param p Parser object.
-	 * @param parent Parent for new Differential object.
-	 * @return Differential object or null if no differential found in parser.
+	 * Build derivative of function to variable as a new subtree.
+	 * @return Root of derivative without differentials.
 	 */
-	static Differential* parse(Parser& p, Node* parent);
+	NodePtr getDerivative() const;
+
+	static const std::string name;     ///< Name of Differential class.
+	static constexpr Kind type = DIFFERENTIAL; ///< Type of Differential class.
 
 private:
 	Box m_internal;      ///< Bounding box of this node.
-	char m_variable;     ///< Variable of Differential.
+	SymbolTable::Id m_id; ///< Id of variable of Differential.
 	NodePtr m_function;  ///< Function to be differentiated.
 
 	/** @name Virtual Private Member Functions */
@@ -1152,11 +1193,157 @@ private:
 	void drawNode(UI::Graphics& gc) const;
 
 	/**
-	 * Get value of this subtree.
+	 * Get value of derivative of function to variable.
 	 * @return Complex value of this subtree.
 	 */
-	Complex getNodeValue() const { return {0, 0}; }
+	Complex getNodeValue(const Complex*) const;
+
+	/**
+	 * Get value of this subtree with gradient to variables.
+	 * Derivative of function is built symbolically, then evaluated with duals.
+	 * @param vars Ids of variables in order of gradient.
+	 * @param duals Value and gradient of derivative of function.
+	 * @return Value and gradient of this subtree.
+	 */
+	Dual getNodeDual(const std::vector<SymbolTable::Id>& vars, const Dual* duals) const;
 	//@}
 };
 
+/** @name Visitor and Traversal Templates */
+//@{
+/**
+ * Call visitor with node cast to its final class.
+ * Dispatch is a switch on the kind kept in the node, so a pass over the tree
+ * needs no virtual member function of its own and no dynamic_cast. Visitor
+ * is a lambda taking auto* or an object with operator() for each class it
+ * handles. All calls must return the same type.
+ * Throws logic_error for a node of unknown kind.
+ * @param node Node to visit.
+ * @param v Visitor.
+ * @return Result of visitor.
+ */
+template <class V>
+decltype(auto) visit(Node* node, V&& v)
+{
+	switch (node->getType()) {
+		case Node::NUMBER:       return v(static_cast<Number*>(node));
+		case Node::CONSTANT:     return v(static_cast<Constant*>(node));
+		case Node::VARIABLE:     return v(static_cast<Variable*>(node));
+		case Node::EXPRESSION:   return v(static_cast<Expression*>(node));
+		case Node::FUNCTION:     return v(static_cast<Function*>(node));
+		case Node::DIVIDE:       return v(static_cast<Divide*>(node));
+		case Node::POWER:        return v(static_cast<Power*>(node));
+		case Node::DIFFERENTIAL: return v(static_cast<Differential*>(node));
+		case Node::INPUT:        return v(static_cast<Input*>(node));
+		case Node::TERM:         return v(static_cast<Term*>(node));
+	}
+	throw std::logic_error("unknown kind of node");
+}
+
+/**
+ * Call function for each child of node in order.
+ * Children of a differential is its function, not its derivative.
+ * @param node Parent node.
+ * @param f Function called with each child as Node*.
+ */
+template <class F>
+void forEachChild(Node* node, F f)
+{
+	switch (node->getType()) {
+		case Node::EXPRESSION:
+			for ( auto& term : *static_cast<Expression*>(node) ) f(term.get());
+			break;
+		case Node::TERM:
+			for ( auto& factor : *static_cast<Term*>(node) ) f(factor.get());
+			break;
+		case Node::DIVIDE:
+		case Node::POWER:
+			f(static_cast<Binary*>(node)->getFirst());
+			f(static_cast<Binary*>(node)->getSecond());
+			break;
+		case Node::FUNCTION:
+			f(static_cast<Function*>(node)->getArgument());
+			break;
+		case Node::DIFFERENTIAL:
+			f(static_cast<Differential*>(node)->getFunction());
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+ * Walk subtree with an explicit stack instead of recursion, so a tree of any
+ * depth can be walked without overflowing the call stack.
+ * Children are visited in order. Each node is passed to pre before its
+ * children and to post after them.
+ * @param root Root of subtree.
+ * @param pre Function called with Node* before children. Children are
+ *            skipped if it returns false.
+ * @param post Function called with Node* after children.
+ */
+template <class Pre, class Post>
+void traverse(Node* root, Pre pre, Post post)
+{
+	// Second of pair is true once children of node are on the stack
+	std::vector<std::pair<Node*, bool>> stack = { { root, false } };
+	while (!stack.empty()) {
+		auto& top = stack.back();
+		Node* node = top.first;
+		if (top.second) {
+			stack.pop_back();
+			post(node);
+			continue;
+		}
+		top.second = true;
+		if (!pre(node)) continue;
+
+		size_t first = stack.size();
+		forEachChild(node, [&stack](Node* kid) { stack.emplace_back(kid, false); });
+		std::reverse(stack.begin() + first, stack.end());
+	}
+}
+
+/**
+ * Walk subtree like traverse, but with the derivative of each differential
+ * as its only child instead of its function. A derivative is created when
+ * its differential is passed to pre and kept until it is passed to post.
+ * @param root Root of subtree.
+ * @param pre Function called with Node* before children. Children are
+ *            skipped if it returns false.
+ * @param post Function called with Node* after children.
+ */
+template <class Pre, class Post>
+void traverseDerived(Node* root, Pre pre, Post post)
+{
+	std::vector<std::pair<Node*, bool>> stack = { { root, false } };
+	std::vector<NodePtr> derivatives; // Derivatives of differentials on the stack
+	while (!stack.empty()) {
+		auto& top = stack.back();
+		Node* node = top.first;
+		bool fDifferential = node->getType() == Node::DIFFERENTIAL;
+		if (top.second) {
+			stack.pop_back();
+			post(node);
+			if (fDifferential) derivatives.pop_back();
+			continue;
+		}
+		top.second = true;
+		if (!pre(node)) {
+			if (fDifferential) derivatives.emplace_back();
+			continue;
+		}
+
+		if (fDifferential) {
+			derivatives.push_back(static_cast<Differential*>(node)->getDerivative());
+			stack.emplace_back(derivatives.back().get(), false);
+			continue;
+		}
+		size_t first = stack.size();
+		forEachChild(node, [&stack](Node* kid) { stack.emplace_back(kid, false); });
+		std::reverse(stack.begin() + first, stack.end());
+	}
+}
+//@}
+
 #endif // __NODES_H
@@ -29,6 +29,11 @@
 #include <memory>
 #include "milo.h"
 #include "ui.h"
+#include "snapshot.h"
+#include "display.h"
+
+// Forward class declerations
+class Plot;
 
 /**
  * User Interface for milo namespace.
@@ -108,16 +113,35 @@ namespace UI {
 		 */
 		bool doMenu(const std::string& menuFunctionName);
 		
-		/** Handle redraw event
+		/** Handle redraw event by replaying equation recorded by calculateSize().
 		 */
 		void doDraw();
 
 		/** 
 		 * Calculate size of panel.
+		 * Equation is only laid out and recorded again if it was changed.
 		 * @return Calculated size of panel.
 		 */
 		Box calculateSize();
 
+		/**
+		 * Mark equation as changed, so the next calculateSize() lays it out
+		 * and records it again.
+		 */
+		void invalidate() { m_fLayout = true; }
+
+		/**
+		 * Check if recording of equation differs from the one last drawn.
+		 * @return True if doDraw() would draw something different.
+		 */
+		bool needsDraw() { return m_fDraw; }
+
+		/**
+		 * Get drawing of equation recorded by last calculateSize().
+		 * @return Display list of equation.
+		 */
+		const DisplayList& getDisplay() const { return m_display; }
+
 		/** 
 		 * Get last calculated size of equation panel.
 		 * @return Last calculated size of equation panel.
@@ -148,9 +172,21 @@ namespace UI {
 		//@{
 		/**
 		 * Get reference to current equation.
+		 * The equation may be changed through it, so the snapshot shown is
+		 * forgotten and the equation is laid out again.
 		 * @return Reference to current equation.
 		 */
-		Equation& getEqn() { return *m_eqn; }
+		Equation& getEqn() { m_shown = Snapshot(); invalidate(); return *m_eqn; }
+
+		/**
+		 * Take snapshot of current equation, which is then the snapshot shown.
+		 * @param pool Table of nodes to share.
+		 * @return Snapshot of equation.
+		 */
+		const Snapshot& snapshot(Snapshot::Pool& pool) {
+			m_shown = Snapshot(*m_eqn, pool);
+			return m_shown;
+		}
 
 		/**
 		 * New equation from string such as 'a+b/c'
@@ -159,6 +195,8 @@ namespace UI {
 		 */
 		Equation& newEqn(std::string eq) {
 			m_eqn.reset(new Equation(eq));
+			m_shown = Snapshot();
+			invalidate();
 			return *m_eqn;
 		}
 
@@ -169,12 +207,32 @@ namespace UI {
 		 */
 		Equation& newEqn(XML::Parser& in) {
 			m_eqn.reset(new Equation(in));
+			m_shown = Snapshot();
+			invalidate();
+			return *m_eqn;
+		}
+
+		/**
+		 * Change equation to snapshot.
+		 * Nodes that are the same as in the snapshot shown are kept.
+		 * @param snapshot Snapshot of equation.
+		 * @return Refrence to equation
+		 */
+		Equation& newEqn(const Snapshot& snapshot) {
+			snapshot.restore(*m_eqn, m_shown);
+			m_shown = snapshot;
+			invalidate();
 			return *m_eqn;
 		}
 		//@}
 
 	private:
 		EqnPtr        m_eqn;            ///< Shared pointer to current equation.
+		DisplayList m_display{*m_gc};   ///< Drawing of equation at last layout.
+		DisplayList m_record{*m_gc};    ///< Drawing of equation being recorded.
+		bool m_fLayout = true;          ///< True if equation changed since last layout.
+		bool m_fDraw = true;            ///< True if drawing changed since last doDraw().
+		Snapshot m_shown;               ///< Snapshot of equation, if unchanged since it was taken.
 		Node* m_start_select = nullptr; ///< If not null, node is selected.
 		int m_start_mouse_x  = INT_MAX; ///< Horiz coord of start of mouse drag.
 		int m_start_mouse_y  = INT_MAX; ///< Vertical coord of start of mouse drag
@@ -471,6 +529,17 @@ namespace UI {
 		 */
 		Box calculateSize() { return m_eqnBox.calculateSize(); }
 
+		/**
+		 * Mark equation as changed.
+		 */
+		void invalidate() { m_eqnBox.invalidate(); }
+
+		/**
+		 * Check if drawing of equation changed since last doDraw().
+		 * @return True if doDraw() would draw something different.
+		 */
+		bool needsDraw() { return m_eqnBox.needsDraw(); }
+
 		/** 
 		 * Get last calculated size.
 		 * @return Last calculated size.
@@ -517,6 +586,18 @@ namespace UI {
 		 */
 		const std::string& getType() { return EqnPanel::name; }
 
+		/**
+		 * Save snapshot of equation for undo history.
+		 * @return State of panel.
+		 */
+		UndoState::Ptr saveUndo();
+
+		/**
+		 * Restore equation from undo history.
+		 * @param state State made by saveUndo().
+		 */
+		void restoreUndo(const UndoState& state);
+
 		/**
 		 * Set size and origin of the graphics of this panel
 		 * @param x Horizontal size of graphics.
@@ -529,7 +610,8 @@ namespace UI {
 
 		static const std::string name; ///< Name of this panel
 	private:
-		EqnBox m_eqnBox;  ///< Equation Event Box handled by EqnPanel.
+		EqnBox m_eqnBox;       ///< Equation Event Box handled by EqnPanel.
+		Snapshot::Pool m_pool; ///< Nodes shared by snapshots in undo history.
 
 		static bool init; ///< Should be true after static initilization.
 
@@ -664,6 +746,17 @@ namespace UI {
 		 */
 		Box calculateSize();
 
+		/**
+		 * Mark both sides as changed.
+		 */
+		void invalidate() { m_left.invalidate(); m_right.invalidate(); }
+
+		/**
+		 * Check if drawing of either side changed since last doDraw().
+		 * @return True if doDraw() would draw something different.
+		 */
+		bool needsDraw() { return m_left.needsDraw() || m_right.needsDraw(); }
+
 		/** 
 		 * Get last calculated size of equation panel.
 		 * @return Last calculated size of equation panel.
@@ -694,6 +787,18 @@ namespace UI {
 		 */
 		const std::string& getType() { return AlgebraPanel::name; }
 
+		/**
+		 * Save side and snapshots of equations for undo history.
+		 * @return State of panel.
+		 */
+		UndoState::Ptr saveUndo();
+
+		/**
+		 * Restore side and equations from undo history.
+		 * @param state State made by saveUndo().
+		 */
+		void restoreUndo(const UndoState& state);
+
 		/**
 		 * Check where there is an active input in this panel.
 		 * @return If true, there is an active input.
@@ -731,6 +836,20 @@ namespace UI {
 		 * @return Side read from xml.
 		 */
 		Side readSide(XML::Parser& in);
+
+		/**
+		 * Find roots of left - right for a variable.
+		 * Throws logic_error if either side cannot be solved.
+		 * @param var Name of variable.
+		 * @return Distinct roots sorted by real then imaginary part.
+		 */
+		std::vector<Complex> solve(const std::string& var);
+
+		/**
+		 * Solve for first variable and insert each root as a new panel after this one.
+		 * @return True, if a root was found.
+		 */
+		bool insertRoots();
 		//@}
 
 		static const std::string name; ///< Name of this panel
@@ -740,10 +859,17 @@ namespace UI {
 		EqnBox   m_right;   ///< Equation of right of algebraic equality.
 		EqualBox m_equal;   ///< Equal sign between the two equations.
 		Node::Frame m_frame; ///< Form containing both equations.
+		Snapshot::Pool m_pool; ///< Nodes shared by snapshots in undo history.
 
 		static const std::string side_tag;    ///< Side tag.
 		static const std::string left_value;  ///< Element value for left.
 		static const std::string right_value; ///< Element value for right.
+
+		using menu_handler = bool (*)(AlgebraPanel&); ///< Menu function for AlgebraPanel.
+
+		/** Association of menu function names with their handlers.
+		 */
+		static const std::unordered_map<std::string, menu_handler> menu_map;
 		
 		static bool init;    ///< Should be true after static initilization.
 
@@ -752,7 +878,150 @@ namespace UI {
 		 */
 		static bool do_init();
 	};
-	
+
+	/**
+	 * Panel that shows a character plot of an equation over a range of its variable.
+	 * Arrow keys move the range left and right or zoom in and out.
+	 */
+	class PlotPanel : public MiloPanel
+	{
+	public:
+		/** @name Constructors and Virtual Desctructor */
+		//@{
+		/** 
+		 * Constructor for PlotPanel of equation in initialization string.
+		 * @param init Initialization string for equation.
+		 */
+	    PlotPanel(const std::string& init);
+
+		/** 
+		 * Constructor for PlotPanel of a copy of an equation.
+		 * @param eqn Equation to be plotted.
+		 */
+	    PlotPanel(const Equation& eqn);
+
+		/** 
+		 * Constructor for PlotPanel getting range and equation from XML paraser
+		 * @param in  XML parser object.
+		 */
+	    PlotPanel(XML::Parser& in);
+
+		~PlotPanel(); ///< Virtual desctructor.
+		//@}
+
+		/** @name Public Member Functions */
+		//@{		
+		/**
+		 * Handle key event for panel by moving or zooming range.
+		 * @param key Key event
+		 */
+		void doKey(const UI::KeyEvent& key);
+
+		/**
+		 * Handle mouse event for panel
+		 * @param mouse Mouse event
+		 */
+		void doMouse(const UI::MouseEvent&) {}
+
+		/**
+		 * Execute panel specific function based on its name. Used for menu handling.
+		 * @param menuFunctionName Name of menu function to be executed.
+		 * @return True if menuFunctionName found.
+		 */
+		bool doPanelMenu(const std::string&) { return false; }
+		
+		/** Handle redraw event
+		 */
+		void doDraw();
+
+		/** 
+		 * Calculate size of panel sampling equation for current range.
+		 * @return Calculated size of panel.
+		 */
+		Box calculateSize();
+
+		/** 
+		 * Get last calculated size of plot panel.
+		 * @return Last calculated size of plot panel.
+		 */
+		Box getSize();
+
+		/**
+		 * Get base line relative to top of box.
+		 * @return Base line.
+		 */
+		int getBase() { return 0; }
+
+		/**
+		 * Output panel contents as xml to XML stream.
+		 * @param XML stream class object.
+		 */
+		void xml_out(XML::Stream& xml);
+
+		/**
+		 * Copy panel state from XML parser keeping samples if equation is unchanged.
+		 * @param in XML parser object.
+		 */
+		void copy(XML::Parser& in);
+
+		/**
+		 * Get type name of panel.
+		 * @return String containing type of panel for xml tag.
+		 */
+		const std::string& getType() { return PlotPanel::name; }
+
+		/**
+		 * Check where there is an active input in this panel.
+		 * @return Plot has no input.
+		 */
+		bool blink() { return false; }
+
+		/**
+		 * Set size and origin of the graphics of this panel
+		 * @param x Horizontal size ofgraphics.
+		 * @param y Vertical size of graphics.
+		 * @param x0 Horizontal origin of graphics.
+		 * @param y0 Vertical origin of graphics.
+		 */
+		void setBox(int x, int y, int x0, int y0);
+
+		/**
+		 * Get coordinates of current active input.
+		 * @param[out] x Horizontal origin of curosr.
+		 * @param[out] y Vertical origin cursor.
+		 */
+		void getCursorOrig(int&, int&) {}
+		//@}
+
+		static const std::string name; ///< Name of this panel
+	private:
+		std::unique_ptr<Equation> m_eqn; ///< Equation being plotted.
+		std::unique_ptr<Plot> m_plot;    ///< Plot with samples of equation.
+
+		static const std::string range_tag; ///< Range tag.
+
+		static bool init;    ///< Should be true after static initilization.
+
+		/**
+		 * Static initialization for class.
+		 */
+		static bool do_init();
+
+		/**
+		 * Compile equation into a new plot.
+		 * @param min Start of range.
+		 * @param max End of range.
+		 */
+		void newPlot(double min, double max);
+
+		/**
+		 * Read range from XML::Parser.
+		 * @param in XML parser object.
+		 * @param[out] min Start of range.
+		 * @param[out] max End of range.
+		 */
+		static void readRange(XML::Parser& in, double& min, double& max);
+	};
 }
 
 #endif // __PANEL_H
@@ -28,10 +28,13 @@
 #include <map>
 #include <limits>
 #include <initializer_list>
+#include <cmath>
+#include <cstdlib>
 
 #include "milo.h"
 #include "nodes.h"
 #include "xml.h"
+#include "lexer.h"
 
 using namespace std;
 
@@ -45,16 +48,21 @@ class Parser
 public:
 	/**
 	 * Constructor for Parser class.
-	 * @param expr String containing equation.
+	 * The text is not copied, so it must outlive the parser.
+	 * @param expr Text containing equation.
 	 * @param eqn  Equation object container for node tree.
 	 */
-	Parser(const string& expr, Equation& eqn) : m_expr(expr), m_eqn(eqn), m_pos(0) {}
+	Parser(string_view expr, Equation& eqn) : m_expr(expr), m_eqn(eqn), m_pos(0) {}
 
 	/**
 	 * Get the next character to be parsed without advancing.
-	 * @return Next character.
+	 * @param ahead Number of characters to look past the next one.
+	 * @return Next character or '\0' if past end.
 	 */
-	char peek() { return m_expr[m_pos]; }
+	char peek(size_t ahead = 0) const
+	{
+		return (m_pos + ahead < m_expr.length()) ? m_expr[m_pos + ahead] : '\0';
+	}
 
 	/**
 	 * Get next character in string and advance pointer.
@@ -68,17 +76,124 @@ public:
 	 */
 	bool match(const string& s);
 
+	/**
+	 * Find longest keyword or operator at current pointer without advancing.
+	 * @return Token and length of keyword.
+	 */
+	Lexer::Match lex() const
+	{
+		return Lexer::trie.match(m_expr.data() + m_pos, m_expr.length() - m_pos);
+	}
+
+	/**
+	 * Get text at current pointer without advancing.
+	 * @param length Number of characters.
+	 * @return Text.
+	 */
+	string text(size_t length) const { return string(m_expr.substr(m_pos, length)); }
+
+	/**
+	 * Advance pointer past characters.
+	 * @param length Number of characters.
+	 */
+	void skip(size_t length) { m_pos = min(m_pos + length, m_expr.length()); }
+
 	/**
 	 * Get reference to Equation object.
 	 * @return Equation object reference.
 	 */
 	Equation& getEqn() { return m_eqn; }
+
+	/**
+	 * Get position of next character to be parsed.
+	 * @return Byte offset in text.
+	 */
+	size_t getPos() const { return m_pos; }
+
+	/**
+	 * Record error if it is the first one and stop parsing.
+	 * The pointer moves to the end of the text, so every parse function
+	 * returns as if the text had ended and no exception is needed.
+	 * @param code Kind of error.
+	 * @param message Description of error.
+	 * @param offset Byte offset of error.
+	 */
+	void fail(ParseError::Code code, const string& message, size_t offset);
+
+	/**
+	 * Record error at next character if it is the first one and stop parsing.
+	 * @param code Kind of error.
+	 * @param message Description of error.
+	 */
+	void fail(ParseError::Code code, const string& message) { fail(code, message, m_pos); }
+
+	/**
+	 * Get first error.
+	 * @return Error, with code NONE if there is none.
+	 */
+	const ParseError& getError() const { return m_error; }
+
+	/**
+	 * Throw first error as logic_error if there is one.
+	 */
+	void check() const { m_error.check(); }
+
+	/**
+	 * Start parenthesis that was just parsed.
+	 */
+	void open() { m_open.push_back(m_pos - 1); }
+
+	/**
+	 * Close innermost parenthesis.
+	 * @return False, if no parenthesis is open.
+	 */
+	bool close()
+	{
+		if (m_open.empty()) return false;
+		m_open.pop_back();
+		return true;
+	}
+
+	/**
+	 * Get position of innermost open parenthesis.
+	 * @return Byte offset of parenthesis or npos if none is open.
+	 */
+	size_t getOpen() const { return m_open.empty() ? string::npos : m_open.back(); }
+
+	/**
+	 * Parse terms of an expression or factors of a term.
+	 * Nested expressions, arguments of functions and operands of divisions
+	 * and powers are kept on an explicit stack, so nesting is only limited
+	 * by memory.
+	 * @param expr Expression to add terms to, or null to parse one term.
+	 * @param term Term to add factors to, if expression is null.
+	 */
+	void parse(Expression* expr, Term* term);
 private:
-	string m_expr;   ///< String to be parsed.
-	Equation& m_eqn; ///< Equation containing node tree.
-	size_t m_pos;    ///< Pointer to next character to be parsed.
+	string_view m_expr;    ///< Text to be parsed.
+	Equation& m_eqn;       ///< Equation containing node tree.
+	size_t m_pos;          ///< Pointer to next character to be parsed.
+	ParseError m_error;    ///< First error in text.
+	vector<size_t> m_open; ///< Positions of open parenthesis.
+
+	/**
+	 * Parse one factor that is not an expression, function or differential.
+	 * @param parent Parent node.
+	 * @return Factor or null if none is next.
+	 */
+	Node* leaf(Node* parent);
 };
 
+void Parser::fail(ParseError::Code code, const string& message, size_t offset)
+{
+	if (m_error.code == ParseError::NONE) {
+		m_error.code = code;
+		m_error.offset = offset;
+		m_error.message = message;
+	}
+	m_pos = m_expr.length();
+}
+
 // Get next character to be parsed or '\0' if at end.
 char Parser::next()
 {
@@ -89,8 +204,7 @@ char Parser::next()
 // Return true if string in parser.
 bool Parser::match(const string& s)
 {
-	size_t pos = m_expr.find(s, m_pos); 
-	if ( pos != string::npos && pos == m_pos ) {
+	if ( m_expr.compare(m_pos, s.length(), s) == 0 ) {
 		m_pos += s.length();
 		return true;
 	}
@@ -98,27 +212,210 @@ bool Parser::match(const string& s)
 		return false;
 }
 
+/**
+ * Check if parser is at the subscript of a variable name.
+ * @param p Parser object.
+ * @param ahead Number of characters to look past the next one.
+ * @return True if an underscore and a digit are next.
+ */
+static bool isSubscript(const Parser& p, size_t ahead = 0)
+{
+	return p.peek(ahead) == '_' && isdigit(p.peek(ahead + 1));
+}
+
+/**
+ * Get name of variable from parser.
+ * A name is a letter optionally followed by an underscore and a subscript of
+ * digits, such as x_12. Subscripts are only digits, so xy is still x times y
+ * and x_1y is x_1 times y.
+ * @param p Parser object pointing to name.
+ * @return Name of variable.
+ */
+static string getVariableName(Parser& p)
+{
+	string name(1, p.next());
+	if (isSubscript(p)) {
+		name += p.next();
+		while (isdigit(p.peek())) name += p.next();
+	}
+	return name;
+}
+
+// Parse leaf factor from first class that matches next character.
+Node* Parser::leaf(Node* parent)
+{
+	Node*      node = Constant::parse(*this, parent);
+	if (!node) node = Number::parse(*this, parent);
+	if (!node) node = Variable::parse(*this, parent);
+	if (!node) node = Input::parse(*this, parent);
+	return node;
+}
+
+void Parser::parse(Expression* expr, Term* term)
+{
+	// Expression being parsed, with its term being parsed and the left
+	// operands of divisions and powers waiting for their right operand.
+	// A nested expression is closed into the node it belongs to.
+	struct Frame {
+		Expression* expr;
+		Term* term;
+		vector<pair<Node*, Lexer::Token>> operands;
+		Node::Kind kind;
+		string name;
+	};
+	vector<Frame> stack;
+	stack.push_back({ expr, term, {}, Node::EXPRESSION, string() });
+
+	Node* node = nullptr; // Factor parsed but not yet added to its term
+	while (true) {
+		Frame& f = stack.back();
+		if (node) {
+			auto op = lex().token;
+			if (op == Lexer::DIVIDE || op == Lexer::POWER) {
+				next();
+				f.operands.push_back({ node, op });
+			}
+			else {
+				// Operators are right associative, so a/b^c is a/(b^c)
+				while (!f.operands.empty()) {
+					auto left = f.operands.back();
+					f.operands.pop_back();
+					if (left.second == Lexer::DIVIDE)
+						node = new Divide(left.first, node, m_eqn, f.term);
+					else
+						node = new Power(left.first, node, m_eqn, f.term);
+				}
+				f.term->factors.push_back(node);
+			}
+			node = nullptr;
+			continue;
+		}
+
+		if (!f.term) {
+			bool neg = false;
+			if (peek() == '+' || peek() == '-') neg = (next() == '-');
+			NodeVector factors;
+			f.term = new Term(factors, m_eqn, f.expr);
+			if (neg) f.term->negative();
+			f.expr->terms.push_back(f.term);
+		}
+
+		auto keyword = lex();
+		if (peek() != '\0' && keyword.token != Lexer::PLUS && keyword.token != Lexer::MINUS &&
+		    keyword.token != Lexer::CLOSE) {
+			auto token = keyword.token;
+			if (token == Lexer::OPEN || token == Lexer::FUNCTION || token == Lexer::DIFFERENTIAL) {
+				Frame nested = { nullptr, nullptr, {}, Node::EXPRESSION, string() };
+				if (token == Lexer::OPEN) {
+					next();
+					open();
+				}
+				else if (token == Lexer::FUNCTION) {
+					// Keyword is name of function followed by its open parenthesis.
+					nested.kind = Node::FUNCTION;
+					nested.name = text(keyword.length - 1);
+					skip(keyword.length);
+					open();
+				}
+				else {
+					// After an error the tree must still be whole, so the
+					// differential still gets an expression.
+					nested.kind = Node::DIFFERENTIAL;
+					skip(keyword.length);
+					if (!isalpha(peek())) {
+						fail(ParseError::VARIABLE, "expected variable name");
+					}
+					else {
+						nested.name = getVariableName(*this);
+						if (lex().token != Lexer::OPEN) {
+							fail(ParseError::EXPRESSION, "expected expression");
+						}
+						else {
+							next();
+							open();
+						}
+					}
+				}
+				TermVector terms;
+				nested.expr = new Expression(terms, m_eqn, nested.kind == Node::EXPRESSION ? f.term : nullptr);
+				stack.push_back(move(nested));
+				continue;
+			}
+			node = leaf(f.term);
+			if (node) continue;
+		}
+
+		if (!f.operands.empty()) {
+			fail(ParseError::OPERAND, "missing operand");
+			node = f.operands.back().first;
+			f.operands.pop_back();
+			continue;
+		}
+
+		// Term has ended, so expression ends or has another term
+		if (!f.expr) return;
+		char c = peek();
+		if ( c != '\0' && c != ')' && c != '+' && c != '-' ) {
+			fail(ParseError::UNEXPECTED, string("unexpected character '") + c + "'");
+		}
+		if ( peek() != '\0' && peek() != ')' ) {
+			f.term = nullptr;
+			continue;
+		}
+		if (peek() == ')' && !close()) fail(ParseError::CLOSE, "unmatched close parenthesis");
+		if (peek() == '\0' && getOpen() != string::npos) {
+			fail(ParseError::OPEN, "missing close parenthesis", getOpen());
+		}
+		next();
+
+		Frame done = move(f);
+		stack.pop_back();
+		done.expr->setDrawParenthesis(true);
+		if (stack.empty()) return;
+
+		Term* parent = stack.back().term;
+		if (done.kind == Node::FUNCTION)
+			node = new Function(done.name, done.expr, m_eqn, parent);
+		else if (done.kind == Node::DIFFERENTIAL)
+			node = new Differential(done.name, done.expr, m_eqn, parent);
+		else
+			node = done.expr;
+	}
+}
+
 /* Serialize xml for Node object.
  * First output header with name of derived class and 
  * attributes nth, negatvie and select if needed.
- * Then call virtual member function xml_out for rest.
+ * Then call virtual member function xml_out for rest of header.
+ * Children follow the header and nodes with children are closed
+ * with a footer once their children are written.
  */
 XML::Stream& Node::out(XML::Stream& xml)
 { 
-	xml << XML::HEADER << getName();
-	if (m_nth != 1) xml << XML::NAME_VALUE << "nth" << to_string(m_nth);
-	if (!m_sign) xml << XML::NAME_VALUE << "negative" << "true";
-	if (m_select != NONE) xml << XML::NAME_VALUE << "select" << select_tags.at(m_select);
-	xml_out(xml);
+	traverse(this,
+		[&xml](Node* node) {
+			xml << XML::HEADER << node->getName();
+			if (node->m_nth != 1) xml << XML::NAME_VALUE << "nth" << to_string(node->m_nth);
+			if (!node->m_sign) xml << XML::NAME_VALUE << "negative" << "true";
+			if (node->m_select != NONE) xml << XML::NAME_VALUE << "select" << select_tags.at(node->m_select);
+			node->xml_out(xml);
+			return true;
+		},
+		[&xml](Node* node) { if (!node->isLeaf()) xml << XML::FOOTER; });
 	return xml;
 }
 
-Node::Node(Parser& p, Node* parent, bool fNeg, Select s) : 
-	m_eqn(p.getEqn()), m_parent(parent), m_sign(!fNeg), m_select(s) {}
+Node::Node(Kind kind, Parser& p, Node* parent, bool fNeg, Select s) : 
+	m_eqn(p.getEqn()), m_kind(kind), m_parent(parent), m_sign(!fNeg), m_select(s) {}
 
-// Constructor for node class from XML parser.
-Node::Node(XML::Parser& in, Equation& eqn, Node* parent) : 
-	 m_eqn(eqn), m_parent(parent),m_sign(true), m_select(NONE), m_nth(1)
+/**
+ * Read attributes common to all nodes from the header of a node.
+ * @param in XML parser after the tag of the header.
+ * @param sign Set false if node is negative.
+ * @param select Set to selection state of node.
+ * @param nth Set to integer power of node.
+ */
+static void readAttributes(XML::Parser& in, bool& sign, Node::Select& select, int& nth)
 {
 	// Check for name, value pairs to load in.
 	if (in.check(XML::NAME_VALUE)) in.next(XML::NAME_VALUE);
@@ -127,27 +424,24 @@ Node::Node(XML::Parser& in, Equation& eqn, Node* parent) :
 	string value;
 	if (in.getAttribute("negative", value)) {
 		if (value != "true" && value != "false") in.syntaxError("bad boolean value");
-		m_sign = (value == "false");
+		sign = (value == "false");
 	}
 	if (in.getAttribute("select", value)) {
-		auto pos = find(select_tags, value);
-		if (pos == select_tags.end()) in.syntaxError("unknown select node value");
-		m_select = (Select) distance(select_tags.begin(), pos);
-		switch (m_select) {
-		    case START: eqn.setSelectStart(this);
-			            break;
-		    case END:   eqn.setSelectEnd(this);
-			            break;
-		    case ALL:   eqn.setSelect(this);
-			            break;
-		    default: 
-				   break;
-		}
+		auto pos = find(Node::select_tags, value);
+		if (pos == Node::select_tags.end()) in.syntaxError("unknown select node value");
+		select = (Node::Select) distance(Node::select_tags.begin(), pos);
 	}
 	if (in.getAttribute("nth", value)) {
 		if (!isInteger(value)) in.syntaxError("not an integer");
-		m_nth = atoi(value.c_str());
+		nth = atoi(value.c_str());
 	}
+}
+
+// Constructor for node class from XML parser.
+Node::Node(Kind kind, XML::Parser& in, Equation& eqn, Node* parent) : 
+	 m_eqn(eqn), m_kind(kind), m_parent(parent),m_sign(true), m_select(NONE), m_nth(1)
+{
+	readAttributes(in, m_sign, m_select, m_nth);
 	eqn.setSelectFromNode(this); // Register selection with Equation.
 }
 
@@ -157,7 +451,7 @@ void Equation::xml_in(XML::Parser& in)
 	// Read in equation header and then expression header.
 	in.next(XML::HEADER, "equation").next(XML::HEADER_END).next(XML::HEADER, Expression::name);
 
-	m_root = new Expression(in, *this, nullptr);
+	m_root = static_cast<Expression*>(Node::create(in, *this, nullptr));
 	m_root->setDrawParenthesis(false);
 
 	in.next(XML::FOOTER);
@@ -184,7 +478,6 @@ Equation& Equation::operator=(const Equation& eqn)
 	// Read in serialized equation.
 	istringstream is(store);
 	XML::Parser in(is);
-	in.next(XML::HEADER, "equation");
 	xml_in(in);
 	return *this;
 }
@@ -210,36 +503,34 @@ const string        Power::name = "power";        // Power class name.
 const string         Term::name = "term";         // Term class name.
 
 /**
- * Template function to return a new class object.
- * Use the template specialization to call the correct
- * constructor to get the desired derived class. Note: 
- * pointer is to the node base class.
+ * Map of tag of header to kind of node.
  */
-template <class T>
-static Node* create(XML::Parser& in, Equation& eqn, Node* parent)
-{
-	return new T(in, eqn, parent);
-}
+static const unordered_map<string, Node::Kind> kinds =
+	{ { Differential::name, Node::DIFFERENTIAL },
+	  {   Expression::name, Node::EXPRESSION   },
+	  {     Function::name, Node::FUNCTION     },
+	  {     Constant::name, Node::CONSTANT     },
+	  {     Variable::name, Node::VARIABLE     },
+	  {       Number::name, Node::NUMBER       },
+	  {       Divide::name, Node::DIVIDE       },
+	  {        Input::name, Node::INPUT        },
+	  {        Power::name, Node::POWER        },
+	  {         Term::name, Node::TERM         },
+	};
 
 /**
- * Function pointer to create a new node.
+ * Read header of next factor from xml.
+ * @param in XML input parser object.
+ * @return True, if the header of a factor was read.
  */
-using createPtr = Node* (*)(XML::Parser&, Equation&, Node*);
+static bool nextFactor(XML::Parser& in)
+{
+	if (!in.check(XML::HEADER)) return false;
 
-/**
- * Map of class name to named constructor.
- */
-static const unordered_map<string, createPtr> create_factors =
-	{ { Differential::name, create<Differential> },
-	  {   Expression::name, create<Expression>   },
-	  {     Function::name, create<Function>     },
-	  {     Constant::name, create<Constant>     },
-	  {     Variable::name, create<Variable>     },
-	  {       Number::name, create<Number>       },
-	  {       Divide::name, create<Divide>       },
-	  {        Input::name, create<Input>        },
-	  {        Power::name, create<Power>        },
-	};
+	in.next(XML::HEADER);
+	auto kind = kinds.find(in.getTag());
+	return kind != kinds.end() && kind->second != Node::TERM;
+}
 
 /**
  * Get next factor from xml.
@@ -250,19 +541,220 @@ static const unordered_map<string, createPtr> create_factors =
  */
 static Node* getFactor(XML::Parser& in, Equation& eqn, Node* parent)
 {
-	if (!in.check(XML::HEADER)) return nullptr;
+	return nextFactor(in) ? Node::create(in, eqn, parent) : nullptr;
+}
 
-	in.next(XML::HEADER);
-	if (create_factors.find(in.getTag()) == create_factors.end()) return nullptr;
+// Read subtree with an explicit stack. Leaves are read by their XML
+// constructors, other nodes are created from their children at their footer.
+Node* Node::create(XML::Parser& in, Equation& eqn, Node* parent)
+{
+	struct Frame {
+		Kind kind;
+		string name;
+		bool sign = true;
+		Select select = NONE;
+		int nth = 1;
+		vector<NodePtr> kids;
+	};
+	vector<Frame> stack;
+
+	while (true) {
+		// Read node whose header was just read, or the header of a composite node
+		Node* node = nullptr;
+		Kind kind = kinds.at(in.getTag());
+		switch (kind) {
+			case NUMBER:   node = new Number(in, eqn, nullptr);   break;
+			case CONSTANT: node = new Constant(in, eqn, nullptr); break;
+			case VARIABLE: node = new Variable(in, eqn, nullptr); break;
+			case INPUT:    node = new Input(in, eqn, nullptr);    break;
+			default: {
+				Frame frame;
+				frame.kind = kind;
+				readAttributes(in, frame.sign, frame.select, frame.nth);
+				if (kind == DIFFERENTIAL) {
+					if (!in.getAttribute("variable", frame.name)) in.syntaxError("missing variable name");
+					in.assertNoAttributes();
+				}
+				in.next(XML::HEADER_END);
+				if (kind == TERM || kind == EXPRESSION) in.assertNoAttributes();
+				if (kind == FUNCTION) {
+					if (!in.getAttribute("name", frame.name)) in.syntaxError("function name not found");
+					auto names = Function::getFunctions();
+					if (find(names, frame.name) == names.end()) in.syntaxError("function name unknown: " + frame.name);
+				}
+				stack.push_back(move(frame));
+				break;
+			}
+		}
+
+		// Add finished nodes to their parents until a parent needs another child
+		while (true) {
+			if (node) {
+				if (stack.empty()) {
+					node->setParent(parent);
+					return node;
+				}
+				stack.back().kids.emplace_back(node);
+				node = nullptr;
+			}
+
+			Frame& frame = stack.back();
+			size_t n = frame.kids.size();
+			bool fChild = false;
+			switch (frame.kind) {
+				case EXPRESSION:
+					fChild = in.check(XML::HEADER, Term::name);
+					if (fChild) in.next(XML::HEADER, Term::name);
+					break;
+				case TERM:
+					fChild = nextFactor(in);
+					break;
+				case FUNCTION:
+				case DIVIDE:
+				case POWER:
+					if (n == (frame.kind == FUNCTION ? 1 : 2)) break;
+					fChild = nextFactor(in);
+					if (!fChild) in.syntaxError("header for factor expected");
+					break;
+				case DIFFERENTIAL:
+					if (n == 1) break;
+					in.next(XML::HEADER, Expression::name);
+					fChild = true;
+					break;
+				default:
+					break;
+			}
+			if (fChild) break;
+
+			in.next(XML::FOOTER);
+			node = create(frame.kind, frame.name, 0, frame.kids, eqn, nullptr);
+			node->m_sign = frame.sign;
+			node->m_select = frame.select;
+			node->m_nth = frame.nth;
+			eqn.setSelectFromNode(node);
+			stack.pop_back();
+		}
+	}
+}
+
+// Serialize subtree to XML fragment without root tag.
+void Node::out(string& str)
+{
+	ostringstream os;
+	{
+		XML::Stream xml(os, string());
+		out(xml);
+	}
+	str = os.str();
+}
 
-	auto cp = create_factors.at(in.getTag());
-	return cp(in, eqn, parent);
+// Create subtree from XML fragment without root tag.
+Node* Node::create(const string& str, Equation& eqn, Node* parent)
+{
+	istringstream is(str);
+	XML::Parser in(is, string());
+	return getFactor(in, eqn, parent);
+}
+
+// Create node from its contents and children.
+Node* Node::create(Kind kind, const string& name, double value, const vector<NodePtr>& kids,
+                   Equation& eqn, Node* parent)
+{
+	static const size_t any = SIZE_MAX;
+	static const size_t arity[] = { 0, 0, 0, any, 1, 2, 2, 1, 0, any };
+	if (arity[kind] != any && kids.size() != arity[kind]) throw logic_error("wrong number of children");
+	if (kind == CONSTANT && name.length() != 1) throw logic_error("bad name: " + name);
+
+	switch (kind) {
+		case NUMBER:       return new Number(value, eqn, parent);
+		case CONSTANT:     return new Constant(name[0], eqn, parent);
+		case VARIABLE:     return new Variable(name, eqn, parent);
+		case INPUT:        return new Input(eqn, name, false, parent);
+		case FUNCTION:     return new Function(name, kids[0].get(), eqn, parent);
+		case DIFFERENTIAL: return new Differential(name, kids[0].get(), eqn, parent);
+		case DIVIDE:
+		case POWER: {
+			Node* node;
+			if (kind == DIVIDE) node = new Divide(kids[0].get(), kids[1].get(), eqn, parent);
+			else                node = new Power(kids[0].get(), kids[1].get(), eqn, parent);
+			kids[0]->setParent(node);
+			kids[1]->setParent(node);
+			return node;
+		}
+		case TERM: {
+			NodeVector factors;
+			for ( auto& kid : kids ) {
+				if (!kid->isFactor()) throw logic_error("term of term");
+				factors.push_back(kid.get());
+			}
+			auto term = new Term(factors, eqn, static_cast<Expression*>(parent));
+			term->setParent();
+			return term;
+		}
+		case EXPRESSION: {
+			TermVector terms;
+			for ( auto& kid : kids ) {
+				if (kid->getType() != TERM) throw logic_error("expression of factor");
+				terms.push_back(static_cast<Term*>(kid.get()));
+			}
+			return new Expression(terms, eqn, parent);
+		}
+	}
+	throw logic_error("unknown kind of node");
+}
+
+// Copy contents of node onto new node with given children.
+NodePtr Node::copy(const vector<NodePtr>& kids, Equation& eqn)
+{
+	string name;
+	double value = 0;
+	switch (m_kind) {
+		case NUMBER:       value = static_cast<Number*>(this)->getReal(); break;
+		case CONSTANT:     name = string(1, static_cast<Constant*>(this)->getConstant()); break;
+		case VARIABLE:     name = static_cast<Variable*>(this)->getVariable(); break;
+		case FUNCTION:     name = static_cast<Function*>(this)->getFunction(); break;
+		case DIFFERENTIAL: name = static_cast<Differential*>(this)->getVariable(); break;
+		case INPUT:        name = static_cast<Input*>(this)->getBuffer(); break;
+		default:           break;
+	}
+	NodePtr node(create(m_kind, name, value, kids, eqn, nullptr));
+	node->m_nth = m_nth;
+	node->m_sign = m_sign;
+	node->m_fDrawParenthesis = m_fDrawParenthesis;
+	return node;
+}
+
+// Copy subtree with an explicit stack, children before their parents.
+NodePtr Node::clone(Equation& eqn, Node* parent)
+{
+	vector<NodePtr> done;
+	traverse(this, [](Node*) { return true; }, [&done, &eqn](Node* node) {
+		size_t n = 0;
+		forEachChild(node, [&n](Node*) { ++n; });
+		vector<NodePtr> kids(done.end() - n, done.end());
+		done.resize(done.size() - n);
+		done.push_back(node->copy(kids, eqn));
+	});
+	done.back()->setParent(parent);
+	return done.back();
 }
 
 Term* Expression::getTerm(Equation& eqn, const string& text, Expression* parent)
 {
 	Parser p(text, eqn);
-	return getTerm(p, parent);
+	Term* term = getTerm(p, parent);
+	p.check();
+	return term;
+}
+
+Term::Term(Parser& p, Expression* parent) : Node(type, p, (Node*) parent)
+{
+	p.parse(nullptr, this);
+}
+
+Expression::Expression(Parser& p, Node* parent) : Node(type, p, parent)
+{
+	p.parse(this, nullptr);
 }
 
 Term* Expression::getTerm(Parser& p, Expression* parent)
@@ -277,26 +769,6 @@ Term* Expression::getTerm(Parser& p, Expression* parent)
 	return node;
 }
 
-bool Expression::add(Parser& p)
-{
-	Term* term = getTerm(p, this);
-	terms.push_back(term);
-	
-	if ( p.peek() == '\0' || p.peek() == ')' ) {
-		p.next();
-		return false;
-	}
-	else
-		return true;
-}
-
-Node* Expression::parse(Parser& p, Node* parent) {
-	if (p.peek() != '(') return nullptr;
-	
-	p.next();
-	return new Expression(p, parent);
-}
-
 void Equation::xml_out(XML::Stream& xml) const
 {
 	xml << XML::HEADER << "equation" << XML::HEADER_END;
@@ -320,21 +792,16 @@ void Equation::xml_out(string& str) const
 void Function::xml_out(XML::Stream& xml) const 
 {
 	xml << XML::NAME_VALUE << "name" << m_name << XML::HEADER_END;
-	m_arg->out(xml);
-	xml << XML::FOOTER;
 }
 
 void Binary::xml_out(XML::Stream& xml) const 
 {
 	xml << XML::HEADER_END;
-	m_first->out(xml);
-	m_second->out(xml);
-	xml << XML::FOOTER;
 }
 
 void Variable::xml_out(XML::Stream& xml) const
 {
-	xml << XML::NAME_VALUE << "name" << string(1, m_name) << XML::ATOM_END;
+	xml << XML::NAME_VALUE << "name" << getVariable() << XML::ATOM_END;
 }
 
 void Constant::xml_out(XML::Stream& xml) const 
@@ -362,63 +829,58 @@ void Input::xml_out(XML::Stream& xml) const
 void Term::xml_out(XML::Stream& xml) const
 {
 	xml << XML::HEADER_END;
-	for ( auto n : factors ) { n->out(xml); }
-	xml << XML::FOOTER;
 }
 
 void Expression::xml_out(XML::Stream& xml) const
 {
 	xml << XML::HEADER_END;
-	for ( auto n : terms ) { n->out(xml); }
-	xml << XML::FOOTER;
 }
 
-Equation::Equation(const string& eq)
+Equation::Equation(string_view eq)
 { 
-	Parser p(eq, *this); 
-	m_root = new Expression(p);
-	m_root->setDrawParenthesis(false);
+	load(eq).check();
 }
 
-void Equation::insert(FactorIterator& it, const string& text)
+ParseResult Equation::parse(string_view eq)
 {
-	Parser p(text, *this);
-	while (p.peek()) {
-		it.insert(Term::parse(p, nullptr));
-		++it;
-	}	
+	unique_ptr<Equation> eqn(new Equation());
+	ParseError error = eqn->load(eq);
+	if (error.code != ParseError::NONE) return error;
+	return ParseResult(move(eqn));
 }
 
-Function* Function::parse(Parser& p, Node* parent) {
-	if (!isalpha(p.peek()) ) return nullptr;
-
-	// Search all built in functions and return a match.
-	for ( auto m : functions ) { 
-		if (p.match(m.first + "(")) {
-			return new Function(m.first, m.second, p, parent);
-		}
-	}
-	return nullptr; // No match found.
+ParseError Equation::load(string_view eq)
+{
+	Parser p(eq, *this); 
+	m_root = new Expression(p);
+	m_root->setDrawParenthesis(false);
+	return p.getError();
 }
 
-Node* Binary::parse(Parser& p, Node* one, Node* parent)
+void Equation::insert(FactorIterator& it, string_view text)
 {
-	char c = p.peek();
-	if (c != '/' && c != '^') return one; // No binary op found, return given node.
-
-	c = p.next();
-	Node* two = Term::parse(p);
-	if (!two) throw logic_error("bad format");
+	// Parse every factor before inserting any, so text with an error
+	// leaves the equation as it was.
+	size_t inputs = m_inputs.size();
+	Parser p(text, *this);
+	NodePtr term(new Term(p, nullptr));
+	if (p.peek()) p.fail(ParseError::UNEXPECTED, string("unexpected character '") + p.peek() + "'");
+	vector<NodePtr> nodes;
+	forEachChild(term.get(), [&nodes](Node* node) { nodes.emplace_back(node); });
+	if (p.getError().code != ParseError::NONE) {
+		while (m_inputs.size() > inputs) removeInput(m_inputs.back());
+		p.check();
+	}
 
-	if ( c == '/' ) 
-		return new Divide(one, two, p.getEqn(), parent); 
-	else if ( c == '^' ) 
-		return new Power(one, two, p.getEqn(), parent);
-	return one;
+	for ( auto& node : nodes ) {
+		it.insert(node.get());
+		++it;
+	}
 }
 
 // Parser constructor for variable. Get name from parser.
-Variable::Variable(Parser& p, Node* parent) : Node(p.getEqn(), parent), m_name( p.next() ) {}
+Variable::Variable(Parser& p, Node* parent) : 
+	Node(type, p.getEqn(), parent), m_id(SymbolTable::global().intern(getVariableName(p), SymbolTable::VARIABLE)) {}
 
 Variable* Variable::parse(Parser& p, Node* parent)
 {
@@ -432,12 +894,12 @@ Variable* Variable::parse(Parser& p, Node* parent)
 
 // Parser constructor for constant. Get name from parser and find value.
 Constant::Constant(Parser& p, Node* parent) : 
-	Node(p.getEqn(), parent), m_name(p.next()), m_value(constants.find(m_name)->second) {}
+	Node(type, p.getEqn(), parent), m_name(p.next()), m_value(constants.find(m_name)->second) {}
 
 Constant* Constant::parse(Parser& p, Node* parent)
 {
 	char c = p.peek();
-	if ( constants.find(c) != constants.end() ) {
+	if ( constants.find(c) != constants.end() && !isSubscript(p, 1) ) {
 		return new Constant(p, parent);
 	}
 	else
@@ -463,90 +925,31 @@ string Number::getInteger(Parser& p)
 
 void Number::getNumber(Parser& p)
 {
+	size_t start = p.getPos();
 	string n = getInteger(p);
-	if (!p.peek() || (p.peek() != '.' && toupper(p.peek()) != 'E')) {
-		m_value = stod(n);
-		return;
-	}
-	char c = p.next();
-	if (c == '.' && isdigit(p.peek())) {
-		n += "." +  getInteger(p);
+	if (p.peek() == '.') {
+		p.next();
+		if (isdigit(p.peek())) n += "." + getInteger(p);
 	}
-	if (toupper(p.peek()) == 'E') {
-		p.next(); n += 'E';
-		if (p.peek() == '-' || p.peek() == '+') n += p.next();
 
-		if (!isdigit(p.peek())) throw logic_error("bad format");
+	// An exponent needs digits, so a lone e is left as the constant
+	char e = p.peek(), s = p.peek(1);
+	if (toupper(e) == 'E' && (isdigit(s) || ((s == '-' || s == '+') && isdigit(p.peek(2))))) {
+		p.next(); n += 'E';
+		if (!isdigit(p.peek())) n += p.next();
 		n += getInteger(p);
 	}
 
-	m_value = stod(n);
+	m_value = strtod(n.c_str(), nullptr);
+	if (isinf(m_value)) p.fail(ParseError::NUMBER, "number out of range", start);
 	m_isInteger = isInteger(m_value);
 }
 
-Node* Term::parse(Parser& p, Node* parent)
-{
-	char c = p.peek();
-	if ( c=='\0' || c=='+' || c=='-' || c==')' ) return nullptr;
-
-	Node*      node = Expression::parse(p, parent);
-	if (!node) node = Function::parse(p, parent);
-	if (!node) node = Differential::parse(p, parent);
-	if (!node) node = Constant::parse(p, parent);
-	if (!node) node = Number::parse(p, parent);
-	if (!node) node = Variable::parse(p, parent);
-	if (!node) node = Input::parse(p, parent);
-	if (!node) return nullptr;
-
-	node = Binary::parse(p, node, parent);
-	return node;
-}
-
-bool Term::add(Parser& p)
-{
-	Node* node = parse(p, this);
-	if (!node) return false;
-
-	factors.push_back(node);
-	return true;
-}
-
-Function::Function(XML::Parser& in, Equation& eqn, Node* parent) : Node(in, eqn, parent)
-{
-	in.next(XML::HEADER_END);
-
-	if (in.getAttribute("name", m_name)) {
-		if (functions.find(m_name) == functions.end()) 
-			in.syntaxError("function name unknown: " + m_name);
-		m_func = functions.at(m_name);
-	}
-	else
-		in.syntaxError("function name not found");
-
-	m_arg  = getFactor(in, eqn, this);
-	if (!m_arg) in.syntaxError("header for factor expected");
-
-	in.next(XML::FOOTER);
-}
-
-Binary::Binary(XML::Parser& in, Equation& eqn, Node* parent) : Node(in, eqn, parent)
-{
-	in.next(XML::HEADER_END);
-
-	m_first  = getFactor(in, eqn, this);
-	if (!m_first) in.syntaxError("header for factor expected");
-
-	m_second = getFactor(in, eqn, this);
-	if (!m_second) in.syntaxError("header for factor expected");
-
-	in.next(XML::FOOTER);
-}
-
-Variable::Variable(XML::Parser& in, Equation& eqn, Node* parent) : Node(in, eqn, parent)
+Variable::Variable(XML::Parser& in, Equation& eqn, Node* parent) : Node(type, in, eqn, parent)
 {
 	string value;
 	if (in.getAttribute("name", value)) {
-		m_name = value[0];
+		m_id = SymbolTable::global().intern(value, SymbolTable::VARIABLE);
 	}
 	else
 		in.syntaxError("Missing name attribute");
@@ -555,7 +958,7 @@ Variable::Variable(XML::Parser& in, Equation& eqn, Node* parent) : Node(in, eqn,
 	in.next(XML::ATOM_END);
 }
 
-Constant::Constant(XML::Parser& in, Equation& eqn, Node* parent) : Node(in, eqn, parent)
+Constant::Constant(XML::Parser& in, Equation& eqn, Node* parent) : Node(type, in, eqn, parent)
 {
 	string value;
 	if (in.getAttribute("name", value)) {
@@ -571,7 +974,7 @@ Constant::Constant(XML::Parser& in, Equation& eqn, Node* parent) : Node(in, eqn,
 	in.next(XML::ATOM_END);
 }
 
-Number::Number(XML::Parser& in, Equation& eqn, Node* parent) : Node(in, eqn, parent)
+Number::Number(XML::Parser& in, Equation& eqn, Node* parent) : Node(type, in, eqn, parent)
 {
 	string real = "0";
 	if (!in.getAttribute("value", real)) in.syntaxError("Missing value attribute");
@@ -583,7 +986,7 @@ Number::Number(XML::Parser& in, Equation& eqn, Node* parent) : Node(in, eqn, par
 	in.next(XML::ATOM_END);
 }
 
-Input::Input(XML::Parser& in, Equation& eqn, Node* parent) : Node(in, eqn, parent), m_sn(++input_sn), m_current(false)
+Input::Input(XML::Parser& in, Equation& eqn, Node* parent) : Node(type, in, eqn, parent), m_sn(++input_sn), m_current(false)
 {
 	m_eqn.addInput(this);
 	string value;
@@ -600,40 +1003,21 @@ Input::Input(XML::Parser& in, Equation& eqn, Node* parent) : Node(in, eqn, paren
 	in.next(XML::ATOM_END);
 }
 
-Term::Term(XML::Parser& in, Equation& eqn, Node* parent) : Node(in, eqn, parent)
-{
-	in.next(XML::HEADER_END);
-	in.assertNoAttributes();
-
-	while (Node* factor = getFactor(in, eqn, this)) { 
-		factors.push_back(factor);
-	}
-
-	in.next(XML::FOOTER);
-}
-
-Expression::Expression(XML::Parser& in, Equation& eqn, Node* parent) : Node(in, eqn, parent)
-{
-	in.next(XML::HEADER_END);
-	in.assertNoAttributes();
-	
-	while (in.check(XML::HEADER, Term::name)) { 
-		in.next(XML::HEADER, Term::name);
-		terms.push_back(new Term(in, eqn, this));
-	}
-	setDrawParenthesis(true);
-
-	in.next(XML::FOOTER);
-}
-
 Input::Input(Parser& p, Node* parent) : 
-	Node(p, parent), m_sn(++input_sn), m_typed(""), m_current(false)
+	Node(type, p, parent), m_sn(++input_sn), m_typed(""), m_current(false)
 {
 	p.getEqn().addInput(this);
+	size_t start = p.getPos();
 	char c = p.next();
 	if (c == '?') return;
 	if (c == '[') {
-		while ( (c = p.next()) != ']' ) { m_typed += c;	}
+		while ( (c = p.next()) != ']' ) {
+			if (c == '\0') {
+				p.fail(ParseError::INPUT, "unterminated input", start);
+				break;
+			}
+			m_typed += c;
+		}
 	}
 	p.getEqn().setCurrentInput(m_sn);
 }
@@ -648,48 +1032,43 @@ Input* Input::parse(Parser& p, Node* parent)
 		return nullptr;
 }
 
-Differential::Differential(Parser& p, Node* parent) : Node(p, parent)
+Constant::Constant(char name, Equation& eqn, Node* parent) : Node(type, eqn, parent), m_name(name)
 {
-	p.match("D/D");
-	m_variable = p.next();
-	if (!isalpha(m_variable)) throw logic_error("expected variable name");
-
-	m_function = Expression::parse(p, this);
-	if (!m_function) throw logic_error("exected expression");
+	auto c = constants.find(name);
+	if (c == constants.end()) throw logic_error("unknown constant: " + string(1, name));
+	m_value = c->second;
 }
 
-Differential::Differential(XML::Parser& in, Equation& eqn, Node* parent) : Node(in, eqn, parent)
+Function::Function(const string& name, Node* arg, Equation& eqn, Node* parent) :
+	Node(type, eqn, parent), m_name(name), m_arg(arg)
 {
-	string name;
-	if (!in.getAttribute("variable", name)) in.syntaxError("missing variable name");
-	m_variable = name[0];
-
-	in.assertNoAttributes();
-	in.next(XML::HEADER_END);
-	in.next(XML::HEADER, Expression::name);
+	auto f = functions.find(name);
+	if (f == functions.end()) throw logic_error("unknown function: " + name);
+	m_func = f->second;
+	arg->setParent(this);
+}
 
-	m_function = new Expression(in, eqn, this);
-	in.next(XML::FOOTER);
+Differential::Differential(const string& variable, Node* function, Equation& eqn, Node* parent) :
+	Node(type, eqn, parent), m_function(function)
+{
+	m_id = variable.empty() ? SymbolTable::none : SymbolTable::global().intern(variable, SymbolTable::VARIABLE);
+	function->setParent(this);
 }
 
-Differential* Differential::parse(Parser& p, Node* parent)
+const string& Differential::getVariable() const
 {
-	if (p.match("D/D")) 
-		return new Differential(p, parent);
-	else 
-		return nullptr;
+	static const string none;
+	return (m_id == SymbolTable::none) ? none : SymbolTable::global().getName(m_id);
 }
 
 string Differential::toString() const
 {
-	return "D/D" + string(1, m_variable) + m_function->toString();
+	return subtreeString(this);
 }
 
 void Differential::xml_out(XML::Stream& xml) const
 {
-	xml << XML::NAME_VALUE << "variable" << string(1, m_variable) << XML::HEADER_END;
-	m_function->out(xml);
-	xml << XML::FOOTER;
+	xml << XML::NAME_VALUE << "variable" << getVariable() << XML::HEADER_END;
 }
 
 
@@ -0,0 +1,305 @@
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file plot.cpp
+ * This file contains the implementation of the Plot class and of PlotPanel,
+ * the panel that shows a plot of an equation.
+ */
+
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "ui.h"
+#include "panel.h"
+#include "plot.h"
+#include "solve.h"
+#include "util.h"
+
+using namespace std;
+using namespace UI;
+
+Plot::Plot(Node* function, const string& var, double min, double max) :
+	m_function(function, { SymbolTable::global().find(var) }), m_var(var), m_min(0), m_max(0), m_yMin(-1), m_yMax(1),
+	m_columns(0), m_rows(0), m_evaluated(0)
+{
+	setRange(min, max);
+}
+
+void Plot::setRange(double min, double max)
+{
+	if (!(min < max)) throw logic_error("plot range is empty");
+	m_min = min;
+	m_max = max;
+}
+
+void Plot::evaluate(const vector<double>& xs)
+{
+	vector<double> points;
+	for ( auto x : xs ) {
+		if (m_samples.find(x) == m_samples.end()) points.push_back(x);
+	}
+	vector<double> values(points.size());
+	parallelFor(points.size(), [this, &points, &values](size_t i) {
+		Complex x(points[i], 0), z = m_function.value(&x);
+		bool fReal = isfinite(z.real()) && abs(z.imag()) <= 1e-9*(1 + abs(z.real()));
+		values[i] = fReal ? z.real() : numeric_limits<double>::quiet_NaN();
+	});
+	for (size_t i = 0; i < points.size(); ++i) m_samples.emplace(points[i], values[i]);
+	m_evaluated += points.size();
+}
+
+void Plot::sample(int columns, int rows)
+{
+	m_columns = columns;
+	m_rows = rows;
+
+	// Grid steps are powers of two so samples stay on the grid when range changes
+	double width = m_max - m_min;
+	double coarse = exp2(ceil(log2(4*width/columns)));
+	double fine = exp2(floor(log2(width/(4*columns))));
+
+	vector<double> grid;
+	for (double i = floor(m_min/coarse); i <= ceil(m_max/coarse); ++i) grid.push_back(i*coarse);
+	evaluate(grid);
+
+	m_yMin = numeric_limits<double>::infinity();
+	m_yMax = -numeric_limits<double>::infinity();
+	for ( auto x : grid ) {
+		double y = m_samples[x];
+		if (isnan(y)) continue;
+		m_yMin = min(m_yMin, y);
+		m_yMax = max(m_yMax, y);
+	}
+	if (m_yMin > m_yMax) { m_yMin = -1; m_yMax = 1; }
+	if (m_yMin == m_yMax) { m_yMin -= 1; m_yMax += 1; }
+	double scale = (rows - 1)/(m_yMax - m_yMin);
+
+	vector<pair<double, double>> intervals;
+	for (size_t i = 1; i < grid.size(); ++i) intervals.emplace_back(grid[i - 1], grid[i]);
+	while (!intervals.empty()) {
+		vector<double> midpoints;
+		for ( auto& ab : intervals ) midpoints.push_back((ab.first + ab.second)/2);
+		evaluate(midpoints);
+
+		vector<pair<double, double>> next;
+		for ( auto& ab : intervals ) {
+			double m = (ab.first + ab.second)/2;
+			double ya = m_samples[ab.first], yb = m_samples[ab.second], ym = m_samples[m];
+			bool fRefine;
+			if (isnan(ya) || isnan(yb) || isnan(ym)) {
+				fRefine = isnan(ya) != isnan(yb) || isnan(ya) != isnan(ym);
+			}
+			else {
+				fRefine = abs(ym - (ya + yb)/2)*scale > 0.5;
+			}
+			if (fRefine && (m - ab.first) >= 2*fine) {
+				next.emplace_back(ab.first, m);
+				next.emplace_back(m, ab.second);
+			}
+		}
+		intervals.swap(next);
+	}
+}
+
+double Plot::interpolate(double x) const
+{
+	auto it = m_samples.lower_bound(x);
+	if (it == m_samples.end()) return numeric_limits<double>::quiet_NaN();
+	if (it->first == x || it == m_samples.begin()) return it->second;
+	auto prev = it;
+	--prev;
+	double t = (x - prev->first)/(it->first - prev->first);
+	return prev->second + t*(it->second - prev->second);
+}
+
+int Plot::row(double y) const
+{
+	double r = (m_yMax - y)/(m_yMax - m_yMin)*(m_rows - 1);
+	return (int) floor(max(-1.0, min(r + 0.5, (double) m_rows)));
+}
+
+void Plot::draw(Graphics& gc) const
+{
+	double dx = (m_max - m_min)/(m_columns - 1);
+	int x_axis = row(0);
+	if (x_axis >= 0 && x_axis < m_rows) {
+		for (int c = 0; c < m_columns; ++c) gc.at(c, x_axis, '-', Graphics::NONE);
+	}
+	if (m_min <= 0 && m_max >= 0) {
+		int y_axis = (int) floor(-m_min/dx + 0.5);
+		for (int r = 0; r < m_rows; ++r) gc.at(y_axis, r, (r == x_axis) ? '+' : '|', Graphics::NONE);
+	}
+
+	// Each column covers samples inside it, joined to the column before
+	bool fPrev = false;
+	int prevLo = 0, prevHi = 0;
+	for (int c = 0; c < m_columns; ++c) {
+		double x = m_min + c*dx;
+		vector<double> ys;
+		double y = interpolate(x);
+		if (!isnan(y)) ys.push_back(y);
+		for (auto it = m_samples.lower_bound(x - dx/2); it != m_samples.end() && it->first < x + dx/2; ++it) {
+			if (!isnan(it->second)) ys.push_back(it->second);
+		}
+		if (ys.empty()) {
+			fPrev = false;
+			continue;
+		}
+		auto range = minmax_element(ys.begin(), ys.end());
+		int lo = row(*range.second), hi = row(*range.first);
+		bool fInside = hi >= 0 && lo < m_rows;
+		if (fPrev && fInside) {
+			if (lo > prevHi + 1) lo = prevHi + 1;
+			if (hi < prevLo - 1) hi = prevLo - 1;
+		}
+		for (int r = max(lo, 0); r <= min(hi, m_rows - 1); ++r) {
+			gc.at(c, r, '*', Graphics::NONE, Graphics::GREEN);
+		}
+		fPrev = fInside;
+		prevLo = lo;
+		prevHi = hi;
+	}
+
+	ostringstream os;
+	os << m_var << ": " << m_min << ".." << m_max << "  y: " << m_yMin << ".." << m_yMax;
+	gc.at(0, m_rows, os.str().substr(0, m_columns), Graphics::NONE);
+}
+
+const string PlotPanel::name = "plot";
+const string PlotPanel::range_tag = "range";
+
+bool PlotPanel::init = PlotPanel::do_init();
+
+bool PlotPanel::do_init()
+{
+	MiloPanel::panel_map[PlotPanel::name] = MiloPanel::create<PlotPanel>;
+	MiloPanel::panel_xml_map[PlotPanel::name] = MiloPanel::createXML<PlotPanel>;
+	return true;
+}
+
+PlotPanel::PlotPanel(const string& init) :
+	MiloPanel(),
+	m_eqn(new Equation(init))
+{
+	newPlot(-10, 10);
+	pushUndo();
+}
+
+PlotPanel::PlotPanel(const Equation& eqn) :
+	MiloPanel(),
+	m_eqn(new Equation(eqn))
+{
+	newPlot(-10, 10);
+	pushUndo();
+}
+
+PlotPanel::PlotPanel(XML::Parser& in) :
+	MiloPanel()
+{
+	double min, max;
+	readRange(in, min, max);
+	m_eqn.reset(new Equation(in));
+	newPlot(min, max);
+	pushUndo();
+}
+
+PlotPanel::~PlotPanel() {}
+
+void PlotPanel::newPlot(double min, double max)
+{
+	Node* root = m_eqn->getRoot();
+	string var = Solver::findVariable(root, root);
+	m_plot.reset(new Plot(root, var.empty() ? "x" : var, min, max));
+}
+
+void PlotPanel::doKey(const KeyEvent& key)
+{
+	double min = m_plot->getMin(), max = m_plot->getMax(), width = max - min;
+	switch (key.getKey()) {
+		case Keys::LEFT:  min -= width/4; max -= width/4; break;
+		case Keys::RIGHT: min += width/4; max += width/4; break;
+		case Keys::UP:    min += width/4; max -= width/4; break;
+		case Keys::DOWN:  min -= width/2; max += width/2; break;
+		default: return;
+	}
+	m_plot->setRange(min, max);
+	calculateSize();
+	pushUndo();
+}
+
+void PlotPanel::doDraw()
+{
+	m_plot->draw(*m_gc);
+}
+
+Box PlotPanel::calculateSize()
+{
+	m_plot->sample(Plot::default_columns, Plot::default_rows);
+	return m_plot->getSize();
+}
+
+Box PlotPanel::getSize()
+{
+	return m_plot->getSize();
+}
+
+void PlotPanel::setBox(int x, int y, int x0, int y0)
+{
+	Box b = getSize();
+	m_gc->set(b.width(), b.height(), x0 + (x - b.width())/2, y0 + (y - b.height())/2);
+}
+
+void PlotPanel::xml_out(XML::Stream& xml)
+{
+	ostringstream os;
+	os << setprecision(17) << m_plot->getMin() << "," << m_plot->getMax();
+	xml << XML::HEADER << range_tag << XML::HEADER_END << XML::ELEMENT << os.str() << XML::FOOTER;
+	xml << *m_eqn;
+}
+
+void PlotPanel::copy(XML::Parser& in)
+{
+	double min, max;
+	readRange(in, min, max);
+	Equation* eqn = new Equation(in);
+	bool fSame = eqn->toString() == m_eqn->toString();
+	m_eqn.reset(eqn);
+	if (fSame) {
+		m_plot->setRange(min, max);
+	}
+	else {
+		newPlot(min, max);
+	}
+	calculateSize();
+}
+
+void PlotPanel::readRange(XML::Parser& in, double& min, double& max)
+{
+	in.next(XML::HEADER, range_tag).next(XML::HEADER_END).next(XML::ELEMENT);
+	if (!in.hasElement()) { in.syntaxError("Missing range element"); }
+	string value = in.getElement();
+	auto sep = value.find(',');
+	if (sep == string::npos) { in.syntaxError("bad range element " + value); }
+	min = stod(value.substr(0, sep));
+	max = stod(value.substr(sep + 1));
+	in.assertNoAttributes();
+	in.next(XML::FOOTER);
+}
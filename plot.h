@@ -0,0 +1,139 @@
+#ifndef __PLOT_H
+#define __PLOT_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file plot.h
+ * This file contains the declaration of the Plot class, which samples a real
+ * valued equation over a range of one variable and draws it with characters.
+ */
+
+#include <map>
+#include <vector>
+#include "milo.h"
+#include "eval.h"
+
+/**
+ * Character plot of a function of one variable.
+ * Samples lie on a grid of powers of two, so the samples of a range are kept
+ * when the range is moved or zoomed by two. A coarse grid is refined where the
+ * midpoint of an interval is more than half a row away from its chord. Each
+ * level of refinement is evaluated as one parallel batch, with real arithmetic
+ * unless the function is complex.
+ */
+class Plot
+{
+public:
+	/**
+	 * Constructor for Plot compiling function.
+	 * Throws logic_error if function cannot be compiled.
+	 * @param function Root of function.
+	 * @param var Name of variable.
+	 * @param min Start of range.
+	 * @param max End of range.
+	 */
+	Plot(Node* function, const std::string& var, double min = -10, double max = 10);
+
+	/**
+	 * Set range of variable.
+	 * @param min Start of range.
+	 * @param max End of range.
+	 */
+	void setRange(double min, double max);
+
+	/**
+	 * Get start of range.
+	 * @return Start of range.
+	 */
+	double getMin() const { return m_min; }
+
+	/**
+	 * Get end of range.
+	 * @return End of range.
+	 */
+	double getMax() const { return m_max; }
+
+	/**
+	 * Get name of variable.
+	 * @return Name of variable.
+	 */
+	const std::string& getVariable() const { return m_var; }
+
+	/**
+	 * Get number of times the function has been evaluated.
+	 * @return Number of evaluations.
+	 */
+	size_t numEvaluated() const { return m_evaluated; }
+
+	/**
+	 * Sample function for a plot of a given size, evaluating only new samples.
+	 * @param columns Number of columns of plot.
+	 * @param rows Number of rows of plot.
+	 */
+	void sample(int columns, int rows);
+
+	/**
+	 * Draw plot with a line of its ranges underneath.
+	 * @param gc Graphics context.
+	 */
+	void draw(UI::Graphics& gc) const;
+
+	/**
+	 * Get size of drawing of last sample.
+	 * @return Size of plot with line of ranges.
+	 */
+	Box getSize() const { return Box(m_columns, m_rows + 1, 0, 0); }
+
+	static const int default_columns = 64; ///< Default number of columns.
+	static const int default_rows = 16;    ///< Default number of rows.
+
+private:
+	Evaluator m_function;             ///< Compiled function.
+	std::string m_var;                ///< Name of variable.
+	double m_min;                     ///< Start of range.
+	double m_max;                     ///< End of range.
+	double m_yMin;                    ///< Bottom of plot.
+	double m_yMax;                    ///< Top of plot.
+	int m_columns;                    ///< Number of columns of last sample.
+	int m_rows;                       ///< Number of rows of last sample.
+	std::map<double, double> m_samples; ///< Real value at each sample or NaN.
+	size_t m_evaluated;               ///< Number of evaluations.
+
+	/**
+	 * Evaluate function at points that are not sampled yet.
+	 * @param xs Points to be sampled.
+	 */
+	void evaluate(const std::vector<double>& xs);
+
+	/**
+	 * Get value between samples by linear interpolation.
+	 * @param x Point in range.
+	 * @return Interpolated value or NaN.
+	 */
+	double interpolate(double x) const;
+
+	/**
+	 * Get row of value.
+	 * @param y Value.
+	 * @return Row counted from top which may be outside plot.
+	 */
+	int row(double y) const;
+};
+
+#endif // __PLOT_H
@@ -0,0 +1,432 @@
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file poly.cpp
+ * This file contains the implementation of the Polynomial class.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+#include "milo.h"
+#include "util.h"
+#include "nodes.h"
+#include "rewrite.h"
+#include "poly.h"
+
+using namespace std;
+
+Polynomial::Polynomial(Node* node, Equation& eqn)
+{
+	*this = convert(make_shared<Symbols>(eqn), node);
+	sortSymbols();
+}
+
+Polynomial::Polynomial(const shared_ptr<Symbols>& symbols, double c) : m_symbols(symbols)
+{
+	if (c != 0) m_terms.emplace_back(Monomial(), c);
+}
+
+Polynomial Polynomial::convert(const shared_ptr<Symbols>& symbols, Node* node)
+{
+	if (node->getType() == Input::type) throw logic_error("cannot convert input to polynomial");
+
+	// A negative power is not polynomial, so the whole factor is an atom.
+	int nth = node->getNth();
+	if (nth < 0) {
+		return atom(symbols, node);
+	}
+
+	Polynomial p(symbols, 0);
+	vector<Node*> kids;
+	RuleSet::symbol(node, kids, false);
+	auto type = node->getType();
+
+	if (type == Expression::type) {
+		for ( auto n : kids ) { p = p + convert(symbols, n); }
+	}
+	else if (type == Term::type) {
+		p = Polynomial(symbols, 1);
+		for ( auto n : kids ) { p = p * convert(symbols, n); }
+	}
+	else if (type == Number::type) {
+		p = Polynomial(symbols, static_cast<Number*>(node)->getReal());
+	}
+	else if (type == Variable::type) {
+		const string& var = static_cast<Variable*>(node)->getVariable();
+		p = symbol(symbols, var, Symbol{ var, string(), NodePtr() });
+	}
+	else {
+		// Powers with a whole number exponent and quotients by a number stay polynomial.
+		bool fNumber = (type == Power::type || type == Divide::type) && kids[1]->getType() == Number::type;
+		Complex z = fNumber ? kids[1]->getValue() : Complex(0, 0);
+		if (type == Power::type && fNumber && z.imag() == 0 && z.real() >= 0 && z.real() <= max_exponent && isInteger(z.real())) {
+			p = convert(symbols, kids[0]).pow(lround(z.real()));
+		}
+		else if (type == Divide::type && fNumber && z.imag() == 0 && z.real() != 0) {
+			p = convert(symbols, kids[0]) * Polynomial(symbols, 1/z.real());
+		}
+		else {
+			return atom(symbols, node);
+		}
+	}
+
+	// Sign of node is inside its power as in Node::getValue().
+	p = p.pow(nth);
+	if (!node->getSign() && (nth&1) == 1) p = -p;
+	return p;
+}
+
+Polynomial Polynomial::atom(const shared_ptr<Symbols>& symbols, Node* node)
+{
+	Symbol sym{ string(), string(), NodePtr() };
+	sym.node = node;
+	node->out(sym.xml);
+	return symbol(symbols, sym.xml, sym);
+}
+
+Polynomial Polynomial::symbol(const shared_ptr<Symbols>& symbols, const string& key, const Symbol& sym)
+{
+	auto it = symbols->index.find(key);
+	int slot;
+	if (it != symbols->index.end()) {
+		slot = it->second;
+	}
+	else {
+		slot = symbols->symbols.size();
+		symbols->symbols.push_back(sym);
+		symbols->index.emplace(key, slot);
+	}
+	Polynomial p(symbols, 0);
+	Monomial m;
+	m.resize(slot + 1);
+	m[slot] = 1;
+	p.m_terms.emplace_back(m, 1);
+	return p;
+}
+
+void Polynomial::sortSymbols()
+{
+	vector<Symbol>& symbols = m_symbols->symbols;
+	vector<int> order(symbols.size());
+	for (unsigned int i = 0; i < order.size(); ++i) order[i] = i;
+
+	// Variables by name, then atoms in order they were found.
+	stable_sort(order.begin(), order.end(), [&symbols](int a, int b) {
+		const string& na = symbols[a].name, & nb = symbols[b].name;
+		if (na.empty() || nb.empty()) return !na.empty() && nb.empty();
+		return na < nb;
+	});
+
+	vector<int> slot(order.size());
+	vector<Symbol> sorted;
+	for (unsigned int i = 0; i < order.size(); ++i) {
+		slot[order[i]] = i;
+		sorted.push_back(symbols[order[i]]);
+	}
+	symbols = sorted;
+	for ( auto& entry : m_symbols->index ) { entry.second = slot[entry.second]; }
+
+	for ( auto& term : m_terms ) {
+		Monomial m;
+		m.resize(slot.size());
+		for (unsigned int s = 0; s < term.first.size(); ++s) m[slot[s]] = term.first[s];
+		trim(m);
+		term.first = m;
+	}
+	sort(m_terms.begin(), m_terms.end(), [](auto& a, auto& b) { return b.first < a.first; });
+}
+
+Polynomial::Monomial Polynomial::multiply(const Monomial& a, const Monomial& b)
+{
+	Monomial m;
+	m.resize(max(a.size(), b.size()));
+	for (size_t i = 0; i < m.size(); ++i) {
+		m[i] = exponent(a, i) + exponent(b, i);
+		if (m[i] > max_exponent) throw logic_error("polynomial exponent too large");
+	}
+	return m;
+}
+
+Polynomial Polynomial::operator+(const Polynomial& b) const
+{
+	Polynomial p(m_symbols, 0);
+	auto i = m_terms.begin(), j = b.m_terms.begin();
+	while (i != m_terms.end() || j != b.m_terms.end()) {
+		if (j == b.m_terms.end() || (i != m_terms.end() && j->first < i->first)) {
+			p.m_terms.push_back(*i++);
+		}
+		else if (i == m_terms.end() || i->first < j->first) {
+			p.m_terms.push_back(*j++);
+		}
+		else {
+			double c = (i++)->second + j->second;
+			if (c != 0) p.m_terms.emplace_back(j->first, c);
+			++j;
+		}
+	}
+	return p;
+}
+
+Polynomial Polynomial::operator*(const Polynomial& b) const
+{
+	// Heap holds one product per term of the shorter polynomial, so the
+	// products come out in order and like monomials are added as they appear.
+	const Terms& f = (m_terms.size() <= b.m_terms.size()) ? m_terms : b.m_terms;
+	const Terms& g = (m_terms.size() <= b.m_terms.size()) ? b.m_terms : m_terms;
+	Polynomial p(m_symbols, 0);
+	if (f.empty()) return p;
+	if (f.size() > max_products/g.size()) throw logic_error("polynomial product too large");
+
+	using Entry = tuple<Monomial, size_t, size_t>;
+	priority_queue<Entry> heap;
+	for (size_t i = 0; i < f.size(); ++i) { heap.emplace(multiply(f[i].first, g[0].first), i, 0); }
+
+	while (!heap.empty()) {
+		Monomial m; size_t i, j;
+		tie(m, i, j) = heap.top();
+		heap.pop();
+
+		double c = f[i].second * g[j].second;
+		if (!isfinite(c)) throw logic_error("polynomial coefficient out of range");
+		if (!p.m_terms.empty() && p.m_terms.back().first == m) {
+			p.m_terms.back().second += c;
+		}
+		else {
+			if (!p.m_terms.empty() && p.m_terms.back().second == 0) p.m_terms.pop_back();
+			p.m_terms.emplace_back(m, c);
+		}
+		if (++j < g.size()) heap.emplace(multiply(f[i].first, g[j].first), i, j);
+	}
+	if (p.m_terms.back().second == 0) p.m_terms.pop_back();
+	return p;
+}
+
+Polynomial Polynomial::operator-() const
+{
+	Polynomial p = *this;
+	for ( auto& term : p.m_terms ) { term.second = -term.second; }
+	return p;
+}
+
+Polynomial Polynomial::pow(int n) const
+{
+	if (n < 0) throw logic_error("negative power of polynomial");
+
+	Polynomial p(m_symbols, 1), base = *this;
+	while (n != 0) {
+		if ((n&1) == 1) p = p * base;
+		n >>= 1;
+		if (n != 0) base = base * base;
+	}
+	return p;
+}
+
+int Polynomial::degree(const string& var) const
+{
+	auto it = m_symbols->index.find(var);
+	if (it == m_symbols->index.end()) return 0;
+
+	int n = 0;
+	for ( auto& term : m_terms ) { n = max(n, exponent(term.first, it->second)); }
+	return n;
+}
+
+/**
+ * Raise complex value to integer power.
+ * @param z Base.
+ * @param k Power.
+ * @return z to the kth power.
+ */
+static Complex power(const Complex& z, int k) { return std::pow(z, k); }
+
+/**
+ * Raise dual to integer power.
+ * @param z Base.
+ * @param k Power.
+ * @return z to the kth power.
+ */
+static Dual power(const Dual& z, int k) { return pow(z, Dual(Complex(k, 0))); }
+
+Complex Polynomial::evaluate() const
+{
+	vector<Complex> values;
+	for ( auto& sym : m_symbols->symbols ) {
+		values.push_back(!sym.name.empty() ? Variable::findValue(sym.name) : sym.node->getValue());
+	}
+	return m_terms.empty() ? Complex(0, 0) : horner(0, m_terms.size(), 0, values);
+}
+
+Dual Polynomial::evaluate(const vector<SymbolTable::Id>& vars) const
+{
+	vector<Dual> values;
+	for ( auto& sym : m_symbols->symbols ) {
+		if (sym.name.empty()) {
+			values.push_back(sym.node->getDual(vars));
+			continue;
+		}
+		auto it = find(vars.begin(), vars.end(), SymbolTable::global().find(sym.name));
+		Complex z = Variable::findValue(sym.name);
+		values.push_back(it == vars.end() ? Dual(z) : Dual(z, vars.size(), it - vars.begin()));
+	}
+	return m_terms.empty() ? Dual() : horner(0, m_terms.size(), 0, values);
+}
+
+template <class T>
+T Polynomial::horner(size_t begin, size_t end, int slot, const vector<T>& values) const
+{
+	if (slot == (int) values.size()) return T(Complex(m_terms[begin].second, 0));
+
+	// Terms are sorted by exponent of slot, so each power is a run of terms.
+	T z(Complex(0, 0));
+	int last = -1;
+	while (begin < end) {
+		int k = exponent(m_terms[begin].first, slot);
+		size_t run = begin;
+		while (run < end && exponent(m_terms[run].first, slot) == k) ++run;
+
+		if (last >= 0) z *= power(values[slot], last - k);
+		z += horner(begin, run, slot + 1, values);
+		last = k;
+		begin = run;
+	}
+	return z * power(values[slot], last);
+}
+
+string Polynomial::toXML(const string& var) const
+{
+	auto it = m_symbols->index.find(var);
+	int slot = (var.empty() || it == m_symbols->index.end()) ? -1 : it->second;
+
+	// Group terms by power of collected variable, highest first.
+	Terms terms = m_terms;
+	if (slot >= 0) {
+		stable_sort(terms.begin(), terms.end(), [slot](auto& a, auto& b) {
+			return exponent(a.first, slot) > exponent(b.first, slot);
+		});
+	}
+
+	ostringstream os;
+	{
+		XML::Stream xml(os, string());
+		xml << XML::HEADER << Expression::name << XML::HEADER_END;
+		if (terms.empty()) emit(xml, Monomial(), 0);
+
+		auto begin = terms.begin();
+		while (begin != terms.end()) {
+			int k = (slot >= 0) ? exponent(begin->first, slot) : 0;
+			auto run = begin;
+			while (run != terms.end() && (slot >= 0 ? exponent(run->first, slot) : 0) == k) ++run;
+
+			if (k == 0 || run - begin == 1) {
+				for (auto t = begin; t != run; ++t) emit(xml, t->first, t->second);
+			}
+			else {
+				xml << XML::HEADER << Term::name << XML::HEADER_END;
+				xml << XML::HEADER << Expression::name << XML::HEADER_END;
+				for (auto t = begin; t != run; ++t) {
+					Monomial m = t->first;
+					m[slot] = 0;
+					trim(m);
+					emit(xml, m, t->second);
+				}
+				xml << XML::FOOTER;
+				emitSymbol(xml, slot, k);
+				xml << XML::FOOTER;
+			}
+			begin = run;
+		}
+		xml << XML::FOOTER;
+	}
+	return os.str();
+}
+
+void Polynomial::emit(XML::Stream& xml, const Monomial& m, double c) const
+{
+	xml << XML::HEADER << Term::name;
+	if (c < 0) xml << XML::NAME_VALUE << "negative" << "true";
+	xml << XML::HEADER_END;
+
+	c = fabs(c);
+	if (c != 1 || m.empty()) {
+		string value = isInteger(c) ? to_string(llround(c)) : to_string(c);
+		xml << XML::HEADER << Number::name << XML::NAME_VALUE << "value" << value << XML::ATOM_END;
+	}
+	for (int slot = 0; slot < (int) m_symbols->symbols.size(); ++slot) {
+		int k = exponent(m, slot);
+		if (k != 0) emitSymbol(xml, slot, k);
+	}
+	xml << XML::FOOTER;
+}
+
+void Polynomial::emitSymbol(XML::Stream& xml, int slot, int nth) const
+{
+	const Symbol& sym = m_symbols->symbols[slot];
+	if (!sym.name.empty()) {
+		xml << XML::HEADER << Variable::name;
+		if (nth != 1) xml << XML::NAME_VALUE << "nth" << to_string(nth);
+		xml << XML::NAME_VALUE << "name" << sym.name << XML::ATOM_END;
+	}
+	else {
+		// Power of an atom multiplies its own power, which keeps its sign inside.
+		NodePtr atom;
+		atom = Node::create(sym.xml, m_symbols->eqn, nullptr);
+		atom->multNth(nth);
+		atom->out(xml);
+	}
+}
+
+bool Equation::expand()
+{
+	return collect(string());
+}
+
+bool Equation::collect(const string& var)
+{
+	if (!m_inputs.empty()) return false;
+
+	clearSelect();
+	NodePtr node;
+	try {
+		Polynomial poly(m_root, *this);
+		node = Node::create(poly.toXML(var), *this, nullptr);
+	}
+	catch (logic_error&) {
+		return false; // Too large to be expanded.
+	}
+	node->setDrawParenthesis(false);
+
+	bool result = node->toString() != m_root->toString();
+	m_root = node;
+	return result;
+}
+
+Complex Equation::evaluate()
+{
+	if (!m_inputs.empty()) return m_root->getValue();
+	try {
+		return Polynomial(m_root, *this).evaluate();
+	}
+	catch (logic_error&) {
+		return m_root->getValue(); // Too large to be expanded.
+	}
+}
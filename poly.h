@@ -0,0 +1,248 @@
+#ifndef __POLY_H
+#define __POLY_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file poly.h
+ * This file contains the declaration of the Polynomial class. A Polynomial is
+ * a sparse sum of monomials, each a small vector of exponents, so expanding
+ * and collecting does not build node trees until the result is converted back
+ * into an expression.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "milo.h"
+#include "smallvec.h"
+
+/**
+ * Sparse multivariate polynomial with real coefficients.
+ * The symbols of a polynomial are variables and atoms. An atom is any factor
+ * that is not polynomial, such as a function, constant or negative power, and
+ * is treated as an opaque symbol. Polynomials converted from the same subtree
+ * share one table of symbols.
+ */
+class Polynomial
+{
+public:
+	using Monomial = SmallVector<int, 6>; ///< @brief Exponent of each symbol by slot, without trailing zeros.
+
+	/**
+	 * Constructor for Polynomial converted from subtree of equation.
+	 * @param node Root of subtree.
+	 * @param eqn Equation that owns subtree.
+	 */
+	Polynomial(Node* node, Equation& eqn);
+
+	/** @name Arithmetic Operators */
+	//@{
+	/**
+	 * Add polynomials by merging their sorted terms.
+	 * @param b Polynomial to be added.
+	 * @return Sum of polynomials.
+	 */
+	Polynomial operator+(const Polynomial& b) const;
+
+	/**
+	 * Multiply polynomials with a heap of partial products.
+	 * @param b Polynomial to be multiplied.
+	 * @return Product of polynomials.
+	 */
+	Polynomial operator*(const Polynomial& b) const;
+
+	/**
+	 * Negate polynomial.
+	 * @return Negated polynomial.
+	 */
+	Polynomial operator-() const;
+
+	/**
+	 * Raise polynomial to integer power.
+	 * @param n Non-negative integer power.
+	 * @return Polynomial to the nth power.
+	 */
+	Polynomial pow(int n) const;
+	//@}
+
+	/**
+	 * Get number of non-zero terms.
+	 * @return Number of terms.
+	 */
+	int size() const { return m_terms.size(); }
+
+	/**
+	 * Get highest power of variable.
+	 * @param var Name of variable.
+	 * @return Degree of polynomial in variable.
+	 */
+	int degree(const std::string& var) const;
+
+	/**
+	 * Evaluate polynomial in Horner form with current values of its symbols.
+	 * @return Value of polynomial.
+	 */
+	Complex evaluate() const;
+
+	/**
+	 * Evaluate polynomial in Horner form with its gradient to variables.
+	 * @param vars Ids of variables in order of gradient.
+	 * @return Value and gradient of polynomial.
+	 */
+	Dual evaluate(const std::vector<SymbolTable::Id>& vars) const;
+
+	/**
+	 * Get polynomial as XML fragment of an expression with one term per monomial.
+	 * @return XML fragment of expression.
+	 */
+	std::string toXML() const { return toXML(std::string()); }
+
+	/**
+	 * Get polynomial as XML fragment of an expression collected by powers of a variable.
+	 * @param var Name of variable, or empty to not collect.
+	 * @return XML fragment of expression.
+	 */
+	std::string toXML(const std::string& var) const;
+
+	static const int max_exponent = 1 << 24;     ///< Largest exponent of a symbol.
+	static const size_t max_products = 1 << 22;  ///< Most pairs of terms multiplied at once.
+
+private:
+	/**
+	 * Variable or atom of a polynomial.
+	 */
+	struct Symbol
+	{
+		std::string name; ///< Name of variable or empty for an atom.
+		std::string xml;  ///< XML of atom.
+		NodePtr node;     ///< Atom factor in equation.
+	};
+
+	/**
+	 * Table of symbols shared by polynomials of one subtree.
+	 */
+	struct Symbols
+	{
+		Equation& eqn;                               ///< Equation of atoms.
+		std::vector<Symbol> symbols;                 ///< Symbol of each exponent slot.
+		std::unordered_map<std::string, int> index;  ///< Slot of each symbol by its key.
+
+		/**
+		 * Constructor for empty table of symbols.
+		 * @param e Equation of atoms.
+		 */
+		Symbols(Equation& e) : eqn(e) {}
+	};
+
+	using Terms = std::vector<std::pair<Monomial, double>>; ///< @brief Monomials with coefficients.
+
+	std::shared_ptr<Symbols> m_symbols; ///< Symbols of exponent slots.
+	Terms m_terms;                      ///< Non-zero terms, highest monomial first.
+
+	/**
+	 * Constructor for constant polynomial.
+	 * @param symbols Table of symbols.
+	 * @param c Value of constant.
+	 */
+	Polynomial(const std::shared_ptr<Symbols>& symbols, double c);
+
+	/**
+	 * Convert subtree into polynomial adding new symbols to table.
+	 * @param symbols Table of symbols.
+	 * @param node Root of subtree.
+	 * @return Converted polynomial.
+	 */
+	static Polynomial convert(const std::shared_ptr<Symbols>& symbols, Node* node);
+
+	/**
+	 * Get polynomial of a single symbol, adding it to table if new.
+	 * @param symbols Table of symbols.
+	 * @param key Unique key of symbol.
+	 * @param sym Symbol to be added.
+	 * @return Polynomial of symbol.
+	 */
+	static Polynomial symbol(const std::shared_ptr<Symbols>& symbols, const std::string& key, const Symbol& sym);
+
+	/**
+	 * Get polynomial of a factor that is kept as an opaque symbol.
+	 * @param symbols Table of symbols.
+	 * @param node Factor to be kept.
+	 * @return Polynomial of atom.
+	 */
+	static Polynomial atom(const std::shared_ptr<Symbols>& symbols, Node* node);
+
+	/**
+	 * Reorder slots so variables come first in alphabetical order.
+	 */
+	void sortSymbols();
+
+	/**
+	 * Get exponent of symbol in monomial.
+	 * @param m Monomial.
+	 * @param slot Slot of symbol.
+	 * @return Exponent of symbol.
+	 */
+	static int exponent(const Monomial& m, int slot) { return (slot < (int) m.size()) ? m[slot] : 0; }
+
+	/**
+	 * Remove trailing zero exponents, so equal monomials have equal vectors.
+	 * @param m Monomial.
+	 */
+	static void trim(Monomial& m) { while (!m.empty() && m.back() == 0) m.pop_back(); }
+
+	/**
+	 * Multiply monomials by adding their exponents.
+	 * Trimmed monomials compare as vectors in the same order as exponents
+	 * padded with zeros, first slot most significant.
+	 * @param a First monomial.
+	 * @param b Second monomial.
+	 * @return Product of monomials.
+	 */
+	static Monomial multiply(const Monomial& a, const Monomial& b);
+
+	/**
+	 * Evaluate range of terms that agree on all slots before slot in Horner form.
+	 * @param begin First term.
+	 * @param end One past last term.
+	 * @param slot Slot of symbol to be factored out.
+	 * @param values Value of each symbol, either Complex or Dual.
+	 * @return Value of terms without the symbols of earlier slots.
+	 */
+	template <class T>
+	T horner(size_t begin, size_t end, int slot, const std::vector<T>& values) const;
+
+	/**
+	 * Output term to XML stream.
+	 * @param xml XML output stream.
+	 * @param m Monomial of term.
+	 * @param c Coefficient of term.
+	 */
+	void emit(XML::Stream& xml, const Monomial& m, double c) const;
+
+	/**
+	 * Output symbol raised to a power to XML stream.
+	 * @param xml XML output stream.
+	 * @param slot Slot of symbol.
+	 * @param nth Power of symbol.
+	 */
+	void emitSymbol(XML::Stream& xml, int slot, int nth) const;
+};
+
+#endif // __POLY_H
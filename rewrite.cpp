@@ -0,0 +1,468 @@
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file rewrite.cpp
+ * This file contains the implementation of the RuleSet class.
+ * Each node is reduced to a symbol of its class, label and number of children.
+ * A pattern is the preorder list of its symbols, so the discrimination net is
+ * a trie over those lists where a pattern variable is an edge that skips a subtree.
+ */
+
+#include <fstream>
+#include <stdexcept>
+
+#include "milo.h"
+#include "nodes.h"
+#include "rewrite.h"
+
+using namespace std;
+
+// Skip over expressions and terms that only wrap a single factor.
+Node* RuleSet::unwrap(Node* node)
+{
+	while (node->getNth() == 1 && node->getSign()) {
+		if (node->getType() == Expression::type) {
+			auto expr = static_cast<Expression*>(node);
+			if (expr->numTerms() != 1) break;
+			node = *expr->begin();
+		}
+		else if (node->getType() == Term::type) {
+			auto term = static_cast<Term*>(node);
+			if (term->end() - term->begin() != 1) break;
+			node = *term->begin();
+		}
+		else {
+			break;
+		}
+	}
+	return node;
+}
+
+/**
+ * Get suffix of symbol for power and sign of node.
+ * @param node Node of symbol.
+ * @return Suffix of symbol.
+ */
+static string suffix(Node* node)
+{
+	string s;
+	if (node->getNth() != 1) s += "^" + to_string(node->getNth());
+	if (!node->getSign()) s += "-";
+	return s;
+}
+
+/**
+ * Get children of node.
+ * @param node Parent node.
+ * @param[out] kids Children of node in order.
+ */
+static void children(Node* node, vector<Node*>& kids)
+{
+	forEachChild(node, [&kids](Node* kid) { kids.push_back(kid); });
+}
+
+// Get symbol of node such as function/sin^2 and its unwrapped children.
+string RuleSet::symbol(Node* node, vector<Node*>& kids, bool fSuffix)
+{
+	children(node, kids);
+	for ( auto& kid : kids ) kid = unwrap(kid);
+
+	string s = node->getName();
+	auto type = node->getType();
+	if (type == Expression::type || type == Term::type) {
+		s += "/" + to_string(kids.size());
+	}
+	else if (type == Function::type) {
+		s += "/" + static_cast<Function*>(node)->getFunction();
+	}
+	else if (type == Differential::type) {
+		s += "/" + static_cast<Differential*>(node)->getVariable();
+	}
+	else if (type == Variable::type) {
+		s += "/" + static_cast<Variable*>(node)->getVariable();
+	}
+	else if (type == Constant::type) {
+		s += "/" + string(1, static_cast<Constant*>(node)->getConstant());
+	}
+	else if (type == Number::type) {
+		s += "/" + node->toString();
+	}
+	return fSuffix ? s + suffix(node) : s;
+}
+
+/**
+ * Get preorder list of symbols of subtree to compare subtrees.
+ * @param node Root of subtree.
+ * @param fSuffix If false, leave out power and sign of root.
+ * @return Signature of subtree.
+ */
+static string signature(Node* node, bool fSuffix = true)
+{
+	string s;
+	vector<Node*> stack = { node };
+	while (!stack.empty()) {
+		Node* top = stack.back();
+		stack.pop_back();
+		vector<Node*> kids;
+		if (!s.empty()) s += " ";
+		s += RuleSet::symbol(top, kids, fSuffix || top != node);
+		stack.insert(stack.end(), kids.rbegin(), kids.rend());
+	}
+	return s;
+}
+
+/**
+ * Check if subtree contains an input node.
+ * @param node Root of subtree.
+ * @return True, if subtree has an input node.
+ */
+static bool hasInput(Node* node)
+{
+	bool fInput = false;
+	traverse(node, [&fInput](Node* n) {
+		fInput |= n->getType() == Input::type;
+		return !fInput;
+	}, [](Node*) {});
+	return fInput;
+}
+
+/**
+ * Collect every term and expression in subtree, children before parents.
+ * @param node Root of subtree.
+ * @param[out] nodes Terms and expressions of subtree.
+ */
+static void collect(Node* node, vector<Node*>& nodes)
+{
+	traverse(node, [](Node*) { return true; }, [&nodes](Node* n) {
+		if (n->getType() == Expression::type || n->getType() == Term::type) nodes.push_back(n);
+	});
+}
+
+/**
+ * Compile pattern subtree into preorder list of tokens.
+ * @param node Root of pattern subtree.
+ * @param[out] tokens Token of each node.
+ */
+static void compile(Node* node, vector<RuleSet::Token>& tokens)
+{
+	size_t first = tokens.size();
+	tokens.push_back({ string(), 0, node->getNth(), node->getSign(), 0, 0 });
+	if (node->getType() == Variable::type) {
+		const string& var = static_cast<Variable*>(node)->getVariable();
+		if (var.length() != 1) throw logic_error("pattern variable must be one letter: " + var);
+		tokens[first].var = var[0];
+	}
+	else {
+		vector<Node*> kids;
+		tokens[first].symbol = RuleSet::symbol(node, kids, false);
+		tokens[first].kids = kids.size();
+		for ( auto kid : kids ) compile(kid, tokens);
+	}
+	tokens[first].end = tokens.size();
+}
+
+/**
+ * Get edge of discrimination net for token.
+ * A pattern variable is a wildcard edge named ? with the power and sign it
+ * must match.
+ * @param token Token of left side.
+ * @return Symbol of edge.
+ */
+static string edge(const RuleSet::Token& token)
+{
+	string s = token.var ? "?" : token.symbol;
+	if (token.nth != 1) s += "^" + to_string(token.nth);
+	if (!token.sign) s += "-";
+	return s;
+}
+
+void RuleSet::insert(int rule)
+{
+	auto& r = m_rules[rule];
+	int state = 0;
+	if (r.window) state = m_states[0].edges.at("window/" + to_string(r.window));
+
+	for ( auto& token : r.lhs ) {
+		string symbol = edge(token);
+		if (token.var) {
+			r.vars.push_back(token.var);
+			auto& wilds = m_states[state].wilds;
+			auto edge = find_if(wilds.begin(), wilds.end(),
+								[&symbol](auto& w) { return w.first == symbol; });
+			if (edge != wilds.end()) {
+				state = edge->second;
+			}
+			else {
+				wilds.push_back({ symbol, (int) m_states.size() });
+				state = m_states.size();
+				m_states.emplace_back();
+			}
+		}
+		else {
+			auto edge = m_states[state].edges.find(symbol);
+			if (edge != m_states[state].edges.end()) {
+				state = edge->second;
+			}
+			else {
+				m_states[state].edges.emplace(symbol, m_states.size());
+				state = m_states.size();
+				m_states.emplace_back();
+			}
+		}
+	}
+	m_states[state].accept.push_back(rule);
+}
+
+void RuleSet::add(const string& rule)
+{
+	auto sep = rule.find("->");
+	if (sep == string::npos) throw logic_error("rewrite rule missing '->': " + rule);
+
+	string lhs_str = rule.substr(0, sep), rhs_str = rule.substr(sep + 2);
+	lhs_str.erase(remove_if(lhs_str.begin(), lhs_str.end(), ::isspace), lhs_str.end());
+	rhs_str.erase(remove_if(rhs_str.begin(), rhs_str.end(), ::isspace), rhs_str.end());
+
+	Equation lhs(lhs_str);
+	auto root = static_cast<Expression*>(lhs.getRoot());
+
+	// Term rules match a window of factors, other rules a whole expression.
+	Rule r{ {}, 0, {}, make_shared<Equation>(rhs_str) };
+	Term* term = *root->begin();
+	if (root->numTerms() == 1 && term->getSign() && term->getNth() == 1) {
+		r.window = term->end() - term->begin();
+		for ( auto factor : *term ) compile(unwrap(factor), r.lhs);
+	}
+	else {
+		compile(root, r.lhs);
+		r.lhs[0].nth = 1;
+		r.lhs[0].sign = true;
+	}
+	if (all_of(r.lhs.begin() + (r.window ? 0 : 1), r.lhs.end(), [](auto& t) { return t.var != 0; }))
+		throw logic_error("rewrite rule matches everything: " + rule);
+
+	// Every slot of right side must be bound by left side.
+	vector<char> vars;
+	for ( auto& token : r.lhs ) if (token.var) vars.push_back(token.var);
+	traverse(r.rhs->getRoot(), [](Node*) { return true; }, [&vars, &rule](Node* node) {
+		if (node->getType() != Variable::type) return;
+		const string& var = static_cast<Variable*>(node)->getVariable();
+		if (var.length() == 1 && find(vars, var[0]) == vars.end())
+			throw logic_error("rewrite rule has unbound variable: " + rule);
+	});
+
+	if (r.window) {
+		auto& edges = m_states[0].edges;
+		if (edges.emplace("window/" + to_string(r.window), m_states.size()).second) m_states.emplace_back();
+		if (find(m_windows, r.window) == m_windows.end()) {
+			m_windows.push_back(r.window);
+			sort(m_windows.begin(), m_windows.end(), greater<int>());
+		}
+	}
+	m_rules.push_back(r);
+	m_source.push_back(lhs_str + "->" + rhs_str);
+	insert(m_rules.size() - 1);
+}
+
+void RuleSet::load(istream& is)
+{
+	string line;
+	while (getline(is, line)) {
+		auto start = line.find_first_not_of(" \t\r");
+		if (start == string::npos || line[start] == '#') continue;
+		add(line);
+	}
+}
+
+const RuleSet& RuleSet::getDefault()
+{
+	static const RuleSet rules = []() {
+		ifstream is(INSTALL_PATH_STR "/data/rules/rules.txt");
+		return is ? RuleSet(is) : RuleSet();
+	}();
+	return rules;
+}
+
+void RuleSet::match(int state, vector<Node*>& stack, Bindings& bound, int& rule, Bindings& found) const
+{
+	const State& st = m_states[state];
+	if (stack.empty()) {
+		for ( int r : st.accept ) {
+			if (rule >= 0 && rule < r) break;
+
+			// Pattern variable used more than once must bind equal subtrees.
+			auto& vars = m_rules[r].vars;
+			unordered_map<char, string> sigs;
+			bool consistent = true;
+			for ( size_t i = 0; i < vars.size() && consistent; ++i ) {
+				string sig = signature(bound[i].node, !bound[i].body);
+				auto p = sigs.emplace(vars[i], sig);
+				consistent = p.second || p.first->second == sig;
+			}
+			if (consistent) {
+				rule = r; found = bound;
+				break;
+			}
+		}
+		return;
+	}
+
+	Node* node = stack.back(); stack.pop_back();
+	for ( auto& wild : st.wilds ) {
+		if (node->getType() == Input::type) break;
+		bool body = wild.first != "?";
+		if (body && wild.first.substr(1) != suffix(node)) continue;
+		bound.push_back({ node, body });
+		match(wild.second, stack, bound, rule, found);
+		bound.pop_back();
+	}
+
+	vector<Node*> kids;
+	auto edge = st.edges.find(symbol(node, kids, state != 0));
+	if (edge != st.edges.end()) {
+		auto depth = stack.size();
+		stack.insert(stack.end(), kids.rbegin(), kids.rend());
+		match(edge->second, stack, bound, rule, found);
+		stack.resize(depth);
+	}
+	stack.push_back(node);
+}
+
+/**
+ * Copy subtree bound to pattern variable into slot of right side.
+ * The copy is wrapped in an expression when it is a term or when the slot
+ * has a power or sign of its own.
+ * @param eqn Equation that owns new nodes.
+ * @param bound Root of subtree bound to pattern variable.
+ * @param body If true, leave out power and sign of bound subtree.
+ * @param slot Variable of right side filled by binding.
+ * @return Factor to put in slot.
+ */
+static NodePtr fill(Equation& eqn, Node* bound, bool body, Node* slot)
+{
+	NodePtr node = bound->clone(eqn);
+	if (body) {
+		node->setNth(1);
+		if (!node->getSign()) node->negative();
+	}
+	if (node->isFactor() && slot->getNth() == 1 && slot->getSign()) return node;
+
+	Term* term = node->isFactor() ? new Term(node.get(), eqn, nullptr) : static_cast<Term*>(node.get());
+	NodePtr expr(new Expression(term, eqn));
+	expr->setNth(slot->getNth());
+	if (!slot->getSign()) expr->negative();
+	return expr;
+}
+
+ExpressionPtr RuleSet::instantiate(Equation& eqn, int rule, const Bindings& bound) const
+{
+	auto& r = m_rules[rule];
+
+	// Build copy of template, children before their parents.
+	vector<NodePtr> done;
+	traverse(r.rhs->getRoot(), [](Node*) { return true; }, [&](Node* node) {
+		if (node->getType() == Variable::type) {
+			const string& var = static_cast<Variable*>(node)->getVariable();
+			if (var.length() == 1) {
+				auto& b = bound[find(r.vars, var[0]) - r.vars.begin()];
+				done.push_back(fill(eqn, b.node, b.body, node));
+				return;
+			}
+		}
+		size_t n = 0;
+		forEachChild(node, [&n](Node*) { ++n; });
+		vector<NodePtr> kids(done.end() - n, done.end());
+		done.resize(done.size() - n);
+		done.push_back(node->copy(kids, eqn));
+	});
+	return ExpressionPtr(static_cast<Expression*>(done.back().get()));
+}
+
+int RuleSet::rewrite(Equation& eqn, Term* term, int index, int count, int rule, const Bindings& bound) const
+{
+	ExpressionPtr expr = instantiate(eqn, rule, bound);
+
+	TermPtr new_term;
+	Term* single = *expr->begin();
+	if (expr->numTerms() == 1 && single->getNth() == 1) {
+		new_term = single;
+		if (!new_term->getSign()) term->negative();
+	}
+	else {
+		new_term = new Term(expr, eqn, nullptr);
+	}
+	int n = new_term->end() - new_term->begin();
+	term->replace(index, count, new_term);
+	return n;
+}
+
+bool RuleSet::apply(Equation& eqn) const
+{
+	if (m_rules.empty()) return false;
+
+	vector<Node*> nodes;
+	collect(eqn.getRoot(), nodes);
+
+	bool result = false;
+	for ( auto node : nodes ) {
+		vector<Node*> stack;
+		Bindings bound, found;
+		int rule = -1;
+
+		if (node->getType() == Expression::type) {
+			stack.push_back(node);
+			match(0, stack, bound, rule, found);
+			if (rule < 0 || hasInput(node)) continue;
+
+			auto expr = static_cast<Expression*>(node);
+			expr->replace(instantiate(eqn, rule, found));
+			result = true;
+			continue;
+		}
+
+		auto term = static_cast<Term*>(node);
+		int i = 0;
+		while (i < term->end() - term->begin()) {
+			int n = term->end() - term->begin(), step = 1;
+			for ( int k : m_windows ) {
+				if (i + k > n) continue;
+				auto entry = m_states[0].edges.find("window/" + to_string(k));
+
+				stack.clear(); rule = -1;
+				for ( int j = i + k - 1; j >= i; --j ) stack.push_back(unwrap(*(term->begin() + j)));
+				match(entry->second, stack, bound, rule, found);
+				if (rule < 0) continue;
+				if (any_of(term->begin() + i, term->begin() + i + k, [](Node* f) { return hasInput(f); }))
+					continue;
+
+				step = max(rewrite(eqn, term, i, k, rule, found), 1);
+				result = true;
+				break;
+			}
+			i += step;
+		}
+	}
+	return result;
+}
+
+bool Equation::rewrite(const RuleSet& rules)
+{
+	clearSelect();
+	bool result = false;
+	for ( int pass = 0; pass < RuleSet::max_passes && rules.apply(*this); ++pass ) result = true;
+	return result;
+}
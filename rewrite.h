@@ -0,0 +1,218 @@
+#ifndef __REWRITE_H
+#define __REWRITE_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file rewrite.h
+ * This file contains the declaration of the RuleSet class. A RuleSet holds
+ * algebraic rewrite rules loaded from a rule file. The left side of every rule
+ * is compiled into one discrimination net so a single traversal of an equation
+ * finds the rules that match at each node.
+ */
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+#include <memory>
+#include "milo.h"
+
+/**
+ * Set of rewrite rules compiled into a discrimination net.
+ * A rule is written in milo syntax as lhs -> rhs, such as x^ax^b -> x^(a+b).
+ * Variables on the left side are pattern variables that match any subtree.
+ * A left side with a single term matches any run of factors inside a term,
+ * otherwise it matches the terms of an expression in order.
+ */
+class RuleSet
+{
+public:
+	/**
+	 * Node of the left side of a rule in preorder.
+	 */
+	struct Token
+	{
+		std::string symbol; ///< Symbol of node without power and sign, empty for pattern variable.
+		char var;           ///< Name of pattern variable or 0.
+		int nth;            ///< Integer power of node.
+		bool sign;          ///< Sign of node.
+		int kids;           ///< Number of children of node.
+		int end;            ///< Index of token after subtree of node.
+	};
+
+	/**
+	 * Compiled rewrite rule.
+	 * The right side is kept as a tree of nodes. Each variable with a one
+	 * letter name in it is a slot filled with a copy of the subtree bound to
+	 * that pattern variable.
+	 */
+	struct Rule
+	{
+		std::vector<Token> lhs;        ///< Left side, for a window the factors one after another.
+		int window;                    ///< Number of factors matched in a term or 0 for whole expression.
+		std::vector<char> vars;        ///< Pattern variable of each wildcard edge in net order.
+		std::shared_ptr<Equation> rhs; ///< Template of right side.
+	};
+
+	/** @name Constructors */
+	//@{
+	/**
+	 * Default constructor for empty RuleSet.
+	 */
+	RuleSet() : m_states(1) {}
+
+	/**
+	 * Constructor for RuleSet loaded from input stream.
+	 * @param is Input stream containing rule file.
+	 */
+	RuleSet(std::istream& is) : m_states(1) { load(is); }
+	//@}
+
+	/**
+	 * Compile rule and add it to discrimination net.
+	 * @param rule String containing rule lhs -> rhs.
+	 */
+	void add(const std::string& rule);
+
+	/**
+	 * Load rules from rule file, one rule per line.
+	 * Empty lines and lines starting with '#' are skipped.
+	 * @param is Input stream containing rule file.
+	 */
+	void load(std::istream& is);
+
+	/**
+	 * Make one pass over equation rewriting every node matched by a rule.
+	 * @param eqn Equation to be rewritten.
+	 * @return True, if equation was changed.
+	 */
+	bool apply(Equation& eqn) const;
+
+	/**
+	 * Get number of rules.
+	 * @return Number of rules.
+	 */
+	int size() const { return m_rules.size(); }
+
+	/**
+	 * Get compiled rule.
+	 * @param rule Index of rule.
+	 * @return Compiled rule.
+	 */
+	const Rule& getRule(int rule) const { return m_rules[rule]; }
+
+	/**
+	 * Get source of each rule.
+	 * @return Rules in order of rule file.
+	 */
+	const std::vector<std::string>& getRules() const { return m_source; }
+
+	/**
+	 * Skip over expressions and terms that only wrap a single factor.
+	 * A wrapper with a power or negative sign is kept.
+	 * @param node Node to unwrap.
+	 * @return Innermost node.
+	 */
+	static Node* unwrap(Node* node);
+
+	/**
+	 * Get symbol of node and its unwrapped children to be matched.
+	 * The symbol is the class name with a label such as the function name or
+	 * number of children, followed by the power and sign of the node.
+	 * @param node Node to get symbol of.
+	 * @param[out] kids Unwrapped children of node.
+	 * @param fSuffix If false, leave out power and sign of node.
+	 * @return Symbol of node.
+	 */
+	static std::string symbol(Node* node, std::vector<Node*>& kids, bool fSuffix = true);
+
+	/**
+	 * Get rules installed with milo.
+	 * @return Rules loaded from install directory.
+	 */
+	static const RuleSet& getDefault();
+
+	static const int max_passes = 64; ///< Maximum passes of Equation::rewrite().
+
+private:
+	/**
+	 * Edges of one state of the discrimination net.
+	 */
+	struct State
+	{
+		std::unordered_map<std::string, int> edges;     ///< Next state for each node symbol.
+		std::vector<std::pair<std::string, int>> wilds; ///< Next state for each pattern variable.
+		std::vector<int> accept;                        ///< Rules matched in this state.
+	};
+
+	/**
+	 * Subtree bound to pattern variable by wildcard edge.
+	 */
+	struct Binding
+	{
+		Node* node; ///< Root of subtree.
+		bool body;  ///< If true, power and sign of node are matched by edge.
+	};
+
+	using Bindings = std::vector<Binding>; ///< @brief Bindings in wildcard edge order.
+
+	std::vector<State> m_states; ///< States of discrimination net, root is first.
+	std::vector<Rule> m_rules;   ///< Rules in order of rule file.
+	std::vector<std::string> m_source; ///< Source of each rule.
+	std::vector<int> m_windows;  ///< Number of factors matched by term rules, largest first.
+
+	/**
+	 * Add left side of rule to discrimination net.
+	 * @param rule Index of rule accepted at end of pattern.
+	 */
+	void insert(int rule);
+
+	/**
+	 * Walk discrimination net collecting every rule that matches.
+	 * @param state Current state of net.
+	 * @param[in,out] stack Subtrees still to be matched, next one at back.
+	 * @param[in,out] bound Bindings of wildcard edges taken so far.
+	 * @param[out] rule Lowest index of rule matched or -1.
+	 * @param[out] found Bindings of matched rule.
+	 */
+	void match(int state, std::vector<Node*>& stack, Bindings& bound, int& rule, Bindings& found) const;
+
+	/**
+	 * Rewrite run of factors in term matched by rule.
+	 * @param eqn Equation that owns term.
+	 * @param term Term being rewritten.
+	 * @param index Index of first factor matched.
+	 * @param count Number of factors matched.
+	 * @param rule Index of rule.
+	 * @param bound Bindings of pattern variables.
+	 * @return Number of factors inserted.
+	 */
+	int rewrite(Equation& eqn, Term* term, int index, int count, int rule, const Bindings& bound) const;
+
+	/**
+	 * Create the right side of rule in the given equation.
+	 * @param eqn Equation that owns new nodes.
+	 * @param rule Index of rule.
+	 * @param bound Bindings of pattern variables.
+	 * @return Expression containing right side of rule.
+	 */
+	ExpressionPtr instantiate(Equation& eqn, int rule, const Bindings& bound) const;
+};
+
+#endif // __REWRITE_H
@@ -0,0 +1,325 @@
+#ifndef __SIMD_H
+#define __SIMD_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file simd.h
+ * This file contains the complex function kernels written once for any vector
+ * of doubles. It is private to kernels.cpp and kernels_avx2.cpp, which supply
+ * the vector types. Each of them is compiled for its own instruction set, so
+ * everything here has internal linkage and no standard library templates are
+ * instantiated, which keeps code of one instruction set from being linked into
+ * another.
+ *
+ * A vector type V has a constructor from double, load(), store(), arithmetic
+ * and comparison operators, a mask type with & and |, and the functions
+ * select(), sqrt(), abs(), copysign(), pow2() and exponent().
+ */
+
+#include <cmath>
+#include <cstddef>
+
+/**
+ * Batch function over interleaved real and imaginary parts.
+ */
+using batch_ptr = void (*)(const double* z, double* out, size_t n);
+
+/**
+ * Batch functions of one instruction set in the order sin, cos, tan, log, exp.
+ */
+struct KernelSet
+{
+	batch_ptr functions[5]; ///< Batch function or null if not compiled.
+};
+
+extern const KernelSet scalar_kernels; ///< Kernels without vectors.
+extern const KernelSet sse2_kernels;   ///< Kernels of two lanes.
+extern const KernelSet avx2_kernels;   ///< Kernels of four lanes.
+
+namespace {
+
+/** @name Constants */
+//@{
+const double pio2_1 = 1.57079632673412561417e+00;  ///< First 33 bits of pi/2.
+const double pio2_2 = 6.07710050630396597660e-11;  ///< Second 33 bits of pi/2.
+const double pio2_2t = 2.02226624879595063154e-21; ///< Rest of pi/2.
+const double ln2_hi = 6.93147180369123816490e-01;  ///< Leading bits of log 2.
+const double ln2_lo = 1.90821492927058770002e-10;  ///< Rest of log 2.
+const double log2e = 1.44269504088896338700e+00;   ///< 1/log 2.
+const double pi = 3.14159265358979311600e+00;      ///< Pi.
+const double pio2 = 1.57079632679489655800e+00;    ///< Pi/2.
+const double sqrt2 = 1.41421356237309514547e+00;   ///< Square root of 2.
+const double two52 = 4503599627370496.0;           ///< 2^52.
+const double min_normal = 2.2250738585072014e-308; ///< Smallest normal double.
+//@}
+
+/**
+ * Table of reciprocal factorials for Taylor series.
+ */
+struct Factorials
+{
+	double inverse[24]; ///< 1/n! for n < 24.
+
+	/**
+	 * Constructor computing table.
+	 */
+	constexpr Factorials() : inverse()
+	{
+		double f = 1;
+		for (int n = 0; n < 24; ++n) {
+			if (n > 0) f *= n;
+			inverse[n] = 1/f;
+		}
+	}
+};
+
+constexpr Factorials factorials; ///< Reciprocal factorials.
+
+/**
+ * Round to nearest integer for values below 2^51.
+ * @param x Value.
+ * @return Nearest integer.
+ */
+template <class V>
+inline V vround(const V& x)
+{
+	const V magic(1.5*two52);
+	return (x + magic) - magic;
+}
+
+/**
+ * Exponential of real vector.
+ * @param x Argument.
+ * @return Exponential, saturating to zero and infinity.
+ */
+template <class V>
+inline V vexp(V x)
+{
+	x = select(x < -800.0, V(-800.0), x);
+	x = select(x > 800.0, V(800.0), x);
+	V k = vround(x*log2e);
+	V r = (x - k*ln2_hi) - k*ln2_lo;
+
+	V p(factorials.inverse[13]);
+	for (int n = 12; n >= 0; --n) p = p*r + factorials.inverse[n];
+
+	// Two factors keep 2^k normal down to underflow
+	V k1 = vround(k*0.5);
+	return p*pow2(k1)*pow2(k - k1);
+}
+
+/**
+ * Logarithm of positive finite real vector.
+ * @param x Argument.
+ * @return Logarithm.
+ */
+template <class V>
+inline V vlog(const V& x)
+{
+	auto tiny = x < min_normal;
+	V m, e = exponent(select(tiny, x*18014398509481984.0, x), m);
+	e = e - select(tiny, V(1023.0 + 54), V(1023.0));
+	auto big = m > sqrt2;
+	m = select(big, m*0.5, m);
+	e = select(big, e + 1.0, e);
+
+	// log m = 2 atanh s with |s| < 0.18
+	V s = (m - 1.0)/(m + 1.0), z = s*s;
+	V p(1.0/21);
+	for (int n = 19; n >= 1; n -= 2) p = p*z + 1.0/n;
+	return e*ln2_hi + (2.0*s*p + e*ln2_lo);
+}
+
+/**
+ * Sine and cosine of real vector for arguments up to 1e5.
+ * @param x Argument.
+ * @param[out] s Sine.
+ * @param[out] c Cosine.
+ */
+template <class V>
+inline void vsincos(const V& x, V& s, V& c)
+{
+	V k = vround(x*(1/pio2));
+	V r = ((x - k*pio2_1) - k*pio2_2) - k*pio2_2t;
+	V quadrant = k - 4.0*vround(k*0.25 - 0.375);
+
+	V r2 = r*r;
+	V ps(factorials.inverse[19]*-1), pc(factorials.inverse[20]);
+	for (int n = 17; n >= 1; n -= 2) ps = ps*r2 + factorials.inverse[n]*(((n/2)&1) ? -1 : 1);
+	for (int n = 18; n >= 0; n -= 2) pc = pc*r2 + factorials.inverse[n]*(((n/2)&1) ? -1 : 1);
+	ps = ps*r;
+
+	auto q1 = quadrant == 1.0, q2 = quadrant == 2.0, q3 = quadrant == 3.0;
+	s = select(q1, pc, select(q2, -ps, select(q3, -pc, ps)));
+	c = select(q1, -ps, select(q2, -pc, select(q3, ps, pc)));
+}
+
+/**
+ * Hyperbolic sine of real vector below one.
+ * @param x Argument.
+ * @return Hyperbolic sine.
+ */
+template <class V>
+inline V vsinhSmall(const V& x)
+{
+	V z = x*x, p(factorials.inverse[17]);
+	for (int n = 15; n >= 1; n -= 2) p = p*z + factorials.inverse[n];
+	return p*x;
+}
+
+/**
+ * Hyperbolic sine and cosine of real vector.
+ * @param x Argument.
+ * @param[out] sh Hyperbolic sine.
+ * @param[out] ch Hyperbolic cosine.
+ */
+template <class V>
+inline void vsinhcosh(const V& x, V& sh, V& ch)
+{
+	V a = abs(x), e = vexp(a), inv = 1.0/e;
+	ch = 0.5*(e + inv);
+	sh = select(a < 1.0, vsinhSmall(x), copysign(0.5*(e - inv), x));
+}
+
+/**
+ * Arctangent of two real vectors.
+ * @param y Imaginary part.
+ * @param x Real part.
+ * @return Angle of point.
+ */
+template <class V>
+inline V vatan2(const V& y, const V& x)
+{
+	V ax = abs(x), ay = abs(y);
+	auto steep = ay > ax;
+	V hi = select(steep, ay, ax), lo = select(steep, ax, ay);
+	V t = select(hi > 0.0, lo/hi, V(0.0));
+
+	// Two half angles bring t below tan(pi/16) for the series
+	t = t/(1.0 + sqrt(1.0 + t*t));
+	t = t/(1.0 + sqrt(1.0 + t*t));
+	V z = t*t, p(-1.0/23);
+	for (int n = 21; n >= 1; n -= 2) p = p*z + (((n/2)&1) ? -1.0 : 1.0)/n;
+	V angle = 4.0*t*p;
+
+	angle = select(steep, pio2 - angle, angle);
+	angle = select(copysign(V(1.0), x) < 0.0, pi - angle, angle);
+	return copysign(angle, y);
+}
+
+/** @name Complex Kernels */
+//@{
+template <class V>
+inline void csin(const V& a, const V& b, V& x, V& y)
+{
+	V s, c, sh, ch;
+	vsincos(a, s, c);
+	vsinhcosh(b, sh, ch);
+	x = s*ch;
+	y = c*sh;
+}
+
+template <class V>
+inline void ccos(const V& a, const V& b, V& x, V& y)
+{
+	V s, c, sh, ch;
+	vsincos(a, s, c);
+	vsinhcosh(b, sh, ch);
+	x = c*ch;
+	y = -(s*sh);
+}
+
+template <class V>
+inline void ctan(const V& a, const V& b, V& x, V& y)
+{
+	// With e = exp(-2|b|) neither part overflows for large |b|
+	V s, c;
+	vsincos(a + a, s, c);
+	V t = abs(b + b), e = vexp(-t);
+	V d = 1.0 + e*e + 2.0*e*c;
+	V num = select(t < 1.0, 2.0*e*vsinhSmall(t), 1.0 - e*e);
+	x = 2.0*e*s/d;
+	y = copysign(num/d, b);
+}
+
+template <class V>
+inline void clog(const V& a, const V& b, V& x, V& y)
+{
+	V aa = abs(a), ab = abs(b);
+	auto steep = ab > aa;
+	V hi = select(steep, ab, aa), lo = select(steep, aa, ab);
+	auto zero = hi == 0.0;
+	V q = select(zero, V(0.0), lo/hi);
+	x = select(zero, V(-HUGE_VAL), vlog(select(zero, V(1.0), hi)) + 0.5*vlog(1.0 + q*q));
+	y = vatan2(b, a);
+}
+
+template <class V>
+inline void cexp(const V& a, const V& b, V& x, V& y)
+{
+	V s, c, e = vexp(a);
+	vsincos(b, s, c);
+	x = e*c;
+	y = e*s;
+}
+//@}
+
+/**
+ * Apply complex kernel to interleaved values, one vector at a time.
+ * Output may be the same array as input.
+ * @param z Real and imaginary parts of arguments.
+ * @param out Real and imaginary parts of values.
+ * @param n Number of complex values.
+ */
+template <class V, void (*F)(const V&, const V&, V&, V&)>
+void batch(const double* z, double* out, size_t n)
+{
+	const size_t w = V::width;
+	double re[w], im[w];
+	for (size_t i = 0; i < n; i += w) {
+		size_t m = (n - i < w) ? n - i : w;
+		for (size_t j = 0; j < w; ++j) {
+			re[j] = (j < m) ? z[2*(i + j)] : 0;
+			im[j] = (j < m) ? z[2*(i + j) + 1] : 0;
+		}
+		V x, y;
+		F(V::load(re), V::load(im), x, y);
+		x.store(re);
+		y.store(im);
+		for (size_t j = 0; j < m; ++j) {
+			out[2*(i + j)] = re[j];
+			out[2*(i + j) + 1] = im[j];
+		}
+	}
+}
+
+/**
+ * Get kernels of a vector type.
+ * @return Kernels in the order sin, cos, tan, log, exp.
+ */
+template <class V>
+constexpr KernelSet makeKernels()
+{
+	return { { batch<V, csin<V>>, batch<V, ccos<V>>, batch<V, ctan<V>>,
+	           batch<V, clog<V>>, batch<V, cexp<V>> } };
+}
+
+} // namespace
+
+#endif // __SIMD_H
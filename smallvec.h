@@ -0,0 +1,397 @@
+#ifndef __SMALLVEC_H
+#define __SMALLVEC_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file smallvec.h
+ * This file contains a vector template that keeps its first few elements
+ * inside the object.
+ */
+
+#include <cstddef>
+#include <new>
+#include <algorithm>
+#include <utility>
+#include <iterator>
+#include <stdexcept>
+#include <initializer_list>
+
+/**
+ * Vector with inline storage for N elements.
+ * Elements are only put on the heap when there are more than N of them, so
+ * a short vector costs no allocation and its elements are next to the object
+ * that holds it. Has the parts of the std::vector interface used by milo.
+ * Iterators are pointers. As with std::vector, adding or removing elements
+ * invalidates iterators. Unlike std::vector, moving or swapping a vector
+ * that is not on the heap also invalidates them.
+ */
+template <class T, size_t N>
+class SmallVector
+{
+public:
+	/**
+	 * Aliases for SmallVector
+	 */
+	using value_type = T;
+	using size_type = size_t;
+	using difference_type = std::ptrdiff_t;
+	using reference = T&;
+	using const_reference = const T&;
+	using pointer = T*;
+	using const_pointer = const T*;
+	using iterator = T*;
+	using const_iterator = const T*;
+	using reverse_iterator = std::reverse_iterator<iterator>;
+	using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+	/** @name Constructors and Destructor */
+	//@{
+	/**
+	 * Default constructor for empty vector.
+	 */
+	SmallVector() : m_data(inline_data()), m_size(0), m_capacity(N) {}
+
+	/**
+	 * Construct vector from initializer list.
+	 */
+	SmallVector(std::initializer_list<T> li) : SmallVector()
+	{
+		reserve(li.size());
+		for ( auto& e : li ) push_back(e);
+	}
+
+	/**
+	 * Copy constructor.
+	 */
+	SmallVector(const SmallVector& v) : SmallVector()
+	{
+		reserve(v.m_size);
+		for ( auto& e : v ) push_back(e);
+	}
+
+	/**
+	 * Move constructor. Takes heap storage or moves inline elements.
+	 */
+	SmallVector(SmallVector&& v) noexcept : SmallVector() { take(v); }
+
+	/**
+	 * Destructor.
+	 */
+	~SmallVector()
+	{
+		clear();
+		if (!isInline()) ::operator delete(m_data);
+	}
+	//@}
+
+	/**
+	 * Assign copy of other vector.
+	 */
+	SmallVector& operator=(const SmallVector& v)
+	{
+		if (this != &v) {
+			clear();
+			reserve(v.m_size);
+			for ( auto& e : v ) push_back(e);
+		}
+		return *this;
+	}
+
+	/**
+	 * Move other vector into this one.
+	 */
+	SmallVector& operator=(SmallVector&& v) noexcept
+	{
+		if (this != &v) {
+			clear();
+			if (!isInline()) ::operator delete(m_data);
+			m_data = inline_data();
+			m_capacity = N;
+			take(v);
+		}
+		return *this;
+	}
+
+	/** @name Element Access */
+	//@{
+	T& operator[](size_type i) { return m_data[i]; }                   ///< Get element.
+	const T& operator[](size_type i) const { return m_data[i]; }       ///< Get element.
+	T& front() { return m_data[0]; }                                   ///< Get first element.
+	const T& front() const { return m_data[0]; }                       ///< Get first element.
+	T& back() { return m_data[m_size - 1]; }                           ///< Get last element.
+	const T& back() const { return m_data[m_size - 1]; }               ///< Get last element.
+	T* data() { return m_data; }                                       ///< Get storage.
+	const T* data() const { return m_data; }                           ///< Get storage.
+
+	/**
+	 * Get element with range check.
+	 * Throws out_of_range if index is too large.
+	 */
+	T& at(size_type i)
+	{
+		if (i >= m_size) throw std::out_of_range("small vector index");
+		return m_data[i];
+	}
+
+	/**
+	 * Get element with range check.
+	 * Throws out_of_range if index is too large.
+	 */
+	const T& at(size_type i) const
+	{
+		if (i >= m_size) throw std::out_of_range("small vector index");
+		return m_data[i];
+	}
+	//@}
+
+	/** @name Iterators */
+	//@{
+	iterator begin() { return m_data; }                                ///< Iterator at first element.
+	const_iterator begin() const { return m_data; }                    ///< Iterator at first element.
+	const_iterator cbegin() const { return m_data; }                   ///< Iterator at first element.
+	iterator end() { return m_data + m_size; }                         ///< Iterator past last element.
+	const_iterator end() const { return m_data + m_size; }             ///< Iterator past last element.
+	const_iterator cend() const { return m_data + m_size; }            ///< Iterator past last element.
+	reverse_iterator rbegin() { return reverse_iterator(end()); }      ///< Reverse iterator at last element.
+	const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); } ///< Reverse iterator at last element.
+	reverse_iterator rend() { return reverse_iterator(begin()); }      ///< Reverse iterator before first element.
+	const_reverse_iterator rend() const { return const_reverse_iterator(begin()); } ///< Reverse iterator before first element.
+	//@}
+
+	/** @name Capacity */
+	//@{
+	size_type size() const { return m_size; }                          ///< Get number of elements.
+	bool empty() const { return m_size == 0; }                         ///< True, if no elements.
+	size_type capacity() const { return m_capacity; }                  ///< Get number of elements without reallocation.
+
+	/**
+	 * Make room for elements.
+	 * @param n Number of elements.
+	 */
+	void reserve(size_type n)
+	{
+		if (n <= m_capacity) return;
+
+		T* data = static_cast<T*>(::operator new(n*sizeof(T)));
+		for (size_type i = 0; i < m_size; ++i) {
+			new (data + i) T(std::move(m_data[i]));
+			m_data[i].~T();
+		}
+		if (!isInline()) ::operator delete(m_data);
+		m_data = data;
+		m_capacity = n;
+	}
+	//@}
+
+	/** @name Modifiers */
+	//@{
+	/**
+	 * Destroy all elements. Capacity is kept.
+	 */
+	void clear()
+	{
+		for (size_type i = 0; i < m_size; ++i) m_data[i].~T();
+		m_size = 0;
+	}
+
+	/**
+	 * Add copy of element at end.
+	 */
+	void push_back(const T& e) { emplace_back(e); }
+
+	/**
+	 * Move element to end.
+	 */
+	void push_back(T&& e) { emplace_back(std::move(e)); }
+
+	/**
+	 * Construct element at end.
+	 * @return New element.
+	 */
+	template <class... Args>
+	T& emplace_back(Args&&... args)
+	{
+		if (m_size == m_capacity) {
+			T e(std::forward<Args>(args)...);
+			grow(m_size + 1);
+			return *new (m_data + m_size++) T(std::move(e));
+		}
+		return *new (m_data + m_size++) T(std::forward<Args>(args)...);
+	}
+
+	/**
+	 * Remove last element.
+	 */
+	void pop_back() { m_data[--m_size].~T(); }
+
+	/**
+	 * Insert copy of element before position.
+	 * @return Position of new element.
+	 */
+	iterator insert(const_iterator pos, const T& e) { return insert(pos, 1, e); }
+
+	/**
+	 * Insert n copies of element before position.
+	 * @return Position of first new element.
+	 */
+	iterator insert(const_iterator pos, size_type n, const T& e)
+	{
+		T copy(e);
+		size_type index = open(pos, n);
+		for (size_type i = 0; i < n; ++i) m_data[index + i] = copy;
+		return m_data + index;
+	}
+
+	/**
+	 * Insert copies of range of elements before position.
+	 * Range must not be inside this vector.
+	 * @return Position of first new element.
+	 */
+	template <class InputIt>
+	iterator insert(const_iterator pos, InputIt first, InputIt last)
+	{
+		size_type index = open(pos, std::distance(first, last));
+		for (size_type i = index; first != last; ++first, ++i) m_data[i] = *first;
+		return m_data + index;
+	}
+
+	/**
+	 * Remove element at position.
+	 * @return Position after removed element.
+	 */
+	iterator erase(const_iterator pos) { return erase(pos, pos + 1); }
+
+	/**
+	 * Remove range of elements.
+	 * @return Position after removed elements.
+	 */
+	iterator erase(const_iterator first, const_iterator last)
+	{
+		iterator dst = m_data + (first - m_data);
+		iterator src = m_data + (last - m_data);
+		if (dst == src) return dst;
+
+		iterator new_end = std::move(src, end(), dst);
+		while (end() != new_end) pop_back();
+		return dst;
+	}
+
+	/**
+	 * Change number of elements.
+	 * New elements are default constructed.
+	 */
+	void resize(size_type n)
+	{
+		while (m_size > n) pop_back();
+		reserve(n);
+		while (m_size < n) emplace_back();
+	}
+
+	/**
+	 * Swap contents with other vector.
+	 */
+	void swap(SmallVector& v) noexcept
+	{
+		SmallVector tmp(std::move(v));
+		v = std::move(*this);
+		*this = std::move(tmp);
+	}
+	//@}
+
+private:
+	T* m_data;              ///< Inline storage or heap storage.
+	size_type m_size;       ///< Number of elements.
+	size_type m_capacity;   ///< Number of elements in storage.
+	alignas(T) unsigned char m_inline[N*sizeof(T)]; ///< Storage of first N elements.
+
+	/**
+	 * Get inline storage.
+	 */
+	T* inline_data() { return reinterpret_cast<T*>(m_inline); }
+
+	/**
+	 * True, if elements are in inline storage.
+	 */
+	bool isInline() const { return m_data == reinterpret_cast<const T*>(m_inline); }
+
+	/**
+	 * Make room for n elements, at least doubling capacity.
+	 */
+	void grow(size_type n) { reserve(std::max(n, 2*m_capacity)); }
+
+	/**
+	 * Take elements of empty vector from other vector, which is left empty.
+	 */
+	void take(SmallVector& v)
+	{
+		if (v.isInline()) {
+			for (size_type i = 0; i < v.m_size; ++i) new (m_data + i) T(std::move(v.m_data[i]));
+			m_size = v.m_size;
+			v.clear();
+		}
+		else {
+			m_data = v.m_data;
+			m_size = v.m_size;
+			m_capacity = v.m_capacity;
+			v.m_data = v.inline_data();
+			v.m_size = 0;
+			v.m_capacity = N;
+		}
+	}
+
+	/**
+	 * Open gap of n default constructed elements before position.
+	 * @return Index of gap.
+	 */
+	size_type open(const_iterator pos, size_type n)
+	{
+		size_type index = pos - m_data;
+		if (m_size + n > m_capacity) grow(m_size + n);
+		size_type old_size = m_size;
+		for (size_type i = 0; i < n; ++i) emplace_back();
+		std::move_backward(m_data + index, m_data + old_size, m_data + old_size + n);
+		return index;
+	}
+};
+
+/**
+ * Compare elements of two vectors.
+ * @param a First vector.
+ * @param b Second vector.
+ * @return True, if vectors have equal elements.
+ */
+template <class T, size_t N>
+bool operator==(const SmallVector<T, N>& a, const SmallVector<T, N>& b)
+{
+	return std::equal(a.begin(), a.end(), b.begin(), b.end());
+}
+
+/**
+ * Compare two vectors lexicographically.
+ * @param a First vector.
+ * @param b Second vector.
+ * @return True, if first vector comes before second.
+ */
+template <class T, size_t N>
+bool operator<(const SmallVector<T, N>& a, const SmallVector<T, N>& b)
+{
+	return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end());
+}
+
+#endif // __SMALLVEC_H
@@ -20,75 +20,236 @@
 
 /** 
  * @file smart.h
- * This file templates that support SmartPtr and SmartVector. These classes
- * extend std::shared_ptr<T> so they more easily work with the pointer T*.
+ * This file templates that support SmartPtr and SmartVector. SmartPtr is a
+ * reference counted pointer that keeps its count in the object it points to,
+ * so it easily works with the pointer T*.
  */
 
+#include <utility>
 #include <vector>
-#include <memory>
 #include <initializer_list>
 
+#include "chunkvec.h"
+
 /** @name Smart Pointer Templates */
 //@{
 /**
- * Extention of std::shared_ptr so that it can be assigned
- * compared to regular pointer.
+ * Base class for objects managed by SmartPtr.
+ * Count of references is kept in the object, so a raw pointer can be
+ * assigned to any number of SmartPtr objects without a separate control
+ * block. Counts are not atomic, so a tree must not be shared between threads.
+ */
+class RefCounted
+{
+public:
+	/**
+	 * Default constructor with no references.
+	 */
+	RefCounted() : m_refs(0) {}
+
+	/**
+	 * Copy constructor. References are not copied.
+	 */
+	RefCounted(const RefCounted&) : m_refs(0) {}
+
+	/**
+	 * Assignment operator. References are not copied.
+	 */
+	RefCounted& operator=(const RefCounted&) { return *this; }
+
+	/**
+	 * Add reference to object.
+	 */
+	void acquire() const { ++m_refs; }
+
+	/**
+	 * Remove reference to object.
+	 * @return True, if it was the last reference.
+	 */
+	bool release() const { return --m_refs == 0; }
+
+	/**
+	 * Get number of references to object.
+	 * @return Number of references.
+	 */
+	int getRefs() const { return m_refs; }
+
+	/**
+	 * Delete object after its last reference is removed.
+	 * Objects that lose their last reference while another object is being
+	 * deleted are queued and deleted after it, so freeing a deep tree takes a
+	 * loop instead of a call for each level.
+	 * @param p Object to delete.
+	 */
+	static void dispose(const RefCounted* p)
+	{
+		// Queue belongs to outermost call, so it outlives no static object
+		thread_local std::vector<const RefCounted*>* pending = nullptr;
+		if (pending) {
+			pending->push_back(p);
+			return;
+		}
+		std::vector<const RefCounted*> queue;
+		pending = &queue;
+		delete p;
+		while (!queue.empty()) {
+			p = queue.back();
+			queue.pop_back();
+			delete p;
+		}
+		pending = nullptr;
+	}
+
+protected:
+	/**
+	 * Virtual destructor so objects are deleted by dispose().
+	 */
+	virtual ~RefCounted() {}
+
+private:
+	mutable int m_refs; ///< Number of SmartPtr objects pointing at this object.
+};
+
+/**
+ * Reference counted pointer that can be assigned and
+ * compared to regular pointer. Object is deleted with its last reference.
  */
 template <class T>
-class SmartPtr : public std::shared_ptr<T>
+class SmartPtr
 {
 public:
 	/**
 	 * Default constructor SmartPtr from regular pointer
 	 */
-	explicit SmartPtr() : std::shared_ptr<T>() {}
+	explicit SmartPtr() : m_p(nullptr) {}
 
 	/**
 	 * Construct SmartPtr from regular pointer
 	 */
-	explicit SmartPtr(T* p) : std::shared_ptr<T>(p) {}
+	explicit SmartPtr(T* p) : m_p(p) { if (m_p) m_p->acquire(); }
 
 	/**
-	 * Construct SmartPtr from shared pointer
+	 * Copy constructor adds reference.
 	 */
-	explicit SmartPtr(const std::shared_ptr<T>& sp) : std::shared_ptr<T>(sp) {}
-	
+	SmartPtr(const SmartPtr& sp) : m_p(sp.m_p) { if (m_p) m_p->acquire(); }
+
+	/**
+	 * Move constructor takes reference.
+	 */
+	SmartPtr(SmartPtr&& sp) noexcept : m_p(sp.m_p) { sp.m_p = nullptr; }
+
+	/**
+	 * Destructor removes reference.
+	 */
+	~SmartPtr() { if (m_p && m_p->release()) RefCounted::dispose(m_p); }
+
+	/**
+	 * Assign other SmartPtr.
+	 */
+	SmartPtr& operator=(const SmartPtr& sp) { SmartPtr a(sp); swap(a); return *this; }
+
+	/**
+	 * Move other SmartPtr.
+	 */
+	SmartPtr& operator=(SmartPtr&& sp) noexcept { swap(sp); return *this; }
+
 	/**
 	 * Assign raw pointer as managed pointer.
 	 */
-	SmartPtr& operator=(T* p) { SmartPtr a(p->getSharedPtr()); *this = a; return *this; }
+	SmartPtr& operator=(T* p) { SmartPtr a(p); swap(a); return *this; }
+
+	/**
+	 * Manage another raw pointer.
+	 */
+	void reset(T* p = nullptr) { *this = p; }
+
+	/**
+	 * Swap pointers without changing references.
+	 */
+	void swap(SmartPtr& sp) noexcept { std::swap(m_p, sp.m_p); }
+
+	/**
+	 * Get managed pointer.
+	 */
+	T* get() const { return m_p; }
+
+	/**
+	 * Access managed object.
+	 */
+	T* operator->() const { return m_p; }
+
+	/**
+	 * Dereference managed pointer.
+	 */
+	T& operator*() const { return *m_p; }
 
 	/**
 	 * Compare raw pointer to managed pointer.
 	 */
-	bool operator==(T* p) const { return this->get() == p; }
+	bool operator==(T* p) const { return m_p == p; }
 
 	/**
 	 * Compare raw pointer to managed pointer.
 	 */
-	bool operator!=(T* p) const { return this->get() != p; }
+	bool operator!=(T* p) const { return m_p != p; }
 
 	/**
 	 * Convert managed pointer to raw pointer for return values.
 	 */
-	operator T*() const { return this->get(); }
+	operator T*() const { return m_p; }
+
+private:
+	T* m_p; ///< Managed pointer.
 };
 
+/**
+ * Cast SmartPtr to derived class. Result shares reference count of sp.
+ * @param sp Smart pointer of base class.
+ * @return Smart pointer of derived class or null if object is not of class T.
+ */
+template <class T, class U>
+SmartPtr<T> dynamic_pointer_cast(const SmartPtr<U>& sp)
+{
+	return SmartPtr<T>(dynamic_cast<T*>(sp.get()));
+}
+
+/**
+ * Cast SmartPtr to derived class that is known to be class of object.
+ * Result shares reference count of sp.
+ * @param sp Smart pointer of base class.
+ * @return Smart pointer of derived class.
+ */
+template <class T, class U>
+SmartPtr<T> static_pointer_cast(const SmartPtr<U>& sp)
+{
+	return SmartPtr<T>(static_cast<T*>(sp.get()));
+}
+
 /**
  * SmartVector will hold objects with share pointers but can 
  * be used with raw pointers.
+ * Each object keeps its position in the vector, which is updated by
+ * the member functions that add or remove objects, so the index of an
+ * object is found without a search. T must have getIndex and setIndex.
+ * The first N pointers are stored inside the vector, since most terms have
+ * only a few factors and most expressions only a few terms.
+ * Pointers are kept in chunks, so adding or removing an object in a long
+ * vector only moves and reindexes the objects of one chunk. The index kept
+ * by an object is its chunk times 2*chunk_size plus its position in the
+ * chunk, so objects in later chunks keep their index and get_index adds the
+ * number of objects before the chunk. For a short vector it is the index.
  */
-template <class T>
-class SmartVector : public std::vector< SmartPtr<T> >
+template <class T, size_t N = 3>
+class SmartVector : public ChunkVector< SmartPtr<T>, N >
 {
 public:
 	/**
 	 * Aliases for SmartVector
 	 */
-	using iterator = typename std::vector< SmartPtr<T> >::iterator;
-	using const_iterator = typename std::vector< SmartPtr<T> >::const_iterator;
-	using size_type = typename std::vector< std::shared_ptr<T> >::size_type;
-	using base = typename std::vector< SmartPtr<T> >;
+	using base = ChunkVector< SmartPtr<T>, N >;
+	using iterator = typename base::iterator;
+	using const_iterator = typename base::const_iterator;
+	using size_type = typename base::size_type;
 
 	/**
 	 * Default Constructor for SmartVector
@@ -103,22 +264,26 @@ public:
 		for ( T* n : li ) { this->push_back(n); }
 	}
 
-	explicit SmartVector(SmartPtr<T> sp) { this->base::push_back(sp); }
+	explicit SmartVector(SmartPtr<T> sp) { this->base::push_back(sp); reindex(); }
 		
 	/**
 	 * Constructor for SmartVector initialized with a single object
 	 */
-	explicit SmartVector(T* p) { SmartPtr<T> a; a = p; this->base::push_back(a); } 
+	explicit SmartVector(T* p) { this->push_back(p); } 
 
 	/**
 	 * Construct vector from initializer list of smart pointers
 	 */
-    SmartVector(std::initializer_list< SmartPtr<T> > li) : base(li) {}
+    SmartVector(std::initializer_list< SmartPtr<T> > li) : base(li) { reindex(); }
 
 	/**
 	 * Push back object into vector managed by share pointer
 	 */
-	void push_back(T* p) { SmartPtr<T> a; a = p; this->base::push_back(a);  }
+	void push_back(T* p)
+	{
+		this->base::push_back(SmartPtr<T>(p));
+		p->setIndex(hint(this->base::end() - 1));
+	}
 
 	/**
 	 * Don't allow push back with shared pointer
@@ -135,7 +300,8 @@ public:
 	 */
 	iterator insert(const_iterator pos, T* val)
 	{
-		return this->base::insert(pos, SmartPtr<T>(val));
+		size_type chunks = this->base::chunks();
+		return reindex(this->base::insert(pos, SmartPtr<T>(val)), chunks);
 	}
 	
 	/**
@@ -143,7 +309,8 @@ public:
 	 */
 	iterator insert(const_iterator pos, size_type n, const T* val)
 	{
-		return this->base::insert(pos, n, SmartPtr<T>(val));
+		size_type chunks = this->base::chunks();
+		return reindex(this->base::insert(pos, n, SmartPtr<T>(val)), chunks);
 	}
 
 	/**
@@ -151,7 +318,8 @@ public:
 	 */
 	iterator insert (const_iterator position, iterator first, iterator last)
 	{
-		return this->base::insert(position, first, last);
+		size_type chunks = this->base::chunks();
+		return reindex(this->base::insert(position, first, last), chunks);
 	}
 
 	/**
@@ -159,7 +327,8 @@ public:
 	 */
 	iterator insert(const_iterator pos, const SmartPtr<T> val)
 	{
-		return this->base::insert(pos, val);
+		size_type chunks = this->base::chunks();
+		return reindex(this->base::insert(pos, val), chunks);
 	}
 
 	/**
@@ -172,10 +341,28 @@ public:
 	 */
 	iterator insert(const_iterator pos, std::initializer_list< SmartPtr<T> > il) = delete;
 
+	/**
+	 * Erase object at position in vector
+	 */
+	iterator erase(const_iterator pos)
+	{
+		size_type chunks = this->base::chunks();
+		return reindex(this->base::erase(pos), chunks);
+	}
+
+	/**
+	 * Erase objects at position in vector from iterator range
+	 */
+	iterator erase(const_iterator first, const_iterator last)
+	{
+		size_type chunks = this->base::chunks();
+		return reindex(this->base::erase(first, last), chunks);
+	}
+
 	/**
 	 * Swap smart vector storage.
 	 */
-	void swap(SmartVector<T>& v) { this->base::swap(v); }
+	void swap(SmartVector& v) { this->base::swap(v); }
 
 	/**
 	 * Delete swap of vectors
@@ -185,17 +372,18 @@ public:
 	/**
 	 * Marge another SmartVector at arbitrary positon
 	 */
-	void merge(SmartVector<T>& v, iterator pos)
+	void merge(SmartVector& v, iterator pos)
 	{
+		size_type index = pos - this->base::begin();
 		this->base::reserve(this->base::size() + v.size());
-		insert(pos, v.base::begin(), v.base::end());
+		insert(this->base::begin() + index, v.base::begin(), v.base::end());
 		v.base::clear();
 	}
 
 	/**
 	 * Merge another SmartVector at end
 	 */
-	void merge(SmartVector<T>& v) { this->merge(v, this->base::begin()); }
+	void merge(SmartVector& v) { this->merge(v, this->base::begin()); }
 	/**
 	 * Insert element at index
 	 */
@@ -213,23 +401,101 @@ public:
 	}
 
 	/**
-	 * Get index of element in vector
+	 * Replace element at index.
+	 */
+	void replace_index(int index, T* e)
+	{
+		auto it = this->base::begin() + index;
+		*it = e;
+		e->setIndex(hint(it));
+	}
+
+	/**
+	 * Get index of element in vector.
+	 * The chunk and position kept by the element are checked first. If the
+	 * vector was reordered directly, the element is searched for and every
+	 * index is updated.
 	 */
 	int get_index(T* e) const
 	{
-		const base* base_this = this;
-		int index = 0;
-		for ( auto n : *base_this ) {
-			if (n.get() == e) return index;
-			++index;
+		int index = e->getIndex();
+		if (index >= 0) {
+			auto it = this->base::at_chunk(index / stride, index % stride);
+			if (it != this->base::end() && it->get() == e) return it.index();
+		}
+
+		index = -1;
+		int i = 0;
+		for (auto it = this->base::begin(); it != this->base::end(); ++it, ++i) {
+			(*it)->setIndex(hint(it));
+			if (it->get() == e) index = i;
 		}
-		return -1;
+		return index;
 	}
 
 	/**
 	 * Get iterator of element in vector
 	 */
-	iterator find(T* e) { return this->base::begin() + get_index(e); }
+	iterator find(T* e)
+	{
+		int index = get_index(e);
+		return (index < 0) ? this->base::end() : this->base::begin() + index;
+	}
+
+	/**
+	 * Get element before another element.
+	 * @return Element before e or null if e is first or not in vector.
+	 */
+	T* before(T* e) const
+	{
+		int index = get_index(e);
+		return (index > 0) ? (*this)[index - 1].get() : nullptr;
+	}
+
+	/**
+	 * Get element after another element.
+	 * @return Element after e or null if e is last or not in vector.
+	 */
+	T* after(T* e) const
+	{
+		int index = get_index(e);
+		return (index >= 0 && (size_type) index + 1 < this->base::size()) ? (*this)[index + 1].get() : nullptr;
+	}
+
+private:
+	static constexpr int stride = 2*base::chunk_size; ///< Largest size of chunk.
+
+	/**
+	 * Get index kept by element at position.
+	 * @return Chunk times stride plus position in chunk.
+	 */
+	static int hint(const_iterator pos) { return pos.chunk_index()*stride + pos.chunk_pos(); }
+
+	/**
+	 * Update index of every element.
+	 */
+	void reindex()
+	{
+		for (auto it = this->base::begin(); it != this->base::end(); ++it) (*it)->setIndex(hint(it));
+	}
+
+	/**
+	 * Update index of elements after vector was changed at position.
+	 * Only elements from position to end of its chunk moved, unless chunks
+	 * were split, joined or removed, which changes the chunks after them.
+	 * @param pos Position of first new element or of element after removed ones.
+	 * @param chunks Number of chunks before change.
+	 * @return Position.
+	 */
+	iterator reindex(iterator pos, size_type chunks)
+	{
+		if (chunks != this->base::chunks()) {
+			reindex();
+			return pos;
+		}
+		for (auto it = pos, end = this->chunk_end(pos); it != end; ++it) (*it)->setIndex(hint(it));
+		return pos;
+	}
 };
 
 /**
@@ -0,0 +1,300 @@
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file snapshot.cpp
+ * This file contains the implementation of the Snapshot class.
+ */
+
+#include <algorithm>
+#include <iterator>
+#include "milo.h"
+#include "nodes.h"
+#include "flat.h"
+#include "snapshot.h"
+
+using namespace std;
+
+PersistentNode::PersistentNode(Node* node) :
+	m_kind(node->getType()), m_nth(node->getNth()), m_sign(node->getSign()),
+	m_select(node->getSelect()), m_value(0), m_fCurrent(false), m_hash(0),
+	m_fMarked(m_kind == Node::INPUT || m_select != Node::NONE)
+{
+	switch (m_kind) {
+		case Node::NUMBER:
+			m_value = static_cast<Number*>(node)->getReal();
+			break;
+		case Node::CONSTANT:
+			m_name = string(1, static_cast<Constant*>(node)->getConstant());
+			break;
+		case Node::VARIABLE:
+			m_name = static_cast<Variable*>(node)->getVariable();
+			break;
+		case Node::FUNCTION:
+			m_name = static_cast<Function*>(node)->getFunction();
+			break;
+		case Node::DIFFERENTIAL:
+			m_name = static_cast<Differential*>(node)->getVariable();
+			break;
+		case Node::INPUT: {
+			auto in = static_cast<Input*>(node);
+			m_name = in->getBuffer();
+			m_fCurrent = in->getCurrent();
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+bool PersistentNode::same(const PersistentNode& node) const
+{
+	return m_hash == node.m_hash && m_kind == node.m_kind && m_nth == node.m_nth &&
+	       m_sign == node.m_sign && m_select == node.m_select && m_value == node.m_value &&
+	       m_fCurrent == node.m_fCurrent && m_name == node.m_name && m_children == node.m_children;
+}
+
+PersistentNode::~PersistentNode()
+{
+	// Children held only by this node are taken apart here, one level at a time
+	Vector stack;
+	stack.swap(m_children);
+	while (!stack.empty()) {
+		Ptr node = move(stack.back());
+		stack.pop_back();
+		if (node.use_count() != 1) continue;
+		auto& kids = const_cast<PersistentNode&>(*node).m_children;
+		move(kids.begin(), kids.end(), back_inserter(stack));
+		kids.clear();
+	}
+}
+
+XML::Stream& PersistentNode::out(XML::Stream& xml) const
+{
+	// Second of pair is true once children of node are on the stack
+	vector<pair<const PersistentNode*, bool>> stack = { { this, false } };
+	while (!stack.empty()) {
+		auto& top = stack.back();
+		const PersistentNode* node = top.first;
+		if (top.second) {
+			stack.pop_back();
+			xml << XML::FOOTER;
+			continue;
+		}
+		top.second = true;
+		if (node->header(xml)) {
+			stack.pop_back();
+			continue;
+		}
+
+		size_t first = stack.size();
+		for ( auto& kid : node->m_children ) stack.emplace_back(kid.get(), false);
+		reverse(stack.begin() + first, stack.end());
+	}
+	return xml;
+}
+
+bool PersistentNode::header(XML::Stream& xml) const
+{
+	xml << XML::HEADER << FlatEquation::getKindName(m_kind);
+	if (m_nth != 1) xml << XML::NAME_VALUE << "nth" << to_string(m_nth);
+	if (!m_sign) xml << XML::NAME_VALUE << "negative" << "true";
+	if (m_select != Node::NONE) xml << XML::NAME_VALUE << "select" << Node::select_tags.at(m_select);
+
+	switch (m_kind) {
+		case Node::NUMBER:
+			xml << XML::NAME_VALUE << "value" << to_string(m_value) << XML::ATOM_END;
+			return true;
+		case Node::CONSTANT:
+		case Node::VARIABLE:
+			xml << XML::NAME_VALUE << "name" << m_name << XML::ATOM_END;
+			return true;
+		case Node::INPUT:
+			if (!m_name.empty()) xml << XML::NAME_VALUE << "text" << m_name;
+			if (m_fCurrent) xml << XML::NAME_VALUE << "current" << "true";
+			xml << XML::ATOM_END;
+			return true;
+		case Node::FUNCTION:
+			xml << XML::NAME_VALUE << "name" << m_name;
+			break;
+		case Node::DIFFERENTIAL:
+			xml << XML::NAME_VALUE << "variable" << m_name;
+			break;
+		default:
+			break;
+	}
+	xml << XML::HEADER_END;
+	return false;
+}
+
+PersistentNode::Ptr Snapshot::Pool::intern(PersistentNode::Ptr node)
+{
+	auto range = m_nodes.equal_range(node->getHash());
+	for (auto it = range.first; it != range.second; ++it) {
+		auto old = it->second.lock();
+		if (old && old->same(*node)) return old;
+	}
+	m_nodes.emplace(node->getHash(), node);
+
+	// Remove freed nodes once table has doubled, so pruning is amortized
+	if (m_nodes.size() >= m_prune) {
+		for (auto it = m_nodes.begin(); it != m_nodes.end(); ) {
+			if (it->second.expired()) it = m_nodes.erase(it); else ++it;
+		}
+		m_prune = max(m_prune, 2*m_nodes.size());
+	}
+	return node;
+}
+
+Snapshot::Snapshot(Equation& eqn, Pool& pool) : m_root(copy(eqn.getRoot(), pool)) {}
+
+PersistentNode::Ptr Snapshot::copy(Node* root, Pool& pool)
+{
+	// Shared copies of visited children of the nodes on the stack, in order
+	PersistentNode::Vector done;
+	traverse(root, [](Node*) { return true; }, [&done, &pool](Node* node) {
+		shared_ptr<PersistentNode> pnode(new PersistentNode(node));
+		size_t n = 0;
+		forEachChild(node, [&n](Node*) { ++n; });
+		pnode->m_children.assign(done.end() - n, done.end());
+		done.resize(done.size() - n);
+		for ( auto& kid : pnode->m_children ) pnode->m_fMarked |= kid->m_fMarked;
+
+		// Children are already shared, so their addresses stand for their contents
+		size_t seed = hash_calculate<int>({ (int) pnode->m_kind, pnode->m_nth, pnode->m_sign, (int) pnode->m_select, pnode->m_fCurrent });
+		boost::hash_combine(seed, pnode->m_value);
+		boost::hash_combine(seed, pnode->m_name);
+		for ( auto& kid : pnode->m_children ) boost::hash_combine(seed, kid.get());
+		pnode->m_hash = seed;
+		done.push_back(pool.intern(pnode));
+	});
+	return done.back();
+}
+
+XML::Stream& Snapshot::out(XML::Stream& xml) const
+{
+	xml << XML::HEADER << "equation" << XML::HEADER_END;
+	m_root->out(xml);
+	xml << XML::FOOTER;
+	return xml;
+}
+
+EqnPtr Snapshot::toEquation() const
+{
+	EqnPtr eqn(new Equation());
+	restore(*eqn, Snapshot());
+	return eqn;
+}
+
+NodePtr Snapshot::build(const PersistentNode* root, const PersistentNode* shown, Node* live, Equation& eqn)
+{
+	if (live && root == shown) return NodePtr(live);
+
+	// Node being made, with the live children of its shown node not yet taken
+	struct Frame {
+		const PersistentNode* node;
+		const PersistentNode* shown;
+		vector<Node*> live;
+		unordered_multimap<const PersistentNode*, size_t> index;
+		vector<NodePtr> kids;
+	};
+	vector<Frame> stack;
+	auto push = [&stack](const PersistentNode* node, const PersistentNode* shown, Node* live) {
+		stack.push_back({ node, live ? shown : nullptr, {}, {}, {} });
+		if (!live) return;
+		auto& frame = stack.back();
+		forEachChild(live, [&frame](Node* kid) { frame.live.push_back(kid); });
+		for (size_t i = 0; i < frame.live.size(); ++i) frame.index.emplace(shown->m_children[i].get(), i);
+	};
+	push(root, shown, live);
+
+	while (true) {
+		auto& frame = stack.back();
+		size_t i = frame.kids.size();
+		if (i < frame.node->m_children.size()) {
+			const PersistentNode* kid = frame.node->m_children[i].get();
+
+			// Take a live child that is the same, else look inside the one at the same place
+			auto same = frame.index.find(kid);
+			if (same != frame.index.end()) {
+				frame.kids.emplace_back(frame.live[same->second]);
+				frame.live[same->second] = nullptr;
+				frame.index.erase(same);
+				continue;
+			}
+			if (i < frame.live.size() && frame.live[i]) {
+				Node* old = frame.live[i];
+				const PersistentNode* was = frame.shown->m_children[i].get();
+				frame.live[i] = nullptr;
+				auto range = frame.index.equal_range(was);
+				for (auto it = range.first; it != range.second; ++it) {
+					if (it->second == i) {
+						frame.index.erase(it);
+						break;
+					}
+				}
+				push(kid, was, old);
+			}
+			else
+				push(kid, nullptr, nullptr);
+			continue;
+		}
+
+		const PersistentNode* pnode = frame.node;
+		NodePtr node(Node::create(pnode->m_kind, pnode->m_name, pnode->m_value, frame.kids, eqn, nullptr));
+		node->setNth(pnode->m_nth);
+		if (node->getSign() != pnode->m_sign) node->negative();
+		node->setSelect(pnode->m_select);
+		if (pnode->m_kind == Node::INPUT) static_cast<Input*>(node.get())->setCurrent(pnode->m_fCurrent);
+
+		stack.pop_back();
+		if (stack.empty()) return node;
+		stack.back().kids.push_back(node);
+	}
+}
+
+void Snapshot::restore(Equation& eqn, const Snapshot& shown) const
+{
+	Node* live = shown.m_root ? eqn.getRoot() : nullptr;
+	if (live && m_root == shown.m_root) return;
+
+	NodePtr root = build(m_root.get(), shown.m_root.get(), live, eqn);
+	root->setParent(nullptr);
+	root->setDrawParenthesis(false);
+	eqn.m_root = root;
+
+	// Register inputs and selection, only walking subtrees that have them
+	eqn.m_inputs.clear();
+	eqn.m_input_index = -1;
+	eqn.m_selectStart = eqn.m_selectEnd = nullptr;
+	vector<pair<const PersistentNode*, Node*>> stack = { { m_root.get(), root.get() } };
+	while (!stack.empty()) {
+		auto [pnode, node] = stack.back();
+		stack.pop_back();
+		if (!pnode->m_fMarked) continue;
+
+		if (pnode->m_kind == Node::INPUT) {
+			eqn.addInput(static_cast<Input*>(node));
+			if (pnode->m_fCurrent) eqn.m_input_index = eqn.m_inputs.size() - 1;
+		}
+		eqn.setSelectFromNode(node);
+
+		vector<Node*> kids;
+		forEachChild(node, [&kids](Node* kid) { kids.push_back(kid); });
+		for (size_t i = kids.size(); i-- > 0; ) stack.emplace_back(pnode->m_children[i].get(), kids[i]);
+	}
+}
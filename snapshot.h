@@ -0,0 +1,218 @@
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file snapshot.h
+ * This file contains the declaration of the Snapshot class, an immutable copy
+ * of an equation that shares unchanged subtrees with earlier snapshots.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "milo.h"
+
+/**
+ * Immutable node of a snapshot.
+ * Nodes are only made by a Snapshot::Pool, which gives nodes with the same
+ * contents and the same children the same object. Children are compared by
+ * address, so comparing two nodes is constant time.
+ */
+class PersistentNode
+{
+public:
+	using Ptr = std::shared_ptr<const PersistentNode>; ///< Shared pointer to node.
+	using Vector = std::vector<Ptr>;                   ///< Children of node.
+
+	/** @name Node Access */
+	//@{
+	Node::Kind getKind() const { return m_kind; }                ///< Get kind of node.
+	int getNth() const { return m_nth; }                         ///< Get power of node.
+	bool getSign() const { return m_sign; }                      ///< Get sign of node.
+	Node::Select getSelect() const { return m_select; }          ///< Get selection of node.
+	double getValue() const { return m_value; }                  ///< Get value of number or zero.
+	bool getCurrent() const { return m_fCurrent; }               ///< True, if current input.
+	const Vector& getChildren() const { return m_children; }     ///< Get children of node.
+	size_t getHash() const { return m_hash; }                    ///< Get hash of node and subtree.
+
+	/**
+	 * Get name of node.
+	 * This is the name of a variable, function or constant, the variable of a
+	 * differential or the text typed into an input. Other nodes have no name.
+	 * @return Name or empty string.
+	 */
+	const std::string& getName() const { return m_name; }
+	//@}
+
+	/**
+	 * Output node and subtree in the XML of Node::out.
+	 * @param xml XML output stream.
+	 * @return XML output stream.
+	 */
+	XML::Stream& out(XML::Stream& xml) const;
+
+	/**
+	 * Destructor that frees children used by no other node without
+	 * recursion, so a snapshot of any depth can be freed.
+	 */
+	~PersistentNode();
+
+private:
+	friend class Snapshot;
+
+	Node::Kind m_kind;     ///< Kind of node.
+	int m_nth;             ///< Power of node.
+	bool m_sign;           ///< Sign of node.
+	Node::Select m_select; ///< Selection of node.
+	double m_value;        ///< Value of number.
+	std::string m_name;    ///< Name of node.
+	bool m_fCurrent;       ///< True, if current input.
+	Vector m_children;     ///< Children of node.
+	size_t m_hash;         ///< Hash of contents and addresses of children.
+	bool m_fMarked;        ///< True, if subtree has an input or a selected node.
+
+	/**
+	 * Constructor copying contents of node but not its children.
+	 * @param node Node to copy.
+	 */
+	PersistentNode(Node* node);
+
+	/**
+	 * Check if contents and children of nodes are the same.
+	 * @param node Other node.
+	 * @return True, if nodes are the same.
+	 */
+	bool same(const PersistentNode& node) const;
+
+	/**
+	 * Output header of node without its children.
+	 * @param xml XML output stream.
+	 * @return True, if node is a leaf and its header is complete.
+	 */
+	bool header(XML::Stream& xml) const;
+};
+
+/**
+ * Persistent copy of an equation.
+ * A snapshot is made of immutable nodes that are shared with every other
+ * snapshot made from the same pool. Taking a snapshot after an edit walks the
+ * tree once but only allocates the nodes that differ from a live snapshot,
+ * which is usually the path from the edit to the root. Keeping a long history
+ * of snapshots costs little more than one copy of the equation.
+ * Copying a snapshot is copying a pointer. Snapshots are never changed, so
+ * they can be read by many threads at once. A pool is not thread safe.
+ */
+class Snapshot
+{
+public:
+	/**
+	 * Table of live nodes of snapshots, used to find nodes to share.
+	 * The table only holds weak pointers, so nodes are freed when the last
+	 * snapshot that uses them is freed.
+	 */
+	class Pool
+	{
+	public:
+		/**
+		 * Get node with same contents and children as given node.
+		 * @param node New node.
+		 * @return Node in table or new node, if there is none.
+		 */
+		PersistentNode::Ptr intern(PersistentNode::Ptr node);
+
+		/**
+		 * Get number of entries in table, some of which may be freed.
+		 * @return Number of entries.
+		 */
+		size_t size() const { return m_nodes.size(); }
+
+	private:
+		std::unordered_multimap<size_t, std::weak_ptr<const PersistentNode>> m_nodes; ///< Nodes by hash.
+		size_t m_prune = 64; ///< Number of entries at which freed nodes are removed.
+	};
+
+	/**
+	 * Constructor for empty snapshot.
+	 */
+	Snapshot() {}
+
+	/**
+	 * Constructor for snapshot of equation.
+	 * @param eqn Equation to copy.
+	 * @param pool Table of nodes to share.
+	 */
+	Snapshot(Equation& eqn, Pool& pool);
+
+	/**
+	 * Get root of snapshot.
+	 * @return Root node.
+	 */
+	const PersistentNode::Ptr& getRoot() const { return m_root; }
+
+	/**
+	 * Output snapshot in the XML of an equation.
+	 * @param xml XML output stream.
+	 * @return XML output stream.
+	 */
+	XML::Stream& out(XML::Stream& xml) const;
+
+	/**
+	 * Make new equation from snapshot.
+	 * @return New equation.
+	 */
+	EqnPtr toEquation() const;
+
+	/**
+	 * Change equation to this snapshot.
+	 * Subtrees of the equation that are the same in both snapshots are kept
+	 * as they are, so only the nodes that differ are made, usually the path
+	 * from an edit to the root. The equation must not have changed since the
+	 * snapshot it shows was taken.
+	 * @param eqn Equation to change.
+	 * @param shown Snapshot of equation as it is, or empty snapshot to make every node.
+	 */
+	void restore(Equation& eqn, const Snapshot& shown) const;
+
+private:
+	PersistentNode::Ptr m_root; ///< Root of snapshot.
+
+	/**
+	 * Make subtree of snapshot, children before their parents.
+	 * Children of a node of the shown snapshot that are in the new snapshot
+	 * are taken from the live tree instead of made.
+	 * @param root Root of subtree to make.
+	 * @param shown Node of shown snapshot at the same place or null.
+	 * @param live Node of equation made from shown node or null.
+	 * @param eqn Equation of new nodes.
+	 * @return Root of subtree.
+	 */
+	static NodePtr build(const PersistentNode* root, const PersistentNode* shown, Node* live, Equation& eqn);
+
+	/**
+	 * Copy subtree into pool, children before their parents.
+	 * @param root Root of subtree.
+	 * @param pool Table of nodes to share.
+	 * @return Shared node.
+	 */
+	static PersistentNode::Ptr copy(Node* root, Pool& pool);
+};
+
+#endif // __SNAPSHOT_H
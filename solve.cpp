@@ -0,0 +1,308 @@
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file solve.cpp
+ * This file contains the implementation of the Solver class. The program of an
+ * equality is evaluated with Dual values, so every step gets the derivative to
+ * the variable without differentiating the tree.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "milo.h"
+#include "nodes.h"
+#include "solve.h"
+#include "util.h"
+
+using namespace std;
+
+/**
+ * Check if subtree contains variable.
+ * @param node Root of subtree.
+ * @param var Id of variable.
+ * @return True, if variable found.
+ */
+static bool contains(Node* node, SymbolTable::Id var)
+{
+	auto type = node->getType();
+	if (type == Variable::type) {
+		return static_cast<Variable*>(node)->getId() == var;
+	}
+	else if (type == Input::type) {
+		return true;
+	}
+	bool fFound = false;
+	forEachChild(node, [&fFound, var](Node* kid) { fFound = fFound || contains(kid, var); });
+	return fFound;
+}
+
+/**
+ * Collect names of variables in subtree.
+ * @param node Root of subtree.
+ * @param[out] vars Names of variables.
+ */
+static void variables(Node* node, vector<string>& vars)
+{
+	if (node->getType() == Variable::type) vars.push_back(static_cast<Variable*>(node)->getVariable());
+	forEachChild(node, [&vars](Node* kid) { variables(kid, vars); });
+}
+
+/**
+ * Check if both parts of complex value are finite.
+ * @param z Complex value.
+ * @return True, if finite.
+ */
+static bool isFinite(const Complex& z) { return isfinite(z.real()) && isfinite(z.imag()); }
+
+Solver::Solver(Node* left, Node* right, const string& var) : m_var(SymbolTable::global().find(var))
+{
+	compile(left);
+	compile(right);
+	emit(Op::NTH, 1, false);
+	emit(Op::SUM, 2);
+}
+
+void Solver::compile(Node* node)
+{
+	if (!contains(node, m_var)) {
+		m_program.push_back({ Op::CONSTANT, node->getValue(), 0, true, nullptr, nullptr });
+		return;
+	}
+	switch (node->getType()) {
+		case Node::VARIABLE:
+			emit(Op::VARIABLE);
+			break;
+		case Node::EXPRESSION:
+		case Node::TERM: {
+			int n = 0;
+			forEachChild(node, [this, &n](Node* kid) { compile(kid); ++n; });
+			emit((node->getType() == Node::EXPRESSION) ? Op::SUM : Op::PRODUCT, n);
+			break;
+		}
+		case Node::DIVIDE:
+		case Node::POWER:
+			forEachChild(node, [this](Node* kid) { compile(kid); });
+			emit((node->getType() == Node::DIVIDE) ? Op::DIVIDE : Op::POWER);
+			break;
+		case Node::FUNCTION: {
+			auto function = static_cast<Function*>(node);
+			compile(function->getArgument());
+			emit(Op::FUNCTION);
+			m_program.back().func = function->getCall();
+			m_program.back().derivative = function->getDerivative();
+			break;
+		}
+		default:
+			throw logic_error("cannot solve " + node->getName() + " of variable");
+	}
+	if (node->getNth() != 1 || !node->getSign()) emit(Op::NTH, node->getNth(), node->getSign());
+}
+
+Dual Solver::evaluate(const Complex& x) const
+{
+	vector<Dual> stack;
+	stack.reserve(m_program.size());
+	for ( const auto& op : m_program ) {
+		switch (op.code) {
+		case Op::CONSTANT:
+			stack.emplace_back(op.value);
+			break;
+		case Op::VARIABLE:
+			stack.emplace_back(x, 1, 0);
+			break;
+		case Op::SUM:
+		case Op::PRODUCT: {
+			auto first = stack.end() - op.n;
+			Dual z = *first;
+			for ( auto it = first + 1; it != stack.end(); ++it ) {
+				if (op.code == Op::SUM) z += *it; else z *= *it;
+			}
+			stack.erase(first, stack.end());
+			stack.push_back(z);
+			break;
+		}
+		case Op::DIVIDE: {
+			Dual b = stack.back();
+			stack.pop_back();
+			stack.back() /= b;
+			break;
+		}
+		case Op::POWER: {
+			Dual b = stack.back();
+			stack.pop_back();
+			stack.back() = pow(stack.back(), b);
+			break;
+		}
+		case Op::FUNCTION: {
+			Complex a = stack.back().getValue();
+			stack.back() = stack.back().chain(op.func(a), op.derivative(a));
+			break;
+		}
+		case Op::NTH: {
+			Dual z(Complex(1, 0));
+			for (int i = 0; i < op.n; ++i) { z *= stack.back(); }
+			if (!op.sign && ((op.n&1) == 1)) z = -z;
+			stack.back() = z;
+			break;
+		}
+		}
+	}
+	return stack.back();
+}
+
+bool Solver::newton(Complex& z) const
+{
+	Dual d = evaluate(z);
+	Complex f = d.getValue(), zPrev = z, fPrev = f;
+	bool fSecant = false;
+	for (int i = 0; i < max_iterations; ++i) {
+		if (!isFinite(f)) return false;
+		if (f == Complex(0, 0)) return true;
+
+		Complex step, df = d.getPartial(0);
+		if (abs(df) > 0) {
+			step = f/df;
+		}
+		else if (fSecant && f != fPrev) {
+			step = f*(z - zPrev)/(f - fPrev);
+		}
+		else {
+			return false;
+		}
+
+		Complex next = z - step;
+		Dual dNext = evaluate(next);
+		for (int k = 0; k < 10 && !(abs(dNext.getValue()) < abs(f)); ++k) {
+			step *= 0.5;
+			next = z - step;
+			dNext = evaluate(next);
+		}
+		zPrev = z;
+		fPrev = f;
+		fSecant = true;
+		z = next;
+		d = dNext;
+		f = d.getValue();
+		if (abs(step) <= 1e-14*(1 + abs(z))) break;
+	}
+	return isFinite(f) && isRoot(f);
+}
+
+bool Solver::bracket(double a, double b, Complex& z) const
+{
+	double lo = a, hi = b, fLo = evaluate(lo).getValue().real();
+	double x = 0.5*(lo + hi);
+	for (int i = 0; i < max_iterations; ++i) {
+		Dual d = evaluate(x);
+		double f = d.getValue().real(), df = d.getPartial(0).real();
+		if (f == 0) break;
+		if ((f < 0) == (fLo < 0)) { lo = x; fLo = f; } else { hi = x; }
+
+		double next = x - f/df;
+		if (!isfinite(next) || next <= min(lo, hi) || next >= max(lo, hi)) next = 0.5*(lo + hi);
+		bool fDone = abs(next - x) <= 1e-15*(1 + abs(x));
+		x = next;
+		if (fDone) break;
+	}
+	z = x;
+	return isRoot(evaluate(z).getValue());
+}
+
+vector<Complex> Solver::solve(double radius) const
+{
+	// Sign changes of a real valued left - right along the real axis
+	vector<pair<double, double>> brackets;
+	vector<Complex> roots;
+	double xPrev = -radius, fPrev = 0;
+	for (int i = 0; i <= scan_intervals; ++i) {
+		double x = radius*(2.0*i/scan_intervals - 1);
+		Complex f = evaluate(x).getValue();
+		bool fReal = isFinite(f) && abs(f.imag()) <= 1e-12*(1 + abs(f.real()));
+		if (fReal && f.real() == 0) {
+			roots.emplace_back(x, 0);
+		}
+		else if (fReal && i > 0 && fPrev != 0 && (f.real() < 0) != (fPrev < 0)) {
+			brackets.emplace_back(xPrev, x);
+		}
+		xPrev = x;
+		fPrev = fReal ? f.real() : 0;
+	}
+
+	// Starting points on circles are off the real axis to reach complex roots
+	vector<Complex> starts;
+	for ( double r : { radius/8, radius/2, radius } ) {
+		for (int k = 0; k < circle_starts; ++k) {
+			starts.push_back(polar(r, 0.5 + 2*M_PI*k/circle_starts));
+		}
+	}
+
+	// Each task writes only its own result, so roots come out in the same order
+	size_t tasks = brackets.size() + starts.size();
+	vector<Complex> results(tasks);
+	vector<char> found(tasks, 0);
+	parallelFor(tasks, [&](size_t i) {
+		if (i < brackets.size()) {
+			found[i] = bracket(brackets[i].first, brackets[i].second, results[i]);
+		}
+		else {
+			results[i] = starts[i - brackets.size()];
+			found[i] = newton(results[i]);
+		}
+	});
+
+	for (size_t i = 0; i < tasks; ++i) {
+		if (found[i]) roots.push_back(results[i]);
+	}
+
+	// Clean rounding noise, then keep one of each root inside circle
+	vector<Complex> distinct;
+	for ( auto z : roots ) {
+		double scale = 1e-9*(1 + abs(z));
+		if (abs(z.real()) < scale) z.real(0);
+		if (abs(z.imag()) < scale) z.imag(0);
+		if (abs(z) > radius) continue;
+		auto same = [&z](const Complex& r) { return abs(r - z) < 1e-6*(1 + abs(z)); };
+		if (none_of(distinct.begin(), distinct.end(), same)) distinct.push_back(z);
+	}
+	sort(distinct.begin(), distinct.end(), [](const Complex& a, const Complex& b) {
+		return (a.real() != b.real()) ? a.real() < b.real() : a.imag() < b.imag();
+	});
+	return distinct;
+}
+
+string Solver::findVariable(Node* left, Node* right)
+{
+	vector<string> vars;
+	variables(left, vars);
+	variables(right, vars);
+	return vars.empty() ? string() : *min_element(vars.begin(), vars.end());
+}
+
+string Solver::toString(const Complex& z)
+{
+	ostringstream os;
+	if (z.real() != 0 || z.imag() == 0) os << z.real() + 0.0;
+	if (z.imag() != 0) {
+		if (z.real() != 0 && z.imag() > 0) os << "+";
+		os << z.imag() << "i";
+	}
+	return os.str();
+}
@@ -0,0 +1,167 @@
+#ifndef __SOLVE_H
+#define __SOLVE_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file solve.h
+ * This file contains the declaration of the Solver class. A Solver finds the
+ * roots of left - right of an equality for one variable. Both sides are
+ * compiled once into a program for a stack machine with every subtree that does
+ * not contain the variable folded into a constant, so each iteration does not
+ * walk the node tree.
+ */
+
+#include <string>
+#include <vector>
+#include "milo.h"
+#include "nodes.h"
+
+/**
+ * Numeric solver for one variable of an equality.
+ * Real roots are bracketed by sign changes along the real axis and refined by
+ * Newton steps kept inside the bracket. Complex roots are found by Newton
+ * iteration with a secant fallback from starting points on circles around the
+ * origin. Starting points are independent, so they are iterated in parallel.
+ */
+class Solver
+{
+public:
+	/**
+	 * Constructor for Solver compiling both sides of equality.
+	 * Throws logic_error if a side has an input or a derivative of the variable.
+	 * @param left Root of left side.
+	 * @param right Root of right side.
+	 * @param var Name of variable to be solved for.
+	 */
+	Solver(Node* left, Node* right, const std::string& var);
+
+	/**
+	 * Constructor for Solver compiling function to be solved for zero.
+	 * Throws logic_error if function has an input or a derivative of the variable.
+	 * @param function Root of function.
+	 * @param var Name of variable.
+	 */
+	Solver(Node* function, const std::string& var) : m_var(SymbolTable::global().find(var)) { compile(function); }
+
+	/**
+	 * Evaluate compiled program with its derivative to the variable.
+	 * @param x Value of variable.
+	 * @return Value and derivative.
+	 */
+	Dual evaluate(const Complex& x) const;
+
+	/**
+	 * Find roots inside a circle around the origin.
+	 * @param radius Radius of circle.
+	 * @return Distinct roots sorted by real then imaginary part.
+	 */
+	std::vector<Complex> solve(double radius = 10) const;
+
+	/**
+	 * Get first variable of equality in alphabetical order.
+	 * @param left Root of left side.
+	 * @param right Root of right side.
+	 * @return Name of variable or empty if there is none.
+	 */
+	static std::string findVariable(Node* left, Node* right);
+
+	/**
+	 * Get root as string that can be parsed as an expression.
+	 * @param z Root.
+	 * @return String of root.
+	 */
+	static std::string toString(const Complex& z);
+
+private:
+	/**
+	 * Instruction of stack machine.
+	 */
+	struct Op
+	{
+		/**
+		 * Operation of instruction.
+		 */
+		enum Code {
+			CONSTANT, ///< Push value.
+			VARIABLE, ///< Push variable.
+			SUM,      ///< Replace top n values by their sum.
+			PRODUCT,  ///< Replace top n values by their product.
+			DIVIDE,   ///< Replace top two values by their quotient.
+			POWER,    ///< Replace top two values by first to power of second.
+			FUNCTION, ///< Apply function to top value.
+			NTH       ///< Raise top value to nth power and apply sign.
+		};
+
+		Code code;                            ///< Operation.
+		Complex value;                        ///< Value of constant.
+		int n;                                ///< Number of values or power.
+		bool sign;                            ///< Sign of power.
+		Function::func_ptr func;              ///< Function.
+		Function::func_ptr derivative;        ///< Derivative of function.
+	};
+
+	std::vector<Op> m_program; ///< Program in postfix order.
+	SymbolTable::Id m_var;     ///< Id of variable.
+
+	/**
+	 * Append program of subtree.
+	 * @param node Root of subtree.
+	 */
+	void compile(Node* node);
+
+	/**
+	 * Append instruction.
+	 * @param code Operation.
+	 * @param n Number of values or power.
+	 * @param sign Sign of power.
+	 */
+	void emit(Op::Code code, int n = 0, bool sign = true)
+	{
+		m_program.push_back({ code, Complex(0, 0), n, sign, nullptr, nullptr });
+	}
+
+	/**
+	 * Refine root by Newton iteration with a secant step where derivative vanishes.
+	 * @param[in,out] z Starting point and root if found.
+	 * @return True, if iteration converged to a root.
+	 */
+	bool newton(Complex& z) const;
+
+	/**
+	 * Refine real root inside bracket by Newton steps falling back to bisection.
+	 * @param a One end of bracket.
+	 * @param b Other end of bracket.
+	 * @param[out] z Root if found.
+	 * @return True, if root found.
+	 */
+	bool bracket(double a, double b, Complex& z) const;
+
+	/**
+	 * Check if value is small enough to be a root.
+	 * @param f Value of left - right.
+	 * @return True, if root.
+	 */
+	static bool isRoot(const Complex& f) { return std::abs(f) < 1e-8; }
+
+	static const int max_iterations = 100; ///< Iterations before a start is given up.
+	static const int scan_intervals = 400; ///< Intervals of real axis scanned for sign changes.
+	static const int circle_starts = 16;   ///< Starting points on each circle.
+};
+
+#endif // __SOLVE_H
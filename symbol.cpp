@@ -43,23 +43,6 @@ static int get_digits(const string & s)
 
 static bool isNumber(const string& s) { return s.find_first_not_of("+-0123456789") == string::npos; }
 
-const type_index Differential::type = typeid(Differential);
-const type_index   Expression::type = typeid(Expression);
-const type_index     Function::type = typeid(Function);
-const type_index     Constant::type = typeid(Constant);
-const type_index     Variable::type = typeid(Variable);
-const type_index       Number::type = typeid(Number);
-const type_index       Divide::type = typeid(Divide);
-const type_index        Input::type = typeid(Input);
-const type_index        Power::type = typeid(Power);
-const type_index         Term::type = typeid(Term);
-
-
-static const vector<type_index> factor_precedence = { 
-	Number::type, Constant::type, Variable::type, Expression::type, 
-	Function::type, Divide::type, Power::type, Differential::type, Input::type
-};
-
 static bool sort_terms(TermPtr a, TermPtr b)
 {
 	if ( !isNumber(a->toString()) && !isNumber(b->toString()) ) {
@@ -78,24 +61,20 @@ static bool sort_terms(TermPtr a, TermPtr b)
 
 bool Function::less(NodePtr b) const
 { 
-	auto bf = dynamic_pointer_cast<Function>(b);
-	if (!bf) throw logic_error("Illegal call of less()");
+	if (b->getType() != Function::type) throw logic_error("Illegal call of less()");
+	auto bf = static_pointer_cast<Function>(b);
 	if ( m_name == bf->m_name ) return toString() < bf->toString(); 
 	return m_name > bf-> m_name;
 }
 
-void Expression::normalize()
+void Expression::normalizeNode()
 {
-	for ( auto term : terms ) term->normalize();
-
 	sort(terms.begin(), terms.end(), sort_terms);
 }
 
-bool Expression::simplify()
+bool Expression::simplifyNode()
 {
 	bool result = false;
-	for ( auto term : terms ) result |= term->simplify();
-
 	if ( terms.back()->numFactors() == 1 && isNumber(terms.back()->toString()) ) {
 		double v = 0;
 		while ( !terms.empty() && terms.back()->numFactors() == 1 && isNumber(terms.back()->toString()) ) {
@@ -135,6 +114,13 @@ void Expression::add(ExpressionPtr old_expr)
 	terms.merge(old_expr->terms);
 }
 
+void Expression::replace(ExpressionPtr new_expr)
+{
+	terms.clear();
+	terms.merge(new_expr->terms);
+	setParent();
+}
+
 void Term::multiply(double n)
 {
 	if ( n == 1 ) return;
@@ -156,20 +142,23 @@ void Term::simplify(NodePtr ref, TermPtr new_term)
 	new_term->factors.clear();
 }
 
+void Term::replace(int index, int count, TermPtr new_term)
+{
+	auto pos = factors.erase(factors.begin() + index, factors.begin() + index + count);
+	factors.insert(pos, new_term->factors.begin(), new_term->factors.end());
+	new_term->factors.clear();
+	setParent();
+}
+
 static bool factor_cmp(NodePtr a, NodePtr b)
 {
+	// Kinds are declared in order of precedence of factors
 	if (a->getType() == b->getType()) return a->less(b);
-
-	auto pos_a = find(factor_precedence, a->getType());
-	auto pos_b = find(factor_precedence, b->getType());
-	
-	return (pos_a < pos_b);
+	return a->getType() < b->getType();
 }
 
-void Term::normalize()
+void Term::normalizeNode()
 {
-	for ( auto factor : factors ) factor->normalize();
-
 	auto pos = factors.begin(); 
 	while ( pos != factors.end() ) {
 		if ( (*pos)->getNth() == 0 ) { 
@@ -182,7 +171,7 @@ void Term::normalize()
 		}
 		if ( (*pos)->getType() != Expression::type ) { ++pos; continue; }
 
-		auto expr = dynamic_pointer_cast<Expression>(*pos);
+		auto expr = static_pointer_cast<Expression>(*pos);
 		if (expr->numTerms() == 1) {
 			TermPtr term = *(expr->begin());
 			for ( auto t : term->factors ) {
@@ -216,16 +205,16 @@ void Term::normalize()
 	}
 }
 
-bool Term::simplify()
+bool Term::beginSimplify()
 {
-	bool result = false;
-	
-	for ( auto factor : factors ) { 
-		factor->multNth(this->getNth());
-		result |= factor->simplify();
-	}
+	for ( auto factor : factors ) factor->multNth(this->getNth());
 	this->setNth(1);
+	return true;
+}
 
+bool Term::simplifyNode()
+{
+	bool result = false;
 	if ( factors.front()->getType() == Number::type && factors.size() > 1 ) {
 		double v = 1.0;
 		while ( !factors.empty() && factors.front()->getType() == Number::type ) {
@@ -283,22 +272,22 @@ void Term::insertAfterMe(Node* me, NodePtr node)
 { 
 	if (me->getParent()->getType() != Term::type) return;
 
-	Term* term = dynamic_cast<Term*>(me->getParent());
+	Term* term = static_cast<Term*>(me->getParent());
 	term->factors.insert(Term::pos(me) + 1, node);
 }
 
-void Power::normalize()
+void Power::beginNormalize()
 {
-	m_first->normalize();
-
 	if (getNth() != 1) {
 		Term* term = new Term(m_second.get(), m_eqn, nullptr);
 		term->multiply(getNth());
 		setNth(1);
 		m_second = new Expression(term, m_eqn, this);
 	}
-	m_second->normalize();
+}
 
+void Power::normalizeNode()
+{
 	if (m_second->numFactors() == 1 && m_second->first()->getType() == Number::type) 
 	{
 		double n = m_second->getValue().real();
@@ -310,11 +299,6 @@ void Power::normalize()
 	}
 }
 
-bool Power::simplify()
-{
-	return m_first->simplify() | m_second->simplify();
-}
-
 bool Power::simplify(NodeVector& factors)
 {
 	for ( auto a = factors.begin(); a != factors.end(); ++a ) {
@@ -332,11 +316,11 @@ bool Power::simplify(NodeVector::iterator a, NodeVector::iterator b)
 {
 	if ((*a)->getType() != Power::type || a == b) return false;
 
-	auto p_a = dynamic_pointer_cast<Power>(*a);
+	auto p_a = static_pointer_cast<Power>(*a);
 	string base_a = p_a->m_first->toString();
 
 	if ((*b)->getType() == Power::type) {
-		auto p_b = dynamic_pointer_cast<Power>(*b);
+		auto p_b = static_pointer_cast<Power>(*b);
 		if (p_b->m_first->toString() == base_a) {
 			p_a->getSecondExpression()->add(p_b->getSecondExpression());
 			return true;
@@ -352,31 +336,29 @@ bool Power::simplify(NodeVector::iterator a, NodeVector::iterator b)
 ExpressionPtr Binary::getFirstExpression()
 {
 	if (m_first->getType() != Expression::type) throw logic_error("expression expected");
-	return ExpressionPtr(dynamic_pointer_cast<Expression>(m_first));
+	return static_pointer_cast<Expression>(m_first);
 }
 
 ExpressionPtr Binary::getSecondExpression()
 {
 	if (m_second->getType() != Expression::type) throw logic_error("expression expected");
-	return ExpressionPtr(dynamic_pointer_cast<Expression>(m_second));
+	return static_pointer_cast<Expression>(m_second);
 }
 
 Node* Divide::normalize(Node* n)
 {
-	Divide* d = dynamic_cast<Divide*>(n);
+	if (n->getType() != Divide::type) throw logic_error("divide expected");
+	Divide* d = static_cast<Divide*>(n);
 	NodeVector factors = { d->m_first, d->m_second };
 	d->m_second->multNth(-1);
 	return new Expression(new Term(factors, d->m_eqn, nullptr), d->m_eqn, n->getParent());
 }
 
-void Divide::normalize()
+void Divide::normalizeNode()
 {
-	m_first->normalize();
 	if (m_first->getType() == Divide::type) {
 		m_first = normalize(m_first);
 	}
-
-	m_second->normalize();
 	if (m_second->getType() == Divide::type) {
 		m_second = normalize(m_second);
 	}
@@ -393,12 +375,7 @@ void Divide::normalize()
 		throw logic_error("can't handle " + getParent()->getName() + " as parent");
 }
 
-bool Divide::simplify()
-{
-	return m_first->simplify() | m_second->simplify();
-}
-
-bool Number::simplify()
+bool Number::simplifyNode()
 {
 	if (getNth() == 1) return false;
 
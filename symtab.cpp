@@ -0,0 +1,55 @@
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file symtab.cpp
+ * This file contains the implementation of the SymbolTable class.
+ */
+
+#include <stdexcept>
+
+#include "milo.h"
+#include "nodes.h"
+#include "symtab.h"
+
+using namespace std;
+
+SymbolTable& SymbolTable::global()
+{
+	static SymbolTable table(Function::getFunctions());
+	return table;
+}
+
+SymbolTable::SymbolTable(const vector<string>& functions)
+{
+	for ( auto& name : functions ) intern(name, FUNCTION);
+}
+
+SymbolTable::Id SymbolTable::intern(const string& name, Kind kind)
+{
+	auto it = m_ids.find(name);
+	if (it != m_ids.end()) {
+		if (m_kinds[it->second] != kind) throw logic_error("name " + name + " is already used");
+		return it->second;
+	}
+	Id id = (Id) m_names.size();
+	m_ids.emplace(name, id);
+	m_names.push_back(name);
+	m_kinds.push_back(kind);
+	m_values.emplace_back(0, 0);
+	return id;
+}
@@ -0,0 +1,127 @@
+#ifndef __SYMTAB_H
+#define __SYMTAB_H
+
+/* Copyright (C) 2018 - James Terman
+ *
+ * milo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * milo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file symtab.h
+ * This file contains the table of interned names of variables and functions.
+ */
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <complex>
+
+/**
+ * Interned names of variables and functions.
+ * Each name is given a small integer id the first time it is seen. Nodes keep
+ * the id instead of the name, and values of variables are kept in an array
+ * indexed by id, so getting the value of a variable is an array load. Names
+ * may be of any length.
+ * The table is shared by all equations, so variables of the same name in
+ * different equations have the same value. Interning is not thread safe.
+ */
+class SymbolTable
+{
+public:
+	using Id = int; ///< Index of name in table.
+
+	/**
+	 * Kinds of names.
+	 */
+	enum Kind { VARIABLE, FUNCTION };
+
+	static constexpr Id none = -1; ///< Id of name not in table.
+
+	/**
+	 * Get table shared by all equations.
+	 * Names of built in functions are interned when table is created.
+	 * @return Symbol table.
+	 */
+	static SymbolTable& global();
+
+	/**
+	 * Get id of name, adding it if not already in table.
+	 * Values of new variables are zero.
+	 * Throws logic_error if name is in table as another kind.
+	 * @param name Name of variable or function.
+	 * @param kind Kind of name.
+	 * @return Id of name.
+	 */
+	Id intern(const std::string& name, Kind kind);
+
+	/**
+	 * Find id of name.
+	 * @param name Name of variable or function.
+	 * @return Id of name or none if not in table.
+	 */
+	Id find(const std::string& name) const
+	{
+		auto it = m_ids.find(name);
+		return (it == m_ids.end()) ? none : it->second;
+	}
+
+	/**
+	 * Get name of id.
+	 * @param id Id of name.
+	 * @return Name.
+	 */
+	const std::string& getName(Id id) const { return m_names[id]; }
+
+	/**
+	 * Get kind of id.
+	 * @param id Id of name.
+	 * @return Kind of name.
+	 */
+	Kind getKind(Id id) const { return m_kinds[id]; }
+
+	/**
+	 * Get number of names in table.
+	 * @return Number of names.
+	 */
+	size_t size() const { return m_names.size(); }
+
+	/**
+	 * Get value of variable.
+	 * @param id Id of variable.
+	 * @return Value of variable.
+	 */
+	const std::complex<double>& getValue(Id id) const { return m_values[id]; }
+
+	/**
+	 * Set value of variable.
+	 * @param id Id of variable.
+	 * @param value New value of variable.
+	 */
+	void setValue(Id id, const std::complex<double>& value) { m_values[id] = value; }
+
+private:
+	std::unordered_map<std::string, Id> m_ids;  ///< Id of each name.
+	std::vector<std::string> m_names;           ///< Name of each id.
+	std::vector<Kind> m_kinds;                  ///< Kind of each id.
+	std::vector<std::complex<double>> m_values; ///< Value of each id, zero for functions.
+
+	/**
+	 * Constructor interning names of built in functions.
+	 * @param functions Names of functions.
+	 */
+	SymbolTable(const std::vector<std::string>& functions);
+};
+
+#endif // __SYMTAB_H
@@ -129,6 +129,36 @@ string KeyEvent::toString() const
 		return string("Key event: ") + mod_string.at(m_mod) + key_string.at(m_key);
 }
 
+int Graphics::getTextLength(const string& s)
+{
+	++m_requests;
+	auto it = m_textLengths.find(s);
+	if (it != m_textLengths.end()) return it->second;
+
+	// Numbers make an unbounded set of strings, so start over when full
+	if (m_textLengths.size() >= max_text_lengths) m_textLengths.clear();
+	++m_misses;
+	return m_textLengths.emplace(s, measureTextLength(s)).first->second;
+}
+
+int Graphics::getParenthesisWidth(int height)
+{
+	++m_requests;
+	auto it = m_parenthesisWidths.find(height);
+	if (it != m_parenthesisWidths.end()) return it->second;
+	++m_misses;
+	return m_parenthesisWidths.emplace(height, measureParenthesisWidth(height)).first->second;
+}
+
+void Graphics::invalidateMetrics()
+{
+	m_chars.fill(CharMetrics());
+	m_textLengths.clear();
+	m_differentials.clear();
+	m_parenthesisWidths.clear();
+	m_textHeight = m_divideLineHeight = unmeasured;
+}
+
 EventBox::EventBox() : m_gc(MiloApp::getGlobal().makeGraphics())
 {
 }
@@ -257,12 +287,17 @@ bool MiloApp::isRunning()
 
 void MiloApp::doMenu(const string& menuFunctionName)
 {
-	if (!getWindow().getPanel().doMenu(menuFunctionName)) {
-		auto menu_entry = menu_map.find(menuFunctionName);
-		if (menu_entry != menu_map.end()) {
-			(menu_entry->second)();
+	try {
+		if (!getWindow().getPanel().doMenu(menuFunctionName)) {
+			auto menu_entry = menu_map.find(menuFunctionName);
+			if (menu_entry != menu_map.end()) {
+				(menu_entry->second)();
+			}
 		}
 	}
+	catch (logic_error& e) {
+		setStatus(menuFunctionName + ": " + e.what());
+	}
 }
 
 void MenuXML::parse_menu(XML::Parser& in)
@@ -333,15 +368,34 @@ void MiloPanel::copy(const string& str)
 	copy(in);
 }
 		
+/**
+ * Undo state of panel kept as its XML.
+ */
+struct XMLState : public MiloPanel::UndoState
+{
+	string xml; ///< Serialized panel.
+};
+
+MiloPanel::UndoState::Ptr MiloPanel::saveUndo()
+{
+	auto state = make_shared<XMLState>();
+	xml_out(state->xml);
+	return state;
+}
+
+void MiloPanel::restoreUndo(const UndoState& state)
+{
+	copy(static_cast<const XMLState&>(state).xml);
+}
+
 void MiloPanel::pushUndo()
 {
-	string this_panel;
-	xml_out(this_panel);
+	auto state = saveUndo();
 	if (m_current > -1) {
 		m_undo.erase(m_undo.begin() + m_current + 1, m_undo.end());
 		m_current = -1;
 	}
-	m_undo.push_back(this_panel);
+	m_undo.push_back(state);
 }
 		
 void MiloPanel::doUndo()
@@ -353,7 +407,7 @@ void MiloPanel::doUndo()
 		m_current = m_undo.size() - 1;
 	}
 	--m_current;
-	copy(m_undo[m_current]);
+	restoreUndo(*m_undo[m_current]);
 }
 
 void MiloPanel::doRedo()
@@ -362,7 +416,7 @@ void MiloPanel::doRedo()
 		return;
 	}
 	++m_current;
-	copy(m_undo[m_current]);
+	restoreUndo(*m_undo[m_current]);
 	if (m_current == int(m_undo.size()) - 1) {
 		m_current = -1;
 	}
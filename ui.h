@@ -25,6 +25,8 @@
  * be ported.
  */
 
+#include <array>
+#include <climits>
 #include <fstream>
 #include <unordered_map>
 #include <string>
@@ -378,12 +380,12 @@ namespace UI {
 		/** @name Virtual Public Member Functions */
 		//@{		
 		/**
-		 * Draw differential of width x0 and height y0 with char variable name.
+		 * Draw differential of width x0 and height y0 with variable name.
 		 * @param x0 Horizontal origin of differential.
 		 * @param y0 Vertical origin of differential.
-		 * @param variable Name of variable of differential.
+		 * @param variable Name of variable of differential, empty if it has none.
 		 */
-		virtual void differential(int x0, int y0, char variable) = 0;
+		virtual void differential(int x0, int y0, const std::string& variable) = 0;
 		
 		/**
 		 * Draw pair of parenthesis around a node of size x_size, y_size and origin x0,y0.
@@ -432,65 +434,98 @@ namespace UI {
 		 */
 		virtual void out() = 0;
 		
+		/**
+		 * Select the area of size x,y at origin x0,y0.
+		 * @param x Horizontal size of both selection area.
+		 * @param y Vertical size of selection area.
+		 * @param x0 Horizontal origin of selection area.
+		 * @param y0 Vertical origin of selection area.
+		 */
+		virtual void setSelect(int x, int y, int x0, int y0) { m_select.set(x, y, x0, y0); }
+		//@}
+
+		/** @name Text Metrics
+		 * Metrics are measured once by the backend and then cached, since layout
+		 * asks for the same metrics of every node on every resize.
+		 */
+		//@{
 		/**
 		 * Get height of text in pixels.
 		 * @return Height of text in pixels.
 		 */
-		virtual int getTextHeight() = 0;
-		
+		int getTextHeight() { return cached(m_textHeight, [this] { return measureTextHeight(); }); }
+
 		/**
 		 * Get length of string in pixels.
+		 * @param s String to measure.
 		 * @return Length of string in pixels.
 		 */
-		virtual int getTextLength(const std::string& s) = 0;
-		
+		int getTextLength(const std::string& s);
+
 		/**
 		 * Get length of character in pixels.
+		 * @param c Character to measure.
 		 * @return Length of character in pixels.
 		 */
-		virtual int getCharLength(char c) = 0;
-		
+		int getCharLength(char c) { return cached(charMetrics(c).length, [this, c] { return measureCharLength(c); }); }
+
 		/**
 		 * Get width of a parenthesis for a given height in pixels.
+		 * @param height Height of parenthesis.
 		 * @return Width of parenthesis.
 		 */
-		virtual int getParenthesisWidth(int height = 1) = 0;
-		
+		int getParenthesisWidth(int height = 1);
+
 		/**
 		 * Get height of line in a division node.
 		 * @return Height of division line.
 		 */
-		virtual int getDivideLineHeight() = 0;
-		
+		int getDivideLineHeight() { return cached(m_divideLineHeight, [this] { return measureDivideLineHeight(); }); }
+
 		/**
 		 * Get height of differential.
-		 * @param c Variable name of differential.
+		 * @param variable Variable name of differential.
 		 * @return Height of differential in pixels.
 		 */
-		virtual int getDifferentialHeight(char c) = 0;
-		
+		int getDifferentialHeight(const std::string& variable) {
+			return cached(m_differentials[variable].height, [this, &variable] { return measureDifferentialHeight(variable); });
+		}
+
 		/**
 		 * Get width of differential.
-		 * @param c Variable name of differential.
+		 * @param variable Variable name of differential.
 		 * @return Width of differential in pixels.
 		 */
-		virtual int getDifferentialWidth(char c) = 0;
-		
+		int getDifferentialWidth(const std::string& variable) {
+			return cached(m_differentials[variable].width, [this, &variable] { return measureDifferentialWidth(variable); });
+		}
+
 		/**
 		 * Get vertical offset of differential.
-		 * @param c Variable name of differential.
+		 * @param variable Variable name of differential.
 		 * @return Vertical offset of differential in pixels.
 		 */
-		virtual int getDifferentialBase(char c) = 0;
-		
+		int getDifferentialBase(const std::string& variable) {
+			return cached(m_differentials[variable].base, [this, &variable] { return measureDifferentialBase(variable); });
+		}
+
 		/**
-		 * Select the area of size x,y at origin x0,y0.
-		 * @param x Horizontal size of both selection area.
-		 * @param y Vertical size of selection area.
-		 * @param x0 Horizontal origin of selection area.
-		 * @param y0 Vertical origin of selection area.
+		 * Forget all cached metrics.
+		 * Must be called by a backend when its font or text attributes change.
 		 */
-		virtual void setSelect(int x, int y, int x0, int y0) { m_select.set(x, y, x0, y0); }
+		void invalidateMetrics();
+
+		/**
+		 * Get number of metrics asked for since construction.
+		 * @return Number of metric requests.
+		 */
+		size_t getMetricRequests() const { return m_requests; }
+
+		/**
+		 * Get number of metrics measured by the backend since construction.
+		 * @return Number of cache misses.
+		 */
+		size_t getMetricMisses() const { return m_misses; }
 		//@}
 
 		/** @name Public helper member functions. */
@@ -555,6 +590,114 @@ namespace UI {
 	protected:
 		Box m_frame;   ///< Frame of this panel.
 		Box m_select;  ///< Currently selected area.
+
+		/** @name Virtual Measuring Functions
+		 * Backends measure text here. They are only called on a cache miss.
+		 */
+		//@{
+		/**
+		 * Measure height of text in pixels.
+		 * @return Height of text in pixels.
+		 */
+		virtual int measureTextHeight() = 0;
+
+		/**
+		 * Measure length of string in pixels.
+		 * @param s String to measure.
+		 * @return Length of string in pixels.
+		 */
+		virtual int measureTextLength(const std::string& s) = 0;
+
+		/**
+		 * Measure length of character in pixels.
+		 * @param c Character to measure.
+		 * @return Length of character in pixels.
+		 */
+		virtual int measureCharLength(char c) = 0;
+
+		/**
+		 * Measure width of a parenthesis for a given height in pixels.
+		 * @param height Height of parenthesis.
+		 * @return Width of parenthesis.
+		 */
+		virtual int measureParenthesisWidth(int height) = 0;
+
+		/**
+		 * Measure height of line in a division node.
+		 * @return Height of division line.
+		 */
+		virtual int measureDivideLineHeight() = 0;
+
+		/**
+		 * Measure height of differential.
+		 * @param variable Variable name of differential.
+		 * @return Height of differential in pixels.
+		 */
+		virtual int measureDifferentialHeight(const std::string& variable) = 0;
+
+		/**
+		 * Measure width of differential.
+		 * @param variable Variable name of differential.
+		 * @return Width of differential in pixels.
+		 */
+		virtual int measureDifferentialWidth(const std::string& variable) = 0;
+
+		/**
+		 * Measure vertical offset of differential.
+		 * @param variable Variable name of differential.
+		 * @return Vertical offset of differential in pixels.
+		 */
+		virtual int measureDifferentialBase(const std::string& variable) = 0;
+		//@}
+
+	private:
+		static const int unmeasured = INT_MIN; ///< Value of metric not yet measured.
+		static const size_t max_text_lengths = 4096; ///< Strings cached before cache is cleared.
+
+		/**
+		 * Cached metrics of one character.
+		 */
+		struct CharMetrics {
+			int length = unmeasured;     ///< Length of character.
+		};
+
+		/**
+		 * Cached metrics of the differential of one variable.
+		 */
+		struct DifferentialMetrics {
+			int height = unmeasured; ///< Height of differential.
+			int width = unmeasured;  ///< Width of differential.
+			int base = unmeasured;   ///< Vertical offset of differential.
+		};
+
+		std::array<CharMetrics, 256> m_chars;              ///< Metrics by character.
+		std::unordered_map<std::string, int> m_textLengths; ///< Lengths of strings.
+		std::unordered_map<std::string, DifferentialMetrics> m_differentials; ///< Metrics of differentials by variable.
+		std::unordered_map<int, int> m_parenthesisWidths;   ///< Widths of parenthesis by height.
+		int m_textHeight = unmeasured;                      ///< Height of text.
+		int m_divideLineHeight = unmeasured;                ///< Height of division line.
+		size_t m_requests = 0;                              ///< Number of metric requests.
+		size_t m_misses = 0;                                ///< Number of metrics measured.
+
+		/**
+		 * Get cached metrics of a character.
+		 * @param c Character.
+		 * @return Reference to cached metrics.
+		 */
+		CharMetrics& charMetrics(char c) { return m_chars[(unsigned char) c]; }
+
+		/**
+		 * Get cached metric, measuring it first if needed.
+		 * @param slot Cached metric.
+		 * @param measure Function to measure metric.
+		 * @return Metric.
+		 */
+		template <class M>
+		int cached(int& slot, M measure) {
+			++m_requests;
+			if (slot == unmeasured) { slot = measure(); ++m_misses; }
+			return slot;
+		}
 	};
 
 	/**
@@ -629,6 +772,22 @@ namespace UI {
 		virtual void getCursorOrig(int& x, int& y) = 0;
 		//@}
 
+		/** @name Virtual Public Member Functions */
+		//@{
+		/**
+		 * Mark contents as changed, so the next calculateSize() lays them
+		 * out again and the next redraw draws them.
+		 */
+		virtual void invalidate() {}
+
+		/**
+		 * Check if drawing changed since last doDraw().
+		 * Boxes that do not keep their drawing always draw again.
+		 * @return True if doDraw() would draw something different.
+		 */
+		virtual bool needsDraw() { return true; }
+		//@}
+
 		/** @name Public helper member functions */
 		//@{
 		/**
@@ -715,6 +874,18 @@ namespace UI {
 		 */
 		using menu_handler = void (*)(MiloPanel&);
 
+		/**
+		 * State of panel kept in undo history.
+		 * By default state is the XML of the panel. Panels may derive their
+		 * own state to keep it in a cheaper form.
+		 */
+		struct UndoState
+		{
+			using Ptr = std::shared_ptr<const UndoState>; ///< Shared pointer to undo state.
+
+			virtual ~UndoState() {} ///< Virtual destructor for derived states.
+		};
+
 		/** @name Constructors and Virtual Destructor */
 		//@{
 		/** Constructor for MiloPanel base class.
@@ -762,6 +933,21 @@ namespace UI {
 		 */
 		virtual const std::string& getType() = 0;
 		//@}
+
+		/** @name Virtual Public Member Functions */
+		//@{
+		/**
+		 * Save state of panel for undo history.
+		 * @return State of panel as XML.
+		 */
+		virtual UndoState::Ptr saveUndo();
+
+		/**
+		 * Restore state of panel from undo history.
+		 * @param state State made by saveUndo().
+		 */
+		virtual void restoreUndo(const UndoState& state);
+		//@}
 		
 		/** @name Public helper member functions */
 		//@{
@@ -846,7 +1032,7 @@ namespace UI {
 		static std::unordered_map<std::string, factory_xml> panel_xml_map;
 
 	private:
-		StringVector m_undo; ///< Stack of undo history.
+		std::vector<UndoState::Ptr> m_undo; ///< Stack of undo history.
 		int m_current = -1;  ///< Current place in undo history.
 
 		/** Handle menu items for all panels.
@@ -1030,8 +1216,21 @@ namespace UI {
 		//@{
 		/**
 		 * Execute function based on its name. Used for menu handling.
+		 * A menu function that fails is reported on the status line.
 		 */
 		void doMenu(const std::string& menuFunctionName);
+
+		/**
+		 * Set message shown on the status line until the next event.
+		 * @param msg Message, empty to clear status line.
+		 */
+		void setStatus(const std::string& msg) { m_status = msg; }
+
+		/**
+		 * Get message shown on the status line.
+		 * @return Message, empty if none.
+		 */
+		const std::string& getStatus() const { return m_status; }
 	
 		/**
 		 * Query if program should quit.
@@ -1192,6 +1391,7 @@ namespace UI {
 		
 		MiloWindow::Vector m_windows;        ///< List of windows for this application.
 		MiloWindow::Iter   m_current_window; ///< Current active window.
+		std::string        m_status;         ///< Message for status line.
 
 		static MiloApp& m_current; ///< Reference to current application singleton
 
@@ -29,6 +29,11 @@
 #include <complex>
 #include <algorithm>
 #include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
 #include <boost/functional/hash.hpp>
 
 /** @name Global Utility Functions */
@@ -198,6 +203,179 @@ const K searchMapValue(const std::unordered_map<K, V>&kv_map,  V value)
 	}
 	return 0;
 }
+
+/**
+ * Threads kept for the life of the program to run parallel loops.
+ * Threads are started on first use and then wait for work, so a parallel
+ * loop costs a wake-up rather than creating threads. The calling thread runs
+ * jobs too. A loop started from inside a job runs on the calling thread
+ * alone, and loops from other threads take turns.
+ */
+class ThreadPool
+{
+public:
+	/**
+	 * Get pool shared by the program.
+	 * @return Global pool.
+	 */
+	static ThreadPool& global()
+	{
+		static ThreadPool pool(std::max(1u, std::min(std::thread::hardware_concurrency(), 8u)));
+		return pool;
+	}
+
+	/**
+	 * Get number of threads that run jobs, counting the calling thread.
+	 * @return Number of threads.
+	 */
+	size_t size() const { return m_threads.size() + 1; }
+
+	/**
+	 * Run jobs 0 to n-1 and wait until all are done.
+	 * If jobs throw, the first exception is rethrown on the calling thread
+	 * once every job has finished.
+	 * @param n Number of jobs.
+	 * @param job Function called with index of each job.
+	 */
+	void run(size_t n, const std::function<void (size_t)>& job)
+	{
+		if (n <= 1 || inJob()) {
+			for (size_t j = 0; j < n; ++j) job(j);
+			return;
+		}
+		std::lock_guard<std::mutex> turn(m_turn);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_job = &job;
+			m_jobs = n;
+			m_next = 0;
+			m_pending = n;
+			m_error = nullptr;
+			++m_generation;
+		}
+		m_start.notify_all();
+
+		inJob() = true;
+		work();
+		inJob() = false;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this]() { return m_pending == 0; });
+		m_job = nullptr;
+		if (m_error) std::rethrow_exception(m_error);
+	}
+
+	ThreadPool(const ThreadPool&) = delete;            ///< Pool is not copied.
+	ThreadPool& operator=(const ThreadPool&) = delete; ///< Pool is not assigned.
+
+	/**
+	 * Destructor stops and joins threads.
+	 */
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_start.notify_all();
+		for ( auto& t : m_threads ) t.join();
+	}
+
+private:
+	std::vector<std::thread> m_threads;  ///< Threads besides the calling thread.
+	std::mutex m_turn;                   ///< Held by the thread running a loop.
+	std::mutex m_mutex;                  ///< Guards state of current loop.
+	std::condition_variable m_start;     ///< Signals new loop or stop.
+	std::condition_variable m_done;      ///< Signals last job done.
+	const std::function<void (size_t)>* m_job = nullptr; ///< Job of current loop.
+	size_t m_jobs = 0;                   ///< Number of jobs in current loop.
+	size_t m_next = 0;                   ///< Next job to be taken.
+	size_t m_pending = 0;                ///< Jobs not finished.
+	unsigned long m_generation = 0;      ///< Number of loops started.
+	std::exception_ptr m_error;          ///< First exception thrown by a job.
+	bool m_stop = false;                 ///< True, when threads must exit.
+
+	/**
+	 * Constructor starting threads.
+	 * @param n Number of threads counting the calling thread.
+	 */
+	explicit ThreadPool(size_t n)
+	{
+		for (size_t t = 1; t < n; ++t) m_threads.emplace_back([this]() { loop(); });
+	}
+
+	/**
+	 * Flag set on threads while they run jobs.
+	 * @return Reference to flag of this thread.
+	 */
+	static bool& inJob()
+	{
+		thread_local bool flag = false;
+		return flag;
+	}
+
+	/**
+	 * Take and run jobs of current loop until none are left.
+	 */
+	void work()
+	{
+		while (true) {
+			const std::function<void (size_t)>* job;
+			size_t j;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_job || m_next >= m_jobs) return;
+				job = m_job;
+				j = m_next++;
+			}
+			std::exception_ptr error;
+			try {
+				(*job)(j);
+			}
+			catch (...) {
+				error = std::current_exception();
+			}
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (error && !m_error) m_error = error;
+			if (--m_pending == 0) m_done.notify_all();
+		}
+	}
+
+	/**
+	 * Body of each thread, waiting for loops until pool is destroyed.
+	 */
+	void loop()
+	{
+		inJob() = true;
+		unsigned long seen = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_start.wait(lock, [this, seen]() { return m_stop || m_generation != seen; });
+				if (m_stop) return;
+				seen = m_generation;
+			}
+			work();
+		}
+	}
+};
+
+/**
+ * Call function for each index on the threads of the global pool.
+ * Index i is handled by job i modulo number of jobs, so a function that
+ * writes only to slot i of its output gives the same result on any machine.
+ * An exception thrown by the function is rethrown on the calling thread.
+ * @param n Number of indexes.
+ * @param f Function called with each index.
+ */
+template <class F>
+void parallelFor(size_t n, F f)
+{
+	size_t nJobs = std::min(ThreadPool::global().size(), n);
+	ThreadPool::global().run(nJobs, [n, nJobs, &f](size_t first) {
+		for (size_t i = first; i < n; i += nJobs) f(i);
+	});
+}
 //@}
 
 /**
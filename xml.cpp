@@ -199,12 +199,12 @@ namespace XML
 		return xml;
 	}
 
-	/* Constructor for class Stream. Add root tag.
+	/* Constructor for class Stream. Add root tag unless writing a fragment.
 	 */
 	Stream::Stream(ostream& os, const string& root, int step, string sep) : 
 		m_sep(sep), m_os(os), m_indent_step(step)
 	{
-		*this << HEADER << root << HEADER_END;
+		if (!root.empty()) *this << HEADER << root << HEADER_END;
 	}
 
 	/* Destructor for class Stream. Close all open headers.
@@ -257,12 +257,12 @@ namespace XML
 	}
 
 	/* Constructor for Parser class reads in XML from input stream.
-	 * Checks for expected root tag.
+	 * Checks for expected root tag unless reading a fragment.
 	 */
 	Parser::Parser(std::istream& in, const string& root) : m_pos(0)
 	{ 
 		tokenize(in);
-		next(HEADER, root).next(HEADER_END);
+		if (!root.empty()) next(HEADER, root).next(HEADER_END);
 	}
 
 	// Helper function for tokenize(istream)
@@ -308,15 +308,14 @@ namespace XML
 	// Tokenize input stream with helper function tokenize(string)
 	void Parser::tokenize(std::istream& in)
 	{
-		static char buffer[1024];
-		
+		string line;
 		string xml;
 		char end_chr = '<';
 		auto pos = string::npos;
 		
-		while (in.getline(buffer, 1024))
+		while (getline(in, line))
 		{
-			xml += string(buffer) + "\n";
+			xml += line + "\n";
 			
 			while ((pos = xml.find(end_chr)) != string::npos)
 			{
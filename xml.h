@@ -173,7 +173,7 @@ namespace XML {
 		 * Constructor for class Stream.
 		 * Initialize private data members and add root header.
 		 * @param os   Output character stream to write XML
-		 * @param root Root tag of xml output
+		 * @param root Root tag of xml output, if empty write fragment without root
 		 * @param step Number of spaces to add to indention
 		 * @param sep  Character to add before each indention
 		 */
@@ -260,7 +260,7 @@ namespace XML {
 		 * Initialize character input stream and read in 
 		 * root header tag.
 		 * @param in Input containing xml content
-		 * @param root Root xml tag
+		 * @param root Root xml tag, if empty read fragment without root
 		 */
 		Parser(std::istream& in, const std::string& root = ROOT);
 